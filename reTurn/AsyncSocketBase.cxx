@@ -2,6 +2,7 @@
 #include "AsyncSocketBaseHandler.hxx"
 #include <rutil/WinLeakCheck.hxx>
 #include <rutil/Logger.hxx>
+#include <rutil/SlabAllocator.hxx>
 #include "ReTurnSubsystem.hxx"
 
 #include <boost/bind.hpp>
@@ -14,6 +15,43 @@ using namespace std;
 
 namespace reTurn {
 
+namespace
+{
+
+void slabDeallocator(char* buffer)
+{
+   resip::SlabAllocator::deallocate(buffer);
+}
+
+// Lets allocate_shared put the DataBuffer and its control block in a slab too
+template<class T>
+class SlabStdAllocator
+{
+public:
+   typedef T value_type;
+   SlabStdAllocator() noexcept {}
+   template<class U> SlabStdAllocator(const SlabStdAllocator<U>&) noexcept {}
+   T* allocate(size_t n) { return static_cast<T*>(resip::SlabAllocator::allocate(n * sizeof(T))); }
+   void deallocate(T* p, size_t) noexcept { resip::SlabAllocator::deallocate(p); }
+   template<class U> bool operator==(const SlabStdAllocator<U>&) const noexcept { return true; }
+   template<class U> bool operator!=(const SlabStdAllocator<U>&) const noexcept { return false; }
+};
+
+}
+
+AsyncSocketBase::SendData::SendData(const StunTuple& destination, unsigned short channel, std::shared_ptr<DataBuffer> data, size_t bufferStartPos) :
+   mDestination(destination), mFramed(channel != NO_CHANNEL), mData(std::move(data)), mBufferStartPos(bufferStartPos)
+{
+   if (mFramed)
+   {
+      // Add Turn Framing
+      channel = htons(channel);
+      memcpy(&mFrame[0], &channel, 2);
+      unsigned short msgsize = htons((unsigned short)mData->size());
+      memcpy(&mFrame[2], (void*)&msgsize, 2);  // UDP doesn't need size - but shouldn't hurt to send it anyway
+   }
+}
+
 AsyncSocketBase::AsyncSocketBase(asio::io_service& ioService) : 
   mIOService(ioService),
   mReceiving(false),
@@ -48,24 +86,18 @@ AsyncSocketBase::doSend(const StunTuple& destination, const std::shared_ptr<Data
 void
 AsyncSocketBase::doSend(const StunTuple& destination, unsigned short channel, const std::shared_ptr<DataBuffer>& data, const size_t bufferStartPos)
 {
-   bool writeInProgress = !mSendDataQueue.empty();
-   if (channel == NO_CHANNEL)
+   if (!mSendDataQueue.empty())
    {
-      mSendDataQueue.push_back(SendData(destination, nullptr, data, bufferStartPos));
+      // Write in progress - queue behind it
+      mSendDataQueue.push_back(SendData(destination, channel, data, bufferStartPos));
+      return;
    }
-   else
-   {
-      // Add Turn Framing
-      const auto frame = allocateBuffer(4);
-      channel = htons(channel);
-      memcpy(&(*frame)[0], &channel, 2);
-      unsigned short msgsize = htons((unsigned short)data->size());
-      memcpy(&(*frame)[2], (void*)&msgsize, 2);  // UDP doesn't need size - but shouldn't hurt to send it anyway
 
-      mSendDataQueue.push_back(SendData(destination, frame, data, bufferStartPos));
-   }
-   if (!writeInProgress)
+   SendData sendData(destination, channel, data, bufferStartPos);
+   setSendBuffers(sendData);
+   if (!transportTrySend(destination, mSendBuffers))
    {
+      mSendDataQueue.push_back(std::move(sendData));
       sendFirstQueuedData();
    }
 }
@@ -93,15 +125,22 @@ AsyncSocketBase::handleSend(const asio::error_code& e)
 }
 
 void 
-AsyncSocketBase::sendFirstQueuedData()
+AsyncSocketBase::setSendBuffers(const SendData& sendData)
 {
-   std::vector<asio::const_buffer> bufs;
-   if (mSendDataQueue.front().mFrameData) // If we have frame data
+   mSendBuffers.clear();
+   if (sendData.mFramed) // If we have frame data
    {
-      bufs.push_back(asio::buffer(mSendDataQueue.front().mFrameData->data(), mSendDataQueue.front().mFrameData->size()));
+      mSendBuffers.push_back(asio::buffer(sendData.mFrame, sizeof(sendData.mFrame)));
    }
-   bufs.push_back(asio::buffer(mSendDataQueue.front().mData->data()+mSendDataQueue.front().mBufferStartPos, mSendDataQueue.front().mData->size()-mSendDataQueue.front().mBufferStartPos));
-   transportSend(mSendDataQueue.front().mDestination, bufs);
+   mSendBuffers.push_back(asio::buffer(sendData.mData->data()+sendData.mBufferStartPos, sendData.mData->size()-sendData.mBufferStartPos));
+}
+
+void 
+AsyncSocketBase::sendFirstQueuedData()
+{
+   // The deque never moves its elements, so the frame buffer stays put until the send completes
+   setSendBuffers(mSendDataQueue.front());
+   transportSend(mSendDataQueue.front().mDestination, mSendBuffers);
 }
 
 void 
@@ -116,7 +155,7 @@ AsyncSocketBase::doReceive()
    if(!mReceiving)
    {
       mReceiving=true;
-      mReceiveBuffer = allocateBuffer(RECEIVE_BUFFER_SIZE);
+      mReceiveBuffer = allocateReceiveBuffer(RECEIVE_BUFFER_SIZE);
       transportReceive();
    }
 }
@@ -133,7 +172,7 @@ AsyncSocketBase::doFramedReceive()
    if(!mReceiving)
    {
       mReceiving=true;
-      mReceiveBuffer = allocateBuffer(RECEIVE_BUFFER_SIZE);
+      mReceiveBuffer = allocateReceiveBuffer(RECEIVE_BUFFER_SIZE);
       transportFramedReceive();
    }
 }
@@ -168,6 +207,21 @@ AsyncSocketBase::allocateBuffer(const size_t size)
    return std::make_shared<DataBuffer>(size);
 }
 
+std::shared_ptr<DataBuffer>  
+AsyncSocketBase::allocateReceiveBuffer(const size_t size)
+{
+   char* buffer = static_cast<char*>(resip::SlabAllocator::allocate(size));
+   try
+   {
+      return DataBuffer::ownShared(SlabStdAllocator<DataBuffer>(), buffer, size, slabDeallocator);
+   }
+   catch(...)
+   {
+      resip::SlabAllocator::deallocate(buffer);
+      throw;
+   }
+}
+
 } // namespace
 
 
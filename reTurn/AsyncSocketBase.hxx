@@ -23,6 +23,11 @@ namespace reTurn {
 class AsyncSocketBaseHandler;
 class AsyncSocketBaseDestroyedHandler;
 
+#ifdef SO_REUSEPORT
+/// SO_REUSEPORT - lets the servers of each io_service thread bind the same address and port
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> ReusePortOption;
+#endif
+
 class AsyncSocketBase :
    public std::enable_shared_from_this<AsyncSocketBase>
 {
@@ -50,6 +55,7 @@ public:
    bool isConnected() const noexcept { return mConnected; }
    asio::ip::address& getConnectedAddress() noexcept { return mConnectedAddress; }
    unsigned short getConnectedPort() const noexcept { return mConnectedPort; }
+   asio::io_service& getIOService() noexcept { return mIOService; }
 
    virtual void setOnBeforeSocketClosedFp(BeforeClosedHandler fp) { mOnBeforeSocketCloseFp = std::move(fp); }
 
@@ -69,6 +75,8 @@ public:
 
    /// Utility API
    static std::shared_ptr<DataBuffer> allocateBuffer(size_t size);
+   /// Uninitialized buffer from the per thread slab caches - for receive buffers that are overwritten anyway
+   static std::shared_ptr<DataBuffer> allocateReceiveBuffer(size_t size);
 
    // Stubbed out async handlers needed by Protocol specific Subclasses of this - the requirement for these 
    // to be in the base class all revolves around the shared_from_this() use/requirement
@@ -107,6 +115,8 @@ protected:
 
 private:
    virtual void transportSend(const StunTuple& destination, std::vector<asio::const_buffer>& buffers) = 0;
+   /// Sends immediately if that can be done without blocking; returns false if the send must be queued instead
+   virtual bool transportTrySend(const StunTuple& destination, const std::vector<asio::const_buffer>& buffers) { return false; }
    virtual void transportReceive() = 0;
    virtual void transportFramedReceive() = 0;
    virtual void transportClose() = 0;
@@ -118,16 +128,20 @@ private:
    class SendData
    {
    public:
-      SendData(const StunTuple& destination, std::shared_ptr<DataBuffer> frameData, std::shared_ptr<DataBuffer> data, size_t bufferStartPos = 0) :
-         mDestination(destination), mFrameData(std::move(frameData)), mData(std::move(data)), mBufferStartPos(bufferStartPos) {}
+      SendData(const StunTuple& destination, unsigned short channel, std::shared_ptr<DataBuffer> data, size_t bufferStartPos = 0);
       StunTuple mDestination;
-      std::shared_ptr<DataBuffer> mFrameData;
+      /// Turn framing (ChannelData header), if any - kept inline rather than in a buffer of its own
+      char mFrame[4];
+      bool mFramed;
       std::shared_ptr<DataBuffer> mData;
       size_t mBufferStartPos;
    };
+   void setSendBuffers(const SendData& sendData);
    /// Queue of data to send
    typedef std::deque<SendData> SendDataQueue;
    SendDataQueue mSendDataQueue;
+   /// Scatter/gather list for the send in progress (frame header plus payload), reused between sends
+   std::vector<asio::const_buffer> mSendBuffers;
 };
 
 typedef std::shared_ptr<AsyncSocketBase> ConnectionPtr;
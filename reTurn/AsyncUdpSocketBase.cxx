@@ -14,7 +14,9 @@ namespace reTurn {
 AsyncUdpSocketBase::AsyncUdpSocketBase(asio::io_service& ioService) 
    : AsyncSocketBase(ioService),
      mSocket(ioService),
-     mResolver(ioService)
+     mResolver(ioService),
+     mReusePort(false),
+     mSendImmediately(false)
 {
 }
 
@@ -41,9 +43,20 @@ AsyncUdpSocketBase::bind(const asio::ip::address& address, unsigned short port)
 #endif
 #endif
       mSocket.set_option(asio::ip::udp::socket::reuse_address(true), errorCode);
+#ifdef SO_REUSEPORT
+      if(mReusePort)
+      {
+         mSocket.set_option(ReusePortOption(true), errorCode);
+      }
+#endif
       mSocket.set_option(asio::socket_base::receive_buffer_size(66560));
       //mSocket.set_option(asio::socket_base::send_buffer_size(66560));
       mSocket.bind(asio::ip::udp::endpoint(address, port), errorCode);
+      if(!errorCode && mSendImmediately)
+      {
+         // Only affects the synchronous send_to in transportTrySend - async operations don't care
+         mSocket.non_blocking(true, errorCode);
+      }
    }
    return errorCode;
 }
@@ -106,6 +119,32 @@ AsyncUdpSocketBase::transportSend(const StunTuple& destination, std::vector<asio
                          boost::bind(&AsyncUdpSocketBase::handleSend, shared_from_this(), asio::placeholders::error));
 }
 
+bool 
+AsyncUdpSocketBase::transportTrySend(const StunTuple& destination, const std::vector<asio::const_buffer>& buffers)
+{
+   if(!mSendImmediately)
+   {
+      return false;
+   }
+   asio::error_code ec;
+   mSocket.send_to(buffers, asio::ip::udp::endpoint(destination.getAddress(), destination.getPort()), 0, ec);
+   if(ec == asio::error::would_block || ec == asio::error::try_again)
+   {
+      // Socket buffer is full - queue it and let async_send_to wait for room
+      return false;
+   }
+   if(!ec)
+   {
+      onSendSuccess();
+   }
+   else
+   {
+      DebugLog(<< "transportTrySend with error: " << ec);
+      onSendFailure(ec);
+   }
+   return true;
+}
+
 void 
 AsyncUdpSocketBase::transportReceive()
 {
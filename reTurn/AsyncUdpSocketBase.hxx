@@ -23,6 +23,7 @@ public:
    void transportReceive() override;
    void transportFramedReceive() override;
    void transportSend(const StunTuple& destination, std::vector<asio::const_buffer>& buffers) override;
+   bool transportTrySend(const StunTuple& destination, const std::vector<asio::const_buffer>& buffers) override;
    void transportClose() override;
 
    asio::ip::address getSenderEndpointAddress() override;
@@ -35,6 +36,13 @@ protected:
    /// Endpoint info for current sender
    asio::ip::udp::endpoint mSenderEndpoint;
 
+   /// Set SO_REUSEPORT when binding
+   bool mReusePort;
+   /// Send straight from doSend when the socket buffer has room, rather than through async_send_to.  
+   /// onSendSuccess/onSendFailure are then called from within doSend, so only set this (before bind)
+   /// where those callbacks do not send again.
+   bool mSendImmediately;
+
    void handleUdpResolve(const asio::error_code& ec,
                          asio::ip::udp::resolver::iterator endpoint_iterator) override;
 
@@ -1,4 +1,5 @@
 #include "ChannelManager.hxx"
+#include <cstring>
 #include <rutil/Random.hxx>
 #include <rutil/WinLeakCheck.hxx>
 #include <rutil/Logger.hxx>
@@ -12,8 +13,11 @@ using namespace std;
 
 namespace reTurn {
 
-ChannelManager::ChannelManager()
+ChannelManager::ChannelManager() :
+   mLastPeer(0)
 {
+   memset(mChannelPages, 0, sizeof(mChannelPages));
+
    // make starting channel number random
    int randInt = resip::Random::getRandom();
    mNextChannelNumber = MIN_CHANNEL_NUM + (unsigned short)(randInt % (MAX_CHANNEL_NUM-MIN_CHANNEL_NUM+1));
@@ -27,6 +31,46 @@ ChannelManager::~ChannelManager()
    {
       delete it->second;
    }
+   for(int i = 0; i < NumChannelPages; i++)
+   {
+      delete [] mChannelPages[i];
+   }
+}
+
+RemotePeer**
+ChannelManager::findChannelSlot(unsigned short channel, bool create)
+{
+   if(channel < MIN_CHANNEL_NUM || channel > MAX_CHANNEL_NUM)
+   {
+      return 0;
+   }
+   unsigned int index = channel - MIN_CHANNEL_NUM;
+   RemotePeer**& page = mChannelPages[index / ChannelPageSize];
+   if(!page)
+   {
+      if(!create)
+      {
+         return 0;
+      }
+      page = new RemotePeer*[ChannelPageSize]();
+   }
+   return &page[index % ChannelPageSize];
+}
+
+void
+ChannelManager::destroyRemotePeer(RemotePeer* remotePeer)
+{
+   RemotePeer** slot = findChannelSlot(remotePeer->getChannel(), false);
+   if(slot && *slot == remotePeer)
+   {
+      *slot = 0;
+   }
+   if(mLastPeer == remotePeer)
+   {
+      mLastPeer = 0;
+   }
+   mTupleRemotePeerMap.erase(remotePeer->getPeerTuple());
+   delete remotePeer;
 }
 
 unsigned short 
@@ -59,26 +103,29 @@ ChannelManager::createChannelBinding(const StunTuple& peerTuple, unsigned short
 
    // Add RemoteAddress to the appropriate maps
    mTupleRemotePeerMap[peerTuple] = remotePeer;
-   mChannelRemotePeerMap[channel] = remotePeer;
+   RemotePeer** slot = findChannelSlot(channel, true);
+   resip_assert(slot);  // callers validate the channel number
+   if(slot)
+   {
+      *slot = remotePeer;
+   }
    return remotePeer;
 }
 
 RemotePeer* 
 ChannelManager::findRemotePeerByChannel(unsigned short channelNumber)
 {
-   ChannelRemotePeerMap::iterator it = mChannelRemotePeerMap.find(channelNumber);
-   if(it != mChannelRemotePeerMap.end())
+   RemotePeer** slot = findChannelSlot(channelNumber, false);
+   if(slot && *slot)
    {
-      if(!it->second->isExpired())
+      if(!(*slot)->isExpired())
       {
-         return it->second;
+         return *slot;
       }
       else
       {
          // cleanup expired channel binding
-         mTupleRemotePeerMap.erase(it->second->getPeerTuple());
-		 delete it->second;
-         mChannelRemotePeerMap.erase(it);
+         destroyRemotePeer(*slot);
       }
    }
    return 0;
@@ -87,22 +134,29 @@ ChannelManager::findRemotePeerByChannel(unsigned short channelNumber)
 RemotePeer* 
 ChannelManager::findRemotePeerByPeerAddress(const StunTuple& peerAddress)
 {
-   // Find RemotePeer
-   TupleRemotePeerMap::iterator it = mTupleRemotePeerMap.find(peerAddress);
-   if(it != mTupleRemotePeerMap.end())
+   RemotePeer* remotePeer = 0;
+   if(mLastPeer && mLastPeer->getPeerTuple() == peerAddress)
    {
-      if(!it->second->isExpired())
-      {
-         return it->second;
-      }
-      else
+      remotePeer = mLastPeer;
+   }
+   else
+   {
+      // Find RemotePeer
+      TupleRemotePeerMap::iterator it = mTupleRemotePeerMap.find(peerAddress);
+      if(it == mTupleRemotePeerMap.end())
       {
-         // cleanup expired channel binding
-         mChannelRemotePeerMap.erase(it->second->getChannel());
-		 delete it->second;
-         mTupleRemotePeerMap.erase(it);
+         return 0;
       }
+      remotePeer = it->second;
+   }
+
+   if(!remotePeer->isExpired())
+   {
+      mLastPeer = remotePeer;
+      return remotePeer;
    }
+   // cleanup expired channel binding
+   destroyRemotePeer(remotePeer);
    return 0;
 }
 
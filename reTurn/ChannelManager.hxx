@@ -6,6 +6,7 @@
 #include <asio/ssl.hpp>
 #endif
 
+#include <map>
 #include "RemotePeer.hxx"
 
 namespace reTurn {
@@ -26,10 +27,19 @@ public:
    RemotePeer* findRemotePeerByPeerAddress(const StunTuple& peerAddress);
 
 private:
-   typedef std::map<unsigned short,RemotePeer*> ChannelRemotePeerMap;
+   // Channel numbers index straight into a table of RemotePeer pointers, split into pages that
+   // are only allocated once a channel in their range is bound - most allocations use a handful
+   enum { ChannelPageSize = 256,
+          NumChannelPages = (MAX_CHANNEL_NUM - MIN_CHANNEL_NUM + 1) / ChannelPageSize };
+   RemotePeer** findChannelSlot(unsigned short channel, bool create);
+   RemotePeer** mChannelPages[NumChannelPages];
+
    typedef std::map<StunTuple,RemotePeer*> TupleRemotePeerMap;
-   ChannelRemotePeerMap mChannelRemotePeerMap;
    TupleRemotePeerMap mTupleRemotePeerMap;
+   // Peer last returned by findRemotePeerByPeerAddress - relayed data usually comes from the same
+   // peer as the packet before it
+   RemotePeer* mLastPeer;
+   void destroyRemotePeer(RemotePeer* remotePeer);
 
    unsigned short getNextChannelNumber();
    unsigned short mNextChannelNumber;
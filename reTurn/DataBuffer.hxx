@@ -2,6 +2,7 @@
 #define DATA_BUFFER_HXX
 
 #include <cstddef>
+#include <memory>
 
 namespace reTurn {
 
@@ -17,6 +18,16 @@ public:
    ~DataBuffer();
 
    static DataBuffer* own(char* data, size_t size, deallocator dealloc = ArrayDeallocator);
+   /// As own(), but shared, with the DataBuffer and the shared_ptr control block allocated through alloc
+   template<class Alloc>
+   static std::shared_ptr<DataBuffer> ownShared(const Alloc& alloc, char* data, size_t size, deallocator dealloc)
+   {
+      std::shared_ptr<DataBuffer> buff = std::allocate_shared<DataBuffer>(alloc, (size_t)0, dealloc);
+      buff->mBuffer = data;
+      buff->mSize = size;
+      buff->mStart = data;
+      return buff;
+   }
 
    const char* data() const noexcept;
    size_t size() const noexcept;
@@ -58,6 +58,7 @@ public:
    asio::ip::address mTurnAddress;
    asio::ip::address mTurnV6Address;
    asio::ip::address mAltStunAddress;
+   unsigned int mIOThreads;  // 0 - one per processor core
 
    resip::Data mAuthenticationRealm;
    int mUserDatabaseCheckInterval;
@@ -516,16 +516,17 @@ RequestHandler::processTurnAllocateRequest(AsyncSocketBase* turnSocket, TurnAllo
       if(request.mTurnEvenPort.propType == StunMessage::PropsPortEven)
       {
          // Attempt to allocate an even port
-         port = mTurnManager.allocateEvenPort(allocationTuple.getTransportType());
+         port = mTurnManager.allocateEvenPort(allocationTuple.getTransportType(), allocationTuple.getAddress());
       }
       else if(request.mTurnEvenPort.propType == StunMessage::PropsPortPair)
       {
          // Attempt to allocate an even port, with a free adjacent odd port
-         port = mTurnManager.allocateEvenPortPair(allocationTuple.getTransportType());
+         UInt64 reservationToken = 0;
+         port = mTurnManager.allocateEvenPortPair(allocationTuple.getTransportType(), allocationTuple.getAddress(), reservationToken);
 
-         // Add Reservation Token to response - for now just use reserved port number as token
+         // Add Reservation Token to response
          response.mHasTurnReservationToken = true;
-         response.mTurnReservationToken = port + 1;
+         response.mTurnReservationToken = reservationToken;
       }
       if(port == 0)
       {
@@ -537,20 +538,22 @@ RequestHandler::processTurnAllocateRequest(AsyncSocketBase* turnSocket, TurnAllo
 
    if(request.mHasTurnReservationToken)
    {
-      // Try to allocate reserved port - for now reservation token is reserved port number
-      port = (unsigned short)request.mTurnReservationToken;
-      if(!mTurnManager.allocatePort(allocationTuple.getTransportType(), port, true /* allocate reserved */))
+      // Try to allocate reserved port - it is on the relay address the reservation was made on
+      asio::ip::address reservedAddress;
+      port = mTurnManager.allocateReservedPort(allocationTuple.getTransportType(), request.mTurnReservationToken, reservedAddress);
+      if(port == 0)
       {
          WarningLog(<< "Unable to allocate requested port - bad reservation token.  Sending 508. Sender=" << request.mRemoteTuple);
          buildErrorResponse(response, 508, "Insufficient Port Capacity");  
          return RespondFromReceiving;
       }      
+      allocationTuple.setAddress(reservedAddress);
    }
 
    if(port == 0)
    {
       // Allocate any available port
-      port = mTurnManager.allocateAnyPort(allocationTuple.getTransportType());      
+      port = mTurnManager.allocateAnyPort(allocationTuple.getTransportType(), allocationTuple.getAddress());      
       if(port == 0)
       {
          WarningLog(<< "Unable to allocate port.  Sending 508. Sender=" << request.mRemoteTuple);
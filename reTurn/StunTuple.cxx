@@ -60,6 +60,27 @@ StunTuple::operator<(const StunTuple& rhs) const
    return false;
 }
 
+size_t
+StunTuple::hash() const
+{
+   // FNV-1a over address, port and transport
+   size_t h = 2166136261u;
+   if(mAddress.is_v6())
+   {
+      asio::ip::address_v6::bytes_type bytes = mAddress.to_v6().to_bytes();
+      for(size_t i = 0; i < bytes.size(); i++)
+      {
+         h = (h ^ bytes[i]) * 16777619u;
+      }
+   }
+   else
+   {
+      h = (h ^ mAddress.to_v4().to_ulong()) * 16777619u;
+   }
+   h = (h ^ mPort) * 16777619u;
+   return (h ^ mTransport) * 16777619u;
+}
+
 void
 StunTuple::toSockaddr(sockaddr* addr) const
 {
@@ -115,6 +136,8 @@ operator<<(EncodeStream& strm, const StunTuple& tuple)
 
 } // namespace
 
+HashValueImp(reTurn::StunTuple, data.hash());
+
 
 /* ====================================================================
 
@@ -19,6 +19,7 @@
 #include <asio/ssl.hpp>
 #endif
 #include <rutil/resipfaststreams.hxx>
+#include <rutil/HashMap.hxx>
 
 namespace reTurn {
 
@@ -39,6 +40,7 @@ public:
    bool operator==(const StunTuple& rhs) const;
    bool operator!=(const StunTuple& rhs) const;
    bool operator<(const StunTuple& rhs) const;
+   size_t hash() const;
 
    TransportType getTransportType() const { return mTransport; }
    void setTransportType(TransportType transport) { mTransport = transport; }
@@ -63,6 +65,8 @@ EncodeStream& operator<<(EncodeStream& strm, const StunTuple& tuple);
 
 } 
 
+HashValue(reTurn::StunTuple);
+
 #endif
 
 
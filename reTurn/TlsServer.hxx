@@ -22,7 +22,8 @@ class TlsServer
 {
 public:
   /// Create the server to listen on the specified TCP address and port
-  explicit TlsServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port);
+  /// reusePort allows one TlsServer per io_service thread on the same address and port
+  explicit TlsServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port, bool reusePort = false);
 
   void start();
 
@@ -41,7 +41,7 @@ TurnAllocation::TurnAllocation(TurnManager& turnManager,
    mRequestedTuple(requestedTuple),
    mTurnManager(turnManager),
    mTurnAllocationManager(turnAllocationManager),
-   mAllocationTimer(turnManager.getIOService()),
+   mAllocationTimer(localTurnSocket->getIOService()),  // stay on the io_service thread of the client's socket
    mLocalTurnSocket(localTurnSocket),
    mBadChannelErrorLogged(false),
    mNoPermissionToPeerLogged(false),
@@ -64,7 +64,7 @@ TurnAllocation::~TurnAllocation()
    stopRelay();
 
    // Deallocate Port
-   mTurnManager.deallocatePort(mRequestedTuple.getTransportType(), mRequestedTuple.getPort());
+   mTurnManager.deallocatePort(mRequestedTuple.getTransportType(), mRequestedTuple.getAddress(), mRequestedTuple.getPort());
 
    // Cleanup Permission Memory
    TurnPermissionMap::iterator it;   
@@ -85,7 +85,7 @@ TurnAllocation::startRelay()
 {
    if(mRequestedTuple.getTransportType() == StunTuple::UDP)
    {
-      mUdpRelayServer = std::make_shared<UdpRelayServer>(mTurnManager.getIOService(), *this);
+      mUdpRelayServer = std::make_shared<UdpRelayServer>(mLocalTurnSocket->getIOService(), *this);
       if(!mUdpRelayServer->startReceiving())
       {
          stopRelay();  // Ensure allocation timer is stopped
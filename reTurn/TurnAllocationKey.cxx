@@ -41,6 +41,8 @@ TurnAllocationKey::operator<(const TurnAllocationKey& rhs) const
 
 } // namespace
 
+HashValueImp(reTurn::TurnAllocationKey, data.hash());
+
 
 /* ====================================================================
 
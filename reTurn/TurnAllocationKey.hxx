@@ -16,6 +16,7 @@ public:
    bool operator==(const TurnAllocationKey& rhs) const;
    bool operator!=(const TurnAllocationKey& rhs) const;
    bool operator<(const TurnAllocationKey& rhs) const;
+   size_t hash() const { return mClientLocalTuple.hash() * 31 + mClientRemoteTuple.hash(); }
 
    const StunTuple& getClientLocalTuple() const { return mClientLocalTuple; }
    const StunTuple& getClientRemoteTuple() const { return mClientRemoteTuple; }
@@ -27,6 +28,8 @@ private:
 
 } 
 
+HashValue(reTurn::TurnAllocationKey);
+
 #endif
 
 
@@ -1,7 +1,7 @@
 #ifndef TURNALLOCATIONMANAGER_HXX
 #define TURNALLOCATIONMANAGER_HXX
 
-#include <map>
+#include <rutil/HashMap.hxx>
 #include <asio.hpp>
 #ifdef USE_SSL
 #include <asio/ssl.hpp>
@@ -29,8 +29,11 @@ public:
    void allocationExpired(const asio::error_code& e, const TurnAllocationKey& turnAllocationKey);
 
 private:
-   typedef std::map<TurnAllocationKey, TurnAllocation*> TurnAllocationMap;  // .slg. consider using hash table
+   typedef HashMap<TurnAllocationKey, TurnAllocation*> TurnAllocationMap;
    TurnAllocationMap mTurnAllocationMap;
+   typedef HashMap<StunTuple, TurnAllocation*> RequestedTupleMap;  // allocations by relay tuple
+   RequestedTupleMap mRequestedTupleMap;
+   void eraseTurnAllocation(TurnAllocationMap::iterator it);
 };
 
 } 
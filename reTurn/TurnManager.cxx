@@ -1,5 +1,5 @@
 #include <rutil/Lock.hxx>
-
+#include <rutil/Random.hxx>
 #include "TurnManager.hxx"
 #include "TurnAllocation.hxx"
 #include <rutil/Logger.hxx>
@@ -11,189 +11,320 @@ using namespace std;
 
 namespace reTurn {
 
-TurnManager::TurnManager(asio::io_service& ioService, const ReTurnConfig& config) : 
-   mLastAllocatedUdpPort(config.mAllocationPortRangeMin-1),
-   mLastAllocatedTcpPort(config.mAllocationPortRangeMin-1),
-   mIOService(ioService),
-   mConfig(config)
+// The ports of a range, taken an even/odd pair at a time.  Each pair is on at
+// most one of three free lists - both ports free, only the even one free, or
+// only the odd one free - so every request is served from the head of a list
+// and every release appends to the tail of one, in constant time.  Releasing
+// to the tail keeps a freed port out of use for as long as possible.
+class TurnManager::PortPool
 {
-   // Initialize Allocation Ports
-   for(unsigned short i = config.mAllocationPortRangeMin; i <= config.mAllocationPortRangeMax && i != 0; i++) // i != 0 catches case where we increment 65535 (as an unsigned short)
+public:
+   PortPool(unsigned short min, unsigned short max);
+
+   unsigned short allocateAny();
+   unsigned short allocateEven();
+   unsigned short allocateOdd();
+   unsigned short allocateEvenPair();  // odd port is left reserved
+   bool allocate(unsigned short port, bool reserved);
+   /// Returns the reservation token of the odd port, if releasing the even
+   /// port also released its reservation, otherwise 0
+   UInt64 deallocate(unsigned short port);
+   void setReservationToken(unsigned short evenPort, UInt64 token) { mPairs[slot(evenPort)].mReservationToken = token; }
+
+private:
+   typedef enum
    {
-      mUdpAllocationPorts[i] = PortStateUnallocated;
-      mTcpAllocationPorts[i] = PortStateUnallocated;
+      PortStateUnallocated,
+      PortStateAllocated,
+      PortStateReserved,
+      PortStateOutOfRange
+   } PortState;
+
+   typedef enum
+   {
+      FreePair,
+      FreeEven,
+      FreeOdd,
+      NumFreeLists,
+      NotFree = NumFreeLists
+   } FreeList;
+
+   static const UInt32 End = 0xFFFFFFFF;
+
+   class Pair
+   {
+   public:
+      unsigned char mState[2];  // even, odd
+      unsigned char mList;
+      UInt32 mPrev;
+      UInt32 mNext;
+      UInt64 mReservationToken;
+   };
+
+   UInt32 slot(unsigned short port) const { return (UInt32)(port - mBase) / 2; }
+   unsigned short portAt(UInt32 slot, int odd) const { return (unsigned short)(mBase + slot * 2 + odd); }
+   bool inRange(unsigned short port) const { return port >= mBase && slot(port) < mPairs.size() && mPairs[slot(port)].mState[port & 1] != PortStateOutOfRange; }
+   unsigned short take(FreeList list, int odd, PortState state);
+   void update(UInt32 slot);
+   void unlink(UInt32 slot);
+   void append(UInt32 slot, FreeList list);
+
+   unsigned int mBase;  // even port at or below the range minimum
+   std::vector<Pair> mPairs;
+   UInt32 mHead[NumFreeLists];
+   UInt32 mTail[NumFreeLists];
+};
+
+TurnManager::PortPool::PortPool(unsigned short min, unsigned short max) :
+   mBase(min & ~1)
+{
+   for(int i = 0; i < NumFreeLists; i++)
+   {
+      mHead[i] = mTail[i] = End;
+   }
+   if(max < min)
+   {
+      return;
+   }
+   mPairs.resize(((unsigned int)max - mBase) / 2 + 1);
+   for(UInt32 i = 0; i < mPairs.size(); i++)
+   {
+      Pair& pair = mPairs[i];
+      pair.mState[0] = portAt(i, 0) >= min ? PortStateUnallocated : PortStateOutOfRange;
+      pair.mState[1] = (unsigned int)mBase + i * 2 + 1 <= max ? PortStateUnallocated : PortStateOutOfRange;
+      pair.mList = NotFree;
+      pair.mPrev = pair.mNext = End;
+      pair.mReservationToken = 0;
+      update(i);
    }
 }
 
-TurnManager::~TurnManager()
+unsigned short
+TurnManager::PortPool::allocateAny()
 {
-   InfoLog(<< "Turn Manager destroyed.");
+   // Split a free pair only when there is nothing else, and then keep the even
+   // port, which even port requests can still use
+   if(mHead[FreeOdd] != End) return take(FreeOdd, 1, PortStateAllocated);
+   if(mHead[FreeEven] != End) return take(FreeEven, 0, PortStateAllocated);
+   return take(FreePair, 1, PortStateAllocated);
 }
 
-unsigned short 
-TurnManager::allocateAnyPort(StunTuple::TransportType transport)
+unsigned short
+TurnManager::PortPool::allocateEven()
 {
-   PortAllocationMap& portAllocationMap = getPortAllocationMap(transport);
-   unsigned short startPortToCheck = advanceLastAllocatedPort(transport);
-   unsigned short portToCheck = startPortToCheck;
-   while(portAllocationMap[portToCheck] != PortStateUnallocated)
-   {
-      portToCheck = advanceLastAllocatedPort(transport);
-      if(portToCheck == startPortToCheck) return 0;  // If we checked all available ports and none found - then return 0
-   }
-   portAllocationMap[portToCheck] = PortStateAllocated;
-   return portToCheck;
+   if(mHead[FreeEven] != End) return take(FreeEven, 0, PortStateAllocated);
+   return take(FreePair, 0, PortStateAllocated);
 }
 
-unsigned short 
-TurnManager::allocateEvenPort(StunTuple::TransportType transport)
+unsigned short
+TurnManager::PortPool::allocateOdd()
+{
+   if(mHead[FreeOdd] != End) return take(FreeOdd, 1, PortStateAllocated);
+   return take(FreePair, 1, PortStateAllocated);
+}
+
+unsigned short
+TurnManager::PortPool::allocateEvenPair()
+{
+   if(mHead[FreePair] == End) return 0;
+   UInt32 i = mHead[FreePair];
+   mPairs[i].mState[1] = PortStateReserved;
+   return take(FreePair, 0, PortStateAllocated);
+}
+
+bool
+TurnManager::PortPool::allocate(unsigned short port, bool reserved)
 {
-   PortAllocationMap& portAllocationMap = getPortAllocationMap(transport);
-   unsigned short startPortToCheck = advanceLastAllocatedPort(transport);
-   // Ensure start port is even
-   while(startPortToCheck % 2 != 0)
+   if(!inRange(port))
    {
-      startPortToCheck = advanceLastAllocatedPort(transport);
+      return false;
    }
-   unsigned short portToCheck = startPortToCheck;
-   while(portAllocationMap[portToCheck] != PortStateUnallocated)
+   UInt32 i = slot(port);
+   unsigned char& state = mPairs[i].mState[port & 1];
+   if(state != (reserved ? PortStateReserved : PortStateUnallocated))
    {
-      portToCheck = advanceLastAllocatedPort(transport, 2);
-      if(portToCheck == startPortToCheck) return 0;  // If we checked all available ports and none found - then return 0
+      return false;
    }
-   portAllocationMap[portToCheck] = PortStateAllocated;
-   return portToCheck;
+   state = PortStateAllocated;
+   if(reserved)
+   {
+      mPairs[i].mReservationToken = 0;
+   }
+   update(i);
+   return true;
 }
 
-// Note:  This is not used, since requesting an odd port was removed
-unsigned short 
-TurnManager::allocateOddPort(StunTuple::TransportType transport)
+UInt64
+TurnManager::PortPool::deallocate(unsigned short port)
 {
-   PortAllocationMap& portAllocationMap = getPortAllocationMap(transport);
-   unsigned short startPortToCheck = advanceLastAllocatedPort(transport);
-   // Ensure start port is odd
-   while(startPortToCheck % 2 != 1)
+   UInt64 releasedToken = 0;
+   if(inRange(port))
    {
-      startPortToCheck = advanceLastAllocatedPort(transport);
+      UInt32 i = slot(port);
+      Pair& pair = mPairs[i];
+      pair.mState[port & 1] = PortStateUnallocated;
+      // If port is even - check if next higher port is reserved - if so unallocate it
+      if(port % 2 == 0 && pair.mState[1] == PortStateReserved)
+      {
+         pair.mState[1] = PortStateUnallocated;
+         releasedToken = pair.mReservationToken;
+         pair.mReservationToken = 0;
+      }
+      update(i);
    }
-   unsigned short portToCheck = startPortToCheck;
-   while(portAllocationMap[portToCheck] != PortStateUnallocated)
+   return releasedToken;
+}
+
+unsigned short
+TurnManager::PortPool::take(FreeList list, int odd, PortState state)
+{
+   UInt32 i = mHead[list];
+   if(i == End)
    {
-      portToCheck = advanceLastAllocatedPort(transport, 2);
-      if(portToCheck == startPortToCheck) return 0;  // If we checked all available ports and none found - then return 0
+      return 0;
    }
-   portAllocationMap[portToCheck] = PortStateAllocated;
-   return portToCheck;
+   mPairs[i].mState[odd] = (unsigned char)state;
+   update(i);
+   return portAt(i, odd);
 }
 
-unsigned short 
-TurnManager::allocateEvenPortPair(StunTuple::TransportType transport)
+void
+TurnManager::PortPool::update(UInt32 i)
 {
-   PortAllocationMap& portAllocationMap = getPortAllocationMap(transport);
-   unsigned short startPortToCheck = advanceLastAllocatedPort(transport);
-   // Ensure start port is even and that start port + 1 is in range
-   while(startPortToCheck % 2 != 0 ||
-         startPortToCheck + 1 == 0 ||
-         startPortToCheck + 1 > mConfig.mAllocationPortRangeMax )
+   Pair& pair = mPairs[i];
+   bool evenFree = pair.mState[0] == PortStateUnallocated;
+   bool oddFree = pair.mState[1] == PortStateUnallocated;
+   FreeList list = evenFree ? (oddFree ? FreePair : FreeEven) : (oddFree ? FreeOdd : NotFree);
+   if(list != pair.mList)
    {
-      startPortToCheck = advanceLastAllocatedPort(transport);
+      unlink(i);
+      if(list != NotFree)
+      {
+         append(i, list);
+      }
    }
-   unsigned short portToCheck = startPortToCheck;
-   while(portAllocationMap[portToCheck] != PortStateUnallocated || portAllocationMap[portToCheck+1] != PortStateUnallocated)
+}
+
+void
+TurnManager::PortPool::unlink(UInt32 i)
+{
+   Pair& pair = mPairs[i];
+   if(pair.mList == NotFree)
    {
-      portToCheck = advanceLastAllocatedPort(transport, 2);
-      if(portToCheck == startPortToCheck) return 0;  // If we checked all available ports and none found - then return 0
+      return;
    }
-   portAllocationMap[portToCheck] = PortStateAllocated;
-   portAllocationMap[portToCheck+1] = PortStateReserved;
-   return portToCheck;
+   if(pair.mPrev != End) mPairs[pair.mPrev].mNext = pair.mNext; else mHead[pair.mList] = pair.mNext;
+   if(pair.mNext != End) mPairs[pair.mNext].mPrev = pair.mPrev; else mTail[pair.mList] = pair.mPrev;
+   pair.mPrev = pair.mNext = End;
+   pair.mList = NotFree;
 }
 
-bool 
-TurnManager::allocatePort(StunTuple::TransportType transport, unsigned short port, bool reserved)
+void
+TurnManager::PortPool::append(UInt32 i, FreeList list)
+{
+   Pair& pair = mPairs[i];
+   pair.mList = (unsigned char)list;
+   pair.mPrev = mTail[list];
+   pair.mNext = End;
+   if(mTail[list] != End) mPairs[mTail[list]].mNext = i; else mHead[list] = i;
+   mTail[list] = i;
+}
+
+TurnManager::TurnManager(asio::io_service& ioService, const ReTurnConfig& config) : 
+   mIOService(ioService),
+   mConfig(config)
+{
+}
+
+TurnManager::~TurnManager()
+{
+   InfoLog(<< "Turn Manager destroyed.");
+}
+
+TurnManager::PortPool&
+TurnManager::getPortPool(StunTuple::TransportType transport, const asio::ip::address& address)
 {
-   if(port >= mConfig.mAllocationPortRangeMin && port <= mConfig.mAllocationPortRangeMax)
+   bool tcp = transport == StunTuple::TCP || transport == StunTuple::TLS;
+   std::unique_ptr<PortPool>& portPool = mPortPools[PortPoolKey(tcp, address)];
+   if(!portPool)
    {
-      PortAllocationMap& portAllocationMap = getPortAllocationMap(transport);
-      if(reserved)
-      {
-         if(portAllocationMap[port] == PortStateReserved)
-         {
-            portAllocationMap[port] = PortStateAllocated;
-            return true;
-         }
-      }
-      else
-      {
-         if(portAllocationMap[port] == PortStateUnallocated)  
-         {
-            portAllocationMap[port] = PortStateAllocated;
-            return true;
-         }
-      }
+      portPool.reset(new PortPool(mConfig.mAllocationPortRangeMin, mConfig.mAllocationPortRangeMax));
    }
-   return false;
+   return *portPool;
 }
 
-void 
-TurnManager::deallocatePort(StunTuple::TransportType transport, unsigned short port)
+unsigned short 
+TurnManager::allocateAnyPort(StunTuple::TransportType transport, const asio::ip::address& address)
 {
-   if(port >= mConfig.mAllocationPortRangeMin && port <= mConfig.mAllocationPortRangeMax)
-   {
-      PortAllocationMap& portAllocationMap = getPortAllocationMap(transport);
-      portAllocationMap[port] = PortStateUnallocated;
+   resip::Lock lock(mMutex);
+   return getPortPool(transport, address).allocateAny();
+}
 
-      // If port is even - check if next higher port is reserved - if so unallocate it
-      if(port % 2 == 0 && portAllocationMap[port+1] == PortStateReserved)
+unsigned short 
+TurnManager::allocateEvenPort(StunTuple::TransportType transport, const asio::ip::address& address)
+{
+   resip::Lock lock(mMutex);
+   return getPortPool(transport, address).allocateEven();
+}
+
+// Note:  This is not used, since requesting an odd port was removed
+unsigned short 
+TurnManager::allocateOddPort(StunTuple::TransportType transport, const asio::ip::address& address)
+{
+   resip::Lock lock(mMutex);
+   return getPortPool(transport, address).allocateOdd();
+}
+
+unsigned short 
+TurnManager::allocateEvenPortPair(StunTuple::TransportType transport, const asio::ip::address& address, UInt64& reservationToken)
+{
+   resip::Lock lock(mMutex);
+   PortPool& portPool = getPortPool(transport, address);
+   unsigned short port = portPool.allocateEvenPair();
+   if(port != 0)
+   {
+      // Token is cryptographically random, so that one client can't claim another's reservation by guessing
+      do
       {
-         portAllocationMap[port+1] = PortStateUnallocated;
-      }
+         resip::Random::getCryptoRandom((unsigned char*)&reservationToken, sizeof(reservationToken));
+      } while(reservationToken == 0 || mReservations.find(reservationToken) != mReservations.end());
+      mReservations.insert(ReservationMap::value_type(reservationToken, Reservation(transport, address, port + 1)));
+      portPool.setReservationToken(port, reservationToken);
    }
+   return port;
 }
 
-TurnManager::PortAllocationMap& 
-TurnManager::getPortAllocationMap(StunTuple::TransportType transport)
+unsigned short 
+TurnManager::allocateReservedPort(StunTuple::TransportType transport, UInt64 reservationToken, asio::ip::address& address)
 {
-   switch(transport)
+   resip::Lock lock(mMutex);
+   ReservationMap::iterator it = mReservations.find(reservationToken);
+   if(it == mReservations.end() || 
+      (it->second.mTransport == StunTuple::UDP) != (transport == StunTuple::UDP))
    {
-   case StunTuple::TCP:
-   case StunTuple::TLS:
-      return mTcpAllocationPorts;
-   case StunTuple::UDP:
-   default:
-      return mUdpAllocationPorts;
+      return 0;
    }
+   unsigned short port = it->second.mPort;
+   address = it->second.mAddress;
+   mReservations.erase(it);
+   return getPortPool(transport, address).allocate(port, true /* reserved */) ? port : 0;
 }
 
-unsigned short 
-TurnManager::advanceLastAllocatedPort(StunTuple::TransportType transport, unsigned int numToAdvance)
+bool 
+TurnManager::allocatePort(StunTuple::TransportType transport, const asio::ip::address& address, unsigned short port)
 {
-   switch(transport)
+   resip::Lock lock(mMutex);
+   return getPortPool(transport, address).allocate(port, false);
+}
+
+void 
+TurnManager::deallocatePort(StunTuple::TransportType transport, const asio::ip::address& address, unsigned short port)
+{
+   resip::Lock lock(mMutex);
+   UInt64 releasedToken = getPortPool(transport, address).deallocate(port);
+   if(releasedToken != 0)
    {
-   case StunTuple::TCP:
-   case StunTuple::TLS:
-      mLastAllocatedTcpPort+=numToAdvance;
-      if(mLastAllocatedTcpPort > mConfig.mAllocationPortRangeMax) 
-      {
-         mLastAllocatedTcpPort = mConfig.mAllocationPortRangeMin+(mLastAllocatedTcpPort-mConfig.mAllocationPortRangeMax-1);
-      }
-      else if(mLastAllocatedTcpPort == 0 /* Wrap around */)
-      {
-         mLastAllocatedTcpPort = mConfig.mAllocationPortRangeMin;
-      }
-      return mLastAllocatedTcpPort;
-   case StunTuple::UDP:
-   default:
-      mLastAllocatedUdpPort+=numToAdvance;
-      if(mLastAllocatedUdpPort > mConfig.mAllocationPortRangeMax) 
-      {
-         mLastAllocatedUdpPort = mConfig.mAllocationPortRangeMin+(mLastAllocatedUdpPort-mConfig.mAllocationPortRangeMax-1);
-      }
-      else if(mLastAllocatedUdpPort == 0 /* Wrap around */)
-      {
-         mLastAllocatedUdpPort = mConfig.mAllocationPortRangeMin;
-      }
-      return mLastAllocatedUdpPort;
+      mReservations.erase(releasedToken);
    }
 }
 
@@ -2,12 +2,16 @@
 #define TURNMANAGER_HXX
 
 #include <map>
+#include <memory>
+#include <vector>
 #include <asio.hpp>
 #ifdef USE_SSL
 #include <asio/ssl.hpp>
 #endif
 #include "ReTurnConfig.hxx"
 #include "StunTuple.hxx"
+#include <rutil/HashMap.hxx>
+#include <rutil/Mutex.hxx>
 
 namespace reTurn {
 
@@ -19,30 +23,44 @@ public:
 
    asio::io_service& getIOService() { return mIOService; }
 
-   unsigned short allocateAnyPort(StunTuple::TransportType transport);
-   unsigned short allocateEvenPort(StunTuple::TransportType transport);
-   unsigned short allocateOddPort(StunTuple::TransportType transport);
-   unsigned short allocateEvenPortPair(StunTuple::TransportType transport);
-   bool allocatePort(StunTuple::TransportType transport, unsigned short port, bool reserved = false);
-   void deallocatePort(StunTuple::TransportType transport, unsigned short port);
+   /// Port allocation is thread safe, so that allocations made on different
+   /// io_service threads can share one relay port range.  Each relay address
+   /// has a port range of its own, and all of these are O(1).
+   unsigned short allocateAnyPort(StunTuple::TransportType transport, const asio::ip::address& address);
+   unsigned short allocateEvenPort(StunTuple::TransportType transport, const asio::ip::address& address);
+   unsigned short allocateOddPort(StunTuple::TransportType transport, const asio::ip::address& address);
+   /// Allocates an even port and reserves the odd port above it; reservationToken
+   /// is set to the token that allocateReservedPort takes to claim the odd port
+   unsigned short allocateEvenPortPair(StunTuple::TransportType transport, const asio::ip::address& address, UInt64& reservationToken);
+   /// Allocates the port reserved under reservationToken and sets address to the
+   /// relay address it is on; returns 0 if there is no such reservation
+   unsigned short allocateReservedPort(StunTuple::TransportType transport, UInt64 reservationToken, asio::ip::address& address);
+   bool allocatePort(StunTuple::TransportType transport, const asio::ip::address& address, unsigned short port);
+   void deallocatePort(StunTuple::TransportType transport, const asio::ip::address& address, unsigned short port);
 
    const ReTurnConfig& getConfig() { return mConfig; }
 
 private:
-
-   typedef enum
+   class PortPool;
+   // Pools are created on first use of a relay address; TCP and TLS share one per address
+   typedef std::pair<bool /* tcp */, asio::ip::address> PortPoolKey;
+   typedef std::map<PortPoolKey, std::unique_ptr<PortPool> > PortPoolMap;
+   PortPoolMap mPortPools;
+   PortPool& getPortPool(StunTuple::TransportType transport, const asio::ip::address& address);
+
+   class Reservation
    {
-      PortStateUnallocated,
-      PortStateAllocated,
-      PortStateReserved
-   } PortState;
-   typedef std::map<unsigned short, PortState> PortAllocationMap;
-   PortAllocationMap mUdpAllocationPorts;  // .slg. expand to be a map/hash table per ip address/interface
-   PortAllocationMap mTcpAllocationPorts;
-   unsigned short mLastAllocatedUdpPort;
-   unsigned short mLastAllocatedTcpPort;
-   PortAllocationMap& getPortAllocationMap(StunTuple::TransportType transport);
-   unsigned short advanceLastAllocatedPort(StunTuple::TransportType transport, unsigned int numToAdvance = 1);
+   public:
+      Reservation(StunTuple::TransportType transport, const asio::ip::address& address, unsigned short port) :
+         mTransport(transport), mAddress(address), mPort(port) {}
+      StunTuple::TransportType mTransport;
+      asio::ip::address mAddress;
+      unsigned short mPort;
+   };
+   typedef HashMap<UInt64, Reservation> ReservationMap;
+   ReservationMap mReservations;
+
+   resip::Mutex mMutex;  // protects the port pools and reservations
 
    asio::io_service& mIOService;
    const ReTurnConfig& mConfig;
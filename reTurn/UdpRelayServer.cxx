@@ -19,6 +19,7 @@ UdpRelayServer::UdpRelayServer(asio::io_service& ioService, TurnAllocation& turn
   mStopping(false),
   mBindSuccess(false)
 {
+   mSendImmediately = true;  // onSendSuccess/onSendFailure don't send
    asio::error_code ec = bind(turnAllocation.getRequestedTuple().getAddress(), turnAllocation.getRequestedTuple().getPort());
    if(ec)
    {
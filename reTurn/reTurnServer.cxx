@@ -22,7 +22,11 @@
 #include <rutil/Logger.hxx>
 #include "ReTurnSubsystem.hxx"
 
+#include <algorithm>
 #include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #define RESIPROCATE_SUBSYSTEM ReTurnSubsystem::RETURN
 
@@ -46,6 +50,100 @@ BOOL WINAPI console_ctrl_handler(DWORD ctrl_type)
 }
 #endif // defined(_WIN32)
 
+namespace
+{
+
+/// The STUN/TURN servers run by one ioService thread.  With more than one
+/// thread every thread binds its own set with SO_REUSEPORT, and the kernel
+/// hands each client's packets and connections to one of them.
+class TurnServers
+{
+public:
+   TurnServers(asio::io_service& ioService, reTurn::RequestHandler& requestHandler, const reTurn::ReTurnConfig& reTurnConfig, bool reusePort)
+   {
+      mUdpTurnServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort, reusePort);
+      mTcpTurnServer = std::make_shared<reTurn::TcpServer>(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort, reusePort);
+#ifdef USE_SSL
+      if(reTurnConfig.mTlsTurnPort != 0)
+      {
+         mTlsTurnServer = std::make_shared<reTurn::TlsServer>(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTlsTurnPort, reusePort);
+      }
+#endif
+
+#ifdef USE_IPV6
+      mUdpV6TurnServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort, reusePort);
+      mTcpV6TurnServer = std::make_shared<reTurn::TcpServer>(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort, reusePort);
+#ifdef USE_SSL
+      if(reTurnConfig.mTlsTurnPort != 0)
+      {
+         mTlsV6TurnServer = std::make_shared<reTurn::TlsServer>(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTlsTurnPort, reusePort);
+      }
+#endif
+#endif
+
+      if(reTurnConfig.mAltStunPort != 0) // if alt stun port is non-zero, then RFC3489 support is enabled
+      {
+         mA1p2StunUdpServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mAltStunPort, reusePort);
+         mA2p1StunUdpServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mTurnPort, reusePort);
+         mA2p2StunUdpServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mAltStunPort, reusePort);
+         mUdpTurnServer->setAlternateUdpServers(mA1p2StunUdpServer.get(), mA2p1StunUdpServer.get(), mA2p2StunUdpServer.get());
+         mA1p2StunUdpServer->setAlternateUdpServers(mUdpTurnServer.get(), mA2p2StunUdpServer.get(), mA2p1StunUdpServer.get());
+         mA2p1StunUdpServer->setAlternateUdpServers(mA2p2StunUdpServer.get(), mUdpTurnServer.get(), mA1p2StunUdpServer.get());
+         mA2p2StunUdpServer->setAlternateUdpServers(mA2p1StunUdpServer.get(), mA1p2StunUdpServer.get(), mUdpTurnServer.get());
+      }
+   }
+
+   void start()
+   {
+      if(mA1p2StunUdpServer)
+      {
+         mA1p2StunUdpServer->start();
+         mA2p1StunUdpServer->start();
+         mA2p2StunUdpServer->start();
+      }
+
+      mUdpTurnServer->start();
+      mTcpTurnServer->start();
+#ifdef USE_SSL
+      if(mTlsTurnServer)
+      {
+         mTlsTurnServer->start();
+      }
+#endif
+
+#ifdef USE_IPV6
+      mUdpV6TurnServer->start();
+      mTcpV6TurnServer->start();
+#ifdef USE_SSL
+      if(mTlsV6TurnServer)
+      {
+         mTlsV6TurnServer->start();
+      }
+#endif
+#endif
+   }
+
+private:
+   std::shared_ptr<reTurn::UdpServer> mUdpTurnServer;  // also a1p1StunUdpServer
+   std::shared_ptr<reTurn::TcpServer> mTcpTurnServer;
+#ifdef USE_SSL
+   std::shared_ptr<reTurn::TlsServer> mTlsTurnServer;
+#endif
+   std::shared_ptr<reTurn::UdpServer> mA1p2StunUdpServer;
+   std::shared_ptr<reTurn::UdpServer> mA2p1StunUdpServer;
+   std::shared_ptr<reTurn::UdpServer> mA2p2StunUdpServer;
+
+#ifdef USE_IPV6
+   std::shared_ptr<reTurn::UdpServer> mUdpV6TurnServer;
+   std::shared_ptr<reTurn::TcpServer> mTcpV6TurnServer;
+#ifdef USE_SSL
+   std::shared_ptr<reTurn::TlsServer> mTlsV6TurnServer;
+#endif
+#endif
+};
+
+}
+
 int main(int argc, char* argv[])
 {
    reTurn::ReTurnServerProcess proc;
@@ -94,82 +192,50 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
       resip::Log::setMaxLineCount(reTurnConfig.mLoggingFileMaxLineCount);
 
       // Initialize server.
-      asio::io_service ioService;                                // The one and only ioService for the stunServer
-      reTurn::TurnManager turnManager(ioService, reTurnConfig);  // The one and only Turn Manager
-
-      std::shared_ptr<reTurn::UdpServer> udpTurnServer;  // also a1p1StunUdpServer
-      std::shared_ptr<reTurn::TcpServer> tcpTurnServer;
-#ifdef USE_SSL
-      std::shared_ptr<reTurn::TlsServer> tlsTurnServer;
-#endif
-      std::shared_ptr<reTurn::UdpServer> a1p2StunUdpServer;
-      std::shared_ptr<reTurn::UdpServer> a2p1StunUdpServer;
-      std::shared_ptr<reTurn::UdpServer> a2p2StunUdpServer;
-
-#ifdef USE_IPV6
-      std::shared_ptr<reTurn::UdpServer> udpV6TurnServer;
-      std::shared_ptr<reTurn::TcpServer> tcpV6TurnServer;
-      std::shared_ptr<reTurn::TlsServer> tlsV6TurnServer;
-#endif
-
-      // The one and only RequestHandler - if altStunPort is non-zero, then assume RFC3489 support is enabled and pass settings to request handler
-      reTurn::RequestHandler requestHandler(turnManager, 
-         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnAddress : 0, 
-         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnPort : 0, 
-         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunAddress : 0, 
-         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunPort : 0); 
-
-      udpTurnServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort);
-      tcpTurnServer = std::make_shared<reTurn::TcpServer>(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort);
-#ifdef USE_SSL
-      if(reTurnConfig.mTlsTurnPort != 0)
+      unsigned int numThreads = reTurnConfig.mIOThreads;
+      if(numThreads == 0)
       {
-         tlsTurnServer = std::make_shared<reTurn::TlsServer>(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTlsTurnPort);
+         numThreads = std::max(std::thread::hardware_concurrency(), 1u);
       }
-#endif
-
-#ifdef USE_IPV6
-      udpV6TurnServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort);
-      tcpV6TurnServer = std::make_shared<reTurn::TcpServer>(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort);
-      if(reTurnConfig.mTlsTurnPort != 0)
+#ifndef SO_REUSEPORT
+      if(numThreads > 1)
       {
-         tlsV6TurnServer = std::make_shared<reTurn::TlsServer>(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTlsTurnPort);
+         WarningLog(<< "IOThreads=" << numThreads << " requires SO_REUSEPORT, which is not available on this platform - using a single thread");
+         numThreads = 1;
       }
 #endif
+      InfoLog(<< "Starting " << numThreads << " STUN/TURN thread(s)");
 
-      if(reTurnConfig.mAltStunPort != 0) // if alt stun port is non-zero, then RFC3489 support is enabled
+      // The servers, and the allocations they own, live until their ioService drops its
+      // pending handlers, so the TurnManager and RequestHandler must outlive the ioServices
+      std::unique_ptr<reTurn::TurnManager> turnManager;
+      std::unique_ptr<reTurn::RequestHandler> requestHandler;
+
+      // One ioService per thread - each runs its own set of servers, and any allocations
+      // (and relays) created through them
+      std::vector<std::unique_ptr<asio::io_service> > ioServices;
+      for(unsigned int i = 0; i < numThreads; i++)
       {
-         a1p2StunUdpServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mAltStunPort);
-         a2p1StunUdpServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mTurnPort);
-         a2p2StunUdpServer = std::make_shared<reTurn::UdpServer>(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mAltStunPort);
-         udpTurnServer->setAlternateUdpServers(a1p2StunUdpServer.get(), a2p1StunUdpServer.get(), a2p2StunUdpServer.get());
-         a1p2StunUdpServer->setAlternateUdpServers(udpTurnServer.get(), a2p2StunUdpServer.get(), a2p1StunUdpServer.get());
-         a2p1StunUdpServer->setAlternateUdpServers(a2p2StunUdpServer.get(), udpTurnServer.get(), a1p2StunUdpServer.get());
-         a2p2StunUdpServer->setAlternateUdpServers(a2p1StunUdpServer.get(), a1p2StunUdpServer.get(), udpTurnServer.get());
-         a1p2StunUdpServer->start();
-         a2p1StunUdpServer->start();
-         a2p2StunUdpServer->start();
+         ioServices.push_back(std::unique_ptr<asio::io_service>(new asio::io_service));
       }
+      turnManager.reset(new reTurn::TurnManager(*ioServices[0], reTurnConfig));  // The one and only Turn Manager
 
-      udpTurnServer->start();
-      tcpTurnServer->start();
-#ifdef USE_SSL
-      if(tlsTurnServer)
+      // The one and only RequestHandler - if altStunPort is non-zero, then assume RFC3489 support is enabled and pass settings to request handler
+      requestHandler.reset(new reTurn::RequestHandler(*turnManager, 
+         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnAddress : 0, 
+         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnPort : 0, 
+         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunAddress : 0, 
+         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunPort : 0)); 
+
+      std::vector<std::unique_ptr<TurnServers> > servers;
+      for(unsigned int i = 0; i < numThreads; i++)
       {
-         tlsTurnServer->start();
+         servers.push_back(std::unique_ptr<TurnServers>(new TurnServers(*ioServices[i], *requestHandler, reTurnConfig, numThreads > 1)));
       }
-#endif
-
-#ifdef USE_IPV6
-      udpV6TurnServer->start();
-      tcpV6TurnServer->start();
-#ifdef USE_SSL
-      if(tlsV6TurnServer)
+      for(unsigned int i = 0; i < numThreads; i++)
       {
-         tlsV6TurnServer->start();
+         servers[i]->start();
       }
-#endif
-#endif
 
       // Drop privileges (can do this now that sockets are bound)
       if(!reTurnConfig.mRunAsUser.empty())
@@ -178,12 +244,12 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
          dropPrivileges(reTurnConfig.mRunAsUser, reTurnConfig.mRunAsGroup);
       }
 
-      ReTurnUserFileScanner userFileScanner(ioService, reTurnConfig);
+      ReTurnUserFileScanner userFileScanner(*ioServices[0], reTurnConfig);
       userFileScanner.start();
 
 #ifdef _WIN32
       // Set console control handler to allow server to be stopped.
-      console_ctrl_function = [&ioService] { ioService.stop(); };
+      console_ctrl_function = [&ioServices] { for(auto& ioService : ioServices) ioService->stop(); };
       SetConsoleCtrlHandler(console_ctrl_handler, TRUE);
 #else
       // Block all signals for background thread.
@@ -193,9 +259,14 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
       pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
 #endif
 
-      // Run the ioService until stopped.
+      // Run the ioServices until stopped.
       // Create a pool of threads to run all of the io_services.
-      asio::thread thread([&ioService] { ioService.run(); });
+      std::vector<std::unique_ptr<asio::thread> > threads;
+      for(auto& ioService : ioServices)
+      {
+         asio::io_service* service = ioService.get();
+         threads.push_back(std::unique_ptr<asio::thread>(new asio::thread([service] { service->run(); })));
+      }
 
 #ifndef _WIN32
       // Restore previous signals.
@@ -210,11 +281,17 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
       pthread_sigmask(SIG_BLOCK, &wait_mask, 0);
       int sig = 0;
       sigwait(&wait_mask, &sig);
-      ioService.stop();
+      for(auto& ioService : ioServices)
+      {
+         ioService->stop();
+      }
 #endif
 
-      // Wait for thread to exit
-      thread.join();
+      // Wait for threads to exit
+      for(auto& thread : threads)
+      {
+         thread->join();
+      }
    }
    catch (const std::exception& e)
    {
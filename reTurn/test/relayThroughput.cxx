@@ -0,0 +1,361 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+// Relay throughput benchmark for a running reTurnServer: creates a number of
+// UDP allocations, binds a channel on each to a local peer socket, then has
+// sender threads push ChannelData through the allocations, either paced at
+// -r packets per second per allocation or, with -r 0, as fast as they can.
+// Reports the allocation rate and the rate at which relayed packets arrive
+// at the peer.
+//
+// usage: relayThroughput [-a turnAddress] [-p turnPort] [-l localAddress]
+//                        [-u username] [-w password] [-n allocations]
+//                        [-t senderThreads] [-r rate] [-s seconds]
+//
+// The defaults match the sample reTurnServer.config and users.txt.  When
+// the server runs on the same host, give it an AllocationPortRange outside
+// the local ephemeral port range, or client and relay ports can collide.
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <vector>
+#include <asio.hpp>
+
+#include <rutil/Data.hxx>
+#include <rutil/Logger.hxx>
+#include <rutil/ThreadIf.hxx>
+#include <rutil/Time.hxx>
+#include <rutil/Timer.hxx>
+
+#include "../StunTuple.hxx"
+#include "../client/TurnUdpSocket.hxx"
+
+using namespace reTurn;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM resip::Subsystem::TEST
+
+namespace
+{
+
+char payload[172];  // size of a G.711 20ms RTP packet
+
+unsigned short
+localPort(TurnSocket& socket)
+{
+   sockaddr_storage addr;
+   socklen_t len = sizeof(addr);
+   if(::getsockname(socket.getSocketDescriptor(), (sockaddr*)&addr, &len) != 0)
+   {
+      return 0;
+   }
+   if(addr.ss_family == AF_INET)
+   {
+      return ntohs(((sockaddr_in*)&addr)->sin_port);
+   }
+#ifdef USE_IPV6
+   return ntohs(((sockaddr_in6*)&addr)->sin6_port);
+#else
+   return 0;
+#endif
+}
+
+// Counts the packets relayed to it
+class Peer : public resip::ThreadIf
+{
+public:
+   Peer(const asio::ip::address& address) : mSocket(address, 0), mReceived(0) {}
+
+   unsigned short getPort() { return localPort(mSocket); }
+   UInt64 getReceived() const { return mReceived; }
+
+   virtual void thread()
+   {
+      char buffer[1024];
+      while(!isShutdown())
+      {
+         unsigned int size = sizeof(buffer);
+         asio::error_code rc = mSocket.receive(buffer, size, 100);
+         if(!rc)
+         {
+            ++mReceived;
+         }
+         else if(rc != asio::error::operation_aborted)
+         {
+            ErrLog(<< "Peer receive error: " << rc.message());
+            break;
+         }
+      }
+   }
+
+private:
+   TurnUdpSocket mSocket;
+   std::atomic<UInt64> mReceived;
+};
+
+// Sends over its share of the allocations, round robin
+class Sender : public resip::ThreadIf
+{
+public:
+   Sender(std::vector<TurnUdpSocket*> sockets, unsigned int rate) : mSockets(sockets), mRate(rate), mSent(0), mErrors(0) {}
+
+   UInt64 getSent() const { return mSent; }
+   UInt64 getErrors() const { return mErrors; }
+
+   virtual void thread()
+   {
+      UInt64 next = resip::Timer::getTimeMs();
+      while(!isShutdown())
+      {
+         for(size_t i = 0; i < mSockets.size(); i++)
+         {
+            if(mRate)
+            {
+               // Spread the round over the interval, as independent streams would be, rather
+               // than bursting every allocation's packet into the server's socket buffer at once
+               UInt64 due = next + i * (1000 / mRate) / mSockets.size();
+               UInt64 now = resip::Timer::getTimeMs();
+               if(due > now)
+               {
+                  resip::sleepMs((unsigned int)(due - now));
+               }
+            }
+            if(mSockets[i]->send(payload, sizeof(payload)))
+            {
+               ++mErrors;
+            }
+            else
+            {
+               ++mSent;
+            }
+         }
+         if(mRate)
+         {
+            next += 1000 / mRate;
+            UInt64 now = resip::Timer::getTimeMs();
+            if(next > now)
+            {
+               resip::sleepMs((unsigned int)(next - now));
+            }
+         }
+      }
+   }
+
+private:
+   std::vector<TurnUdpSocket*> mSockets;
+   unsigned int mRate;
+   std::atomic<UInt64> mSent;
+   std::atomic<UInt64> mErrors;
+};
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   resip::Data turnAddress("127.0.0.1");
+   unsigned short turnPort = 3478;
+   resip::Data localAddress("127.0.0.1");
+   resip::Data username("test");
+   resip::Data password("1234");
+   unsigned int allocations = 100;
+   unsigned int senders = 2;
+   unsigned int rate = 50;  // one packet every 20ms, as for RTP
+   unsigned int seconds = 10;
+
+   for(int i = 1; i + 1 < argc; i += 2)
+   {
+      resip::Data opt(argv[i]);
+      resip::Data val(argv[i + 1]);
+      if(opt == "-a") turnAddress = val;
+      else if(opt == "-p") turnPort = (unsigned short)val.convertUnsignedLong();
+      else if(opt == "-l") localAddress = val;
+      else if(opt == "-u") username = val;
+      else if(opt == "-w") password = val;
+      else if(opt == "-n") allocations = val.convertUnsignedLong();
+      else if(opt == "-t") senders = val.convertUnsignedLong();
+      else if(opt == "-r") rate = val.convertUnsignedLong();
+      else if(opt == "-s") seconds = val.convertUnsignedLong();
+      else
+      {
+         cerr << "usage: " << argv[0] << " [-a turnAddress] [-p turnPort] [-l localAddress] [-u username] [-w password]"
+              << " [-n allocations] [-t senderThreads] [-r rate] [-s seconds]" << endl;
+         return 1;
+      }
+   }
+   if(allocations == 0 || senders == 0)
+   {
+      cerr << "need at least one allocation and one sender" << endl;
+      return 1;
+   }
+   if(rate > 1000)
+   {
+      rate = 1000;
+   }
+   if(senders > allocations)
+   {
+      senders = allocations;
+   }
+
+   resip::Log::initialize(resip::Log::Cout, resip::Log::Warning, argv[0]);
+   asio::ip::address local = asio::ip::address::from_string(localAddress.c_str());
+
+   try
+   {
+      Peer peer(local);
+      unsigned short peerPort = peer.getPort();
+      peer.run();
+
+      // Allocate, and bind a channel to the peer on each allocation
+      std::vector<std::unique_ptr<TurnUdpSocket> > sockets;
+      // TurnUdpSocket binds with SO_REUSEADDR, so the kernel may hand out an
+      // ephemeral port twice; keep the duplicates open (so the port is not
+      // offered again) but unused until all allocations are made
+      std::set<unsigned short> ports;
+      ports.insert(peerPort);
+      std::vector<std::unique_ptr<TurnUdpSocket> > duplicates;
+      UInt64 start = resip::Timer::getTimeMs();
+      for(unsigned int i = 0; i < allocations; i++)
+      {
+         std::unique_ptr<TurnUdpSocket> socket(new TurnUdpSocket(local, 0));
+         if(!ports.insert(localPort(*socket)).second)
+         {
+            duplicates.push_back(std::move(socket));
+            i--;
+            continue;
+         }
+         asio::error_code rc = socket->connect(turnAddress.c_str(), turnPort);
+         if(!rc)
+         {
+            socket->setUsernameAndPassword(username.c_str(), password.c_str());
+            rc = socket->createAllocation(TurnSocket::UnspecifiedLifetime,
+                                          TurnSocket::UnspecifiedBandwidth,
+                                          StunMessage::PropsNone,
+                                          TurnSocket::UnspecifiedToken,
+                                          StunTuple::UDP);
+         }
+         if(!rc)
+         {
+            rc = socket->setActiveDestination(local, peerPort);
+         }
+         if(rc)
+         {
+            cerr << "allocation " << i << " failed: " << rc.message() << endl;
+            break;
+         }
+         sockets.push_back(std::move(socket));
+      }
+      UInt64 allocateMs = resip::Timer::getTimeMs() - start;
+      // Unicast to a shared port goes to the socket bound last, so the
+      // duplicates would swallow the responses to the destroys below
+      duplicates.clear();
+      cout << sockets.size() << " allocations in " << allocateMs << "ms ("
+           << (allocateMs ? sockets.size() * 1000 / allocateMs : 0) << "/s)" << endl;
+
+      if(!sockets.empty())
+      {
+         if(senders > sockets.size())
+         {
+            senders = (unsigned int)sockets.size();
+         }
+         std::vector<std::unique_ptr<Sender> > senderThreads;
+         for(unsigned int i = 0; i < senders; i++)
+         {
+            std::vector<TurnUdpSocket*> share;
+            for(size_t j = i; j < sockets.size(); j += senders)
+            {
+               share.push_back(sockets[j].get());
+            }
+            senderThreads.push_back(std::unique_ptr<Sender>(new Sender(share, rate)));
+         }
+
+         UInt64 receivedBefore = peer.getReceived();
+         start = resip::Timer::getTimeMs();
+         for(size_t i = 0; i < senderThreads.size(); i++)
+         {
+            senderThreads[i]->run();
+         }
+         resip::sleepMs(seconds * 1000);
+         for(size_t i = 0; i < senderThreads.size(); i++)
+         {
+            senderThreads[i]->shutdown();
+            senderThreads[i]->join();
+         }
+         UInt64 sendMs = resip::Timer::getTimeMs() - start;
+         resip::sleepMs(500);  // let the relay drain
+         UInt64 received = peer.getReceived() - receivedBefore;
+
+         UInt64 sent = 0;
+         UInt64 errors = 0;
+         for(size_t i = 0; i < senderThreads.size(); i++)
+         {
+            sent += senderThreads[i]->getSent();
+            errors += senderThreads[i]->getErrors();
+         }
+         cout << senders << " senders, " << sendMs << "ms: sent " << sent << " (" << sent * 1000 / sendMs << "/s, "
+              << errors << " errors), relayed " << received << " (" << received * 1000 / sendMs << "/s, "
+              << (sent ? (double)(sent - std::min(sent, received)) * 100 / sent : 0) << "% lost)" << endl;
+      }
+
+      unsigned int destroyFailures = 0;
+      for(size_t i = 0; i < sockets.size(); i++)
+      {
+         if(sockets[i]->destroyAllocation())
+         {
+            destroyFailures++;
+         }
+      }
+      if(destroyFailures)
+      {
+         cerr << destroyFailures << " allocations could not be destroyed" << endl;
+      }
+      peer.shutdown();
+      peer.join();
+   }
+   catch(const std::exception& e)
+   {
+      cerr << "exception: " << e.what() << endl;
+      return 1;
+   }
+
+   return 0;
+}
+
+
+/* ====================================================================
+
+ Copyright (c) 2007-2008, Plantronics, Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are
+ met:
+
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ 3. Neither the name of Plantronics nor the names of its contributors
+    may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==================================================================== */
@@ -0,0 +1,240 @@
+// Checks the relay port allocation in TurnManager: any, even and odd ports,
+// even/odd pairs with reservation tokens, a pool per relay address and
+// transport, and running out of ports.
+
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <vector>
+#include <asio.hpp>
+
+#include "../ReTurnConfig.hxx"
+#include "../TurnManager.hxx"
+#include <rutil/Logger.hxx>
+
+using namespace reTurn;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM resip::Subsystem::TEST
+
+static const unsigned short RangeMin = 50000;
+static const unsigned short RangeMax = 50009;  // 5 even/odd pairs
+static const unsigned int RangeSize = RangeMax - RangeMin + 1;
+
+// Takes every free port and gives them all back; a port that was freed twice
+// would show up twice here
+static set<unsigned short>
+freePorts(TurnManager& manager, StunTuple::TransportType transport, const asio::ip::address& address)
+{
+   set<unsigned short> ports;
+   vector<unsigned short> taken;
+   unsigned short port;
+   while((port = manager.allocateAnyPort(transport, address)) != 0)
+   {
+      assert(port >= RangeMin && port <= RangeMax);
+      assert(ports.insert(port).second);
+      taken.push_back(port);
+      assert(taken.size() <= RangeSize);
+   }
+   for(vector<unsigned short>::iterator it = taken.begin(); it != taken.end(); ++it)
+   {
+      manager.deallocatePort(transport, address, *it);
+   }
+   return ports;
+}
+
+int main(int argc, char* argv[])
+{
+   resip::Log::initialize(resip::Log::Cout, resip::Log::Info, "");
+
+   asio::io_service ioService;
+   ReTurnConfig config;
+   config.mAllocationPortRangeMin = RangeMin;
+   config.mAllocationPortRangeMax = RangeMax;
+   TurnManager manager(ioService, config);
+
+   const asio::ip::address addressA = asio::ip::address::from_string("192.0.2.1");
+   const asio::ip::address addressB = asio::ip::address::from_string("192.0.2.2");
+   const asio::ip::address addressC = asio::ip::address::from_string("2001:db8::1");
+
+   // any port, until the range runs out
+   {
+      set<unsigned short> ports = freePorts(manager, StunTuple::UDP, addressA);
+      assert(ports.size() == RangeSize);
+      vector<unsigned short> taken;
+      for(unsigned int i = 0; i < RangeSize; i++)
+      {
+         taken.push_back(manager.allocateAnyPort(StunTuple::UDP, addressA));
+         assert(taken.back() != 0);
+      }
+      assert(manager.allocateAnyPort(StunTuple::UDP, addressA) == 0);
+      assert(manager.allocateEvenPort(StunTuple::UDP, addressA) == 0);
+      assert(manager.allocateOddPort(StunTuple::UDP, addressA) == 0);
+      UInt64 token = 0;
+      assert(manager.allocateEvenPortPair(StunTuple::UDP, addressA, token) == 0);
+      assert(token == 0);
+
+      // other addresses and transports have pools of their own; TCP and TLS share one
+      assert(manager.allocateAnyPort(StunTuple::UDP, addressB) != 0);
+      assert(manager.allocateAnyPort(StunTuple::UDP, addressC) != 0);
+      unsigned short tcpPort = manager.allocateAnyPort(StunTuple::TCP, addressA);
+      assert(tcpPort != 0);
+      assert(!manager.allocatePort(StunTuple::TLS, addressA, tcpPort));
+      manager.deallocatePort(StunTuple::TLS, addressA, tcpPort);
+      assert(freePorts(manager, StunTuple::TCP, addressA).size() == RangeSize);
+      assert(freePorts(manager, StunTuple::UDP, addressB).size() == RangeSize - 1);
+
+      // a released port can be had again, once
+      manager.deallocatePort(StunTuple::UDP, addressA, taken[3]);
+      assert(manager.allocateAnyPort(StunTuple::UDP, addressA) == taken[3]);
+      assert(manager.allocateAnyPort(StunTuple::UDP, addressA) == 0);
+      for(vector<unsigned short>::iterator it = taken.begin(); it != taken.end(); ++it)
+      {
+         manager.deallocatePort(StunTuple::UDP, addressA, *it);
+      }
+      assert(freePorts(manager, StunTuple::UDP, addressA).size() == RangeSize);
+   }
+
+   // even and odd ports; any port prefers the odd half of a split pair, so
+   // that whole pairs stay free for even port requests
+   {
+      const asio::ip::address address = asio::ip::address::from_string("192.0.2.3");
+      set<unsigned short> evens;
+      set<unsigned short> odds;
+      unsigned short port;
+      while((port = manager.allocateEvenPort(StunTuple::UDP, address)) != 0)
+      {
+         assert(port % 2 == 0 && port >= RangeMin && port <= RangeMax);
+         assert(evens.insert(port).second);
+      }
+      assert(evens.size() == RangeSize / 2);
+      while((port = manager.allocateOddPort(StunTuple::UDP, address)) != 0)
+      {
+         assert(port % 2 == 1 && port >= RangeMin && port <= RangeMax);
+         assert(odds.insert(port).second);
+      }
+      assert(odds.size() == RangeSize / 2);
+      assert(manager.allocateAnyPort(StunTuple::UDP, address) == 0);
+
+      manager.deallocatePort(StunTuple::UDP, address, *evens.begin());
+      assert(manager.allocateOddPort(StunTuple::UDP, address) == 0);
+      assert(manager.allocateEvenPort(StunTuple::UDP, address) == *evens.begin());
+      manager.deallocatePort(StunTuple::UDP, address, *odds.begin());
+      manager.deallocatePort(StunTuple::UDP, address, *evens.begin());
+      assert(manager.allocateAnyPort(StunTuple::UDP, address) == *odds.begin());
+      assert(manager.allocateEvenPort(StunTuple::UDP, address) == *evens.begin());
+
+      assert(manager.allocatePort(StunTuple::UDP, address, RangeMax) == false);
+      manager.deallocatePort(StunTuple::UDP, address, RangeMax);
+      assert(manager.allocatePort(StunTuple::UDP, address, RangeMax));
+      assert(!manager.allocatePort(StunTuple::UDP, address, RangeMin - 1));
+      assert(!manager.allocatePort(StunTuple::UDP, address, RangeMax + 1));
+   }
+
+   // a pair whose odd port is claimed with its token
+   {
+      UInt64 token = 0;
+      unsigned short port = manager.allocateEvenPortPair(StunTuple::UDP, addressB, token);
+      assert(port != 0 && port % 2 == 0 && token != 0);
+      assert(!manager.allocatePort(StunTuple::UDP, addressB, port + 1));
+      assert(freePorts(manager, StunTuple::UDP, addressB).count(port + 1) == 0);
+
+      asio::ip::address address;
+      assert(manager.allocateReservedPort(StunTuple::TCP, token, address) == 0);  // wrong transport
+      assert(manager.allocateReservedPort(StunTuple::UDP, token + 1, address) == 0);
+      assert(manager.allocateReservedPort(StunTuple::UDP, token, address) == port + 1);
+      assert(address == addressB);
+      assert(manager.allocateReservedPort(StunTuple::UDP, token, address) == 0);
+
+      // the claimed port stays with whoever claimed it when the even port goes
+      manager.deallocatePort(StunTuple::UDP, addressB, port);
+      assert(!manager.allocatePort(StunTuple::UDP, addressB, port + 1));
+      manager.deallocatePort(StunTuple::UDP, addressB, port + 1);
+      assert(freePorts(manager, StunTuple::UDP, addressB).size() == RangeSize - 1);
+      manager.deallocatePort(StunTuple::UDP, addressB, port + 1);
+      assert(freePorts(manager, StunTuple::UDP, addressB).size() == RangeSize - 1);
+   }
+
+   // a pair whose even port allocation expires before the token is used
+   {
+      UInt64 token = 0;
+      unsigned short port = manager.allocateEvenPortPair(StunTuple::TCP, addressB, token);
+      assert(port != 0 && token != 0);
+      manager.deallocatePort(StunTuple::TCP, addressB, port);
+      asio::ip::address address;
+      assert(manager.allocateReservedPort(StunTuple::TCP, token, address) == 0);
+      assert(freePorts(manager, StunTuple::TCP, addressB).size() == RangeSize);
+      manager.deallocatePort(StunTuple::TCP, addressB, port);
+      assert(freePorts(manager, StunTuple::TCP, addressB).size() == RangeSize);
+   }
+
+   // pairs run out before single ports do
+   {
+      const asio::ip::address address = asio::ip::address::from_string("192.0.2.4");
+      vector<unsigned short> pairs;
+      vector<UInt64> tokens;
+      UInt64 token;
+      unsigned short port;
+      while((port = manager.allocateEvenPortPair(StunTuple::UDP, address, token)) != 0)
+      {
+         for(vector<UInt64>::iterator it = tokens.begin(); it != tokens.end(); ++it)
+         {
+            assert(*it != token);
+         }
+         pairs.push_back(port);
+         tokens.push_back(token);
+      }
+      assert(pairs.size() == RangeSize / 2);
+      assert(manager.allocateAnyPort(StunTuple::UDP, address) == 0);
+
+      manager.deallocatePort(StunTuple::UDP, address, pairs[0]);
+      assert(manager.allocateEvenPortPair(StunTuple::UDP, address, token) == pairs[0]);
+      asio::ip::address reservedAddress;
+      assert(manager.allocateReservedPort(StunTuple::UDP, tokens[0], reservedAddress) == 0);
+      assert(manager.allocateReservedPort(StunTuple::UDP, token, reservedAddress) == pairs[0] + 1);
+      for(size_t i = 1; i < tokens.size(); i++)
+      {
+         assert(manager.allocateReservedPort(StunTuple::UDP, tokens[i], reservedAddress) == pairs[i] + 1);
+         assert(reservedAddress == address);
+      }
+      assert(manager.allocateAnyPort(StunTuple::UDP, address) == 0);
+   }
+
+   InfoLog(<< "All tests passed!");
+   return 0;
+}
+
+
+/* ====================================================================
+
+ Copyright (c) 2007-2008, Plantronics, Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are
+ met:
+
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ 3. Neither the name of Plantronics nor the names of its contributors
+    may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==================================================================== */
@@ -696,6 +696,14 @@ AbstractDb::getStaticReg( const AbstractDb::Key& key) const
       return rec;
    }
 
+   decodeStaticRegRecord(data, rec);
+   return rec;
+}
+
+
+void
+AbstractDb::decodeStaticRegRecord(Data& data, StaticRegRecord& rec) const
+{
    iDataStream s(data);
 
    short version;
@@ -714,8 +722,6 @@ AbstractDb::getStaticReg( const AbstractDb::Key& key) const
       ErrLog( <<"Data in StaticReg database with unknown version " << version );
       ErrLog( <<"record size is " << data.size() );
    }
-      
-   return rec;
 }
 
 
@@ -880,24 +886,28 @@ AbstractDb::addToSilo(const Key& key, const SiloRecord& rec)
    resip_assert( !key.empty() );
    
    Data data;
-   {
-      oDataStream s(data);
+   encodeSiloRecord(rec, data);
+   return dbWriteRecord(SiloTable, key, data);
+}
 
-      short version=1;
-      resip_assert(sizeof( version) == 2);
-      s.write((char*)(&version) , sizeof(version));
+void
+AbstractDb::encodeSiloRecord(const SiloRecord& rec, Data& data)
+{
+   oDataStream s(data);
 
-      encodeString(s, rec.mDestUri);
-      encodeString(s, rec.mSourceUri);
-      s.write((char*)(&rec.mOriginalSentTime), sizeof (rec.mOriginalSentTime));
-      resip_assert(sizeof(rec.mOriginalSentTime) == 8);
-      encodeString(s, rec.mTid);
-      encodeString(s, rec.mMimeType);
-      encodeString(s, rec.mMessageBody);
+   short version=1;
+   resip_assert(sizeof( version) == 2);
+   s.write((char*)(&version) , sizeof(version));
 
-      s.flush();
-   }
-   return dbWriteRecord(SiloTable, key, data);
+   encodeString(s, rec.mDestUri);
+   encodeString(s, rec.mSourceUri);
+   s.write((char*)(&rec.mOriginalSentTime), sizeof (rec.mOriginalSentTime));
+   resip_assert(sizeof(rec.mOriginalSentTime) == 8);
+   encodeString(s, rec.mTid);
+   encodeString(s, rec.mMimeType);
+   encodeString(s, rec.mMessageBody);
+
+   s.flush();
 }
 
 void
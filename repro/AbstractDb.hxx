@@ -227,7 +227,9 @@ class AbstractDb
       virtual void encodeUser(const UserRecord& rec, resip::Data& buffer);
       virtual void encodeRoute(const RouteRecord& rec, resip::Data& buffer);
       virtual void encodeFilter(const FilterRecord& rec, resip::Data& buffer);
+      virtual void encodeSiloRecord(const SiloRecord& rec, resip::Data& buffer);
       virtual void decodeSiloRecord(resip::Data& data, SiloRecord& rec);
+      virtual void decodeStaticRegRecord(resip::Data& data, StaticRegRecord& rec) const;
 };
 
 }
@@ -13,6 +13,7 @@
 #include "repro/RequestContext.hxx"
 #include "repro/ProxyConfig.hxx"
 #include "repro/PersistentMessageQueue.hxx"
+#include "repro/MessageJournal.hxx"
 #include "resip/stack/Tuple.hxx"
 #include "resip/stack/Helper.hxx"
 #include "resip/stack/SipMessage.hxx"
@@ -32,6 +33,10 @@ const static Data registrationEventQueueName = "regeventqueue";
 
 AccountingCollector::AccountingCollector(ProxyConfig& config) :
    mDbBaseDir(config.getConfigData("DatabasePath", "./", true)),
+   mUseJournal(isEqualNoCase(config.getConfigData("AccountingQueueType", "berkeleydb"), "journal")),
+   mJournalSegmentSize(config.getConfigUnsignedLong("AccountingJournalSegmentSize", MessageJournal::DefaultSegmentSize)),
+   mJournalSyncIntervalMs(config.getConfigUnsignedLong("AccountingJournalSyncIntervalMs", MessageJournal::DefaultSyncIntervalMs)),
+   mJournalSyncRecords(config.getConfigUnsignedLong("AccountingJournalSyncRecords", MessageJournal::DefaultSyncRecords)),
    mSessionEventQueue(0),
    mRegistrationEventQueue(0),
    mSessionAccountingAddRoutingHeaders(config.getConfigBool("SessionAccountingAddRoutingHeaders", false)),
@@ -590,7 +595,17 @@ AccountingCollector::doSessionAccounting(const resip::SipMessage& msg, bool rece
    }
 }
 
-PersistentMessageEnqueue* 
+MessageEnqueue*
+AccountingCollector::createEventQueue()
+{
+   if(mUseJournal)
+   {
+      return new MessageJournalEnqueue(mDbBaseDir, mJournalSegmentSize, mJournalSyncIntervalMs, mJournalSyncRecords);
+   }
+   return new PersistentMessageEnqueue(mDbBaseDir);
+}
+
+MessageEnqueue* 
 AccountingCollector::initializeEventQueue(FifoEventType type, bool destroyFirst)
 {
    switch(type)
@@ -603,7 +618,7 @@ AccountingCollector::initializeEventQueue(FifoEventType type, bool destroyFirst)
       }
       if(!mSessionEventQueue)
       {
-         mSessionEventQueue = new PersistentMessageEnqueue(mDbBaseDir);
+         mSessionEventQueue = createEventQueue();
          if(!mSessionEventQueue->init(true, sessionEventQueueName))
          {
             delete mSessionEventQueue;
@@ -619,7 +634,7 @@ AccountingCollector::initializeEventQueue(FifoEventType type, bool destroyFirst)
       }
       if(!mRegistrationEventQueue)
       {
-         mRegistrationEventQueue = new PersistentMessageEnqueue(mDbBaseDir);
+         mRegistrationEventQueue = createEventQueue();
          if(!mRegistrationEventQueue->init(true, registrationEventQueueName))
          {
             delete mRegistrationEventQueue;
@@ -654,7 +669,7 @@ AccountingCollector::internalProcess(std::unique_ptr<FifoEvent> eventData)
 {
    InfoLog(<< "AccountingCollector::internalProcess: JSON=" << endl << eventData->mData);
 
-   PersistentMessageEnqueue* queue = initializeEventQueue(eventData->mType);
+   MessageEnqueue* queue = initializeEventQueue(eventData->mType);
 
    if(!queue)
    {
@@ -690,15 +705,29 @@ AccountingCollector::internalProcess(std::unique_ptr<FifoEvent> eventData)
 void 
 AccountingCollector::thread()
 {
+   // The journal only syncs to disk as records are pushed, so when it goes
+   // quiet we wake up in time to sync the last of them
+   int waitMs = mUseJournal ? (int)resipMax(mJournalSyncIntervalMs, 1U) : 1000;
    while (!isShutdown() || !mFifo.empty())  // Ensure we drain the queue before shutting down
    {
       try
       {
-         std::unique_ptr<FifoEvent> eventData(mFifo.getNext(1000));  // Only need to wake up to see if we are shutdown
+         std::unique_ptr<FifoEvent> eventData(mFifo.getNext(waitMs));  // Only need to wake up to see if we are shutdown
          if (eventData)
          {
             internalProcess(std::move(eventData));
          }
+         else
+         {
+            if(mSessionEventQueue)
+            {
+               mSessionEventQueue->flush();
+            }
+            if(mRegistrationEventQueue)
+            {
+               mRegistrationEventQueue->flush();
+            }
+         }
       }
       catch (BaseException& e)
       {
@@ -14,7 +14,7 @@ namespace json
 namespace repro
 {
 class RequestContext;
-class PersistentMessageEnqueue;
+class MessageEnqueue;
 class ProxyConfig;
 
 class AccountingCollector : public resip::ThreadIf
@@ -47,8 +47,12 @@ public:
 
 private:
    resip::Data mDbBaseDir;
-   PersistentMessageEnqueue* mSessionEventQueue;
-   PersistentMessageEnqueue* mRegistrationEventQueue;
+   bool mUseJournal;
+   unsigned int mJournalSegmentSize;
+   unsigned int mJournalSyncIntervalMs;
+   unsigned int mJournalSyncRecords;
+   MessageEnqueue* mSessionEventQueue;
+   MessageEnqueue* mRegistrationEventQueue;
    bool mSessionAccountingAddRoutingHeaders;
    bool mSessionAccountingAddViaHeaders;
    bool mRegistrationAccountingAddRoutingHeaders;
@@ -69,7 +73,8 @@ private:
       resip::Data mData;
    };
    resip::TimeLimitFifo<FifoEvent> mFifo;
-   PersistentMessageEnqueue* initializeEventQueue(FifoEventType type, bool destroyFirst=false);
+   MessageEnqueue* createEventQueue();
+   MessageEnqueue* initializeEventQueue(FifoEventType type, bool destroyFirst=false);
    void pushEventObjectToQueue(json::Object& object, FifoEventType type);
    void internalProcess(std::unique_ptr<FifoEvent> eventData);
 };
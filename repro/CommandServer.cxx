@@ -125,6 +125,14 @@ CommandServer::handleRequest(unsigned int connectionId, unsigned int requestId,
       {
          handleRemoveTransportRequest(connectionId, requestId, xml);
       }
+      else if(isEqualNoCase(xml.getTag(), "GetUserAuthCacheStats"))
+      {
+         handleGetUserAuthCacheStatsRequest(connectionId, requestId, xml);
+      }
+      else if(isEqualNoCase(xml.getTag(), "ClearUserAuthCache"))
+      {
+         handleClearUserAuthCacheRequest(connectionId, requestId, xml);
+      }
       else 
       {
          WarningLog(<< "CommandServer::handleRequest: Received XML message with unknown method: " << xml.getTag());
@@ -351,6 +359,28 @@ CommandServer::handleSetCongestionToleranceRequest(unsigned int connectionId, un
    }
 }
 
+void 
+CommandServer::handleGetUserAuthCacheStatsRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
+{
+   InfoLog(<< "CommandServer::handleGetUserAuthCacheStatsRequest");
+
+   Data buffer;
+   {
+      DataStream strm(buffer);
+      mReproRunner.getProxy()->getUserStore().encodeAuthCacheStats(strm);
+   }
+   sendResponse(connectionId, requestId, buffer, 200, "User auth cache stats retrieved.");
+}
+
+void 
+CommandServer::handleClearUserAuthCacheRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
+{
+   InfoLog(<< "CommandServer::handleClearUserAuthCacheRequest");
+
+   mReproRunner.getProxy()->getUserStore().clearAuthCache();
+   sendResponse(connectionId, requestId, Data::Empty, 200, "User auth cache cleared.");
+}
+
 void 
 CommandServer::handleShutdownRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
 {
@@ -60,6 +60,8 @@ private:
    void handleRestartRequest(unsigned int connectionId, unsigned int requestId, resip::XMLCursor& xml);
    void handleAddTransportRequest(unsigned int connectionId, unsigned int requestId, resip::XMLCursor& xml);
    void handleRemoveTransportRequest(unsigned int connectionId, unsigned int requestId, resip::XMLCursor& xml);
+   void handleGetUserAuthCacheStatsRequest(unsigned int connectionId, unsigned int requestId, resip::XMLCursor& xml);
+   void handleClearUserAuthCacheRequest(unsigned int connectionId, unsigned int requestId, resip::XMLCursor& xml);
 
    ReproRunner& mReproRunner;
    resip::Mutex mStatisticsWaitersMutex;
@@ -1,4 +1,6 @@
 
+#include <algorithm>
+
 #include "rutil/Logger.hxx"
 #include "rutil/ParseBuffer.hxx"
 #include "rutil/Lock.hxx"
@@ -71,6 +73,7 @@ FilterStore::FilterStore(AbstractDb& db):
 
       key = mDb.nextFilterKey();
    } 
+   rebuildIndex();
    mCursor = mFilterOperators.begin();
 }
 
@@ -160,6 +163,7 @@ FilterStore::addFilter(const resip::Data& cond1Header,
    {
       WriteLock lock(mMutex);
       mFilterOperators.insert( filter );
+      rebuildIndex();
    }
    mCursor = mFilterOperators.begin(); 
 
@@ -229,6 +233,7 @@ FilterStore::eraseFilter(const resip::Data& key)
             it++;
          }
       }
+      rebuildIndex();
    }
    mCursor = mFilterOperators.begin();  // reset the cursor since it may have been on deleted filter
 }
@@ -340,10 +345,13 @@ FilterStore::getHeaderFromSipMessage(const SipMessage& msg, const Data& headerNa
    {
       Data headerData;
       const HeaderFieldValueList* hfv = msg.getRawHeader(headerType);
-      for(HeaderFieldValueList::const_iterator it = hfv->begin(); it != hfv->end(); it++)
+      if(hfv)
       {
-         it->toShareData(headerData);
-         headerList.push_back(headerData);
+         for(HeaderFieldValueList::const_iterator it = hfv->begin(); it != hfv->end(); it++)
+         {
+            it->toShareData(headerData);
+            headerList.push_back(headerData);
+         }
       }
    }
    else // Check if custom header
@@ -433,9 +441,31 @@ FilterStore::process(const SipMessage& request,
    Data method(request.methodStr());
    Data event(request.exists(h_Event) ? request.header(h_Event).value() : Data::Empty);
 
-   for (FilterOpList::iterator it = mFilterOperators.begin();
-        it != mFilterOperators.end(); it++)
+   // Only the filters whose method, event and first condition's anchored
+   // literals fit the request are checked in full
+   RegexRuleIndex::PositionList candidates;
+   for (ConditionIndexMap::const_iterator cit = mCondition1Index.begin();
+        cit != mCondition1Index.end(); cit++)
+   {
+      if(cit->second.mHeader.empty())
+      {
+         cit->second.mIndex.candidates(method, event, Data::Empty, candidates);
+         continue;
+      }
+      list<Data> values;
+      getHeaderFromSipMessage(request, cit->second.mHeader, values);
+      for(list<Data>::const_iterator vit = values.begin(); vit != values.end(); vit++)
+      {
+         cit->second.mIndex.candidates(method, event, *vit, candidates);
+      }
+   }
+   sort(candidates.begin(), candidates.end());
+   candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+   for (RegexRuleIndex::PositionList::const_iterator pos = candidates.begin();
+        pos != candidates.end(); pos++)
    {
+      const FilterOp* it = mOrderedFilters[*pos];
       const AbstractDb::FilterRecord& rec = it->filterRecord;
 
       if(!rec.mMethod.empty())
@@ -547,6 +577,32 @@ FilterStore::test(const resip::Data& cond1Header,
 }
 
 
+void
+FilterStore::rebuildIndex()
+{
+   mOrderedFilters.clear();
+   mCondition1Index.clear();
+   for (FilterOpList::const_iterator it = mFilterOperators.begin();
+        it != mFilterOperators.end(); it++)
+   {
+      const AbstractDb::FilterRecord& rec = it->filterRecord;
+      // process() only checks condition 1 if it has a usable regex
+      const bool hasCondition1 = !rec.mCondition1Header.empty() && it->pcond1;
+      Data name(hasCondition1 ? rec.mCondition1Header : Data::Empty);
+      ConditionIndex& index = mCondition1Index[name.lowercase()];
+      index.mHeader = hasCondition1 ? rec.mCondition1Header : Data::Empty;
+      index.mIndex.add(mOrderedFilters.size(), rec.mMethod, rec.mEvent,
+                       hasCondition1 ? rec.mCondition1Regex : Data::Empty);
+      mOrderedFilters.push_back(&*it);
+   }
+   for (ConditionIndexMap::iterator it = mCondition1Index.begin();
+        it != mCondition1Index.end(); it++)
+   {
+      it->second.mIndex.build();
+   }
+}
+
+
 FilterStore::Key 
 FilterStore::buildKey(const resip::Data& cond1Header,
                       const resip::Data& cond1Regex,
@@ -9,11 +9,14 @@
 
 #include <set>
 #include <list>
+#include <vector>
 
 #include "rutil/Data.hxx"
+#include "rutil/HashMap.hxx"
 #include "rutil/RWMutex.hxx"
 
 #include "repro/AbstractDb.hxx"
+#include "repro/RegexRuleIndex.hxx"
 
 namespace resip
 {
@@ -116,6 +119,20 @@ class FilterStore
       typedef std::multiset<FilterOp> FilterOpList;
       FilterOpList mFilterOperators; 
       FilterOpList::iterator mCursor;
+
+      // Filters indexed by the header their first condition looks at (an
+      // empty name holding those without one); positions refer to
+      // mOrderedFilters. Rebuilt whenever mFilterOperators changes.
+      class ConditionIndex
+      {
+         public:
+            resip::Data mHeader;
+            RegexRuleIndex mIndex;
+      };
+      typedef HashMap<resip::Data, ConditionIndex> ConditionIndexMap;
+      void rebuildIndex();
+      std::vector<const FilterOp*> mOrderedFilters;
+      ConditionIndexMap mCondition1Index;
 };
 
  }
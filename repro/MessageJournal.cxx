@@ -0,0 +1,722 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "rutil/Data.hxx"
+#include "rutil/FileSystem.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+#include "repro/MessageJournal.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
+
+static const Data segmentPrefix("journal.");
+static const Data offsetFileName("consumer.offset");
+
+#ifndef WIN32
+static size_t
+pageSize()
+{
+   static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+   return size;
+}
+
+// makes a new file in the directory survive a crash
+static void
+syncDirectory(const Data& directory)
+{
+   int fd = open(directory.c_str(), O_RDONLY);
+   if(fd >= 0)
+   {
+      fsync(fd);
+      close(fd);
+   }
+}
+#endif
+
+MessageJournal::MessageJournal(const Data& baseDir) :
+   mBaseDir(baseDir),
+   mSync(true),
+   mRecoveryNeeded(false)
+{
+}
+
+MessageJournal::~MessageJournal()
+{
+}
+
+UInt32
+MessageJournal::crc32(UInt32 crc, const void* data, size_t size)
+{
+   // CRC-32 as used by zlib, so that crc32(crc32(0, a), b) == crc32(0, ab)
+   static const struct Table
+   {
+      Table()
+      {
+         for(UInt32 i = 0; i < 256; i++)
+         {
+            UInt32 c = i;
+            for(int k = 0; k < 8; k++)
+            {
+               c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            mEntries[i] = c;
+         }
+      }
+      UInt32 mEntries[256];
+   } table;
+
+   const unsigned char* p = static_cast<const unsigned char*>(data);
+   crc = ~crc;
+   for(size_t i = 0; i < size; i++)
+   {
+      crc = table.mEntries[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+   }
+   return ~crc;
+}
+
+bool
+MessageJournal::openDirectory(const Data& queueName)
+{
+   if (mBaseDir.postfix("/") ||
+       mBaseDir.postfix("\\") ||
+       mBaseDir.empty())
+   {
+      mDirectory = mBaseDir + queueName;
+   }
+   else
+   {
+      mDirectory = mBaseDir + Data("/") + queueName;
+   }
+
+   // Create directory if it doesn't exist
+   FileSystem::Directory dir(mDirectory);
+   dir.create();
+#ifdef WIN32
+   ErrLog(<< "MessageJournal: memory-mapped journals are not supported on this platform, use the BerkeleyDb queue");
+   return false;
+#else
+   return true;
+#endif
+}
+
+Data
+MessageJournal::segmentPath(UInt64 number) const
+{
+   return mDirectory + "/" + segmentPrefix + Data(number);
+}
+
+vector<UInt64>
+MessageJournal::listSegments() const
+{
+   vector<UInt64> segments;
+   FileSystem::Directory dir(mDirectory);
+   for(FileSystem::Directory::iterator it = dir.begin(); it != dir.end(); ++it)
+   {
+      // skip segments still being created (see mapSegment)
+      if(it->prefix(segmentPrefix) && !it->postfix(".tmp"))
+      {
+         UInt64 number = Data(it->data() + segmentPrefix.size(), it->size() - segmentPrefix.size()).convertUInt64();
+         if(number > 0)
+         {
+            segments.push_back(number);
+         }
+      }
+   }
+   sort(segments.begin(), segments.end());
+   return segments;
+}
+
+bool
+MessageJournal::mapSegment(UInt64 number, bool writable, size_t size, Segment& segment)
+{
+#ifdef WIN32
+   return false;
+#else
+   Data path(segmentPath(number));
+   int fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+   if(fd < 0 && errno == ENOENT && writable && size > 0)
+   {
+      // sized before it gets its name, so a consumer never maps a short file
+      Data tmpPath(path + ".tmp");
+      fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if(fd >= 0 && (ftruncate(fd, (off_t)size) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0))
+      {
+         ErrLog(<< "MessageJournal: cannot create " << path << ": " << strerror(errno));
+         close(fd);
+         unlink(tmpPath.c_str());
+         return false;
+      }
+      if(fd >= 0 && mSync)
+      {
+         syncDirectory(mDirectory);
+      }
+   }
+   if(fd < 0)
+   {
+      if(errno != ENOENT)
+      {
+         ErrLog(<< "MessageJournal: cannot open " << path << ": " << strerror(errno));
+      }
+      return false;
+   }
+
+   struct stat st;
+   if(fstat(fd, &st) != 0 || st.st_size < (off_t)FrameHeaderSize)
+   {
+      ErrLog(<< "MessageJournal: " << path << " is not a journal segment");
+      close(fd);
+      return false;
+   }
+   void* data = mmap(0, (size_t)st.st_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+   if(data == MAP_FAILED)
+   {
+      ErrLog(<< "MessageJournal: cannot map " << path << ": " << strerror(errno));
+      close(fd);
+      return false;
+   }
+   segment.mNumber = number;
+   segment.mData = static_cast<char*>(data);
+   segment.mSize = (size_t)st.st_size;
+   segment.mFd = fd;
+   return true;
+#endif
+}
+
+void
+MessageJournal::unmapSegment(Segment& segment)
+{
+#ifndef WIN32
+   if(segment.mData)
+   {
+      munmap(segment.mData, segment.mSize);
+      close(segment.mFd);
+   }
+#endif
+   segment = Segment();
+}
+
+UInt32
+MessageJournal::frameAt(const Segment& segment, size_t offset, bool& corrupt)
+{
+   corrupt = false;
+   if(offset >= segment.mSize || segment.mSize - offset < FrameHeaderSize)
+   {
+      // the producer never starts a frame it cannot finish in the segment
+      return EndOfSegment;
+   }
+   const char* frame = segment.mData + offset;
+   UInt32 length = *reinterpret_cast<const volatile UInt32*>(frame);
+   // pairs with the fence in MessageJournalEnqueue::push
+   atomic_thread_fence(memory_order_acquire);
+   if(length == 0 || length == EndOfSegment)
+   {
+      return length;
+   }
+   if(length < FrameHeaderSize || paddedSize(length) > segment.mSize - offset)
+   {
+      corrupt = true;
+      return 0;
+   }
+   UInt32 crc;
+   memcpy(&crc, frame + 4, 4);
+   if(crc != crc32(crc32(0, &length, 4), frame + FrameHeaderSize, length - FrameHeaderSize))
+   {
+      corrupt = true;
+      return 0;
+   }
+   return length;
+}
+
+MessageJournalEnqueue::MessageJournalEnqueue(const Data& baseDir,
+                                             unsigned int segmentSize,
+                                             unsigned int syncIntervalMs,
+                                             unsigned int syncRecords) :
+   MessageJournal(baseDir),
+   mSegmentSize(max(segmentSize, 4096U)),
+   mSyncIntervalMs(syncIntervalMs),
+   mSyncRecords(max(syncRecords, 1U)),
+   mOffset(0),
+   mSyncedOffset(0),
+   mUnsyncedRecords(0),
+   mLastSyncMs(0)
+{
+}
+
+MessageJournalEnqueue::~MessageJournalEnqueue()
+{
+   if(mSegment.mData && mSync)
+   {
+      sync();
+   }
+   unmapSegment(mSegment);
+}
+
+bool
+MessageJournalEnqueue::init(bool sync, const Data& queueName)
+{
+   mSync = sync;
+   if(!openDirectory(queueName))
+   {
+      return false;
+   }
+   return recover();
+}
+
+bool
+MessageJournalEnqueue::recover()
+{
+   vector<UInt64> segments = listSegments();
+   if(segments.empty())
+   {
+      return startSegment(1, 0);
+   }
+   if(!mapSegment(segments.back(), true, 0, mSegment))
+   {
+      return false;
+   }
+
+   size_t offset = 0;
+   bool corrupt = false;
+   while(true)
+   {
+      UInt32 length = frameAt(mSegment, offset, corrupt);
+      if(length == EndOfSegment)
+      {
+         return startSegment(mSegment.mNumber + 1, 0);
+      }
+      if(length == 0)
+      {
+         break;
+      }
+      offset += paddedSize(length);
+   }
+
+   // anything past the last good record was left by a write that did not
+   // complete; clear it so that it cannot be taken for a frame later
+   char* end = mSegment.mData + mSegment.mSize;
+   if(find_if(mSegment.mData + offset, end, [](char c) { return c != 0; }) != end)
+   {
+      WarningLog(<< "MessageJournal: discarding incomplete record at offset " << offset
+                 << " of " << segmentPath(mSegment.mNumber));
+      memset(mSegment.mData + offset, 0, mSegment.mSize - offset);
+   }
+
+   // The consumer reads through the mapping, so after an OS crash its
+   // committed position can lie past what made it to disk.  Appending here
+   // would put new frames under that position; end the segment instead, and
+   // the consumer moves on to the next one (see MessageJournalDequeue::pop).
+   if(mSegment.mSize - offset >= 4)
+   {
+      *reinterpret_cast<volatile UInt32*>(mSegment.mData + offset) = EndOfSegment;
+   }
+   mOffset = mSegment.mSize;
+   mSyncedOffset = 0;
+   mUnsyncedRecords = 0;
+   return startSegment(mSegment.mNumber + 1, 0);
+}
+
+bool
+MessageJournalEnqueue::startSegment(UInt64 number, size_t minimumSize)
+{
+#ifdef WIN32
+   return false;
+#else
+   if(mSegment.mData)
+   {
+      if(mSync && !sync())
+      {
+         return false;
+      }
+      unmapSegment(mSegment);
+   }
+   size_t size = max(mSegmentSize, minimumSize);
+   size = (size + pageSize() - 1) & ~(pageSize() - 1);
+   if(!mapSegment(number, true, size, mSegment))
+   {
+      mRecoveryNeeded = true;
+      return false;
+   }
+   mOffset = 0;
+   mSyncedOffset = 0;
+   mLastSyncMs = Timer::getTimeMs();
+   return true;
+#endif
+}
+
+bool
+MessageJournalEnqueue::push(const Data& data)
+{
+   if(!mSegment.mData)
+   {
+      mRecoveryNeeded = true;
+      return false;
+   }
+   if((UInt64)data.size() + FrameHeaderSize >= EndOfSegment)
+   {
+      ErrLog(<< "MessageJournalEnqueue::push - record of " << data.size() << " bytes is too large");
+      return false;
+   }
+   UInt32 length = (UInt32)(data.size() + FrameHeaderSize);
+   size_t padded = paddedSize(length);
+   if(padded > mSegment.mSize - mOffset)
+   {
+      if(mSegment.mSize - mOffset >= 4)
+      {
+         *reinterpret_cast<volatile UInt32*>(mSegment.mData + mOffset) = EndOfSegment;
+      }
+      mOffset = mSegment.mSize;
+      if(!startSegment(mSegment.mNumber + 1, padded))
+      {
+         return false;
+      }
+   }
+
+   char* frame = mSegment.mData + mOffset;
+   UInt32 crc = crc32(crc32(0, &length, 4), data.data(), data.size());
+   memcpy(frame + 4, &crc, 4);
+   memcpy(frame + FrameHeaderSize, data.data(), data.size());
+   // the length goes in last, once the consumer can read the rest
+   atomic_thread_fence(memory_order_release);
+   *reinterpret_cast<volatile UInt32*>(frame) = length;
+   mOffset += padded;
+
+   if(mSync && (++mUnsyncedRecords >= mSyncRecords ||
+                Timer::getTimeMs() - mLastSyncMs >= mSyncIntervalMs))
+   {
+      return sync();
+   }
+   return true;
+}
+
+bool
+MessageJournalEnqueue::flush()
+{
+   if(!mSync || !mSegment.mData)
+   {
+      return true;
+   }
+   return sync();
+}
+
+bool
+MessageJournalEnqueue::sync()
+{
+#ifndef WIN32
+   if(mOffset > mSyncedOffset)
+   {
+      size_t start = mSyncedOffset & ~(pageSize() - 1);
+      if(msync(mSegment.mData + start, mOffset - start, MS_SYNC) != 0)
+      {
+         ErrLog(<< "MessageJournalEnqueue: msync of " << segmentPath(mSegment.mNumber) << " failed: " << strerror(errno));
+         mRecoveryNeeded = true;
+         return false;
+      }
+      mSyncedOffset = mOffset;
+   }
+#endif
+   mUnsyncedRecords = 0;
+   mLastSyncMs = Timer::getTimeMs();
+   return true;
+}
+
+MessageJournalDequeue::MessageJournalDequeue(const Data& baseDir) :
+   MessageJournal(baseDir),
+   mReadSegment(0),
+   mReadOffset(0),
+   mCommittedSegment(0),
+   mCommittedOffset(0),
+   mNumRecords(0),
+   mOffsets(0),
+   mOffsetFd(-1),
+   mOffsetSequence(0),
+   mLowestSegment(0),
+   mCorruptionReported(false)
+{
+}
+
+MessageJournalDequeue::~MessageJournalDequeue()
+{
+   unmapSegment(mSegment);
+#ifndef WIN32
+   if(mOffsets)
+   {
+      munmap(mOffsets, 2 * sizeof(OffsetSlot));
+      close(mOffsetFd);
+   }
+#endif
+}
+
+bool
+MessageJournalDequeue::init(bool sync, const Data& queueName)
+{
+   mSync = sync;
+   if(!openDirectory(queueName))
+   {
+      return false;
+   }
+#ifdef WIN32
+   return false;
+#else
+   Data path(mDirectory + "/" + offsetFileName);
+   mOffsetFd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+   struct stat st;
+   if(mOffsetFd < 0 || fstat(mOffsetFd, &st) != 0 ||
+      (st.st_size < (off_t)(2 * sizeof(OffsetSlot)) && ftruncate(mOffsetFd, 2 * sizeof(OffsetSlot)) != 0))
+   {
+      ErrLog(<< "MessageJournalDequeue: cannot open " << path << ": " << strerror(errno));
+      return false;
+   }
+   void* offsets = mmap(0, 2 * sizeof(OffsetSlot), PROT_READ | PROT_WRITE, MAP_SHARED, mOffsetFd, 0);
+   if(offsets == MAP_FAILED)
+   {
+      ErrLog(<< "MessageJournalDequeue: cannot map " << path << ": " << strerror(errno));
+      return false;
+   }
+   mOffsets = static_cast<OffsetSlot*>(offsets);
+
+   // the newer of the two slots that check out; with neither, start at the
+   // first segment there is
+   for(int i = 0; i < 2; i++)
+   {
+      const OffsetSlot& slot = mOffsets[i];
+      if(slot.mSequence > mOffsetSequence &&
+         slot.mCrc == crc32(0, &slot, offsetof(OffsetSlot, mCrc)))
+      {
+         mOffsetSequence = slot.mSequence;
+         mCommittedSegment = slot.mSegment;
+         mCommittedOffset = (size_t)slot.mOffset;
+      }
+   }
+   mReadSegment = mCommittedSegment;
+   mReadOffset = mCommittedOffset;
+   return true;
+#endif
+}
+
+bool
+MessageJournalDequeue::openReadSegment()
+{
+   if(mSegment.mData && mSegment.mNumber == mReadSegment)
+   {
+      return true;
+   }
+   unmapSegment(mSegment);
+   vector<UInt64> segments = listSegments();
+   for(vector<UInt64>::iterator it = segments.begin(); it != segments.end(); ++it)
+   {
+      if(*it >= mReadSegment)
+      {
+         if(*it != mReadSegment)
+         {
+            mReadSegment = *it;
+            mReadOffset = 0;
+         }
+         return mapSegment(*it, false, 0, mSegment);
+      }
+   }
+   return false;
+}
+
+bool
+MessageJournalDequeue::pop(size_t numRecords, vector<Data>& records, bool autoCommit)
+{
+   if(!mOffsets)
+   {
+      return false;
+   }
+   if(mNumRecords != 0)  // previous pop wasn't committed
+   {
+      abort();
+   }
+   records.clear();
+
+   while(records.size() < numRecords && openReadSegment())
+   {
+      bool corrupt;
+      UInt32 length = frameAt(mSegment, mReadOffset, corrupt);
+      if(corrupt || length == 0 || length == EndOfSegment)
+      {
+         // move on once the producer has started the next segment
+         vector<UInt64> segments = listSegments();
+         vector<UInt64>::iterator next = upper_bound(segments.begin(), segments.end(), mReadSegment);
+         if(next == segments.end())
+         {
+            if(corrupt && !mCorruptionReported)
+            {
+               // the producer clears this when it next starts
+               WarningLog(<< "MessageJournalDequeue: bad record at offset " << mReadOffset
+                          << " of " << segmentPath(mReadSegment) << ", waiting for the producer to recover");
+               mCorruptionReported = true;
+            }
+            break;
+         }
+         if(length != EndOfSegment)
+         {
+            // The producer ends a segment before it starts the next, so this
+            // is normally a record written since the first look.  If it is
+            // still empty or bad, the read position is past the end that the
+            // producer recovered after a crash, and it ended the segment there.
+            length = frameAt(mSegment, mReadOffset, corrupt);
+            if(corrupt || length == 0)
+            {
+               WarningLog(<< "MessageJournalDequeue: nothing to read at offset " << mReadOffset
+                          << " of " << segmentPath(mReadSegment) << ", records lost in a crash; moving on to "
+                          << segmentPath(*next));
+               length = EndOfSegment;
+            }
+         }
+         if(length == EndOfSegment)
+         {
+            mReadSegment = *next;
+            mReadOffset = 0;
+            continue;
+         }
+      }
+      mCorruptionReported = false;
+      records.push_back(Data(mSegment.mData + mReadOffset + FrameHeaderSize, length - FrameHeaderSize));
+      mReadOffset += paddedSize(length);
+   }
+
+   mNumRecords = records.size();
+   if(autoCommit)
+   {
+      return commit();
+   }
+   return true;
+}
+
+bool
+MessageJournalDequeue::commit()
+{
+   mNumRecords = 0;
+   if(mReadSegment == mCommittedSegment && mReadOffset == mCommittedOffset)
+   {
+      return true;
+   }
+   if(!writeOffset(mReadSegment, mReadOffset))
+   {
+      mRecoveryNeeded = true;
+      return false;
+   }
+   mCommittedSegment = mReadSegment;
+   mCommittedOffset = mReadOffset;
+   removeConsumedSegments();
+   return true;
+}
+
+void
+MessageJournalDequeue::abort()
+{
+   mReadSegment = mCommittedSegment;
+   mReadOffset = mCommittedOffset;
+   mNumRecords = 0;
+}
+
+bool
+MessageJournalDequeue::writeOffset(UInt64 segment, UInt64 offset)
+{
+   OffsetSlot slot;
+   slot.mSequence = mOffsetSequence + 1;
+   slot.mSegment = segment;
+   slot.mOffset = offset;
+   slot.mCrc = crc32(0, &slot, offsetof(OffsetSlot, mCrc));
+   slot.mPad = 0;
+
+   // the other slot still holds the previous position if this write is torn
+   mOffsets[slot.mSequence % 2] = slot;
+#ifndef WIN32
+   if(mSync && msync(mOffsets, 2 * sizeof(OffsetSlot), MS_SYNC) != 0)
+   {
+      ErrLog(<< "MessageJournalDequeue: msync of " << offsetFileName << " failed: " << strerror(errno));
+      return false;
+   }
+#endif
+   mOffsetSequence = slot.mSequence;
+   return true;
+}
+
+void
+MessageJournalDequeue::removeConsumedSegments()
+{
+   if(mCommittedSegment <= mLowestSegment)
+   {
+      return;
+   }
+   vector<UInt64> segments = listSegments();
+   for(vector<UInt64>::iterator it = segments.begin(); it != segments.end() && *it < mCommittedSegment; ++it)
+   {
+      if(mSegment.mData && mSegment.mNumber == *it)
+      {
+         unmapSegment(mSegment);
+      }
+#ifndef WIN32
+      unlink(segmentPath(*it).c_str());
+#endif
+   }
+   mLowestSegment = mCommittedSegment;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
@@ -0,0 +1,200 @@
+#if !defined(RESIP_MESSAGEJOURNAL_HXX)
+#define RESIP_MESSAGEJOURNAL_HXX
+
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "repro/PersistentMessageQueue.hxx"
+
+namespace repro
+{
+
+// A persistent message queue kept as a directory of memory-mapped,
+// append-only segment files, for one producer process and one consumer
+// process.  It is the alternative to the BerkeleyDb backed
+// PersistentMessageQueue: a push is a copy into the mapped segment, and
+// with sync set the producer flushes to disk once every SyncRecords
+// records or SyncIntervalMs (group commit) instead of once per record.
+//
+// Segments are named journal.<number> in the queue directory.  Every record
+// is framed as a 4 byte length (of the whole frame), a CRC32 of the length
+// and payload, then the payload padded to 4 bytes, all in host byte order.
+// A zero length marks the end of what has been written; a length of
+// EndOfSegment means the producer moved on to the next segment.  The
+// producer stores the length last, so the consumer never sees a record that
+// is only partly written.  After a crash the producer ends its last segment
+// after the last record that checks out and starts a new one; it never
+// appends to a segment it recovered, since the consumer may already have
+// read (and committed) records there that did not reach the disk.
+//
+// The consumer keeps its position in consumer.offset, which has two
+// CRC-protected slots that are written in turn, and deletes segments once
+// it has committed everything in them.  Delivery is at least once: records
+// popped after the last commit that reached the disk are popped again after
+// a crash.
+class MessageJournal
+{
+public:
+   static const unsigned int DefaultSegmentSize = 16 * 1024 * 1024;
+   static const unsigned int DefaultSyncIntervalMs = 100;
+   static const unsigned int DefaultSyncRecords = 100;
+
+   MessageJournal(const resip::Data& baseDir);
+   virtual ~MessageJournal();
+
+   static UInt32 crc32(UInt32 crc, const void* data, size_t size);
+
+protected:
+   static const UInt32 EndOfSegment = 0xFFFFFFFF;
+   static const size_t FrameHeaderSize = 8;
+
+   struct Segment
+   {
+      Segment() : mNumber(0), mData(0), mSize(0), mFd(-1) {}
+      UInt64 mNumber;
+      char* mData;
+      size_t mSize;
+      int mFd;
+   };
+
+   // creates the queue directory under the base dir
+   bool openDirectory(const resip::Data& queueName);
+   resip::Data segmentPath(UInt64 number) const;
+   // numbers of the segments in the directory, lowest first
+   std::vector<UInt64> listSegments() const;
+   // maps an existing segment; a writable one is created with size bytes
+   // if it does not exist
+   bool mapSegment(UInt64 number, bool writable, size_t size, Segment& segment);
+   void unmapSegment(Segment& segment);
+
+   // length of the frame at offset, 0 if there is none yet, EndOfSegment
+   // if the segment has no more; sets corrupt if the frame does not check out
+   static UInt32 frameAt(const Segment& segment, size_t offset, bool& corrupt);
+   static size_t paddedSize(UInt32 length) { return ((size_t)length + 3) & ~(size_t)3; }
+
+   resip::Data mBaseDir;
+   resip::Data mDirectory;
+   bool mSync;
+   bool mRecoveryNeeded;
+};
+
+class MessageJournalEnqueue : public MessageJournal, public MessageEnqueue
+{
+public:
+   MessageJournalEnqueue(const resip::Data& baseDir,
+                         unsigned int segmentSize = DefaultSegmentSize,
+                         unsigned int syncIntervalMs = DefaultSyncIntervalMs,
+                         unsigned int syncRecords = DefaultSyncRecords);
+   virtual ~MessageJournalEnqueue();
+
+   virtual bool init(bool sync, const resip::Data& queueName);
+   virtual bool push(const resip::Data& data);
+   virtual bool flush();
+   virtual bool isRecoveryNeeded() { return mRecoveryNeeded; }
+
+private:
+   // finds where the last segment ends, discarding a torn last record, and
+   // starts the next one
+   bool recover();
+   bool startSegment(UInt64 number, size_t minimumSize);
+   bool sync();
+
+   size_t mSegmentSize;
+   unsigned int mSyncIntervalMs;
+   unsigned int mSyncRecords;
+   Segment mSegment;
+   size_t mOffset;
+   size_t mSyncedOffset;
+   unsigned int mUnsyncedRecords;
+   UInt64 mLastSyncMs;
+};
+
+class MessageJournalDequeue : public MessageJournal, public MessageDequeue
+{
+public:
+   MessageJournalDequeue(const resip::Data& baseDir);
+   virtual ~MessageJournalDequeue();
+
+   virtual bool init(bool sync, const resip::Data& queueName);
+   // Note: only one consumer may use a journal at a time, autoCommit or not
+   virtual bool pop(size_t numRecords, std::vector<resip::Data>& records, bool autoCommit);
+   virtual bool commit();
+   virtual void abort();
+   virtual bool isRecoveryNeeded() { return mRecoveryNeeded; }
+
+private:
+   struct OffsetSlot
+   {
+      UInt64 mSequence;
+      UInt64 mSegment;
+      UInt64 mOffset;
+      UInt32 mCrc;
+      UInt32 mPad;
+   };
+
+   // opens the segment holding the read position, or the first one after
+   // it; false if there is none yet
+   bool openReadSegment();
+   bool writeOffset(UInt64 segment, UInt64 offset);
+   void removeConsumedSegments();
+
+   Segment mSegment;
+   UInt64 mReadSegment;
+   size_t mReadOffset;
+   UInt64 mCommittedSegment;
+   size_t mCommittedOffset;
+   size_t mNumRecords;
+   OffsetSlot* mOffsets;  // two slots, mapped from consumer.offset
+   int mOffsetFd;
+   UInt64 mOffsetSequence;
+   UInt64 mLowestSegment;  // segments below this have been removed
+   bool mCorruptionReported;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
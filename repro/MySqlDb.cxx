@@ -80,8 +80,7 @@ MySqlDb::MySqlDb(const resip::ConfigParse& config,
    mDBPassword(password),
    mDBName(databaseName),
    mDBPort(port),
-   mCustomUserAuthQuery(customUserAuthQuery),
-   mConn(0)
+   mCustomUserAuthQuery(customUserAuthQuery)
 { 
    InfoLog( << "Using MySQL DB with server=" << server << ", user=" << user << ", dbName=" << databaseName << ", port=" << port);
 
@@ -91,70 +90,97 @@ MySqlDb::MySqlDb(const resip::ConfigParse& config,
    }
 
    mysql_library_init(0, 0, 0);
+   createConnectionPool();
    if(!mysql_thread_safe())
    {
       ErrLog( << "Repro uses MySQL from multiple threads - you MUST link with a thread safe version of the mySQL client library!");
    }
    else
    {
-      connectToDatabase();
+      initialize();
+      ConnectionLease lease(*this);
+      connectToDatabase(lease.connection());
    }
 }
 
 
 MySqlDb::~MySqlDb()
 {
-   disconnectFromDatabase();
+   for (int i=0;i<MaxTable;i++)
+   {
+      if (mResult[i])
+      {  
+         mysql_free_result(mResult[i]); 
+         mResult[i]=0;
+      }
+   }
 }
 
-void
-MySqlDb::initialize() const
+MySqlDb::MySqlConnection::MySqlConnection() :
+   mConn(0)
 {
-   if(!g_MySQLInitializer.isInitialized())
+   for (int i=0;i<MaxStatement;i++)
    {
-      g_MySQLInitializer.setInitialized();
-      mysql_thread_init();
+      mStatements[i]=0;
    }
 }
 
+MySqlDb::MySqlConnection::~MySqlConnection()
+{
+   close();
+}
+
 void
-MySqlDb::disconnectFromDatabase() const
+MySqlDb::MySqlConnection::close()
 {
-   if(mConn)
+   // statements have to go before the connection they were prepared on
+   for (int i=0;i<MaxStatement;i++)
    {
-      for (int i=0;i<MaxTable;i++)
+      if (mStatements[i])
       {
-         if (mResult[i])
-         {  
-            mysql_free_result(mResult[i]); 
-            mResult[i]=0;
-         }
+         mysql_stmt_close(mStatements[i]);
+         mStatements[i]=0;
       }
-   
+   }
+   if(mConn)
+   {
       mysql_close(mConn);
       mConn = 0;
-      setConnected(false);
    }
 }
 
+void
+MySqlDb::initialize() const
+{
+   if(!g_MySQLInitializer.isInitialized())
+   {
+      g_MySQLInitializer.setInitialized();
+      mysql_thread_init();
+   }
+}
+
+SqlDb::Connection*
+MySqlDb::createConnection() const
+{
+   return new MySqlConnection;
+}
+
 int 
-MySqlDb::connectToDatabase() const
+MySqlDb::connectToDatabase(Connection& connection) const
 {
-   // Disconnect from database first (if required)
-   disconnectFromDatabase();
+   MySqlConnection& conn = static_cast<MySqlConnection&>(connection);
 
-   // Now try to connect
-   resip_assert(mConn == 0);
-   resip_assert(isConnected() == false);
+   // Disconnect from database first (if required)
+   conn.close();
 
-   mConn = mysql_init(0);
-   if(mConn == 0)
+   conn.mConn = mysql_init(0);
+   if(conn.mConn == 0)
    {
       ErrLog( << "MySQL init failed: insufficient memory.");
       return CR_OUT_OF_MEMORY;
    }
 
-   MYSQL* ret = mysql_real_connect(mConn,
+   MYSQL* ret = mysql_real_connect(conn.mConn,
                                    mDBServer.c_str(),   // hostname
                                    mDBUser.c_str(),     // user
                                    mDBPassword.c_str(), // password
@@ -165,10 +191,9 @@ MySqlDb::connectToDatabase() const
 
    if (ret == 0)
    { 
-      int rc = mysql_errno(mConn);
-      ErrLog( << "MySQL connect failed: error=" << rc << ": " << mysql_error(mConn));
-      mysql_close(mConn); 
-      mConn = 0;
+      int rc = mysql_errno(conn.mConn);
+      ErrLog( << "MySQL connect failed: error=" << rc << ": " << mysql_error(conn.mConn));
+      conn.close();
       setConnected(false);
       return rc;
    }
@@ -188,37 +213,38 @@ MySqlDb::query(const Data& queryCommand, MYSQL_RES** result) const
 
    DebugLog( << "MySqlDb::query: executing query: " << queryCommand);
 
-   Lock lock(mMutex);
-   if(mConn == 0 || !isConnected())
+   ConnectionLease lease(*this);
+   MySqlConnection& conn = static_cast<MySqlConnection&>(lease.connection());
+   if(conn.mConn == 0)
    {
-      rc = connectToDatabase();
+      rc = connectToDatabase(conn);
    }
    if(rc == 0)
    {
-      resip_assert(mConn!=0);
-      resip_assert(isConnected());
-      rc = mysql_query(mConn,queryCommand.c_str());
+      resip_assert(conn.mConn!=0);
+      rc = mysql_query(conn.mConn,queryCommand.c_str());
       if(rc != 0)
       {
-         rc = mysql_errno(mConn);
+         rc = mysql_errno(conn.mConn);
          if(rc == CR_SERVER_GONE_ERROR ||
             rc == CR_SERVER_LOST)
          {
             // First failure is a connection error - try to re-connect and then try again
-            rc = connectToDatabase();
+            rc = connectToDatabase(conn);
             if(rc == 0)
             {
                // OK - we reconnected - try query again
-               rc = mysql_query(mConn,queryCommand.c_str());
+               rc = mysql_query(conn.mConn,queryCommand.c_str());
                if( rc != 0)
                {
-                  ErrLog( << "MySQL query failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+                  rc = mysql_errno(conn.mConn);
+                  ErrLog( << "MySQL query failed: error=" << rc << ": " << mysql_error(conn.mConn));
                }
             }
          }
          else
          {
-            ErrLog( << "MySQL query failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+            ErrLog( << "MySQL query failed: error=" << rc << ": " << mysql_error(conn.mConn));
          }
       }
    }
@@ -226,13 +252,13 @@ MySqlDb::query(const Data& queryCommand, MYSQL_RES** result) const
    // Now store result - if pointer to result pointer was supplied and no errors
    if(rc == 0 && result)
    {
-      *result = mysql_store_result(mConn);
+      *result = mysql_store_result(conn.mConn);
       if(*result == 0)
       {
-         rc = mysql_errno(mConn);
+         rc = mysql_errno(conn.mConn);
          if(rc != 0)
          {
-            ErrLog( << "MySQL store result failed: error=" << rc << ": " << mysql_error(mConn));
+            ErrLog( << "MySQL store result failed: error=" << rc << ": " << mysql_error(conn.mConn));
          }
       }
    }
@@ -250,6 +276,164 @@ MySqlDb::query(const Data& queryCommand) const
    return query(queryCommand, 0);
 }
 
+Data
+MySqlDb::statementText(Statement statement) const
+{
+   switch (statement)
+   {
+      case UserAuthStatement:
+         return "SELECT passwordHash FROM " + tableName(UserTable) + " WHERE user = ? AND domain = ?";
+      case SiloInsertStatement:
+         return "REPLACE INTO " + tableName(SiloTable) + " (attr, attr2, value) VALUES (?, ?, ?)";
+      case SiloFetchStatement:
+         return "SELECT value FROM " + tableName(SiloTable) + " WHERE attr2 = ?";
+      case SiloEraseStatement:
+         return "DELETE FROM " + tableName(SiloTable) + " WHERE attr = ?";
+      case StaticRegFetchStatement:
+         return "SELECT value FROM " + tableName(StaticRegTable);
+      default:
+         resip_assert(0);
+   }
+   return Data::Empty;
+}
+
+int
+MySqlDb::preparedQuery(Statement statement, const std::vector<Data>& params, std::vector<Data>* rows) const
+{
+   int rc = 0;
+
+   initialize();
+
+   ConnectionLease lease(*this);
+   MySqlConnection& conn = static_cast<MySqlConnection&>(lease.connection());
+   if(conn.mConn == 0)
+   {
+      rc = connectToDatabase(conn);
+   }
+   if(rc == 0)
+   {
+      rc = executeStatement(conn, statement, params, rows);
+      if(rc == CR_SERVER_GONE_ERROR ||
+         rc == CR_SERVER_LOST)
+      {
+         // First failure is a connection error - try to re-connect (which
+         // drops the prepared statements) and then try again
+         rc = connectToDatabase(conn);
+         if(rc == 0)
+         {
+            rc = executeStatement(conn, statement, params, rows);
+         }
+      }
+   }
+   return rc;
+}
+
+int
+MySqlDb::executeStatement(MySqlConnection& conn, Statement statement, const std::vector<Data>& params, std::vector<Data>* rows) const
+{
+   MYSQL_STMT*& stmt = conn.mStatements[statement];
+   if(stmt == 0)
+   {
+      Data text(statementText(statement));
+      DebugLog( << "MySqlDb::executeStatement: preparing: " << text);
+      stmt = mysql_stmt_init(conn.mConn);
+      if(stmt == 0)
+      {
+         ErrLog( << "MySQL statement init failed: insufficient memory.");
+         return CR_OUT_OF_MEMORY;
+      }
+      if(mysql_stmt_prepare(stmt, text.data(), text.size()) != 0)
+      {
+         int rc = mysql_stmt_errno(stmt);
+         ErrLog( << "MySQL prepare failed: error=" << rc << ": " << mysql_stmt_error(stmt) << ", statement was: " << text);
+         mysql_stmt_close(stmt);
+         stmt = 0;
+         return rc;
+      }
+   }
+
+   MYSQL_BIND bind[MaxStatementParams];
+   unsigned long lengths[MaxStatementParams];
+   resip_assert(params.size() <= MaxStatementParams);
+   resip_assert(params.size() == mysql_stmt_param_count(stmt));
+   memset(bind, 0, sizeof(bind));
+   for(unsigned int i = 0; i < params.size(); i++)
+   {
+      lengths[i] = params[i].size();
+      bind[i].buffer_type = MYSQL_TYPE_STRING;
+      bind[i].buffer = (void*)params[i].data();
+      bind[i].buffer_length = lengths[i];
+      bind[i].length = &lengths[i];
+   }
+   if((!params.empty() && mysql_stmt_bind_param(stmt, bind) != 0) ||
+      mysql_stmt_execute(stmt) != 0)
+   {
+      int rc = mysql_stmt_errno(stmt);
+      ErrLog( << "MySQL statement failed: error=" << rc << ": " << mysql_stmt_error(stmt) << ", statement was: " << statementText(statement));
+      return rc;
+   }
+   if(rows == 0)
+   {
+      return 0;
+   }
+
+   // Bind the column without a buffer, to learn each value's length, then
+   // fetch it into a Data of that size
+   MYSQL_BIND result;
+   unsigned long length = 0;
+   memset(&result, 0, sizeof(result));
+   result.buffer_type = MYSQL_TYPE_STRING;
+   result.length = &length;
+   int rc = 0;
+   if(mysql_stmt_bind_result(stmt, &result) != 0 ||
+      mysql_stmt_store_result(stmt) != 0)
+   {
+      rc = mysql_stmt_errno(stmt);
+      ErrLog( << "MySQL store result failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+   }
+   else
+   {
+      int fetched;
+      while((fetched = mysql_stmt_fetch(stmt)) == 0 || fetched == MYSQL_DATA_TRUNCATED)
+      {
+         Data value;
+         if(length > 0)
+         {
+            result.buffer = value.getBuf((Data::size_type)length);
+            result.buffer_length = length;
+            rc = mysql_stmt_fetch_column(stmt, &result, 0, 0);
+            result.buffer = 0;
+            result.buffer_length = 0;
+            if(rc != 0)
+            {
+               rc = mysql_stmt_errno(stmt);
+               ErrLog( << "MySQL fetch column failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+               break;
+            }
+         }
+         rows->push_back(value);
+      }
+      if(rc == 0 && fetched != MYSQL_NO_DATA)
+      {
+         rc = mysql_stmt_errno(stmt);
+         ErrLog( << "MySQL fetch row failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+      }
+   }
+   mysql_stmt_free_result(stmt);
+   return rc;
+}
+
+int
+MySqlDb::replaceSiloRows(const Data& keys, const Data& rows) const
+{
+   Data command;
+   {
+      DataStream ds(command);
+      ds << "REPLACE INTO " << tableName(SiloTable) << " (attr, attr2, value) VALUES " << rows;
+   }
+   return query(command, 0);
+}
+
 int
 MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields) const
 {
@@ -274,15 +458,8 @@ MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields)
       }
       else
       {
-         rc = mysql_errno(mConn);
-         if(rc != 0)
-         {
-            ErrLog( << "MySQL fetch row failed: error=" << rc << ": " << mysql_error(mConn));
-         }
-         else
-         {
-            DebugLog(<<"singleResultQuery: no rows returned by query");
-         }
+         // the result is stored, so there is nothing left to fail once we have it
+         DebugLog(<<"singleResultQuery: no rows returned by query");
       }
       mysql_free_result(result);
    }
@@ -292,7 +469,17 @@ MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields)
 resip::Data& 
 MySqlDb::escapeString(const resip::Data& str, resip::Data& escapedStr) const
 {
-   escapedStr.truncate2(mysql_real_escape_string(mConn, (char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size()));
+   // the connection's character set decides what needs escaping
+   ConnectionLease lease(*this);
+   MySqlConnection& conn = static_cast<MySqlConnection&>(lease.connection());
+   if(conn.mConn == 0)
+   {
+      initialize();
+      connectToDatabase(conn);
+   }
+   char* buf = escapedStr.getBuf(str.size()*2+1);
+   escapedStr.truncate2(conn.mConn ? mysql_real_escape_string(conn.mConn, buf, str.c_str(), str.size()) :
+                                     mysql_escape_string(buf, str.c_str(), str.size()));
    return escapedStr;
 }
 
@@ -347,7 +534,7 @@ MySqlDb::getUser( const AbstractDb::Key& key ) const
    
    if (result==0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL query returned no result set");
       return ret;
    }
 
@@ -376,28 +563,37 @@ MySqlDb::getUserAuthInfo(  const AbstractDb::Key& key ) const
 { 
    std::vector<Data> ret;
 
-   Data command;
+   Data user;
+   Data domain;
+   UserStore::getUserAndDomainFromKey(key, user, domain);
+
+   // Note: domain is empty when querying for HTTP admin user - for this special user, 
+   // we will only check the repro db, by not adding the UNION statement below
+   if(mCustomUserAuthQuery.empty() || domain.empty())
    {
-      DataStream ds(command);
-      Data user;
-      Data domain;
-      UserStore::getUserAndDomainFromKey(key, user, domain);
-      ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE user = '" << user << "' AND domain = '" << domain << "' ";
-   
-      // Note: domain is empty when querying for HTTP admin user - for this special user, 
-      // we will only check the repro db, by not adding the UNION statement below
-      if(!mCustomUserAuthQuery.empty() && !domain.empty())  
+      std::vector<Data> params;
+      params.push_back(user);
+      params.push_back(domain);
+      if(preparedQuery(UserAuthStatement, params, &ret) != 0 || ret.size() == 0)
       {
-         ds << " UNION " << mCustomUserAuthQuery;
-         ds.flush();
-         command.replace("$user", user);
-         command.replace("$domain", domain);
+         return Data::Empty;
       }
    }
-
-   if(singleResultQuery(command, ret) != 0 || ret.size() == 0)
+   else
    {
-      return Data::Empty;
+      Data command;
+      {
+         DataStream ds(command);
+         ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE user = '" << user << "' AND domain = '" << domain << "' ";
+         ds << " UNION " << mCustomUserAuthQuery;
+      }
+      command.replace("$user", user);
+      command.replace("$domain", domain);
+
+      if(singleResultQuery(command, ret) != 0 || ret.size() == 0)
+      {
+         return Data::Empty;
+      }
    }
    
    DebugLog( << "Auth password is " << ret.front());
@@ -429,7 +625,7 @@ MySqlDb::firstUserKey()
 
    if(mResult[UserTable] == 0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL query returned no result set");
       return Data::Empty;
    }
    
@@ -498,7 +694,7 @@ MySqlDb::getTlsPeerIdentity( const AbstractDb::Key& key ) const
 
    if (result==0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL query returned no result set");
       return ret;
    }
 
@@ -539,7 +735,7 @@ MySqlDb::firstTlsPeerIdentityKey()
 
    if(mResult[TlsPeerIdentityTable] == 0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL query returned no result set");
       return Data::Empty;
    }
 
@@ -625,7 +821,7 @@ MySqlDb::dbReadRecord(const Table table,
 
    if (result == 0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL query returned no result set");
       return false;
    }
    else
@@ -668,7 +864,7 @@ MySqlDb::dbNextKey(const Table table, bool first)
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+         ErrLog( << "MySQL query returned no result set");
          return Data::Empty;
       }
    }
@@ -732,7 +928,7 @@ MySqlDb::dbNextRecord(const Table table,
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+         ErrLog( << "MySQL query returned no result set");
          return false;
       }
    }
@@ -758,12 +954,18 @@ MySqlDb::dbNextRecord(const Table table,
 bool 
 MySqlDb::dbBeginTransaction(const Table table)
 {
+   // the rest of the transaction has to run on this connection too
+   pinConnection();
    Data command("SET SESSION TRANSACTION ISOLATION LEVEL REPEATABLE READ");
    if(query(command, 0) == 0)
    {
       command = "START TRANSACTION";
-      return query(command, 0) == 0;
+      if(query(command, 0) == 0)
+      {
+         return true;
+      }
    }
+   unpinConnection();
    return false;
 }
 
@@ -62,11 +62,31 @@ class MySqlDb: public SqlDb
                                 bool first=false);  // return false if no more
       virtual bool dbBeginTransaction(const Table table);
 
+      class MySqlConnection : public Connection
+      {
+         public:
+            MySqlConnection();
+            virtual ~MySqlConnection();
+            void close();
+
+            MYSQL* mConn;
+            MYSQL_STMT* mStatements[MaxStatement];  // prepared when first used
+      };
+      static const unsigned int MaxStatementParams = 3;
+
       void initialize() const;
-      void disconnectFromDatabase() const;
-      int connectToDatabase() const;
+      virtual Connection* createConnection() const;
+      virtual int connectToDatabase(Connection& connection) const;
       int query(const resip::Data& queryCommand, MYSQL_RES** result) const;
       virtual int query(const resip::Data& queryCommand) const;
+      resip::Data statementText(Statement statement) const;
+      virtual int preparedQuery(Statement statement,
+                                const std::vector<resip::Data>& params,
+                                std::vector<resip::Data>* rows) const;
+      int executeStatement(MySqlConnection& conn, Statement statement,
+                           const std::vector<resip::Data>& params,
+                           std::vector<resip::Data>* rows) const;
+      virtual int replaceSiloRows(const resip::Data& keys, const resip::Data& rows) const;
       resip::Data& escapeString(const resip::Data& str, resip::Data& escapedStr) const;
 
       resip::Data mDBServer;
@@ -76,7 +96,6 @@ class MySqlDb: public SqlDb
       unsigned int mDBPort;
       resip::Data mCustomUserAuthQuery;
 
-      mutable MYSQL* mConn;
       mutable MYSQL_RES* mResult[MaxTable];
 
       void userWhereClauseToDataStream(const Key& key, resip::DataStream& ds) const;
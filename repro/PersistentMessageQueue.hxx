@@ -120,6 +120,37 @@
 
 namespace repro
 {
+
+// Producer side of a persistent message queue, whichever store backs it:
+// PersistentMessageEnqueue (BerkeleyDb) or MessageJournalEnqueue (see
+// MessageJournal.hxx).
+class MessageEnqueue
+{
+public:
+   virtual ~MessageEnqueue() {}
+
+   virtual bool init(bool sync, const resip::Data& queueName) = 0;
+   virtual bool push(const resip::Data& data) = 0;
+   // Makes what has been pushed durable now, for stores that batch their
+   // syncs; producers call it when they have gone idle
+   virtual bool flush() { return true; }
+   virtual bool isRecoveryNeeded() = 0;
+};
+
+// Consumer side of a persistent message queue, see MessageEnqueue
+class MessageDequeue
+{
+public:
+   virtual ~MessageDequeue() {}
+
+   virtual bool init(bool sync, const resip::Data& queueName) = 0;
+   // returns true for success, false for failure - can return true and 0 records if none available
+   virtual bool pop(size_t numRecords, std::vector<resip::Data>& records, bool autoCommit) = 0;
+   virtual bool commit() = 0;
+   virtual void abort() = 0;
+   virtual bool isRecoveryNeeded() = 0;
+};
+
 #ifndef DISABLE_BERKELEYDB_USE
 class PersistentMessageQueue : public DbEnv 
 #else
@@ -141,19 +172,22 @@ protected:
    bool mRecoveryNeeded;
 };  
 
-class PersistentMessageEnqueue : public PersistentMessageQueue 
+class PersistentMessageEnqueue : public PersistentMessageQueue, public MessageEnqueue
 { 
 public:
    PersistentMessageEnqueue(const resip::Data& baseDir) : 
       PersistentMessageQueue(baseDir) {}
    virtual ~PersistentMessageEnqueue() {}
+
+   virtual bool init(bool sync, const resip::Data& queueName) { return PersistentMessageQueue::init(sync, queueName); }
+   virtual bool isRecoveryNeeded() { return PersistentMessageQueue::isRecoveryNeeded(); }
    
    // Note:  this has a potential to block if the a consumer crashes and leaves a lock open on the database (deadlock)
    // typically restarting the consumer will "recover" the "dead" lock and allow this call to unblock
-   bool push(const resip::Data& data);
+   virtual bool push(const resip::Data& data);
 };  
 
-class PersistentMessageDequeue : public PersistentMessageQueue 
+class PersistentMessageDequeue : public PersistentMessageQueue, public MessageDequeue
 { 
 public:     
    PersistentMessageDequeue(const resip::Data& baseDir) : 
@@ -161,11 +195,14 @@ public:
       mNumRecords(0) {}
    virtual ~PersistentMessageDequeue () {}
 
+   virtual bool init(bool sync, const resip::Data& queueName) { return PersistentMessageQueue::init(sync, queueName); }
+   virtual bool isRecoveryNeeded() { return PersistentMessageQueue::isRecoveryNeeded(); }
+
    // returns true for success, false for failure - can return true and 0 records if none available
    // Note:  if autoCommit is used then it is safe to allow multiple consumers
-   bool pop(size_t numRecords, std::vector<resip::Data>& records, bool autoCommit);
-   bool commit();
-   void abort();
+   virtual bool pop(size_t numRecords, std::vector<resip::Data>& records, bool autoCommit);
+   virtual bool commit();
+   virtual void abort();
 
 private:
    size_t mNumRecords;
@@ -76,8 +76,7 @@ PostgreSqlDb::PostgreSqlDb(const resip::ConfigParse& config,
    mDBPassword(password),
    mDBName(databaseName),
    mDBPort(port),
-   mCustomUserAuthQuery(customUserAuthQuery),
-   mConn(0)
+   mCustomUserAuthQuery(customUserAuthQuery)
 { 
    InfoLog( << "Using PostgreSQL DB with server=" << server << ", user=" << user << ", dbName=" << databaseName << ", port=" << port);
 
@@ -87,62 +86,84 @@ PostgreSqlDb::PostgreSqlDb(const resip::ConfigParse& config,
       mRow[i]=0;
    }
 
+   createConnectionPool();
    if(!PQisthreadsafe())
    {
       ErrLog( << "Repro uses PostgreSQL from multiple threads - you MUST link with a thread safe version of the PostgreSQL client library (libpq)!");
    }
    else
    {
-      connectToDatabase();
+      ConnectionLease lease(*this);
+      connectToDatabase(lease.connection());
    }
 }
 
 
 PostgreSqlDb::~PostgreSqlDb()
 {
-   disconnectFromDatabase();
+   for (int i=0;i<MaxTable;i++)
+   {
+      if (mResult[i])
+      {  
+         PQclear(mResult[i]); 
+         mResult[i]=0;
+         mRow[i]=0;
+      }
+   }
 }
 
-void
-PostgreSqlDb::initialize() const
+PostgreSqlDb::PostgreSqlConnection::PostgreSqlConnection() :
+   mConn(0)
 {
-   if(!g_PostgreSQLInitializer.isInitialized())
+   for (int i=0;i<MaxStatement;i++)
    {
-      g_PostgreSQLInitializer.setInitialized();
-      //mysql_thread_init();   // FIXME - PostgreSQL equivalent?
+      mPrepared[i]=false;
    }
 }
 
+PostgreSqlDb::PostgreSqlConnection::~PostgreSqlConnection()
+{
+   close();
+}
+
 void
-PostgreSqlDb::disconnectFromDatabase() const
+PostgreSqlDb::PostgreSqlConnection::close()
 {
+   // prepared statements go with the connection
+   for (int i=0;i<MaxStatement;i++)
+   {
+      mPrepared[i]=false;
+   }
    if(mConn)
    {
-      for (int i=0;i<MaxTable;i++)
-      {
-         if (mResult[i])
-         {  
-            PQclear(mResult[i]); 
-            mResult[i]=0;
-            mRow[i]=0;
-         }
-      }
-   
       PQfinish(mConn);
       mConn = 0;
-      setConnected(false);
    }
 }
 
+void
+PostgreSqlDb::initialize() const
+{
+   if(!g_PostgreSQLInitializer.isInitialized())
+   {
+      g_PostgreSQLInitializer.setInitialized();
+      //mysql_thread_init();   // FIXME - PostgreSQL equivalent?
+   }
+}
+
+SqlDb::Connection*
+PostgreSqlDb::createConnection() const
+{
+   return new PostgreSqlConnection;
+}
+
 int 
-PostgreSqlDb::connectToDatabase() const
+PostgreSqlDb::connectToDatabase(Connection& connection) const
 {
-   // Disconnect from database first (if required)
-   disconnectFromDatabase();
+   PostgreSqlConnection& conn = static_cast<PostgreSqlConnection&>(connection);
 
-   // Now try to connect
-   resip_assert(mConn == 0);
-   resip_assert(isConnected() == false);
+   // Disconnect from database first (if required)
+   conn.close();
 
    Data connInfo(mDBConnInfo);
    if(!mDBServer.empty())
@@ -169,13 +190,13 @@ PostgreSqlDb::connectToDatabase() const
    }
 
    DebugLog(<<"Trying to connect to PostgreSQL server with conninfo string: " << connInfoLogString);
-   mConn = PQconnectdb(connInfo.c_str());
+   conn.mConn = PQconnectdb(connInfo.c_str());
 
-   int rc = PQstatus(mConn);
+   int rc = PQstatus(conn.mConn);
    if (rc != CONNECTION_OK)
    { 
-      ErrLog( << "PostgreSQL connect failed: " << PQerrorMessage(mConn));
-      mConn = 0;
+      ErrLog( << "PostgreSQL connect failed: " << PQerrorMessage(conn.mConn));
+      conn.close();
       setConnected(false);
       return -1;
    }
@@ -196,44 +217,47 @@ int
 PostgreSqlDb::query(const Data& queryCommand, PGresult** result) const
 {
    int rc = 0;
-   PGresult *_result;
+   PGresult *_result = 0;
 
    initialize();
 
    DebugLog( << "PostgreSqlDb::query: executing query: " << queryCommand);
 
-   Lock lock(mMutex);
-   if(mConn == 0 || !isConnected())
+   ConnectionLease lease(*this);
+   PostgreSqlConnection& conn = static_cast<PostgreSqlConnection&>(lease.connection());
+   if(conn.mConn == 0)
    {
-      rc = connectToDatabase();
+      rc = connectToDatabase(conn);
    }
    if(rc == 0)
    {
-      resip_assert(mConn!=0);
-      resip_assert(isConnected());
-      _result = PQexec(mConn, queryCommand.c_str());
+      resip_assert(conn.mConn!=0);
+      _result = PQexec(conn.mConn, queryCommand.c_str());
       rc = pqOK(_result);
       if(rc != 0)
       {
          PQclear(_result);
-         if(rc == PGRES_FATAL_ERROR)
+         _result = 0;
+         if(PQstatus(conn.mConn) != CONNECTION_OK)
          {
-            // First failure may be a connection error - try to re-connect and then try again
-            rc = connectToDatabase();
+            // First failure is a connection error - try to re-connect and then try again
+            rc = connectToDatabase(conn);
             if(rc == 0)
             {
                // OK - we reconnected - try query again
-               _result = PQexec(mConn,queryCommand.c_str());
+               _result = PQexec(conn.mConn,queryCommand.c_str());
                rc = pqOK(_result);
                if( rc != 0)
                {
-                  ErrLog( << "PostgreSQL query failed (twice): " << PQerrorMessage(mConn));
+                  ErrLog( << "PostgreSQL query failed (twice): " << PQerrorMessage(conn.mConn));
+                  PQclear(_result);
+                  _result = 0;
                }
             }
          }
          else
          {
-            ErrLog( << "PostgreSQL query failed: " << PQerrorMessage(mConn));
+            ErrLog( << "PostgreSQL query failed: " << PQerrorMessage(conn.mConn));
          }
       }
    }
@@ -243,6 +267,10 @@ PostgreSqlDb::query(const Data& queryCommand, PGresult** result) const
    {
       *result = _result;
    }
+   else if(_result)
+   {
+      PQclear(_result);
+   }
 
    if(rc != 0)
    {
@@ -257,6 +285,120 @@ PostgreSqlDb::query(const Data& queryCommand) const
    return query(queryCommand, 0);
 }
 
+Data
+PostgreSqlDb::statementText(Statement statement) const
+{
+   switch (statement)
+   {
+      case UserAuthStatement:
+         return "SELECT passwordHash FROM " + tableName(UserTable) + " WHERE username = $1 AND domain = $2";
+      case SiloInsertStatement:
+         // A single prepared statement can't hold the DELETE and INSERT that
+         // dbWriteRecord uses, so replace an existing row through the
+         // (attr, attr2) primary key instead
+         return "INSERT INTO " + tableName(SiloTable) + " (attr, attr2, value) VALUES ($1, $2, $3)"
+                " ON CONFLICT (attr, attr2) DO UPDATE SET value = EXCLUDED.value";
+      case SiloFetchStatement:
+         return "SELECT value FROM " + tableName(SiloTable) + " WHERE attr2 = $1";
+      case SiloEraseStatement:
+         return "DELETE FROM " + tableName(SiloTable) + " WHERE attr = $1";
+      case StaticRegFetchStatement:
+         return "SELECT value FROM " + tableName(StaticRegTable);
+      default:
+         resip_assert(0);
+   }
+   return Data::Empty;
+}
+
+int
+PostgreSqlDb::preparedQuery(Statement statement, const std::vector<Data>& params, std::vector<Data>* rows) const
+{
+   int rc = 0;
+
+   initialize();
+
+   ConnectionLease lease(*this);
+   PostgreSqlConnection& conn = static_cast<PostgreSqlConnection&>(lease.connection());
+   if(conn.mConn == 0)
+   {
+      rc = connectToDatabase(conn);
+   }
+   if(rc == 0)
+   {
+      rc = executeStatement(conn, statement, params, rows);
+      if(rc != 0 && PQstatus(conn.mConn) != CONNECTION_OK)
+      {
+         // First failure is a connection error - try to re-connect (which
+         // drops the prepared statements) and then try again
+         rc = connectToDatabase(conn);
+         if(rc == 0)
+         {
+            rc = executeStatement(conn, statement, params, rows);
+         }
+      }
+   }
+   return rc;
+}
+
+int
+PostgreSqlDb::executeStatement(PostgreSqlConnection& conn, Statement statement, const std::vector<Data>& params, std::vector<Data>* rows) const
+{
+   // statements are named after their position in Statement
+   Data name("repro_stmt_" + Data((UInt32)statement));
+   if(!conn.mPrepared[statement])
+   {
+      Data text(statementText(statement));
+      DebugLog( << "PostgreSqlDb::executeStatement: preparing: " << text);
+      PGresult* result = PQprepare(conn.mConn, name.c_str(), text.c_str(), (int)params.size(), 0);
+      int rc = pqOK(result);
+      PQclear(result);
+      if(rc != 0)
+      {
+         ErrLog( << "PostgreSQL prepare failed: " << PQerrorMessage(conn.mConn) << ", statement was: " << text);
+         return rc;
+      }
+      conn.mPrepared[statement] = true;
+   }
+
+   const char* values[MaxStatementParams];
+   int lengths[MaxStatementParams];
+   resip_assert(params.size() <= MaxStatementParams);
+   for(unsigned int i = 0; i < params.size(); i++)
+   {
+      values[i] = params[i].data();
+      lengths[i] = (int)params[i].size();
+   }
+   PGresult* result = PQexecPrepared(conn.mConn, name.c_str(), (int)params.size(), values, lengths, 0, 0);
+   int rc = pqOK(result);
+   if(rc != 0)
+   {
+      ErrLog( << "PostgreSQL statement failed: " << PQerrorMessage(conn.mConn) << ", statement was: " << statementText(statement));
+   }
+   else if(rows)
+   {
+      int count = PQntuples(result);
+      for(int row = 0; row < count; row++)
+      {
+         rows->push_back(Data(PQgetvalue(result, row, 0), PQgetlength(result, row, 0)));
+      }
+   }
+   PQclear(result);
+   return rc;
+}
+
+int
+PostgreSqlDb::replaceSiloRows(const Data& keys, const Data& rows) const
+{
+   Data command;
+   {
+      DataStream ds(command);
+      // Use two queries together to simulate UPSERT, as dbWriteRecord does
+      ds << "DELETE FROM " << tableName(SiloTable) << " WHERE attr IN (" << keys << ");"
+         << " INSERT INTO " << tableName(SiloTable) << " (attr, attr2, value) VALUES " << rows;
+   }
+   return query(command, 0);
+}
+
 int
 PostgreSqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields) const
 {
@@ -291,11 +433,25 @@ PostgreSqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fie
 resip::Data& 
 PostgreSqlDb::escapeString(const resip::Data& str, resip::Data& escapedStr) const
 {
+   // the connection's encoding decides what needs escaping
+   ConnectionLease lease(*this);
+   PostgreSqlConnection& conn = static_cast<PostgreSqlConnection&>(lease.connection());
+   if(conn.mConn == 0)
+   {
+      initialize();
+      connectToDatabase(conn);
+   }
+   char* buf = escapedStr.getBuf(str.size()*2+1);
+   if(conn.mConn == 0)
+   {
+      escapedStr.truncate2(PQescapeString(buf, str.c_str(), str.size()));
+      return escapedStr;
+   }
    int rc = 0;
-   escapedStr.truncate2(PQescapeStringConn(mConn, (char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size(), &rc));
+   escapedStr.truncate2(PQescapeStringConn(conn.mConn, buf, str.c_str(), str.size(), &rc));
    if(rc != 0)
    {
-      ErrLog(<< "PostgreSQL string escaping failed: " << PQerrorMessage(mConn));
+      ErrLog(<< "PostgreSQL string escaping failed: " << PQerrorMessage(conn.mConn));
       // FIXME - should probably throw here.  According to the docs, there is a value in
       // the output buffer even after failure so we'll try to use it and fail later.
    }
@@ -357,7 +513,7 @@ PostgreSqlDb::getUser( const AbstractDb::Key& key ) const
    
    if (result==0)
    {
-      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL query returned no result");
       return ret;
    }
 
@@ -385,28 +541,37 @@ PostgreSqlDb::getUserAuthInfo(  const AbstractDb::Key& key ) const
 { 
    std::vector<Data> ret;
 
-   Data command;
+   Data user;
+   Data domain;
+   UserStore::getUserAndDomainFromKey(key, user, domain);
+
+   // Note: domain is empty when querying for HTTP admin user - for this special user, 
+   // we will only check the repro db, by not adding the UNION statement below
+   if(mCustomUserAuthQuery.empty() || domain.empty())
    {
-      DataStream ds(command);
-      Data user;
-      Data domain;
-      UserStore::getUserAndDomainFromKey(key, user, domain);
-      ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE username = '" << user << "' AND domain = '" << domain << "' ";
-   
-      // Note: domain is empty when querying for HTTP admin user - for this special user, 
-      // we will only check the repro db, by not adding the UNION statement below
-      if(!mCustomUserAuthQuery.empty() && !domain.empty())  
+      std::vector<Data> params;
+      params.push_back(user);
+      params.push_back(domain);
+      if(preparedQuery(UserAuthStatement, params, &ret) != 0 || ret.size() == 0)
       {
-         ds << " UNION " << mCustomUserAuthQuery;
-         ds.flush();
-         command.replace("$user", user);
-         command.replace("$domain", domain);
+         return Data::Empty;
       }
    }
-
-   if(singleResultQuery(command, ret) != 0 || ret.size() == 0)
+   else
    {
-      return Data::Empty;
+      Data command;
+      {
+         DataStream ds(command);
+         ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE username = '" << user << "' AND domain = '" << domain << "' ";
+         ds << " UNION " << mCustomUserAuthQuery;
+      }
+      command.replace("$user", user);
+      command.replace("$domain", domain);
+
+      if(singleResultQuery(command, ret) != 0 || ret.size() == 0)
+      {
+         return Data::Empty;
+      }
    }
    
    DebugLog( << "Auth password is " << ret.front());
@@ -439,7 +604,7 @@ PostgreSqlDb::firstUserKey()
 
    if(mResult[UserTable] == 0)
    {
-      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL query returned no result");
       return Data::Empty;
    }
    
@@ -514,7 +679,7 @@ PostgreSqlDb::getTlsPeerIdentity( const AbstractDb::Key& key ) const
  
    if (result==0)
    {
-      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL query returned no result");
       return ret;
    }
 
@@ -555,7 +720,7 @@ PostgreSqlDb::firstTlsPeerIdentityKey()
 
    if(mResult[TlsPeerIdentityTable] == 0)
    {
-      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL query returned no result");
       return Data::Empty;
    }
 
@@ -651,7 +816,7 @@ PostgreSqlDb::dbReadRecord(const Table table,
 
    if (result == 0)
    {
-      ErrLog( << "PostgreSQL result failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL query returned no result");
       return false;
    }
    else
@@ -696,7 +861,7 @@ PostgreSqlDb::dbNextKey(const Table table, bool first)
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+         ErrLog( << "PostgreSQL query returned no result");
          return Data::Empty;
       }
    }
@@ -761,7 +926,7 @@ PostgreSqlDb::dbNextRecord(const Table table,
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+         ErrLog( << "PostgreSQL query returned no result");
          return false;
       }
    }
@@ -788,12 +953,18 @@ PostgreSqlDb::dbNextRecord(const Table table,
 bool 
 PostgreSqlDb::dbBeginTransaction(const Table table)
 {
+   // the rest of the transaction has to run on this connection too
+   pinConnection();
    Data command("SET SESSION CHARACTERISTICS AS TRANSACTION ISOLATION LEVEL REPEATABLE READ");
-   if(query(command, 0))
+   if(query(command, 0) == 0)
    {
       command = "BEGIN";
-      return query(command, 0);
+      if(query(command, 0) == 0)
+      {
+         return true;
+      }
    }
+   unpinConnection();
    return false;
 }
 
@@ -59,11 +59,31 @@ class PostgreSqlDb: public SqlDb
                                 bool first=false);  // return false if no more
       virtual bool dbBeginTransaction(const Table table);
 
+      class PostgreSqlConnection : public Connection
+      {
+         public:
+            PostgreSqlConnection();
+            virtual ~PostgreSqlConnection();
+            void close();
+
+            PGconn* mConn;
+            bool mPrepared[MaxStatement];  // prepared when first used
+      };
+      static const unsigned int MaxStatementParams = 3;
+
       void initialize() const;
-      void disconnectFromDatabase() const;
-      int connectToDatabase() const;
+      virtual Connection* createConnection() const;
+      virtual int connectToDatabase(Connection& connection) const;
       int query(const resip::Data& queryCommand, PGresult** result) const;
       virtual int query(const resip::Data& queryCommand) const;
+      resip::Data statementText(Statement statement) const;
+      virtual int preparedQuery(Statement statement,
+                                const std::vector<resip::Data>& params,
+                                std::vector<resip::Data>* rows) const;
+      int executeStatement(PostgreSqlConnection& conn, Statement statement,
+                           const std::vector<resip::Data>& params,
+                           std::vector<resip::Data>* rows) const;
+      virtual int replaceSiloRows(const resip::Data& keys, const resip::Data& rows) const;
       resip::Data& escapeString(const resip::Data& str, resip::Data& escapedStr) const;
 
       resip::Data mDBConnInfo;
@@ -74,7 +94,6 @@ class PostgreSqlDb: public SqlDb
       unsigned int mDBPort;
       resip::Data mCustomUserAuthQuery;
 
-      mutable PGconn* mConn;
       mutable PGresult* mResult[MaxTable];
       mutable int mRow[MaxTable];
 
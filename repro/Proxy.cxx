@@ -19,6 +19,7 @@
 #include "rutil/Inserter.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
+#include <memory>
 #include <utility>
 
 #define RESIPROCATE_SUBSYSTEM resip::Subsystem::REPRO
@@ -540,7 +541,10 @@ Proxy::processUnknownMessage(Message* msg)
 void
 Proxy::send(const SipMessage& msg) 
 {
-   mStack.send(msg, this);
+   // The copy only lives as long as its transaction; have it share msg's
+   // receive buffers, so that whatever we forward unchanged is sent
+   // straight out of them
+   mStack.send(std::unique_ptr<SipMessage>(new SipMessage(msg, SipMessage::ShareReceiveBuffers)), this);
 }
 
 void
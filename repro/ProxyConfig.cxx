@@ -44,6 +44,8 @@ ProxyConfig::createDataStore(AbstractDb* db, AbstractDb* runtimedb)
 {
    resip_assert(db);
    mStore = new Store(*db, runtimedb);
+   mStore->mUserStore.configureAuthCache(getConfigUnsignedLong("UserAuthCacheTTL", 60),
+                                         getConfigUnsignedLong("UserAuthCacheMaxEntries", 100000));
 }
 
 }
@@ -24,12 +24,16 @@ using namespace std;
 RegSyncClient::RegSyncClient(InMemorySyncRegDb* regDb,
                              Data address,
                              unsigned short port,
-                             InMemorySyncPubDb* pubDb) :
+                             InMemorySyncPubDb* pubDb,
+                             bool binary) :
    mRegDb(regDb),
    mPubDb(pubDb),
    mAddress(address),
    mPort(port),
-   mSocketDesc(0)
+   mSocketDesc(0),
+   mBinaryRequested(binary),
+   mBinary(false),
+   mLastSequence(0)
 {
     resip_assert(mRegDb);
 }
@@ -121,12 +125,31 @@ RegSyncClient::thread()
          continue;
       }
 
+      // Servers that don't know the binary encoding ignore everything after
+      // <Version> and answer in XML
+      Data binaryRequest;
+      if(mBinaryRequested)
+      {
+         binaryRequest = "     <Binary>" + Data(RegSyncCodec::Version) + "</Binary>\r\n";
+         if(RegSyncCodec::compressionSupported())
+         {
+            binaryRequest += "     <Compression>zlib</Compression>\r\n";
+         }
+         if(!mServerEpoch.empty())
+         {
+            binaryRequest += "     <Epoch>" + mServerEpoch + "</Epoch>\r\n"
+                             "     <Sequence>" + Data(mLastSequence) + "</Sequence>\r\n";
+         }
+      }
       Data request(
          "<InitialSync>\r\n"
          "  <Request>\r\n"
          "     <Version>" + Data(REGSYNC_VERSION) + "</Version>\r\n"   // For use in detecting if client/server are a compatible version
+         + binaryRequest +
          "  </Request>\r\n"
          "</InitialSync>\r\n");   
+      mRxDataBuffer.clear();
+      mBinary = false;
       rc = ::send(mSocketDesc, request.c_str(), (int)request.size(), 0);
       if(rc < 0) 
       {
@@ -177,7 +200,7 @@ RegSyncClient::thread()
          }
          else if(rc == 0) // timeout - send keepalive
          {
-            rc = ::send(mSocketDesc, Symbols::CRLFCRLF, (int)request.size(), 0);
+            rc = ::send(mSocketDesc, Symbols::CRLFCRLF, (int)strlen(Symbols::CRLFCRLF), 0);
             if(rc < 0) 
             {
                int e = getErrno();
@@ -204,6 +227,12 @@ RegSyncClient::thread()
              break;
          }
       }
+      if(mSocketDesc && !mShutdown)
+      {
+         // closed by the server, or by us after a bad binary frame
+         closeSocket(mSocketDesc);
+         mSocketDesc = 0;
+      }
    } // end while
 
    if(mSocketDesc) closeSocket(mSocketDesc);
@@ -212,6 +241,12 @@ RegSyncClient::thread()
 bool 
 RegSyncClient::tryParse()
 {
+   if(mBinary)
+   {
+      tryParseBinary();
+      return false;
+   }
+
    ParseBuffer pb(mRxDataBuffer);
    Data initialTag;
    const char* start = pb.position();
@@ -264,7 +299,7 @@ RegSyncClient::handleXml(const Data& xmlData)
       if(isEqualNoCase(xml.getTag(), "InitialSync"))
       {
          // Must be an InitialSync response
-         InfoLog(<< "RegSyncClient::handleXml: InitialSync complete.");
+         handleInitialSyncResponse(xml);
       }
       else if(isEqualNoCase(xml.getTag(), "reginfo"))
       {
@@ -299,6 +334,197 @@ RegSyncClient::handleXml(const Data& xmlData)
    }
 }
 
+void
+RegSyncClient::handleInitialSyncResponse(resip::XMLCursor& xml)
+{
+   unsigned int binaryVersion = 0;
+   Data epoch;
+   UInt64 sequence = 0;
+   bool resumed = false;
+   if(xml.firstChild())
+   {
+      do
+      {
+         if(isEqualNoCase(xml.getTag(), "response") && xml.firstChild())
+         {
+            do
+            {
+               if(isEqualNoCase(xml.getTag(), "binary"))
+               {
+                  if(xml.firstChild())
+                  {
+                     binaryVersion = xml.getValue().convertUnsignedLong();
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "epoch"))
+               {
+                  if(xml.firstChild())
+                  {
+                     epoch = xml.getValue();
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "sequence"))
+               {
+                  if(xml.firstChild())
+                  {
+                     sequence = xml.getValue().convertUInt64();
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "resumed"))
+               {
+                  if(xml.firstChild())
+                  {
+                     resumed = isEqualNoCase(xml.getValue(), "true");
+                     xml.parent();
+                  }
+               }
+            } while(xml.nextSibling());
+            xml.parent();
+         }
+      } while(xml.nextSibling());
+      xml.parent();
+   }
+
+   if(mBinaryRequested && binaryVersion == RegSyncCodec::Version)
+   {
+      // everything after this response is binary frames
+      mBinary = true;
+      mServerEpoch = epoch;
+      mLastSequence = sequence;
+      if(resumed)
+      {
+         InfoLog(<< "RegSyncClient::handleInitialSyncResponse: resuming binary sync after change " << sequence);
+      }
+      else
+      {
+         InfoLog(<< "RegSyncClient::handleInitialSyncResponse: binary InitialSync started.");
+      }
+   }
+   else
+   {
+      InfoLog(<< "RegSyncClient::handleXml: InitialSync complete.");
+   }
+}
+
+void
+RegSyncClient::tryParseBinary()
+{
+   Data::size_type offset = 0;
+   RegSyncCodec::FrameType type;
+   UInt8 flags;
+   Data::size_type frameSize;
+   RegSyncCodec::HeaderStatus status;
+   while((status = RegSyncCodec::decodeFrameHeader(mRxDataBuffer.data() + offset, mRxDataBuffer.size() - offset,
+                                                   type, flags, frameSize)) == RegSyncCodec::HeaderComplete)
+   {
+      if(!handleFrame(type, flags, mRxDataBuffer.data() + offset + RegSyncCodec::HeaderSize,
+                      frameSize - RegSyncCodec::HeaderSize))
+      {
+         ErrLog(<< "RegSyncClient::tryParseBinary: bad frame of type " << (int)type << ", reconnecting");
+         resync();
+         return;
+      }
+      offset += frameSize;
+   }
+   if(status == RegSyncCodec::HeaderMalformed)
+   {
+      ErrLog(<< "RegSyncClient::tryParseBinary: malformed frame header, reconnecting");
+      resync();
+      return;
+   }
+   if(offset > 0)
+   {
+      mRxDataBuffer = mRxDataBuffer.substr(offset);
+   }
+}
+
+void
+RegSyncClient::resync()
+{
+   // Can't trust anything after this; start over with a full sync
+   mServerEpoch.clear();
+   mRxDataBuffer.clear();
+#ifdef WIN32
+   ::shutdown(mSocketDesc, SD_BOTH);
+#else
+   ::shutdown(mSocketDesc, SHUT_RDWR);
+#endif
+}
+
+bool
+RegSyncClient::handleFrame(RegSyncCodec::FrameType type, UInt8 flags, const char* data, Data::size_type size)
+{
+   Data inflated;
+   if(flags & RegSyncCodec::Compressed)
+   {
+      if(!RegSyncCodec::uncompress(data, size, inflated))
+      {
+         return false;
+      }
+      data = inflated.data();
+      size = inflated.size();
+   }
+
+   RegSyncCodec::Reader reader(data, size);
+   UInt64 now = Timer::getTimeSecs();
+   UInt64 serverNow = 0;
+   UInt64 first = 0;
+   UInt64 count = 0;
+   switch(type)
+   {
+      case RegSyncCodec::ContactBatch:
+         if(!reader.readVarint(serverNow) || !reader.readVarint(first) || !reader.readVarint(count))
+         {
+            return false;
+         }
+         if(first != mLastSequence + 1)
+         {
+            // changes were lost (or replayed); what we hold can't be patched up
+            WarningLog(<< "RegSyncClient::handleFrame: expected change " << mLastSequence + 1 << ", got " << first);
+            return false;
+         }
+         mLastSequence = first + count - 1;
+         break;
+      case RegSyncCodec::Snapshot:
+         if(!reader.readVarint(serverNow) || !reader.readVarint(count))
+         {
+            return false;
+         }
+         break;
+      case RegSyncCodec::SnapshotDone:
+         if(!reader.readVarint(count))
+         {
+            return false;
+         }
+         InfoLog(<< "RegSyncClient::handleFrame: InitialSync complete, " << count << " aors.");
+         return true;
+      case RegSyncCodec::XmlEvent:
+         handleXml(Data(data, size));
+         return true;
+      default:
+         DebugLog(<< "RegSyncClient::handleFrame: ignoring frame of unknown type " << (int)type);
+         return true;
+   }
+
+   for(UInt64 i = 0; i < count; i++)
+   {
+      Uri aor;
+      ContactList contacts;
+      if(!reader.readAor(aor, contacts, serverNow, now))
+      {
+         return false;
+      }
+      if(mRegDb && !contacts.empty())
+      {
+         processModify(aor, contacts);
+      }
+   }
+   return reader.atEnd();
+}
+
 void 
 RegSyncClient::handleRegInfoEvent(resip::XMLCursor& xml)
 {
@@ -435,7 +661,7 @@ RegSyncClient::processModify(const resip::Uri& aor, ContactList& syncContacts)
    mRegDb->lockRecord(aor);
    mRegDb->getContacts(aor, currentContacts);
 
-   InfoLog(<< "RegSyncClient::processModify: for aor=" << aor << 
+   DebugLog(<< "RegSyncClient::processModify: for aor=" << aor << 
               ", numSyncContacts=" << syncContacts.size() << 
               ", numCurrentContacts=" << currentContacts.size());
 
@@ -445,7 +671,7 @@ RegSyncClient::processModify(const resip::Uri& aor, ContactList& syncContacts)
    bool found;
    for(; itSync != syncContacts.end(); itSync++)
    {
-      InfoLog(<< "  RegSyncClient::processModify: contact=" << itSync->mContact << ", instance=" << itSync->mInstance << ", regid=" << itSync->mRegId);
+      DebugLog(<< "  RegSyncClient::processModify: contact=" << itSync->mContact << ", instance=" << itSync->mInstance << ", regid=" << itSync->mRegId);
 
       // See if contact already exists in currentContacts       
       found = false;
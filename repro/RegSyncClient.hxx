@@ -3,6 +3,7 @@
 
 #include <rutil/Data.hxx>
 #include <rutil/XMLCursor.hxx>
+#include "repro/RegSyncCodec.hxx"
 #include <resip/dum/InMemorySyncRegDb.hxx>
 #include <resip/dum/InMemorySyncPubDb.hxx>
 #include <rutil/ThreadIf.hxx>
@@ -13,10 +14,13 @@ namespace repro
 class RegSyncClient : public resip::ThreadIf
 {
 public:
+   /// binary: ask the server for the binary encoding (see RegSyncCodec),
+   /// falling back to XML if it does not support it
    RegSyncClient(resip::InMemorySyncRegDb* regDb,
                  resip::Data address,
                  unsigned short port,
-                 resip::InMemorySyncPubDb* pubDb = 0);
+                 resip::InMemorySyncPubDb* pubDb = 0,
+                 bool binary = true);
 
    virtual void thread();
    virtual void shutdown();
@@ -24,7 +28,11 @@ public:
 private: 
    void delaySeconds(unsigned int seconds);
    bool tryParse();  // returns true if we processed something and there is more data in the buffer
+   void tryParseBinary();
+   void resync();  // drops the connection; the next one starts with a full sync
+   bool handleFrame(RegSyncCodec::FrameType type, UInt8 flags, const char* data, resip::Data::size_type size);
    void handleXml(const resip::Data& xmlData);
+   void handleInitialSyncResponse(resip::XMLCursor& xml);
    void handleRegInfoEvent(resip::XMLCursor& xml);
    void handlePubInfoEvent(resip::XMLCursor& xml);
    void processModify(const resip::Uri& aor, resip::ContactList& syncContacts);
@@ -33,9 +41,14 @@ private:
    resip::InMemorySyncPubDb* mPubDb;
    resip::Data mAddress;
    unsigned short mPort;
-   char mRxBuffer[8000];
+   char mRxBuffer[65536];
    resip::Data mRxDataBuffer;
    int mSocketDesc;
+
+   bool mBinaryRequested;
+   bool mBinary;                 // the current connection has switched to binary
+   resip::Data mServerEpoch;     // where we are in the server's changes, for resuming
+   UInt64 mLastSequence;
 };
 
 }
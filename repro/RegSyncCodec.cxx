@@ -0,0 +1,363 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <resip/stack/Tuple.hxx>
+#include <rutil/ResipAssert.h>
+#include <rutil/Data.hxx>
+#include <rutil/Logger.hxx>
+
+#include "repro/RegSyncCodec.hxx"
+#include <rutil/WinLeakCheck.hxx>
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
+
+bool
+RegSyncCodec::compressionSupported()
+{
+#ifdef USE_ZLIB
+   return true;
+#else
+   return false;
+#endif
+}
+
+void
+RegSyncCodec::encodeVarint(Data& out, UInt64 value)
+{
+   char buf[10];
+   int n = 0;
+   while(value >= 0x80)
+   {
+      buf[n++] = (char)(value | 0x80);
+      value >>= 7;
+   }
+   buf[n++] = (char)value;
+   out.append(buf, n);
+}
+
+void
+RegSyncCodec::encodeString(Data& out, const Data& value)
+{
+   encodeVarint(out, value.size());
+   out.append(value.data(), value.size());
+}
+
+bool
+RegSyncCodec::encodeAor(Data& out, const Uri& aor, const ContactList& contacts)
+{
+   UInt64 count = 0;
+   ContactList::const_iterator cit = contacts.begin();
+   for(; cit != contacts.end(); cit++)
+   {
+      if(!cit->mReceivedFrom.onlyUseExistingConnection &&
+         cit->mRegExpires != NeverExpire)  // Don't sync over static registrations
+      {
+         count++;
+      }
+   }
+   if(count == 0)
+   {
+      return false;
+   }
+
+   encodeString(out, Data::from(aor));
+   encodeVarint(out, count);
+   Data token;
+   for(cit = contacts.begin(); cit != contacts.end(); cit++)
+   {
+      const ContactInstanceRecord& rec = *cit;
+      if(rec.mReceivedFrom.onlyUseExistingConnection || rec.mRegExpires == NeverExpire)
+      {
+         continue;
+      }
+      encodeString(out, Data::from(rec.mContact));
+      encodeVarint(out, rec.mRegExpires);
+      encodeVarint(out, rec.mLastUpdated);
+      token.clear();
+      if(rec.mReceivedFrom.getPort() != 0)
+      {
+         Tuple::writeBinaryToken(rec.mReceivedFrom, token);
+      }
+      encodeString(out, token);
+      token.clear();
+      if(rec.mPublicAddress.getType() != UNKNOWN_TRANSPORT)
+      {
+         Tuple::writeBinaryToken(rec.mPublicAddress, token);
+      }
+      encodeString(out, token);
+      encodeVarint(out, rec.mSipPath.size());
+      for(NameAddrs::const_iterator naIt = rec.mSipPath.begin(); naIt != rec.mSipPath.end(); naIt++)
+      {
+         encodeString(out, Data::from(naIt->uri()));
+      }
+      encodeString(out, rec.mInstance);
+      encodeVarint(out, rec.mRegId);
+      encodeString(out, rec.mUserAgent);
+   }
+   return true;
+}
+
+Data::size_type
+RegSyncCodec::startFrame(Data& out, FrameType type)
+{
+   Data::size_type start = out.size();
+   const char header[HeaderSize] = { 0, 0, 0, 0, (char)type, 0 };
+   out.append(header, HeaderSize);
+   return start;
+}
+
+void
+RegSyncCodec::finishFrame(Data& out, Data::size_type start, bool compress)
+{
+#ifdef USE_ZLIB
+   Data::size_type payloadSize = out.size() - start - HeaderSize;
+   if(compress && payloadSize > 0)
+   {
+      uLongf deflatedSize = compressBound((uLong)payloadSize);
+      Data deflated;
+      if(compress2((Bytef*)deflated.getBuf((Data::size_type)deflatedSize), &deflatedSize,
+                   (const Bytef*)out.data() + start + HeaderSize, (uLong)payloadSize, Z_BEST_SPEED) == Z_OK &&
+         deflatedSize + 10 < payloadSize)
+      {
+         // the uncompressed size goes first, so the reader can size its buffer
+         out.truncate2(start + HeaderSize);
+         encodeVarint(out, payloadSize);
+         out.append(deflated.data(), (Data::size_type)deflatedSize);
+         out[start + 5] = (char)Compressed;
+      }
+   }
+#endif
+   Data::size_type length = out.size() - start - 4;
+   resip_assert(length <= MaxFrameSize);
+   out[start] = (char)(length >> 24);
+   out[start + 1] = (char)(length >> 16);
+   out[start + 2] = (char)(length >> 8);
+   out[start + 3] = (char)length;
+}
+
+RegSyncCodec::HeaderStatus
+RegSyncCodec::decodeFrameHeader(const char* data, Data::size_type size,
+                                FrameType& type, UInt8& flags, Data::size_type& frameSize)
+{
+   if(size < HeaderSize)
+   {
+      return HeaderIncomplete;
+   }
+   const unsigned char* p = (const unsigned char*)data;
+   UInt32 length = ((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) | ((UInt32)p[2] << 8) | p[3];
+   if(length < HeaderSize - 4 || length > MaxFrameSize)
+   {
+      return HeaderMalformed;
+   }
+   frameSize = (Data::size_type)length + 4;
+   if(size < frameSize)
+   {
+      return HeaderIncomplete;
+   }
+   type = (FrameType)p[4];
+   flags = p[5];
+   return HeaderComplete;
+}
+
+bool
+RegSyncCodec::uncompress(const char* data, Data::size_type size, Data& payload)
+{
+#ifdef USE_ZLIB
+   Reader reader(data, size);
+   UInt64 payloadSize;
+   if(!reader.readVarint(payloadSize) || payloadSize > MaxFrameSize * 64)
+   {
+      return false;
+   }
+
+   uLongf uncompressedSize = (uLongf)payloadSize;
+   if(::uncompress((Bytef*)payload.getBuf((Data::size_type)payloadSize), &uncompressedSize,
+                   (const Bytef*)reader.position(), (uLong)reader.remaining()) != Z_OK ||
+      uncompressedSize != payloadSize)
+   {
+      return false;
+   }
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool
+RegSyncCodec::Reader::readVarint(UInt64& value)
+{
+   value = 0;
+   for(unsigned int shift = 0; shift < 64 && mPos < mEnd; shift += 7)
+   {
+      unsigned char c = (unsigned char)*mPos++;
+      value |= (UInt64)(c & 0x7F) << shift;
+      if(!(c & 0x80))
+      {
+         return true;
+      }
+   }
+   mPos = mEnd;
+   return false;
+}
+
+bool
+RegSyncCodec::Reader::readString(Data& value)
+{
+   UInt64 size;
+   if(!readVarint(size) || size > (UInt64)(mEnd - mPos))
+   {
+      mPos = mEnd;
+      return false;
+   }
+   value = Data(mPos, (Data::size_type)size);
+   mPos += size;
+   return true;
+}
+
+bool
+RegSyncCodec::Reader::readAor(Uri& aor, ContactList& contacts, UInt64 serverNow, UInt64 now)
+{
+   Data value;
+   UInt64 count;
+   if(!readString(value) || !readVarint(count))
+   {
+      return false;
+   }
+   bool aorOk = true;
+   try
+   {
+      aor = Uri(value);
+   }
+   catch(BaseException& e)
+   {
+      WarningLog(<< "RegSyncCodec: skipping unparseable aor " << value << ": " << e);
+      aorOk = false;
+   }
+   for(UInt64 i = 0; i < count; i++)
+   {
+      ContactInstanceRecord rec;
+      Data contact;
+      UInt64 expires;
+      UInt64 lastUpdated;
+      UInt64 pathCount;
+      UInt64 regId;
+      if(!readString(contact) || !readVarint(expires) || !readVarint(lastUpdated))
+      {
+         return false;
+      }
+      // expired or removed contacts come across as 0, as in the XML events
+      rec.mRegExpires = (expires <= serverNow) ? 0 : now + (expires - serverNow);
+      rec.mLastUpdated = (lastUpdated >= serverNow) ? now :
+                         (serverNow - lastUpdated > now) ? 0 : now - (serverNow - lastUpdated);
+      if(!readString(value))
+      {
+         return false;
+      }
+      if(!value.empty())
+      {
+         rec.mReceivedFrom = Tuple::makeTupleFromBinaryToken(value);
+      }
+      if(!readString(value))
+      {
+         return false;
+      }
+      if(!value.empty())
+      {
+         rec.mPublicAddress = Tuple::makeTupleFromBinaryToken(value);
+      }
+      if(!readVarint(pathCount))
+      {
+         return false;
+      }
+      bool ok = aorOk;
+      for(UInt64 p = 0; p < pathCount; p++)
+      {
+         if(!readString(value))
+         {
+            return false;
+         }
+         try
+         {
+            rec.mSipPath.push_back(NameAddr(value));
+         }
+         catch(BaseException& e)
+         {
+            WarningLog(<< "RegSyncCodec: skipping contact with unparseable path " << value << ": " << e);
+            ok = false;
+         }
+      }
+      if(!readString(rec.mInstance) || !readVarint(regId) || !readString(rec.mUserAgent))
+      {
+         return false;
+      }
+      rec.mRegId = (UInt32)regId;
+      rec.mSyncContact = true;  // This ContactInstanceRecord came from registration sync process
+      try
+      {
+         rec.mContact = NameAddr(contact);
+      }
+      catch(BaseException& e)
+      {
+         WarningLog(<< "RegSyncCodec: skipping unparseable contact " << contact << ": " << e);
+         ok = false;
+      }
+      if(ok)
+      {
+         contacts.push_back(rec);
+      }
+   }
+   return true;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
@@ -0,0 +1,148 @@
+#if !defined(RegSyncCodec_hxx)
+#define RegSyncCodec_hxx
+
+#include <rutil/Data.hxx>
+#include <resip/stack/Uri.hxx>
+#include <resip/dum/ContactInstanceRecord.hxx>
+
+namespace repro
+{
+
+/**
+   Binary encoding used between RegSyncServer and RegSyncClient once both
+   sides have agreed on it in the InitialSync exchange, in place of the
+   <reginfo> XML events.
+
+   Every frame starts with a 6 byte header: the length of the rest of the
+   frame (4 bytes, network order), the frame type and a flags byte.
+   Integers in the payload are varints (7 bits per byte, least significant
+   first) and strings are a varint length followed by the bytes.
+
+   ContactBatch   server time, first sequence number, count, AOR records
+   Snapshot       server time, count, AOR records (part of the initial sync)
+   SnapshotDone   number of AORs sent in the initial sync
+   XmlEvent       an XML event (<pubinfo>) as it would be sent in XML mode
+
+   An AOR record is the AOR followed by its contacts. Times are absolute
+   on the server's clock; the server time in the frame lets the client
+   convert them to its own, the way the relative times of the XML events
+   do. Snapshot payloads may be deflated (Compressed flag) when both ends
+   are built with zlib.
+*/
+class RegSyncCodec
+{
+public:
+   static const unsigned int Version = 1;  // bump when the encoding changes
+   static const unsigned int HeaderSize = 6;
+   static const unsigned int MaxFrameSize = 0xFFFFFF;  // so the first byte of a frame is always 0
+   static const UInt8 Compressed = 0x01;
+
+   typedef enum
+   {
+      ContactBatch = 1,
+      Snapshot = 2,
+      SnapshotDone = 3,
+      XmlEvent = 4
+   } FrameType;
+
+   typedef enum
+   {
+      HeaderIncomplete,  // wait for more data
+      HeaderComplete,    // the whole frame is there
+      HeaderMalformed    // length out of range; drop the connection
+   } HeaderStatus;
+
+   static bool compressionSupported();
+
+   /// appends one AOR and its replicated contacts; false (and nothing
+   /// appended) if none of the contacts are replicated
+   static bool encodeAor(resip::Data& out, const resip::Uri& aor, const resip::ContactList& contacts);
+
+   /// starts a frame at the end of out; returns where it starts, for finishFrame()
+   static resip::Data::size_type startFrame(resip::Data& out, FrameType type);
+   /// fills in the length of the frame started at start; if compress is set
+   /// and compression is supported, deflates the payload first
+   static void finishFrame(resip::Data& out, resip::Data::size_type start, bool compress=false);
+
+   static void encodeVarint(resip::Data& out, UInt64 value);
+   static void encodeString(resip::Data& out, const resip::Data& value);
+
+   /// reads the header at data; HeaderComplete if size covers the whole
+   /// frame, frameSize then being the size of the frame including the
+   /// header. A length below the header or above MaxFrameSize is
+   /// HeaderMalformed as soon as the header is in, rather than waiting
+   /// for a frame that will never fit.
+   static HeaderStatus decodeFrameHeader(const char* data, resip::Data::size_type size,
+                                         FrameType& type, UInt8& flags, resip::Data::size_type& frameSize);
+   /// false if the compressed payload is corrupt
+   static bool uncompress(const char* data, resip::Data::size_type size, resip::Data& payload);
+
+   /// Walks a payload; every read fails once the payload is exhausted or corrupt
+   class Reader
+   {
+   public:
+      Reader(const char* data, resip::Data::size_type size) : mPos(data), mEnd(data + size) {}
+
+      bool atEnd() const { return mPos == mEnd; }
+      const char* position() const { return mPos; }
+      resip::Data::size_type remaining() const { return (resip::Data::size_type)(mEnd - mPos); }
+      bool readVarint(UInt64& value);
+      bool readString(resip::Data& value);
+      /// reads an AOR record, converting its times from serverNow to now;
+      /// contacts that do not parse are left out, as are all of them if
+      /// the AOR does not
+      bool readAor(resip::Uri& aor, resip::ContactList& contacts, UInt64 serverNow, UInt64 now);
+
+   private:
+      const char* mPos;
+      const char* mEnd;
+   };
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
@@ -10,13 +10,16 @@
 #include <rutil/Data.hxx>
 #include <rutil/DnsUtil.hxx>
 #include <rutil/Logger.hxx>
+#include <rutil/Lock.hxx>
 #include <rutil/ParseBuffer.hxx>
+#include <rutil/Random.hxx>
 #include <rutil/Socket.hxx>
 #include <rutil/TransportType.hxx>
 #include <rutil/Timer.hxx>
 
 #include "repro/XmlRpcServerBase.hxx"
 #include "repro/XmlRpcConnection.hxx"
+#include "repro/RegSyncCodec.hxx"
 #include "repro/RegSyncServer.hxx"
 
 using namespace repro;
@@ -32,7 +35,17 @@ RegSyncServer::RegSyncServer(resip::InMemorySyncRegDb* regDb,
                              resip::InMemorySyncPubDb* pubDb) :
    XmlRpcServerBase(port, version),
    mRegDb(regDb),
-   mPubDb(pubDb)
+   mPubDb(pubDb),
+   mBinaryEnabled(true),
+   mEpoch(Random::getRandomHex(8)),
+   mBacklogSize(DefaultBacklogSize),
+   mSequence(0),
+   mBatchFirstSequence(0),
+   mBatchCount(0),
+   mSnapshotConnectionId(0),
+   mSnapshotCompress(false),
+   mSnapshotCount(0),
+   mSnapshotTotal(0)
 {
    if (mRegDb)
    {
@@ -49,7 +62,17 @@ RegSyncServer::RegSyncServer(resip::InMemorySyncRegDb* regDb,
                              resip::InMemorySyncPubDb* pubDb) :
    XmlRpcServerBase(brokerQueue),
    mRegDb(regDb),
-   mPubDb(pubDb)
+   mPubDb(pubDb),
+   mBinaryEnabled(false),  // there are no connections to switch
+   mEpoch(Random::getRandomHex(8)),
+   mBacklogSize(0),
+   mSequence(0),
+   mBatchFirstSequence(0),
+   mBatchCount(0),
+   mSnapshotConnectionId(0),
+   mSnapshotCompress(false),
+   mSnapshotCount(0),
+   mSnapshotTotal(0)
 {
    if (mRegDb)
    {
@@ -78,12 +101,13 @@ RegSyncServer::sendResponse(unsigned int connectionId,
                            unsigned int requestId, 
                            const Data& responseData, 
                            unsigned int resultCode, 
-                           const Data& resultText)
+                           const Data& resultText,
+                           bool startBinary)
 {
    std::stringstream ss;
    ss << Symbols::CRLF << responseData << "    <Result Code=\"" << resultCode << "\"";
    ss << ">" << resultText.xmlCharDataEncode() << "</Result>" << Symbols::CRLF;
-   XmlRpcServerBase::sendResponse(connectionId, requestId, ss.str().c_str(), resultCode >= 200 /* isFinal */);
+   XmlRpcServerBase::sendResponse(connectionId, requestId, ss.str().c_str(), resultCode >= 200 /* isFinal */, startBinary);
 }
 
 void 
@@ -199,7 +223,7 @@ RegSyncServer::sendDocumentModifiedEvent(unsigned int connectionId, const Data&
    }
    ss << "</pubinfo>" << Symbols::CRLF;
 
-   sendEvent(connectionId, ss.str().c_str());
+   sendXmlEvent(connectionId, ss.str().c_str());
 }
 
 void 
@@ -216,7 +240,7 @@ RegSyncServer::sendDocumentRemovedEvent(unsigned int connectionId, const Data& e
    ss << "   <lastupdate>" << now - lastUpdated << "</lastupdate>" << Symbols::CRLF;
    ss << "</pubinfo>" << Symbols::CRLF;
 
-   sendEvent(connectionId, ss.str().c_str());
+   sendXmlEvent(connectionId, ss.str().c_str());
 }
 
 void 
@@ -251,29 +275,72 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
 {
    InfoLog(<< "RegSyncServer::handleInitialSyncRequest");
 
-   // Check for correct Version
+   // Check for correct Version, and whether the client can take binary events
    unsigned int version = 0;
+   unsigned int binaryVersion = 0;
+   bool compress = false;
+   Data resumeEpoch;
+   UInt64 resumeSequence = 0;
    if(xml.firstChild())
    {
       if(isEqualNoCase(xml.getTag(), "request"))
       {
          if(xml.firstChild())
          {
-            if(isEqualNoCase(xml.getTag(), "version"))
+            do
             {
-               if(xml.firstChild())
+               if(isEqualNoCase(xml.getTag(), "version"))
                {
-                  version = xml.getValue().convertUnsignedLong();
-                  xml.parent();
+                  if(xml.firstChild())
+                  {
+                     version = xml.getValue().convertUnsignedLong();
+                     xml.parent();
+                  }
                }
-            }
+               else if(isEqualNoCase(xml.getTag(), "binary"))
+               {
+                  if(xml.firstChild())
+                  {
+                     binaryVersion = xml.getValue().convertUnsignedLong();
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "compression"))
+               {
+                  if(xml.firstChild())
+                  {
+                     compress = isEqualNoCase(xml.getValue(), "zlib") && RegSyncCodec::compressionSupported();
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "epoch"))
+               {
+                  if(xml.firstChild())
+                  {
+                     resumeEpoch = xml.getValue();
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "sequence"))
+               {
+                  if(xml.firstChild())
+                  {
+                     resumeSequence = xml.getValue().convertUInt64();
+                     xml.parent();
+                  }
+               }
+            } while(xml.nextSibling());
             xml.parent();
          }
       }
       xml.parent();
    }
 
-   if(version == REGSYNC_VERSION)
+   if(version == REGSYNC_VERSION && binaryVersion == RegSyncCodec::Version && mBinaryEnabled)
+   {
+      handleBinarySyncRequest(connectionId, requestId, compress, resumeEpoch, resumeSequence);
+   }
+   else if(version == REGSYNC_VERSION)
    {
       if (mRegDb)
       {
@@ -291,6 +358,196 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
    }
 }
 
+void
+RegSyncServer::handleBinarySyncRequest(unsigned int connectionId, unsigned int requestId, bool compress,
+                                       const Data& resumeEpoch, UInt64 resumeSequence)
+{
+   bool resumed;
+   {
+      Lock lock(mBinaryMutex);
+
+      // Everything numbered up to mSequence goes out before the switch, so
+      // the client is either sent it here or has it in the snapshot
+      flushBatch();
+      resumed = resumeEpoch == mEpoch &&
+                resumeSequence <= mSequence &&
+                (resumeSequence == mSequence ||
+                 (!mBacklog.empty() && mBacklog.front().first <= resumeSequence + 1));
+
+      std::stringstream ss;
+      ss << "    <Binary>" << RegSyncCodec::Version << "</Binary>" << Symbols::CRLF;
+      if(compress)
+      {
+         ss << "    <Compression>zlib</Compression>" << Symbols::CRLF;
+      }
+      ss << "    <Epoch>" << mEpoch << "</Epoch>" << Symbols::CRLF;
+      ss << "    <Sequence>" << (resumed ? resumeSequence : mSequence) << "</Sequence>" << Symbols::CRLF;
+      ss << "    <Resumed>" << (resumed ? "true" : "false") << "</Resumed>" << Symbols::CRLF;
+      sendResponse(connectionId, requestId, ss.str().c_str(), 200,
+                   resumed ? "Resumed." : "Initial Sync Started.", true /* startBinary */);
+
+      if(resumed)
+      {
+         InfoLog(<< "RegSyncServer::handleBinarySyncRequest: resuming connection " << connectionId
+                 << " from change " << resumeSequence << " of " << mSequence);
+         UInt64 now = Timer::getTimeSecs();
+         Backlog::const_iterator it = mBacklog.begin();
+         while(it != mBacklog.end() && it->first <= resumeSequence)
+         {
+            it++;
+         }
+         while(it != mBacklog.end())
+         {
+            Data frame;
+            Data::size_type start = RegSyncCodec::startFrame(frame, RegSyncCodec::ContactBatch);
+            Data records;
+            UInt64 first = it->first;
+            UInt64 count = 0;
+            for(; it != mBacklog.end() && records.size() < MaxBatchSize; it++, count++)
+            {
+               records += it->second;
+            }
+            RegSyncCodec::encodeVarint(frame, now);
+            RegSyncCodec::encodeVarint(frame, first);
+            RegSyncCodec::encodeVarint(frame, count);
+            frame += records;
+            RegSyncCodec::finishFrame(frame, start);
+            sendBinaryEvent(connectionId, frame);
+         }
+      }
+   }
+
+   if(!resumed)
+   {
+      InfoLog(<< "RegSyncServer::handleBinarySyncRequest: sending initial sync to connection " << connectionId
+              << (compress ? " (compressed)" : ""));
+      mSnapshotConnectionId = connectionId;
+      mSnapshotCompress = compress;
+      mSnapshotTotal = 0;
+      if (mRegDb)
+      {
+         mRegDb->initialSync(connectionId);
+      }
+      flushSnapshot();
+
+      Data frame;
+      Data::size_type start = RegSyncCodec::startFrame(frame, RegSyncCodec::SnapshotDone);
+      RegSyncCodec::encodeVarint(frame, mSnapshotTotal);
+      RegSyncCodec::finishFrame(frame, start);
+      sendBinaryEvent(connectionId, frame);
+   }
+
+   // Publications are not numbered, so a resumed client gets them all again
+   mSnapshotConnectionId = connectionId;
+   if (mPubDb)
+   {
+      mPubDb->initialSync(connectionId);
+   }
+   mSnapshotConnectionId = 0;
+}
+
+void
+RegSyncServer::flushSnapshot()
+{
+   if(mSnapshotCount == 0)
+   {
+      return;
+   }
+   Data frame(mSnapshot.size() + 32, Data::Preallocate);
+   Data::size_type start = RegSyncCodec::startFrame(frame, RegSyncCodec::Snapshot);
+   RegSyncCodec::encodeVarint(frame, Timer::getTimeSecs());
+   RegSyncCodec::encodeVarint(frame, mSnapshotCount);
+   frame += mSnapshot;
+   RegSyncCodec::finishFrame(frame, start, mSnapshotCompress);
+   sendBinaryEvent(mSnapshotConnectionId, frame);
+   mSnapshot.clear();
+   mSnapshotCount = 0;
+}
+
+void
+RegSyncServer::queueBinaryChange(const resip::Uri& aor, const ContactList& contacts)
+{
+   if(!mBinaryEnabled)
+   {
+      return;
+   }
+   Data record;
+   if(!RegSyncCodec::encodeAor(record, aor, contacts))
+   {
+      return;
+   }
+
+   Lock lock(mBinaryMutex);
+   UInt64 sequence = ++mSequence;
+   if(mBatchCount++ == 0)
+   {
+      mBatchFirstSequence = sequence;
+      wakeup();  // flushEvents() sends whatever has been added by the time it runs
+   }
+   mBatch += record;
+   if(mBacklogSize > 0)
+   {
+      mBacklog.push_back(std::make_pair(sequence, record));
+      while(mBacklog.size() > mBacklogSize)
+      {
+         mBacklog.pop_front();
+      }
+   }
+   if(mBatch.size() >= MaxBatchSize)
+   {
+      flushBatch();
+   }
+}
+
+void
+RegSyncServer::flushBatch()
+{
+   if(mBatchCount == 0)
+   {
+      return;
+   }
+   Data frame(mBatch.size() + 32, Data::Preallocate);
+   Data::size_type start = RegSyncCodec::startFrame(frame, RegSyncCodec::ContactBatch);
+   RegSyncCodec::encodeVarint(frame, Timer::getTimeSecs());
+   RegSyncCodec::encodeVarint(frame, mBatchFirstSequence);
+   RegSyncCodec::encodeVarint(frame, mBatchCount);
+   frame += mBatch;
+   RegSyncCodec::finishFrame(frame, start);
+   sendBinaryEvent(0, frame);
+   mBatch.clear();
+   mBatchCount = 0;
+}
+
+void
+RegSyncServer::flushEvents()
+{
+   Lock lock(mBinaryMutex);
+   flushBatch();
+}
+
+void
+RegSyncServer::sendXmlEvent(unsigned int connectionId, const Data& eventData)
+{
+   if(connectionId != 0 && connectionId != mSnapshotConnectionId)
+   {
+      // initial sync of an XML client
+      sendEvent(connectionId, eventData);
+      return;
+   }
+   if(mBinaryEnabled)
+   {
+      Data frame(eventData.size() + RegSyncCodec::HeaderSize, Data::Preallocate);
+      Data::size_type start = RegSyncCodec::startFrame(frame, RegSyncCodec::XmlEvent);
+      frame += eventData;
+      RegSyncCodec::finishFrame(frame, start);
+      sendBinaryEvent(connectionId, frame);
+   }
+   if(connectionId == 0 && hasTextReceivers())
+   {
+      sendEvent(0, eventData);
+   }
+}
+
 void 
 RegSyncServer::streamContactInstanceRecord(std::stringstream& ss, const ContactInstanceRecord& rec)
 {
@@ -336,12 +593,29 @@ RegSyncServer::streamContactInstanceRecord(std::stringstream& ss, const ContactI
 void 
 RegSyncServer::onAorModified(const resip::Uri& aor, const ContactList& contacts)
 {
-   sendRegistrationModifiedEvent(0, aor, contacts);
+   if(hasTextReceivers())
+   {
+      sendRegistrationModifiedEvent(0, aor, contacts);
+   }
+   queueBinaryChange(aor, contacts);
 }
 
 void 
 RegSyncServer::onInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts)
 {
+   if(connectionId == mSnapshotConnectionId)
+   {
+      if(RegSyncCodec::encodeAor(mSnapshot, aor, contacts))
+      {
+         mSnapshotCount++;
+         mSnapshotTotal++;
+         if(mSnapshot.size() >= SnapshotFrameSize)
+         {
+            flushSnapshot();
+         }
+      }
+      return;
+   }
    sendRegistrationModifiedEvent(connectionId, aor, contacts);
 }
 
@@ -1,7 +1,11 @@
 #if !defined(RegSyncServer_hxx)
 #define RegSyncServer_hxx 
 
+#include <deque>
+#include <utility>
+
 #include <rutil/Data.hxx>
+#include <rutil/Mutex.hxx>
 #include <rutil/TransportType.hxx>
 #include <rutil/XMLCursor.hxx>
 #include <resip/dum/InMemorySyncRegDb.hxx>
@@ -14,11 +18,25 @@ namespace repro
 {
 class RegSyncServer;
 
+/**
+   Sends the registrations (and publications) of this instance to the
+   RegSyncClient of a peer: all of them when the client connects and sends
+   InitialSync, and every change after that.
+
+   By default this is done with XML events. A client that asks for it in
+   its InitialSync request is switched to the binary encoding described in
+   RegSyncCodec instead: changes are numbered and sent in batches, and the
+   most recent ones are kept so that a client that reconnects can pick up
+   where it left off rather than being sent everything again. The initial
+   sync is sent in large, optionally compressed, frames.
+*/
 class RegSyncServer: public XmlRpcServerBase, 
                      public resip::InMemorySyncRegDbHandler,
                      public resip::InMemorySyncPubDbHandler
 {
 public:
+   static const unsigned int DefaultBacklogSize = 10000;
+
    RegSyncServer(resip::InMemorySyncRegDb* regDb,
                  int port, 
                  resip::IpVersion version,
@@ -28,12 +46,17 @@ public:
                  resip::InMemorySyncPubDb* pubDb = 0);
    virtual ~RegSyncServer();
 
+   /// number of changes kept for binary clients to catch up with after
+   /// reconnecting; set before the server is in use
+   void setBacklogSize(unsigned int changes) { mBacklogSize = changes; }
+
    // thread safe
    virtual void sendResponse(unsigned int connectionId, 
                              unsigned int requestId, 
                              const resip::Data& responseData, 
                              unsigned int resultCode, 
-                             const resip::Data& resultText);
+                             const resip::Data& resultText,
+                             bool startBinary = false);
 
    // Use connectionId == 0 to send to all connections
    virtual void sendRegistrationModifiedEvent(unsigned int connectionId, const resip::Uri& aor);
@@ -43,6 +66,7 @@ public:
 
 protected:
    virtual void handleRequest(unsigned int connectionId, unsigned int requestId, const resip::Data& request); 
+   virtual void flushEvents();
 
    // InMemorySyncRegDbHandler methods
    virtual void onAorModified(const resip::Uri& aor, const resip::ContactList& contacts);
@@ -54,11 +78,42 @@ protected:
    virtual void onInitialSyncDocument(unsigned int connectionId, const resip::Data& eventType, const resip::Data& documentKey, const resip::Data& eTag, UInt64 expirationTime, UInt64 lastUpdated, const resip::Contents* contents, const resip::SecurityAttributes* securityAttributes);
 
 private: 
+   static const unsigned int MaxBatchSize = 64 * 1024;
+   static const unsigned int SnapshotFrameSize = 256 * 1024;
+
    void handleInitialSyncRequest(unsigned int connectionId, unsigned int requestId, resip::XMLCursor& xml);
+   void handleBinarySyncRequest(unsigned int connectionId, unsigned int requestId, bool compress,
+                                const resip::Data& resumeEpoch, UInt64 resumeSequence);
    void streamContactInstanceRecord(std::stringstream& ss, const resip::ContactInstanceRecord& rec);
 
+   // sends an XML event to the connections it is for, framed for binary ones
+   void sendXmlEvent(unsigned int connectionId, const resip::Data& eventData);
+   void queueBinaryChange(const resip::Uri& aor, const resip::ContactList& contacts);
+   void flushBatch();  // caller holds mBinaryMutex
+   void flushSnapshot();
+
    resip::InMemorySyncRegDb* mRegDb;
    resip::InMemorySyncPubDb* mPubDb;
+
+   // binary mode; mEpoch identifies this run of the server, so that a client
+   // never resumes from a sequence number another run handed out
+   bool mBinaryEnabled;
+   const resip::Data mEpoch;
+   unsigned int mBacklogSize;
+   resip::Mutex mBinaryMutex;
+   UInt64 mSequence;               // of the last change
+   resip::Data mBatch;             // encoded changes not sent yet
+   UInt64 mBatchFirstSequence;
+   UInt64 mBatchCount;
+   typedef std::deque<std::pair<UInt64, resip::Data> > Backlog;
+   Backlog mBacklog;               // the last mBacklogSize changes, by sequence
+
+   // binary initial sync in progress; only used from the thread calling process()
+   unsigned int mSnapshotConnectionId;
+   bool mSnapshotCompress;
+   resip::Data mSnapshot;
+   UInt64 mSnapshotCount;          // AORs in mSnapshot
+   UInt64 mSnapshotTotal;
 };
 
 }
@@ -0,0 +1,451 @@
+#include <algorithm>
+#include <string.h>
+
+#include "repro/RegexRuleIndex.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+namespace
+{
+
+// Escapes that stand for the character itself in any regex flavour: the
+// ERE special characters
+const char LiteralEscapes[] = ".[]{}()*+?|^$\\";
+// Escapes GNU regex takes as anchors (word start and end, buffer start and
+// end); a pattern using them is not indexed
+const char GnuAnchors[] = "<>`'";
+
+bool
+isOneOf(char c, const char* set)
+{
+   return c != 0 && strchr(set, c) != 0;
+}
+
+// One atom of a pattern: a literal character, or anything else (marked by
+// literal being false), with the repetition that follows it
+class Atom
+{
+   public:
+      Atom(char c, bool literal) : mChar(c), mLiteral(literal), mRepeat(0) {}
+      char mChar;
+      bool mLiteral;
+      char mRepeat;  // 0, '*', '+', '?' or '{'
+};
+
+// Returns the index just past the bracket expression starting at pattern[i],
+// or npos if it is unterminated or contains a backslash (POSIX and PCRE
+// disagree on what that means inside brackets)
+Data::size_type
+skipBracket(const Data& pattern, Data::size_type i)
+{
+   const Data::size_type n = pattern.size();
+   i++;
+   if(i < n && pattern[i] == '^') i++;
+   if(i < n && pattern[i] == ']') i++;
+   while(i < n && pattern[i] != ']')
+   {
+      if(pattern[i] == '\\')
+      {
+         return Data::npos;
+      }
+      if(pattern[i] == '[' && i + 1 < n &&
+         (pattern[i + 1] == ':' || pattern[i + 1] == '.' || pattern[i + 1] == '='))
+      {
+         // [:class:], [.coll.] or [=equiv=]
+         const char term[3] = { pattern[i + 1], ']', 0 };
+         Data::size_type end = pattern.find(Data(term), i + 2);
+         if(end == Data::npos)
+         {
+            return Data::npos;
+         }
+         i = end + 2;
+         continue;
+      }
+      i++;
+   }
+   return i < n ? i + 1 : Data::npos;
+}
+
+// Returns the index just past the group starting at pattern[i], or npos if
+// it is unterminated or uses something parse() gives up on
+Data::size_type
+skipGroup(const Data& pattern, Data::size_type i)
+{
+   const Data::size_type n = pattern.size();
+   int depth = 0;
+   while(i < n)
+   {
+      switch(pattern[i])
+      {
+         case '\\':
+            if(i + 1 < n && isOneOf(pattern[i + 1], GnuAnchors))
+            {
+               return Data::npos;
+            }
+            i += 2;
+            continue;
+         case '[':
+            i = skipBracket(pattern, i);
+            if(i == Data::npos)
+            {
+               return Data::npos;
+            }
+            continue;
+         case '(':
+            if(i + 1 < n && pattern[i + 1] == '?')
+            {
+               return Data::npos;  // PCRE extension, may change flags such as (?i)
+            }
+            depth++;
+            break;
+         case ')':
+            if(--depth == 0)
+            {
+               return i + 1;
+            }
+            break;
+      }
+      i++;
+   }
+   return Data::npos;
+}
+
+// Splits pattern into atoms; false if it has an alternative at the top level
+// or anything else that would make its anchors or literals unreliable
+bool
+parse(const Data& pattern, bool& anchoredStart, bool& anchoredEnd, vector<Atom>& atoms)
+{
+   const Data::size_type n = pattern.size();
+   Data::size_type i = 0;
+   anchoredStart = n > 0 && pattern[0] == '^';
+   anchoredEnd = false;
+   if(anchoredStart)
+   {
+      i++;
+   }
+   while(i < n)
+   {
+      const char c = pattern[i];
+      switch(c)
+      {
+         case '$':
+            if(i == n - 1)
+            {
+               anchoredEnd = true;
+            }
+            else
+            {
+               atoms.push_back(Atom(c, false));
+            }
+            i++;
+            break;
+         case '\\':
+            if(i + 1 >= n)
+            {
+               return false;
+            }
+            if(isOneOf(pattern[i + 1], GnuAnchors))
+            {
+               return false;
+            }
+            // \. is a literal dot, but \d, \w and the like are classes to
+            // PCRE, and what other escapes mean depends on the regex library
+            atoms.push_back(Atom(pattern[i + 1], isOneOf(pattern[i + 1], LiteralEscapes)));
+            i += 2;
+            break;
+         case '[':
+            i = skipBracket(pattern, i);
+            if(i == Data::npos)
+            {
+               return false;
+            }
+            atoms.push_back(Atom(c, false));
+            break;
+         case '(':
+            i = skipGroup(pattern, i);
+            if(i == Data::npos)
+            {
+               return false;
+            }
+            atoms.push_back(Atom(c, false));
+            break;
+         case '|':
+            return false;
+         case '*':
+         case '+':
+         case '?':
+         case '{':
+            if(atoms.empty())
+            {
+               return false;
+            }
+            // a repeated repetition (a+?, a{2}*) is treated as optional
+            atoms.back().mRepeat = atoms.back().mRepeat ? '*' : c;
+            if(c == '{')
+            {
+               i = pattern.find("}", i);
+               if(i == Data::npos)
+               {
+                  return false;
+               }
+            }
+            i++;
+            break;
+         case '.':
+         case '^':
+         case ')':
+         case ']':
+         case '}':
+            atoms.push_back(Atom(c, false));
+            i++;
+            break;
+         default:
+            atoms.push_back(Atom(c, true));
+            i++;
+            break;
+      }
+   }
+   return true;
+}
+
+// Adds atom to literal; false once the literal cannot be extended past it
+bool
+extend(const Atom& atom, Data& literal)
+{
+   if(!atom.mLiteral || (atom.mRepeat != 0 && atom.mRepeat != '+'))
+   {
+      return false;
+   }
+   literal += atom.mChar;
+   return atom.mRepeat == 0;  // a+ guarantees one a, but not what follows it
+}
+
+}
+
+
+RegexRuleIndex::RegexRuleIndex()
+{
+}
+
+
+void
+RegexRuleIndex::clear()
+{
+   mBuckets.clear();
+   mPending.clear();
+}
+
+
+void
+RegexRuleIndex::getLiterals(const Data& pattern, Data& prefix, Data& suffix)
+{
+   prefix.clear();
+   suffix.clear();
+
+   bool anchoredStart;
+   bool anchoredEnd;
+   vector<Atom> atoms;
+   if(!parse(pattern, anchoredStart, anchoredEnd, atoms))
+   {
+      return;
+   }
+   if(anchoredStart)
+   {
+      for(vector<Atom>::const_iterator it = atoms.begin(); it != atoms.end() && extend(*it, prefix); ++it)
+      {
+      }
+   }
+   if(anchoredEnd)
+   {
+      Data reversed;
+      for(vector<Atom>::const_reverse_iterator it = atoms.rbegin(); it != atoms.rend() && extend(*it, reversed); ++it)
+      {
+      }
+      suffix.reserve(reversed.size());
+      for(Data::size_type i = reversed.size(); i > 0; i--)
+      {
+         suffix += reversed[i - 1];
+      }
+   }
+}
+
+
+Data
+RegexRuleIndex::bucketKey(const Data& method, const Data& event)
+{
+   Data key(method.size() + event.size() + 1, Data::Preallocate);
+   key += method;
+   key += '\n';
+   key += event;
+   key.lowercase();
+   return key;
+}
+
+
+void
+RegexRuleIndex::add(size_t position, const Data& method, const Data& event, const Data& pattern)
+{
+   mPending.push_back(PendingRule());
+   PendingRule& rule = mPending.back();
+   rule.mPosition = position;
+   rule.mBucket = bucketKey(method, event);
+   getLiterals(pattern, rule.mPrefix, rule.mSuffix);
+}
+
+
+void
+RegexRuleIndex::build()
+{
+   // A dial plan's rules tend to share a suffix (@example\.com$) and differ
+   // in their prefixes, or the other way round; file each rule under
+   // whichever of its literals fewer others have
+   HashMap<Data, size_t> prefixCounts;
+   HashMap<Data, size_t> suffixCounts;
+   for(vector<PendingRule>::const_iterator it = mPending.begin(); it != mPending.end(); ++it)
+   {
+      if(!it->mPrefix.empty())
+      {
+         prefixCounts[it->mPrefix]++;
+      }
+      if(!it->mSuffix.empty())
+      {
+         suffixCounts[it->mSuffix]++;
+      }
+   }
+
+   for(vector<PendingRule>::const_iterator it = mPending.begin(); it != mPending.end(); ++it)
+   {
+      Bucket& bucket = mBuckets[it->mBucket];
+      bool usePrefix = !it->mPrefix.empty();
+      if(usePrefix && !it->mSuffix.empty())
+      {
+         size_t prefixCount = prefixCounts[it->mPrefix];
+         size_t suffixCount = suffixCounts[it->mSuffix];
+         usePrefix = prefixCount < suffixCount ||
+                     (prefixCount == suffixCount && it->mPrefix.size() >= it->mSuffix.size());
+      }
+      if(usePrefix)
+      {
+         bucket.mPrefixes[it->mPrefix.size()][it->mPrefix].push_back(it->mPosition);
+      }
+      else if(!it->mSuffix.empty())
+      {
+         bucket.mSuffixes[it->mSuffix.size()][it->mSuffix].push_back(it->mPosition);
+      }
+      else
+      {
+         bucket.mUnindexed.push_back(it->mPosition);
+      }
+   }
+   mPending.clear();
+}
+
+
+void
+RegexRuleIndex::lookup(const LiteralsByLength& literals,
+                       const Data& subject,
+                       bool prefix,
+                       PositionList& positions)
+{
+   for(LiteralsByLength::const_iterator it = literals.begin();
+       it != literals.end() && it->first <= subject.size(); ++it)
+   {
+      Data probe(Data::Share,
+                 subject.data() + (prefix ? 0 : subject.size() - it->first),
+                 (Data::size_type)it->first);
+      LiteralMap::const_iterator found = it->second.find(probe);
+      if(found != it->second.end())
+      {
+         positions.insert(positions.end(), found->second.begin(), found->second.end());
+      }
+   }
+}
+
+
+void
+RegexRuleIndex::lookup(const Data& key, const Data& subject, PositionList& positions) const
+{
+   BucketMap::const_iterator it = mBuckets.find(key);
+   if(it == mBuckets.end())
+   {
+      return;
+   }
+   const Bucket& bucket = it->second;
+   positions.insert(positions.end(), bucket.mUnindexed.begin(), bucket.mUnindexed.end());
+   lookup(bucket.mPrefixes, subject, true, positions);
+   lookup(bucket.mSuffixes, subject, false, positions);
+}
+
+
+void
+RegexRuleIndex::candidates(const Data& method,
+                           const Data& event,
+                           const Data& subject,
+                           PositionList& positions) const
+{
+   const PositionList::size_type start = positions.size();
+
+   lookup(bucketKey(Data::Empty, Data::Empty), subject, positions);
+   if(!method.empty())
+   {
+      lookup(bucketKey(method, Data::Empty), subject, positions);
+   }
+   if(!event.empty())
+   {
+      lookup(bucketKey(Data::Empty, event), subject, positions);
+      if(!method.empty())
+      {
+         lookup(bucketKey(method, event), subject, positions);
+      }
+   }
+
+   // each rule sits in one place only, so there is nothing to dedupe
+   sort(positions.begin() + start, positions.end());
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
@@ -0,0 +1,141 @@
+#if !defined(REPRO_REGEXRULEINDEX_HXX)
+#define REPRO_REGEXRULEINDEX_HXX
+
+#include <map>
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/HashMap.hxx"
+
+namespace repro
+{
+
+/**
+   Narrows an ordered list of regex rules (routes or filters) down to the
+   ones that can possibly match a request, so that only those need to be
+   run through regexec().
+
+   Each rule is filed under its method and event (empty meaning any) and,
+   when its pattern is anchored, under the literal text a subject has to
+   start with (^sip:1234@) or end with (@example\.com$), whichever fewer
+   rules share. candidates() looks in the four method/event buckets a
+   request can fall into, probes the prefixes and suffixes of the subject
+   against the literals of each length present there, and adds the rules
+   that could not be indexed. Every rule that can match is returned, in
+   order; some of them may still fail their regex.
+
+   Rules are add()ed and then build() makes them visible to candidates();
+   the index is meant to be rebuilt from scratch when the rules change.
+*/
+class RegexRuleIndex
+{
+   public:
+      typedef std::vector<size_t> PositionList;
+
+      RegexRuleIndex();
+
+      void clear();
+
+      /// position is the rule's place in evaluation order
+      void add(size_t position,
+               const resip::Data& method,
+               const resip::Data& event,
+               const resip::Data& pattern);
+      /// files the rules added since the last build()
+      void build();
+
+      /// appends the positions of the rules subject may match, in ascending order
+      void candidates(const resip::Data& method,
+                      const resip::Data& event,
+                      const resip::Data& subject,
+                      PositionList& positions) const;
+
+      /** Sets prefix and suffix to the literal text that any string matched
+          by pattern (a POSIX extended regex) must start and end with. Both
+          are left empty when pattern is not anchored, or uses something
+          this simple parser does not follow. */
+      static void getLiterals(const resip::Data& pattern,
+                              resip::Data& prefix,
+                              resip::Data& suffix);
+
+   private:
+      typedef HashMap<resip::Data, PositionList> LiteralMap;
+      typedef std::map<size_t, LiteralMap> LiteralsByLength;
+
+      class Bucket
+      {
+         public:
+            LiteralsByLength mPrefixes;
+            LiteralsByLength mSuffixes;
+            PositionList mUnindexed;
+      };
+      typedef HashMap<resip::Data, Bucket> BucketMap;
+
+      class PendingRule
+      {
+         public:
+            size_t mPosition;
+            resip::Data mBucket;
+            resip::Data mPrefix;
+            resip::Data mSuffix;
+      };
+
+      static resip::Data bucketKey(const resip::Data& method, const resip::Data& event);
+      void lookup(const resip::Data& key,
+                  const resip::Data& subject,
+                  PositionList& positions) const;
+      static void lookup(const LiteralsByLength& literals,
+                         const resip::Data& subject,
+                         bool prefix,
+                         PositionList& positions);
+
+      BucketMap mBuckets;
+      std::vector<PendingRule> mPending;
+};
+
+}
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
@@ -92,6 +92,7 @@
 #if defined(USE_SSL)
 #include "repro/stateAgents/CertServer.hxx"
 #include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsBaseTransport.hxx"
 #define DEFAULT_TLS_METHOD SecurityTypes::SSLv23
 #endif
 
@@ -332,6 +333,10 @@ ReproRunner::run(int argc, char** argv)
                    mProxyConfig->getConfigData("LogFilename", "repro.log", true).c_str(),
                    isEqualNoCase(loggingType, "file") ? &g_ReproLogger : 0, // if logging to file then write WARNINGS, and Errors to console still
                    syslogFacilityName);
+   if(mProxyConfig->getConfigBool("AsyncLogging", false))
+   {
+      Log::enableAsync(mProxyConfig->getConfigUnsignedLong("AsyncLoggingRingBytes", Log::DefaultAsyncRingBytes));
+   }
 
    InfoLog( << "Starting repro version " << VersionUtils::instance().releaseVersion() << "...");
 
@@ -711,6 +716,10 @@ ReproRunner::createSipStack()
          "OpenSSLCTXSetOptions", BaseSecurity::OpenSSLCTXSetOptions);
    setOpenSSLCTXOptionsFromConfig(
          "OpenSSLCTXClearOptions", BaseSecurity::OpenSSLCTXClearOptions);
+   BaseSecurity::TlsSessionCacheSize = mProxyConfig->getConfigInt("TlsSessionCacheSize", BaseSecurity::TlsSessionCacheSize);
+   BaseSecurity::TlsSessionTimeout = mProxyConfig->getConfigInt("TlsSessionTimeout", BaseSecurity::TlsSessionTimeout);
+   BaseSecurity::TlsTicketKeyLifetime = mProxyConfig->getConfigInt("TlsTicketKeyLifetime", BaseSecurity::TlsTicketKeyLifetime);
+   TlsBaseTransport::HandshakeThreads = mProxyConfig->getConfigUnsignedLong("TlsHandshakeThreads", TlsBaseTransport::HandshakeThreads);
    Security::CipherList cipherList = Security::StrongestSuite;
    Data ciphers = mProxyConfig->getConfigData("OpenSSLCipherList", Data::Empty);
    if(!ciphers.empty())
@@ -788,6 +797,14 @@ ReproRunner::createSipStack()
                             compression,
                             mFdPollGrp);
 
+   // Split transaction processing over several TransactionControllers, if
+   // configured - must happen before any transports are added
+   int numTransactionShards = mProxyConfig->getConfigInt("NumTransactionShards", 1);
+   if(numTransactionShards > 1)
+   {
+      mSipStack->setTransactionShards(numTransactionShards);
+   }
+
    // Set any enum suffixes from configuration
    std::vector<Data> enumSuffixes;
    mProxyConfig->getConfigValue("EnumSuffixes", enumSuffixes);
@@ -1027,7 +1044,11 @@ ReproRunner::createDatastore()
    if(!mRestarting)  // If we are restarting then we left the InMemorySyncRegDb and InMemorySyncPubDb intact at restart - don't recreate
    {
       resip_assert(!mRegistrationPersistenceManager);
-      mRegistrationPersistenceManager = new InMemorySyncRegDb(mRegSyncPort ? 86400 /* 24 hours */ : 0 /* removeLingerSecs */);  // !slg! could make linger time a setting
+      // Replication can be handed off to a notification thread, so that a slow
+      // reg sync peer does not hold up registration processing; off by default,
+      // since it only costs time while the peers keep up
+      mRegistrationPersistenceManager = new InMemorySyncRegDb(mRegSyncPort ? 86400 /* 24 hours */ : 0 /* removeLingerSecs */,  // !slg! could make linger time a setting
+                                                              mRegSyncPort != 0 && mProxyConfig->getConfigBool("RegSyncAsyncNotify", false));
       resip_assert(!mPublicationPersistenceManager);
       mPublicationPersistenceManager = new InMemorySyncPubDb((mRegSyncPort && mProxyConfig->getConfigBool("EnablePublicationReplication", false)) ? true : false);
    }
@@ -1428,12 +1449,14 @@ ReproRunner::createRegSync()
    bool enablePublicationReplication = mProxyConfig->getConfigBool("EnablePublicationReplication", false);
    if(mRegSyncPort != 0)
    {
+      unsigned long regSyncBacklogSize = mProxyConfig->getConfigUnsignedLong("RegSyncBacklogSize", RegSyncServer::DefaultBacklogSize);
       std::list<RegSyncServer*> regSyncServerList;
       if(mUseV4) 
       {
          mRegSyncServerV4 = new RegSyncServer(dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager), 
                                               mRegSyncPort, V4, 
                                               enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0);
+         mRegSyncServerV4->setBacklogSize(regSyncBacklogSize);
          regSyncServerList.push_back(mRegSyncServerV4);
       }
       if(mUseV6) 
@@ -1441,6 +1464,7 @@ ReproRunner::createRegSync()
          mRegSyncServerV6 = new RegSyncServer(dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager),
                                               mRegSyncPort, V6,
                                               enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0);
+         mRegSyncServerV6->setBacklogSize(regSyncBacklogSize);
          regSyncServerList.push_back(mRegSyncServerV6);
       }
       if(!regSyncServerList.empty())
@@ -1457,7 +1481,8 @@ ReproRunner::createRegSync()
          }
          mRegSyncClient = new RegSyncClient(dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager),
                                             regSyncPeerAddress, remoteRegSyncPort,
-                                            enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0);
+                                            enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0,
+                                            mProxyConfig->getConfigBool("RegSyncBinary", true));
       }
    }
    Data regSyncBrokerTopic = mProxyConfig->getConfigData("RegSyncBrokerTopic", Data::Empty);
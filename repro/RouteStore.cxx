@@ -73,6 +73,8 @@ RouteStore::RouteStore(AbstractDb& db):
       }
    }
 
+   rebuildIndex();
+
    // Initialize cursor to the start
    mCursor = mRouteOperators.begin();
 }
@@ -143,6 +145,7 @@ RouteStore::addRoute(const resip::Data& method,
    {
       WriteLock lock(mMutex);
       mRouteOperators.insert( route );
+      rebuildIndex();
    }
    mCursor = mRouteOperators.begin(); 
 
@@ -209,6 +212,7 @@ RouteStore::eraseRoute(const resip::Data& key )
             it++;
          }
       }
+      rebuildIndex();
    }
    mCursor = mRouteOperators.begin();  // reset the cursor since it may have been on deleted route
 }
@@ -308,11 +312,26 @@ RouteStore::process(const resip::Uri& ruri,
    RouteStore::UriList targetSet;
    if(mRouteOperators.empty()) return targetSet;  // If there are no routes bail early to save a few cycles (size check is atomic enough, we don't need a lock)
 
+   Data uri;
+   {
+      DataStream s(uri);
+      s << ruri;
+      s.flush();
+   }
+
    ReadLock lock(mMutex);
 
-   for (RouteOpList::iterator it = mRouteOperators.begin();
-        it != mRouteOperators.end(); it++)
+   // Only the rules whose method, event and anchored literals fit the
+   // request are considered; rules without a usable regex never produce a
+   // target and are not indexed at all
+   RegexRuleIndex::PositionList candidates;
+   mIndex.candidates(method, event, uri, candidates);
+
+   for (RegexRuleIndex::PositionList::const_iterator pos = candidates.begin();
+        pos != candidates.end(); pos++)
    {
+      const RouteOp* it = mIndexedRoutes[*pos];
+
       DebugLog( << "Consider route " // << *it
                 << " reqUri=" << ruri
                 << " method=" << method 
@@ -344,13 +363,6 @@ RouteStore::process(const resip::Uri& ruri,
          int ret;
          // TODO - !cj! www.pcre.org looks like it has better performance
          // !mbg! is this true now that the compiled regexp is used?
-         Data uri;
-         {
-            DataStream s(uri);
-            s << ruri;
-            s.flush();
-         }
-         
          const int nmatch=10;
          regmatch_t pmatch[nmatch];
          
@@ -430,6 +442,24 @@ RouteStore::process(const resip::Uri& ruri,
 }
   
 
+void
+RouteStore::rebuildIndex()
+{
+   mIndexedRoutes.clear();
+   mIndex.clear();
+   for (RouteOpList::const_iterator it = mRouteOperators.begin();
+        it != mRouteOperators.end(); it++)
+   {
+      if ( it->preq )
+      {
+         mIndex.add(mIndexedRoutes.size(), it->routeRecord.mMethod, it->routeRecord.mEvent, it->routeRecord.mMatchingPattern);
+         mIndexedRoutes.push_back(&*it);
+      }
+   }
+   mIndex.build();
+}
+
+
 RouteStore::Key 
 RouteStore::buildKey(const resip::Data& method,
                      const resip::Data& event,
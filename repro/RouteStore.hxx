@@ -8,12 +8,14 @@
 #endif
 
 #include <set>
+#include <vector>
 
 #include "rutil/Data.hxx"
 #include "rutil/RWMutex.hxx"
 #include "resip/stack/Uri.hxx"
 
 #include "repro/AbstractDb.hxx"
+#include "repro/RegexRuleIndex.hxx"
 
 
 namespace repro
@@ -80,6 +82,12 @@ class RouteStore
       typedef std::multiset<RouteOp> RouteOpList;
       RouteOpList mRouteOperators; 
       RouteOpList::iterator mCursor;
+
+      // Rules with a usable regex, in order; positions in mIndex refer to
+      // this. Rebuilt whenever mRouteOperators changes.
+      void rebuildIndex();
+      std::vector<const RouteOp*> mIndexedRoutes;
+      RegexRuleIndex mIndex;
 };
 
  }
@@ -8,6 +8,7 @@
 #include "rutil/ResipAssert.h"
 #include "rutil/Data.hxx"
 #include "rutil/DataStream.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/ParseBuffer.hxx"
 
@@ -21,10 +22,92 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
 
-SqlDb::SqlDb(const resip::ConfigParse& config) : mConnected(false)
+SqlDb::SqlDb(const resip::ConfigParse& config) : 
+   mConnected(false),
+   mConnectionPoolSize(config.getConfigData("ConnectionPoolSize", Data(DefaultConnectionPoolSize), true).convertUnsignedLong()),
+   mSiloWriteInProgress(false)
 {
    mTlsPeerAuthorizationQuery = config.getConfigData("CustomTlsAuthQuery", "");
    mTableNamePrefix = config.getConfigData("TableNamePrefix", "");
+   if(mConnectionPoolSize == 0)
+   {
+      mConnectionPoolSize = 1;
+   }
+}
+
+SqlDb::~SqlDb()
+{
+   for(std::vector<Connection*>::iterator it = mConnections.begin(); it != mConnections.end(); it++)
+   {
+      delete *it;
+   }
+}
+
+void
+SqlDb::createConnectionPool()
+{
+   resip_assert(mConnections.empty());
+   InfoLog( << "Using a pool of " << mConnectionPoolSize << " database connections");
+   for(unsigned int i = 0; i < mConnectionPoolSize; i++)
+   {
+      Connection* connection = createConnection();
+      mConnections.push_back(connection);
+      mIdleConnections.push_back(connection);
+   }
+}
+
+SqlDb::Connection*
+SqlDb::acquireConnection() const
+{
+   ThreadIf::Id self = ThreadIf::selfId();
+   Lock lock(mMutex);
+   std::map<ThreadIf::Id, std::pair<Connection*, unsigned int> >::iterator it = mHeldConnections.find(self);
+   if(it != mHeldConnections.end())
+   {
+      it->second.second++;
+      return it->second.first;
+   }
+   while(mIdleConnections.empty())
+   {
+      mConnectionReleased.wait(mMutex);
+   }
+   Connection* connection = mIdleConnections.back();
+   mIdleConnections.pop_back();
+   mHeldConnections[self] = std::make_pair(connection, 1U);
+   return connection;
+}
+
+void
+SqlDb::releaseConnection() const
+{
+   Lock lock(mMutex);
+   std::map<ThreadIf::Id, std::pair<Connection*, unsigned int> >::iterator it = mHeldConnections.find(ThreadIf::selfId());
+   resip_assert(it != mHeldConnections.end());
+   if(--it->second.second == 0)
+   {
+      mIdleConnections.push_back(it->second.first);
+      mHeldConnections.erase(it);
+      mConnectionReleased.signal();
+   }
+}
+
+void
+SqlDb::pinConnection() const
+{
+   acquireConnection();
+}
+
+void
+SqlDb::unpinConnection() const
+{
+   {
+      Lock lock(mMutex);
+      if(mHeldConnections.find(ThreadIf::selfId()) == mHeldConnections.end())
+      {
+         return;  // not in a transaction
+      }
+   }
+   releaseConnection();
 }
 
 void 
@@ -138,14 +221,156 @@ bool
 SqlDb::dbCommitTransaction(const Table table)
 {
    Data command("COMMIT");
-   return query(command) == 0;
+   bool success = query(command) == 0;
+   unpinConnection();
+   return success;
 }
 
 bool 
 SqlDb::dbRollbackTransaction(const Table table)
 {
    Data command("ROLLBACK");
-   return query(command) == 0;
+   bool success = query(command) == 0;
+   unpinConnection();
+   return success;
+}
+
+AbstractDb::StaticRegRecordList
+SqlDb::getAllStaticRegs()
+{
+   AbstractDb::StaticRegRecordList ret;
+   std::vector<Data> rows;
+   if(preparedQuery(StaticRegFetchStatement, std::vector<Data>(), &rows) != 0)
+   {
+      return ret;
+   }
+   for(std::vector<Data>::iterator it = rows.begin(); it != rows.end(); it++)
+   {
+      Data data = it->base64decode();
+      AbstractDb::StaticRegRecord rec;
+      if(!data.empty())
+      {
+         decodeStaticRegRecord(data, rec);
+      }
+      ret.push_back(rec);
+   }
+   return ret;
+}
+
+bool
+SqlDb::addToSilo(const Key& key, const SiloRecord& rec)
+{
+   resip_assert(!key.empty());
+
+   SiloWrite write;
+   write.mKey = key;
+   write.mDestUri = rec.mDestUri;  // secondary key
+   {
+      Data data;
+      encodeSiloRecord(rec, data);
+      write.mValue = data.base64encode();
+   }
+
+   Lock lock(mSiloMutex);
+   mPendingSiloWrites.push_back(&write);
+   while(!write.mDone)
+   {
+      if(mSiloWriteInProgress)
+      {
+         mSiloWritten.wait(mSiloMutex);
+         continue;
+      }
+
+      // Nobody is writing - write what has queued up since the last write
+      std::vector<SiloWrite*> batch;
+      if(mPendingSiloWrites.size() <= MaxSiloBatchSize)
+      {
+         batch.swap(mPendingSiloWrites);
+      }
+      else
+      {
+         batch.assign(mPendingSiloWrites.begin(), mPendingSiloWrites.begin() + MaxSiloBatchSize);
+         mPendingSiloWrites.erase(mPendingSiloWrites.begin(), mPendingSiloWrites.begin() + MaxSiloBatchSize);
+      }
+      mSiloWriteInProgress = true;
+      mSiloMutex.unlock();
+      int rc = writeSiloBatch(batch);
+      mSiloMutex.lock();
+      for(std::vector<SiloWrite*>::iterator it = batch.begin(); it != batch.end(); it++)
+      {
+         (*it)->mSuccess = rc == 0;
+         (*it)->mDone = true;
+      }
+      mSiloWriteInProgress = false;
+      mSiloWritten.broadcast();
+   }
+   return write.mSuccess;
+}
+
+int
+SqlDb::writeSiloBatch(const std::vector<SiloWrite*>& batch)
+{
+   if(batch.size() == 1)
+   {
+      std::vector<Data> params;
+      params.push_back(batch.front()->mKey);
+      params.push_back(batch.front()->mDestUri);
+      params.push_back(batch.front()->mValue);
+      return preparedQuery(SiloInsertStatement, params, 0);
+   }
+
+   DebugLog( << "Writing " << batch.size() << " silo records in one statement");
+   Data keys;
+   Data rows;
+   {
+      DataStream keysStream(keys);
+      DataStream rowsStream(rows);
+      Data escapedKey;
+      Data escapedSKey;
+      for(std::vector<SiloWrite*>::const_iterator it = batch.begin(); it != batch.end(); it++)
+      {
+         if(it != batch.begin())
+         {
+            keysStream << ", ";
+            rowsStream << ", ";
+         }
+         escapeString((*it)->mKey, escapedKey);
+         keysStream << "'" << escapedKey << "'";
+         rowsStream << "('" << escapedKey
+                    << "', '" << escapeString((*it)->mDestUri, escapedSKey)
+                    << "', '" << (*it)->mValue
+                    << "')";
+      }
+   }
+   return replaceSiloRows(keys, rows);
+}
+
+bool
+SqlDb::getSiloRecords(const Key& skey, SiloRecordList& recordList)
+{
+   std::vector<Data> params;
+   params.push_back(skey);
+   std::vector<Data> rows;
+   if(preparedQuery(SiloFetchStatement, params, &rows) != 0)
+   {
+      return false;
+   }
+   for(std::vector<Data>::iterator it = rows.begin(); it != rows.end(); it++)
+   {
+      Data data = it->base64decode();
+      AbstractDb::SiloRecord rec;
+      decodeSiloRecord(data, rec);
+      recordList.push_back(rec);
+   }
+   return true;
+}
+
+void
+SqlDb::eraseSiloRecord(const Key& key)
+{
+   std::vector<Data> params;
+   params.push_back(key);
+   preparedQuery(SiloEraseStatement, params, 0);
 }
 
 static const char userTable[] = "users";
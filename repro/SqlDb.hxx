@@ -1,8 +1,15 @@
 #if !defined(RESIP_SQLDB_HXX)
 #define RESIP_SQLDB_HXX 
 
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "rutil/Condition.hxx"
 #include "rutil/ConfigParse.hxx"
 #include "rutil/Data.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
 #include "repro/AbstractDb.hxx"
 
 namespace resip
@@ -13,10 +20,27 @@ namespace resip
 namespace repro
 {
 
+/**
+   Common base of the SQL backends.
+
+   Queries run on a pool of ConnectionPoolSize connections (default 4), so
+   the auth grabber and async processor threads are not queued up behind
+   one another on a single connection. A connection is lent to a thread
+   for one query at a time, or from dbBeginTransaction until the matching
+   commit or rollback; nested calls on the same thread reuse it.
+
+   The queries made for every request or message (user auth info and the
+   message silo) and the static registration load go through statements
+   prepared once per connection. Silo inserts from concurrent threads are
+   written together: whoever finds no write in progress writes everything
+   queued, as one multi-row statement, while the others wait for the
+   result.
+*/
 class SqlDb: public AbstractDb
 {
    public:
       SqlDb(const resip::ConfigParse& config);
+      virtual ~SqlDb();
       
       virtual bool isSane() {return mConnected;}
 
@@ -25,23 +49,83 @@ class SqlDb: public AbstractDb
 
       virtual bool isAuthorized(const std::set<resip::Data>& peerNames, const std::set<resip::Data>& identities) const;
 
+      virtual StaticRegRecordList getAllStaticRegs();
+
+      virtual bool addToSilo(const Key& key, const SiloRecord& rec);
+      virtual bool getSiloRecords(const Key& skey, SiloRecordList& recordList); 
+      virtual void eraseSiloRecord(const Key& key);
+
       // Perform a query that expects a single result/row - returns all column/field data in a vector
       virtual int singleResultQuery(const resip::Data& queryCommand, std::vector<resip::Data>& fields) const = 0;
 
    protected:
+      static const unsigned int DefaultConnectionPoolSize = 4;
+      static const unsigned int MaxSiloBatchSize = 100;
+
+      /// One connection to the server; the backends add the handle and the
+      /// statements they have prepared on it
+      class Connection
+      {
+         public:
+            virtual ~Connection() {}
+      };
+
+      /// Borrows a connection from the pool for as long as it is in scope
+      class ConnectionLease
+      {
+         public:
+            ConnectionLease(const SqlDb& db) : mDb(db), mConnection(db.acquireConnection()) {}
+            ~ConnectionLease() { mDb.releaseConnection(); }
+            Connection& connection() const { return *mConnection; }
+
+         private:
+            const SqlDb& mDb;
+            Connection* mConnection;
+      };
+
+      typedef enum
+      {
+         UserAuthStatement=0,       // user, domain -> passwordHash
+         SiloInsertStatement,       // attr, attr2, value
+         SiloFetchStatement,        // attr2 -> value
+         SiloEraseStatement,        // attr
+         StaticRegFetchStatement,   // -> value
+         MaxStatement  // This one MUST be last
+      } Statement;
+
+      /// runs a prepared statement on a pool connection; the first column
+      /// of every row returned is appended to rows, if given
+      virtual int preparedQuery(Statement statement,
+                                const std::vector<resip::Data>& params,
+                                std::vector<resip::Data>* rows) const = 0;
+      /// inserts or replaces several silo rows in one statement; rows is a
+      /// VALUES list of (attr, attr2, value) tuples and keys the attr values,
+      /// both already escaped and quoted
+      virtual int replaceSiloRows(const resip::Data& keys, const resip::Data& rows) const = 0;
+
+      /// called from the backend's constructor, once it can make
+      /// connections; only the first is connected up front
+      void createConnectionPool();
+      virtual Connection* createConnection() const = 0;
+      virtual int connectToDatabase(Connection& connection) const = 0;
+
+      void pinConnection() const;    // hold this thread's connection past the current lease
+      void unpinConnection() const;
+
       virtual void setConnected(bool connected) const { mConnected = connected; }
       virtual bool isConnected() const { return mConnected; }
 
       void setToData(const std::set<resip::Data>& items, resip::Data& result, const resip::Data& sep = ",", const char quote = '\'') const;
 
-      // when multiple threads are in use with the same connection, you need to
-      // mutex calls to mysql_query and mysql_store_result:
-      // http://dev.mysql.com/doc/refman/5.1/en/threaded-clients.html
+      // guards the connection pool
       mutable resip::Mutex mMutex;
 
       resip::Data tableName( Table table ) const;
 
    private:
+      Connection* acquireConnection() const;
+      void releaseConnection() const;
+
       // Db manipulation routines
       virtual void dbEraseRecord(const Table table, 
                                  const resip::Data& key,
@@ -57,6 +141,30 @@ class SqlDb: public AbstractDb
       resip::Data mTlsPeerAuthorizationQuery;
       resip::Data mTableNamePrefix;
 
+      unsigned int mConnectionPoolSize;
+      mutable resip::Condition mConnectionReleased;
+      std::vector<Connection*> mConnections;
+      mutable std::vector<Connection*> mIdleConnections;
+      // connection held by each thread, and how many leases/pins it has on it
+      mutable std::map<resip::ThreadIf::Id, std::pair<Connection*, unsigned int> > mHeldConnections;
+
+      class SiloWrite
+      {
+         public:
+            SiloWrite() : mDone(false), mSuccess(false) {}
+            resip::Data mKey;
+            resip::Data mDestUri;
+            resip::Data mValue;  // base64
+            bool mDone;
+            bool mSuccess;
+      };
+      int writeSiloBatch(const std::vector<SiloWrite*>& batch);
+
+      resip::Mutex mSiloMutex;
+      resip::Condition mSiloWritten;
+      std::vector<SiloWrite*> mPendingSiloWrites;
+      bool mSiloWriteInProgress;
+
       virtual void userWhereClauseToDataStream(const Key& key, resip::DataStream& ds) const = 0;
       virtual void tlsPeerIdentityWhereClauseToDataStream(const Key& key, resip::DataStream& ds) const = 0;
 };
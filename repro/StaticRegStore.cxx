@@ -15,10 +15,11 @@ using namespace std;
 StaticRegStore::StaticRegStore(AbstractDb& db):
    mDb(db)
 {
-   AbstractDb::Key key = mDb.firstStaticRegKey();
-   while (!key.empty())
+   // one query on SQL backends rather than one per record
+   AbstractDb::StaticRegRecordList recs = mDb.getAllStaticRegs();
+   for (AbstractDb::StaticRegRecordList::iterator it = recs.begin(); it != recs.end(); it++)
    {
-      AbstractDb::StaticRegRecord rec = mDb.getStaticReg(key);
+      const AbstractDb::StaticRegRecord& rec = *it;
 
       try
       {
@@ -44,8 +45,6 @@ StaticRegStore::StaticRegStore(AbstractDb& db):
          // This should never happen, since the format should be verified before writing to DB
          ErrLog(<<"Failed to load a static registration due to parse error: " << e);
       }
-
-      key = mDb.nextStaticRegKey();
    }
 }
 
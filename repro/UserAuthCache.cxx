@@ -0,0 +1,244 @@
+#include "rutil/Lock.hxx"
+#include "rutil/Timer.hxx"
+
+#include "repro/UserAuthCache.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+UserAuthCache::Shard::Shard() :
+   mHits(0),
+   mMisses(0),
+   mCoalesced(0),
+   mExpired(0),
+   mEvicted(0),
+   mInvalidated(0)
+{
+}
+
+UserAuthCache::UserAuthCache(unsigned long ttlSeconds, unsigned long maxEntries) :
+   mTtlMs(0),
+   mMaxEntriesPerShard(0)
+{
+   configure(ttlSeconds, maxEntries);
+}
+
+UserAuthCache::~UserAuthCache()
+{
+}
+
+void
+UserAuthCache::configure(unsigned long ttlSeconds, unsigned long maxEntries)
+{
+   // only ever called before the store is in use
+   mTtlMs = (UInt64)ttlSeconds * 1000;
+   mMaxEntriesPerShard = (maxEntries + NumShards - 1) / NumShards;
+   clear();
+}
+
+Data
+UserAuthCache::getUserAuthInfo(AbstractDb& db, const AbstractDb::Key& key)
+{
+   if(!isEnabled())
+   {
+      return db.getUserAuthInfo(key);
+   }
+
+   Shard& shard = shardFor(key);
+   std::shared_ptr<PendingLoad> load;
+   {
+      Lock lock(shard.mMutex);
+
+      HashMap<Data, Entry>::iterator it = shard.mEntries.find(key);
+      if(it != shard.mEntries.end())
+      {
+         if(it->second.mExpires > Timer::getTimeMs())
+         {
+            shard.mHits++;
+            shard.mLru.splice(shard.mLru.begin(), shard.mLru, it->second.mLru);
+            return it->second.mA1;
+         }
+         shard.mExpired++;
+         erase(shard, it);
+      }
+
+      HashMap<Data, std::shared_ptr<PendingLoad> >::iterator pending = shard.mLoads.find(key);
+      if(pending != shard.mLoads.end())
+      {
+         // someone is already asking the db; wait for their answer
+         shard.mCoalesced++;
+         load = pending->second;
+         while(!load->mLoaded)
+         {
+            load->mLoadedCondition.wait(shard.mMutex);
+         }
+         return load->mA1;
+      }
+
+      shard.mMisses++;
+      load = std::make_shared<PendingLoad>();
+      shard.mLoads[key] = load;
+   }
+
+   Data a1 = db.getUserAuthInfo(key);
+
+   {
+      Lock lock(shard.mMutex);
+
+      if(!load->mStale)
+      {
+         shard.mLoads.erase(key);
+      }
+      load->mA1 = a1;
+      load->mLoaded = true;
+      load->mLoadedCondition.broadcast();
+      // an empty answer may be a failed query rather than an unknown user
+      if(!load->mStale && !a1.empty())
+      {
+         shard.mLru.push_front(key);
+         Entry& entry = shard.mEntries[key];
+         entry.mA1 = a1;
+         entry.mExpires = Timer::getTimeMs() + mTtlMs;
+         entry.mLru = shard.mLru.begin();
+
+         while(shard.mEntries.size() > mMaxEntriesPerShard)
+         {
+            shard.mEvicted++;
+            erase(shard, shard.mEntries.find(shard.mLru.back()));
+         }
+      }
+   }
+   return a1;
+}
+
+void
+UserAuthCache::erase(Shard& shard, HashMap<Data, Entry>::iterator it)
+{
+   shard.mLru.erase(it->second.mLru);
+   shard.mEntries.erase(it);
+}
+
+void
+UserAuthCache::invalidate(const AbstractDb::Key& key)
+{
+   Shard& shard = shardFor(key);
+   Lock lock(shard.mMutex);
+
+   HashMap<Data, Entry>::iterator it = shard.mEntries.find(key);
+   if(it != shard.mEntries.end())
+   {
+      shard.mInvalidated++;
+      erase(shard, it);
+   }
+   HashMap<Data, std::shared_ptr<PendingLoad> >::iterator pending = shard.mLoads.find(key);
+   if(pending != shard.mLoads.end())
+   {
+      pending->second->mStale = true;
+      shard.mLoads.erase(pending);
+   }
+}
+
+void
+UserAuthCache::clear()
+{
+   for(unsigned int i = 0; i < NumShards; i++)
+   {
+      Shard& shard = mShards[i];
+      Lock lock(shard.mMutex);
+
+      shard.mInvalidated += shard.mEntries.size();
+      shard.mEntries.clear();
+      shard.mLru.clear();
+      for(HashMap<Data, std::shared_ptr<PendingLoad> >::iterator it = shard.mLoads.begin();
+          it != shard.mLoads.end(); it++)
+      {
+         it->second->mStale = true;
+      }
+      shard.mLoads.clear();
+   }
+}
+
+EncodeStream&
+UserAuthCache::encodeStats(EncodeStream& strm) const
+{
+   UInt64 entries = 0;
+   UInt64 hits = 0;
+   UInt64 misses = 0;
+   UInt64 coalesced = 0;
+   UInt64 expired = 0;
+   UInt64 evicted = 0;
+   UInt64 invalidated = 0;
+   for(unsigned int i = 0; i < NumShards; i++)
+   {
+      const Shard& shard = mShards[i];
+      Lock lock(shard.mMutex);
+
+      entries += shard.mEntries.size();
+      hits += shard.mHits;
+      misses += shard.mMisses;
+      coalesced += shard.mCoalesced;
+      expired += shard.mExpired;
+      evicted += shard.mEvicted;
+      invalidated += shard.mInvalidated;
+   }
+
+   UInt64 lookups = hits + misses + coalesced;
+   strm << "Enabled: " << (isEnabled() ? "true" : "false") << endl
+        << "TTL: " << mTtlMs / 1000 << "s" << endl
+        << "MaxEntries: " << mMaxEntriesPerShard * NumShards << endl
+        << "Entries: " << entries << endl
+        << "Hits: " << hits << endl
+        << "Misses: " << misses << endl
+        << "CoalescedMisses: " << coalesced << endl
+        << "HitRatio: " << (lookups ? hits * 100 / lookups : 0) << "%" << endl
+        << "Expired: " << expired << endl
+        << "Evicted: " << evicted << endl
+        << "Invalidated: " << invalidated << endl;
+   return strm;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
@@ -0,0 +1,146 @@
+#if !defined(REPRO_USERAUTHCACHE_HXX)
+#define REPRO_USERAUTHCACHE_HXX
+
+#include <list>
+#include <memory>
+
+#include "rutil/Condition.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/HashMap.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/resipfaststreams.hxx"
+
+#include "repro/AbstractDb.hxx"
+
+namespace repro
+{
+
+/**
+   Read-through cache of the A1 hashes UserStore::getUserAuthInfo fetches,
+   so that a user refreshing a registration every few minutes does not cost
+   a database round trip (on one of the few auth grabber threads) each time.
+
+   Entries live for a fixed TTL and the least recently used ones are
+   dropped beyond a size bound. Empty answers are never cached: AbstractDb
+   returns one both for an unknown user and for a failed query, and the
+   latter must not stick for a whole TTL. The cache is
+   split into shards by key, each with its own lock. Concurrent misses for
+   the same key wait for the first one's query instead of issuing their
+   own. If a key is invalidated while its query is in flight, the answer
+   still goes to the callers already waiting on it but is not cached, and
+   later callers start a new query.
+*/
+class UserAuthCache
+{
+   public:
+      /// ttlSeconds or maxEntries of 0 disable the cache
+      UserAuthCache(unsigned long ttlSeconds=0, unsigned long maxEntries=0);
+      ~UserAuthCache();
+
+      void configure(unsigned long ttlSeconds, unsigned long maxEntries);
+      bool isEnabled() const { return mTtlMs != 0 && mMaxEntriesPerShard != 0; }
+
+      resip::Data getUserAuthInfo(AbstractDb& db, const AbstractDb::Key& key);
+
+      void invalidate(const AbstractDb::Key& key);
+      void clear();
+
+      /// writes the settings and hit/miss counters, one per line
+      EncodeStream& encodeStats(EncodeStream& strm) const;
+
+   private:
+      static const unsigned int NumShards = 16;
+
+      class Entry
+      {
+         public:
+            resip::Data mA1;
+            UInt64 mExpires;
+            std::list<resip::Data>::iterator mLru;
+      };
+
+      class PendingLoad
+      {
+         public:
+            PendingLoad() : mLoaded(false), mStale(false) {}
+            resip::Condition mLoadedCondition;
+            bool mLoaded;
+            bool mStale;  // invalidated while loading; don't cache the answer
+            resip::Data mA1;
+      };
+
+      class Shard
+      {
+         public:
+            Shard();
+            mutable resip::Mutex mMutex;
+            HashMap<resip::Data, Entry> mEntries;
+            std::list<resip::Data> mLru;  // most recently used first
+            HashMap<resip::Data, std::shared_ptr<PendingLoad> > mLoads;
+
+            UInt64 mHits;
+            UInt64 mMisses;
+            UInt64 mCoalesced;
+            UInt64 mExpired;
+            UInt64 mEvicted;
+            UInt64 mInvalidated;
+      };
+
+      Shard& shardFor(const resip::Data& key) { return mShards[key.hash() % NumShards]; }
+      void erase(Shard& shard, HashMap<resip::Data, Entry>::iterator it);
+
+      UInt64 mTtlMs;
+      unsigned long mMaxEntriesPerShard;
+      Shard mShards[NumShards];
+
+      // no value semantics
+      UserAuthCache(const UserAuthCache&);
+      UserAuthCache& operator=(const UserAuthCache&);
+};
+
+}
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
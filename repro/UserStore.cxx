@@ -42,7 +42,25 @@ UserStore::getUserAuthInfo(  const resip::Data& user,
                              const resip::Data& realm ) const
 {
    Key key =  buildKey(user, realm);
-   return mDb.getUserAuthInfo( key );
+   return mAuthCache.getUserAuthInfo( mDb, key );
+}
+
+void
+UserStore::configureAuthCache(unsigned long ttlSeconds, unsigned long maxEntries)
+{
+   mAuthCache.configure(ttlSeconds, maxEntries);
+}
+
+void
+UserStore::clearAuthCache()
+{
+   mAuthCache.clear();
+}
+
+EncodeStream&
+UserStore::encodeAuthCacheStats(EncodeStream& strm) const
+{
+   return mAuthCache.encodeStats(strm);
 }
 
 bool 
@@ -91,13 +109,23 @@ UserStore::addUser( const Data& username,
    rec.email = emailAddress;
    rec.forwardAddress = Data::Empty;
 
-   return mDb.addUser( buildKey(username,domain), rec);
+   // Digest lookups are keyed by user@realm
+   bool ret = mDb.addUser( buildKey(username,domain), rec);
+   mAuthCache.invalidate(buildKey(username,domain));
+   mAuthCache.invalidate(buildKey(username,realm));
+   return ret;
 }
 
 void 
 UserStore::eraseUser( const Key& key )
 { 
+   AbstractDb::UserRecord rec = mDb.getUser( key );
    mDb.eraseUser( key );
+   mAuthCache.invalidate( key );
+   if ( !rec.user.empty() )
+   {
+      mAuthCache.invalidate( buildKey(rec.user, rec.realm) );
+   }
 }
 
 bool
@@ -112,12 +140,18 @@ UserStore::updateUser( const Key& originalKey,
                        const resip::Data& passwordHashAlt)
 {
    Key newkey = buildKey(user, domain);
+   AbstractDb::UserRecord original = mDb.getUser(originalKey);
    
    bool ret = addUser(user, domain, realm, password, applyA1HashToPassword, fullName, emailAddress, passwordHashAlt);
    if ( newkey != originalKey )
    {
       eraseUser(originalKey);
    }
+   else if ( !original.user.empty() )
+   {
+      // the realm may have changed
+      mAuthCache.invalidate(buildKey(original.user, original.realm));
+   }
    return ret;
 }
 
@@ -6,6 +6,7 @@
 #include "resip/stack/Message.hxx"
 
 #include "repro/AbstractDb.hxx"
+#include "repro/UserAuthCache.hxx"
 
 namespace resip
 {
@@ -30,6 +31,15 @@ class UserStore
 
       resip::Data getUserAuthInfo( const resip::Data& user,
                                    const resip::Data& realm ) const;
+
+      // Answers from getUserAuthInfo are cached for ttlSeconds, up to
+      // maxEntries of them; 0 for either turns the cache off.  Users changed
+      // through this class are dropped from the cache straight away, changes
+      // made to the database directly are only seen once the TTL expires
+      // (or after clearAuthCache).
+      void configureAuthCache(unsigned long ttlSeconds, unsigned long maxEntries);
+      void clearAuthCache();
+      EncodeStream& encodeAuthCacheStats(EncodeStream& strm) const;
       
       bool addUser( const resip::Data& user, 
                     const resip::Data& domain, 
@@ -61,6 +71,7 @@ class UserStore
    private:
 
       AbstractDb& mDb;
+      mutable UserAuthCache mAuthCache;
       static const resip::Data SEPARATOR;
 };
 
@@ -25,9 +25,12 @@ XmlRpcConnection::XmlRpcConnection(XmlRpcServerBase& server, resip::Socket sock)
    mXmlRcpServer(server),
    mConnectionId(NextConnectionId++),
    mNextRequestId(1),
-   mSock(sock)
+   mSock(sock),
+   mTxOffset(0),
+   mBinary(false)
 {
 	resip_assert(mSock > 0);
+   mXmlRcpServer.mTextConnections++;
 }
 
 
@@ -40,6 +43,10 @@ XmlRpcConnection::~XmlRpcConnection()
    close(mSock);
 #endif
    mSock=0;
+   if(!mBinary)
+   {
+      mXmlRcpServer.mTextConnections--;
+   }
 }
 
       
@@ -177,10 +184,12 @@ XmlRpcConnection::processSomeWrites()
    
    //DebugLog (<< "XmlRpcConnection::processSomeWrites: Writing " << mTxBuffer );
 
+   const char* data = mTxBuffer.data() + mTxOffset;
+   Data::size_type size = mTxBuffer.size() - mTxOffset;
 #if defined(WIN32)
-   int bytesWritten = ::send(mSock, mTxBuffer.data(), (int)mTxBuffer.size(), 0);
+   int bytesWritten = ::send(mSock, data, (int)size, 0);
 #else
-   int bytesWritten = ::write(mSock, mTxBuffer.data(), mTxBuffer.size() );
+   int bytesWritten = ::write(mSock, data, size);
 #endif
 
    if (bytesWritten == INVALID_SOCKET)
@@ -192,19 +201,26 @@ XmlRpcConnection::processSomeWrites()
       return false;
    }
    
-   if (bytesWritten == (int)mTxBuffer.size())
+   if (bytesWritten == (int)size)
    {
       DebugLog (<< "XmlRpcConnection::processSomeWrites - Wrote it all" );
-      mTxBuffer = Data::Empty;
+      mTxBuffer.clear();
+      mTxOffset = 0;
 
       //return false; // return false causes connection to close and clean up
       return true;  // keep connection up
    }
    else
    {
-      Data rest = mTxBuffer.substr(bytesWritten);
-      mTxBuffer = rest;
-      DebugLog( << "XmlRpcConnection::processSomeWrites - Wrote " << bytesWritten << " bytes - still need to do " << mTxBuffer );
+      // Only move the rest down once it is less than what was written, so
+      // that draining a large buffer (an initial sync) is not quadratic
+      mTxOffset += bytesWritten;
+      if (mTxOffset >= mTxBuffer.size() - mTxOffset)
+      {
+         mTxBuffer = mTxBuffer.substr(mTxOffset);
+         mTxOffset = 0;
+      }
+      DebugLog( << "XmlRpcConnection::processSomeWrites - Wrote " << bytesWritten << " bytes - still need to do " << mTxBuffer.size() - mTxOffset );
    }
    
    return true;
@@ -263,6 +279,16 @@ XmlRpcConnection::sendEvent(const Data& eventData)
    mTxBuffer += eventData;
 }
 
+void
+XmlRpcConnection::startBinary()
+{
+   if(!mBinary)
+   {
+      mBinary = true;
+      mXmlRcpServer.mTextConnections--;
+   }
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
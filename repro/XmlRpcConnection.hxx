@@ -27,6 +27,10 @@ public:
    virtual bool sendResponse(unsigned int requestId, const resip::Data& responseData, bool isFinal);
    virtual void sendEvent(const resip::Data& eventData);
 
+   // once binary, a connection only gets binary events; see XmlRpcServerBase::sendBinaryEvent
+   bool isBinary() const { return mBinary; }
+   void startBinary();
+
 private:
    bool processSomeReads();
    bool processSomeWrites();
@@ -43,6 +47,8 @@ private:
    resip::Socket mSock;
    resip::Data mRxBuffer;
    resip::Data mTxBuffer;
+   resip::Data::size_type mTxOffset;  // bytes of mTxBuffer already written
+   bool mBinary;
 };
 
 }
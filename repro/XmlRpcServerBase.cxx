@@ -27,7 +27,8 @@ using namespace std;
 
 XmlRpcServerBase::XmlRpcServerBase(int port, IpVersion ipVer, Data ipAddr) :
    mTuple(ipAddr,port,ipVer,TCP,Data::Empty),
-   mSane(true)
+   mSane(true),
+   mTextConnections(0)
 {   
 #ifdef USE_IPV6
    mFd = ::socket(ipVer == V4 ? PF_INET : PF_INET6, SOCK_STREAM, 0);
@@ -120,7 +121,8 @@ XmlRpcServerBase::XmlRpcServerBase(int port, IpVersion ipVer, Data ipAddr) :
 }
 
 XmlRpcServerBase::XmlRpcServerBase(const Data& brokerUrl) :
-   mSane(true)
+   mSane(true),
+   mTextConnections(0)
 {
    // AMQP mode
 #ifdef BUILD_QPID_PROTON
@@ -183,6 +185,8 @@ XmlRpcServerBase::process(FdSet& fdset)
    }
 #endif
 
+   flushEvents();
+
    // Process Response fifo first
    while (mResponseFifo.messageAvailable())
    {
@@ -195,7 +199,10 @@ XmlRpcServerBase::process(FdSet& fdset)
             ConnectionMap::iterator it = mConnections.begin();
             for(; it != mConnections.end(); it++)
             {
-               it->second->sendEvent(responseInfo->getResponseData());
+               if(it->second->isBinary() == responseInfo->getBinary())
+               {
+                  it->second->sendEvent(responseInfo->getResponseData());
+               }
             }
          }
          else
@@ -214,6 +221,10 @@ XmlRpcServerBase::process(FdSet& fdset)
          if(it != mConnections.end())
          {
             it->second->sendResponse(responseInfo->getRequestId(), responseInfo->getResponseData(), responseInfo->getIsFinal());
+            if(responseInfo->getBinary())
+            {
+               it->second->startBinary();
+            }
          }
       }
       delete responseInfo;
@@ -277,7 +288,8 @@ void
 XmlRpcServerBase::sendResponse(unsigned int connectionId,
                                unsigned int requestId, 
                                const Data& responseData,
-                               bool isFinal)
+                               bool isFinal,
+                               bool startBinary)
 {
 #ifdef BUILD_QPID_PROTON
    // FIXME: response support not yet completed/tested
@@ -287,7 +299,7 @@ XmlRpcServerBase::sendResponse(unsigned int connectionId,
       return;
    }
 #endif
-   mResponseFifo.add(new ResponseInfo(connectionId, requestId, responseData, isFinal));
+   mResponseFifo.add(new ResponseInfo(connectionId, requestId, responseData, isFinal, startBinary));
    mSelectInterruptor.interrupt();
 }
 
@@ -306,6 +318,26 @@ XmlRpcServerBase::sendEvent(unsigned int connectionId,
    mSelectInterruptor.interrupt();
 }
 
+void 
+XmlRpcServerBase::sendBinaryEvent(unsigned int connectionId,
+                                  const Data& eventData)
+{
+   mResponseFifo.add(new ResponseInfo(connectionId, 0 /* requestId */, eventData, true /* isFinal */, true /* binary */));
+   mSelectInterruptor.interrupt();
+}
+
+bool
+XmlRpcServerBase::hasTextReceivers() const
+{
+   return mQpidProtonThread.get() != 0 || mTextConnections > 0;
+}
+
+void
+XmlRpcServerBase::wakeup()
+{
+   mSelectInterruptor.interrupt();
+}
+
 std::shared_ptr<ThreadIf>
 XmlRpcServerBase::getThread()
 {
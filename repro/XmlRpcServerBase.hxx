@@ -14,6 +14,7 @@
 #include "repro/QpidProtonThread.hxx"
 #endif
 
+#include <atomic>
 #include <memory>
 
 /// This Class is used to implement a primitive form of RPC using loose XML formatting.
@@ -30,22 +31,27 @@ public:
    ResponseInfo(unsigned int connectionId,
                 unsigned int requestId,
                 const resip::Data& responseData,
-                bool isFinal) :
+                bool isFinal,
+                bool binary = false) :
       mConnectionId(connectionId),
       mRequestId(requestId),
       mResponseData(responseData),
-      mIsFinal(isFinal) {}
+      mIsFinal(isFinal),
+      mBinary(binary) {}
 
    unsigned int getConnectionId() const noexcept { return mConnectionId; }
    unsigned int getRequestId() const noexcept { return mRequestId; }
    const resip::Data& getResponseData() const noexcept { return mResponseData; }
    bool getIsFinal() const noexcept { return mIsFinal; }
+   // for an event: it is binary; for a response: the connection switches to binary after it
+   bool getBinary() const noexcept { return mBinary; }
 
 private:
    unsigned int mConnectionId;
    unsigned int mRequestId;
    resip::Data mResponseData;
    bool mIsFinal;
+   bool mBinary;
 };
 
 class XmlRpcServerBase
@@ -63,22 +69,39 @@ public:
    bool isSane();
    static void logSocketError(int e);
 
-   // thread safe - uses fifo
+   // thread safe - uses fifo; if startBinary is set, the connection carries
+   // only binary events (and no more responses) after this response
    void sendResponse(unsigned int connectionId,
                      unsigned int requestId,
                      const resip::Data& responseData,
-                     bool isFinal=true);
+                     bool isFinal=true,
+                     bool startBinary=false);
 
-   // thread safe - uses fifo (use connectionId == 0 to send to all connections)
+   // thread safe - uses fifo (use connectionId == 0 to send to all connections
+   // that have not switched to binary)
    void sendEvent(unsigned int connectionId,
                   const resip::Data& eventData);
 
+   // thread safe - uses fifo (use connectionId == 0 to send to all connections
+   // that have switched to binary)
+   void sendBinaryEvent(unsigned int connectionId,
+                        const resip::Data& eventData);
+
+   // thread safe - true if an event sent to all connections would go anywhere
+   bool hasTextReceivers() const;
+
    std::shared_ptr<resip::ThreadIf> getThread();
 
 protected:
    virtual void handleRequest(unsigned int connectionId, 
                               unsigned int requestId, 
                               const resip::Data& request) = 0; 
+
+   // called from process() before queued responses and events are sent,
+   // for subclasses that collect events to send in batches
+   virtual void flushEvents() {}
+   // thread safe - makes the thread calling process() return from select
+   void wakeup();
       
 private:
    static const unsigned int MaxConnections = 60;   // Note:  use caution if making this any bigger, default fd_set size in windows is 64
@@ -99,6 +122,8 @@ private:
 
    resip::Fifo<ResponseInfo> mResponseFifo;
    resip::SelectInterruptor mSelectInterruptor;
+
+   std::atomic<unsigned int> mTextConnections;  // maintained by XmlRpcConnection
 };
 
 }
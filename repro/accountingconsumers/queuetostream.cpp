@@ -4,6 +4,7 @@
 #include "rutil/compat.hxx"
 
 #include "repro/PersistentMessageQueue.hxx"
+#include "repro/MessageJournal.hxx"
 #include <rutil/Time.hxx>
 #include <rutil/Logger.hxx>
 #include <rutil/WinLeakCheck.hxx>
@@ -13,6 +14,17 @@ using namespace std;
 using namespace repro;
 
 static bool finished = false;
+static bool useJournal = false;
+
+static MessageDequeue*
+createQueue()
+{
+   if(useJournal)
+   {
+      return new MessageJournalDequeue("");
+   }
+   return new PersistentMessageDequeue("");
+}
 
 static void
 signalHandler(int signo)
@@ -48,12 +60,18 @@ main (int argc, char** argv)
    // Log any resip logs to cerr, since session events are logged to cout
    Log::initialize(Log::Cerr, Log::Info, "");
 
+   // usage: queuetostream [queueName] [berkeleydb|journal], the second
+   // matching the AccountingQueueType repro is configured with
    Data msgQueueName("sessioneventqueue");
    if(argc >= 2)
    {
       msgQueueName = argv[1];
    }
-   PersistentMessageDequeue* queue = new PersistentMessageDequeue("");
+   if(argc >= 3)
+   {
+      useJournal = isEqualNoCase(argv[2], "journal");
+   }
+   MessageDequeue* queue = createQueue();
    if(queue->init(true, msgQueueName))
    {
       vector<resip::Data> recs;
@@ -78,7 +96,7 @@ main (int argc, char** argv)
             if(queue->isRecoveryNeeded())
             {
                delete queue;
-               queue = new PersistentMessageDequeue("");
+               queue = createQueue();
                if(!queue->init(true, msgQueueName))
                {
                   cerr << "Error initializing message queue after error!" << endl;
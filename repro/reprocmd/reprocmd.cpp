@@ -60,6 +60,10 @@ main (int argc, char** argv)
       cerr << "                [tlscvm=<NONE|OPT|MAN>] [tlsuseemail=<YES|NO>]" << endl;
       cerr << "                - adds a new transport to the stack." << endl;
       cerr << "  /RemoveTransport key=<transportKey> - removes the requested transport" << endl; 
+      cerr << "  /GetUserAuthCacheStats - retrieves the user authentication cache settings and" << endl;
+      cerr << "                          hit/miss counters" << endl;
+      cerr << "  /ClearUserAuthCache - empties the user authentication cache, so that changes made" << endl;
+      cerr << "                       directly in the database are picked up" << endl;
       exit(1);
    }
 
@@ -0,0 +1,200 @@
+// Pushes accounting-sized records through a MessageJournal while a consumer
+// pops them, and reports the rate with group commit; with BerkeleyDb built
+// in, does the same through the PersistentMessageQueue for comparison.
+// Crash recovery is covered by testMessageJournal.
+//
+// usage: journalPerf [records] [directory]
+//   records    pushed per backend (default 100000)
+//   directory  where the queues go (default ./journalPerf.tmp), emptied first
+
+#include <iostream>
+#include <vector>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include "rutil/Data.hxx"
+#include "rutil/FileSystem.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+#include "repro/MessageJournal.hxx"
+#include "repro/PersistentMessageQueue.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
+
+namespace
+{
+
+Data
+recordFor(unsigned int i)
+{
+   return "{\"EventId\":4,\"EventName\":\"Session Established\",\"Datetime\":" + Data(1700000000 + i) +
+          ",\"CallId\":\"" + Data(i) + "-a84b4c76e66710@192.0.2.4\",\"Request\":{\"Uri\":\"sip:bob@example.com\"}}";
+}
+
+class Consumer : public ThreadIf
+{
+   public:
+      Consumer(MessageDequeue& queue, unsigned int count) : mQueue(queue), mCount(count), mReceived(0), mErrors(0) {}
+
+      virtual void thread()
+      {
+         vector<Data> records;
+         UInt64 deadline = Timer::getTimeMs() + 600000;
+         while(mReceived < mCount && Timer::getTimeMs() < deadline)
+         {
+            if(!mQueue.pop(100, records, true))
+            {
+               mErrors++;
+               break;
+            }
+            for(size_t i = 0; i < records.size(); i++)
+            {
+               if(records[i] != recordFor(mReceived++))
+               {
+                  mErrors++;
+               }
+            }
+            if(records.empty())
+            {
+               sleepMs(1);
+            }
+         }
+      }
+
+      MessageDequeue& mQueue;
+      unsigned int mCount;
+      unsigned int mReceived;
+      unsigned int mErrors;
+};
+
+bool
+run(const char* name, MessageEnqueue& producer, MessageDequeue& consumer, const Data& queueName, unsigned int count)
+{
+   if(!producer.init(true, queueName) || !consumer.init(true, queueName))
+   {
+      cerr << name << ": cannot open " << queueName << endl;
+      return false;
+   }
+   Consumer reader(consumer, count);
+   UInt64 start = Timer::getTimeMs();
+   reader.run();
+   for(unsigned int i = 0; i < count; i++)
+   {
+      if(!producer.push(recordFor(i)))
+      {
+         cerr << name << ": push failed" << endl;
+         break;
+      }
+   }
+   producer.flush();
+   UInt64 pushMs = Timer::getTimeMs() - start;
+   reader.join();
+   UInt64 totalMs = Timer::getTimeMs() - start;
+
+   cout << name << ": pushed " << count << " records in " << pushMs << "ms ("
+        << (pushMs ? (UInt64)count * 1000 / pushMs : 0) << "/s), consumed in " << totalMs << "ms" << endl;
+   if(reader.mReceived != count || reader.mErrors)
+   {
+      cerr << name << ": consumed " << reader.mReceived << " with " << reader.mErrors << " errors" << endl;
+      return false;
+   }
+   return true;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   unsigned int count = argc > 1 ? Data(argv[1]).convertUnsignedLong() : 100000;
+   Data baseDir(argc > 2 ? argv[2] : "./journalPerf.tmp");
+
+   Log::initialize(Log::Cerr, Log::Warning, argv[0]);
+
+   FileSystem::Directory dir(baseDir);
+   dir.create();
+   // start from empty queues
+   for(FileSystem::Directory::iterator it = dir.begin(); it != dir.end(); ++it)
+   {
+      if(it.is_directory() && !it->prefix("."))
+      {
+         FileSystem::Directory queueDir(baseDir + "/" + *it);
+         for(FileSystem::Directory::iterator file = queueDir.begin(); file != queueDir.end(); ++file)
+         {
+            if(!file.is_directory())
+            {
+               unlink((baseDir + "/" + *it + "/" + *file).c_str());
+            }
+         }
+      }
+   }
+
+   bool ok = true;
+   {
+      // small segments, so that the consumer has to follow the producer
+      // across many of them
+      MessageJournalEnqueue producer(baseDir, 1024 * 1024);
+      MessageJournalDequeue consumer(baseDir);
+      ok = run("journal", producer, consumer, "journalqueue", count) && ok;
+   }
+#ifndef DISABLE_BERKELEYDB_USE
+   {
+      PersistentMessageEnqueue producer(baseDir);
+      PersistentMessageDequeue consumer(baseDir);
+      ok = run("berkeleydb", producer, consumer, "bdbqueue", count) && ok;
+   }
+#endif
+   return ok ? 0 : 1;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
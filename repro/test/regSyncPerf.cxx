@@ -0,0 +1,178 @@
+// Replicates a registration database from a RegSyncServer to a RegSyncClient
+// over loopback, first with the XML events and then with the binary
+// encoding, and reports how long the initial sync and a round of updates
+// take. Checks that the client ends up with what the server has.
+//
+// usage: regSyncPerf [contacts] [xmlContacts] [port]
+//   contacts     synced with the binary encoding (default 1000000)
+//   xmlContacts  synced with XML, for comparison; 0 to skip (default 100000)
+
+#include <atomic>
+#include <iostream>
+#include <list>
+
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "resip/dum/InMemorySyncRegDb.hxx"
+
+#include "repro/RegSyncClient.hxx"
+#include "repro/RegSyncServer.hxx"
+#include "repro/RegSyncServerThread.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
+
+namespace
+{
+
+// Counts the contacts the client writes to its database
+class ChangeCounter : public InMemorySyncRegDbHandler
+{
+   public:
+      ChangeCounter() : InMemorySyncRegDbHandler(AllChanges), mChanges(0) {}
+      virtual void onAorModified(const Uri& aor, const ContactList& contacts) { mChanges++; }
+      std::atomic<UInt64> mChanges;
+};
+
+Uri
+aorFor(unsigned int i)
+{
+   return Uri("sip:user" + Data(i) + "@example.com");
+}
+
+ContactInstanceRecord
+contactFor(unsigned int i, UInt64 updated, UInt64 expires)
+{
+   Data host("192.0.2." + Data(i % 250 + 1));
+   ContactInstanceRecord rec;
+   rec.mContact = NameAddr("<sip:user" + Data(i) + "@" + host + ":" + Data(5060 + i % 1000) + ";transport=tcp>");
+   rec.mRegExpires = updated + expires;
+   rec.mLastUpdated = updated;
+   rec.mReceivedFrom = Tuple(host, 5060 + i % 1000, V4, TCP);
+   rec.mInstance = "<urn:uuid:00000000-0000-0000-0000-" + Data(100000000000ULL + i) + ">";
+   rec.mRegId = 1;
+   rec.mUserAgent = "regSyncPerf/1.0";
+   return rec;
+}
+
+bool
+waitFor(ChangeCounter& counter, UInt64 changes, unsigned int timeoutSecs)
+{
+   UInt64 deadline = Timer::getTimeMs() + timeoutSecs * 1000;
+   while(counter.mChanges < changes)
+   {
+      if(Timer::getTimeMs() > deadline)
+      {
+         cerr << "timed out with " << counter.mChanges << " of " << changes << " changes" << endl;
+         return false;
+      }
+      sleepMs(5);
+   }
+   return true;
+}
+
+// Syncs count contacts to a fresh client, then updates every tenth one
+bool
+run(const char* name, unsigned int count, int port, bool binary)
+{
+   UInt64 now = Timer::getTimeSecs();
+   InMemorySyncRegDb serverDb;
+   for(unsigned int i = 0; i < count; i++)
+   {
+      serverDb.updateContact(aorFor(i), contactFor(i, now - 60, 3600));
+   }
+
+   RegSyncServer server(&serverDb, port, V4);
+   if(!server.isSane())
+   {
+      cerr << "could not listen on port " << port << endl;
+      return false;
+   }
+   std::list<RegSyncServer*> servers;
+   servers.push_back(&server);
+   RegSyncServerThread serverThread(servers);
+   serverThread.run();
+
+   InMemorySyncRegDb clientDb;
+   ChangeCounter counter;
+   clientDb.addHandler(&counter);
+   RegSyncClient client(&clientDb, "127.0.0.1", (unsigned short)port, 0, binary);
+
+   UInt64 start = Timer::getTimeMs();
+   client.run();
+   bool ok = waitFor(counter, count, 1200);
+   UInt64 syncMs = Timer::getTimeMs() - start;
+
+   unsigned int updates = count / 10;
+   UInt64 updateMs = 0;
+   if(ok)
+   {
+      // the client only takes a contact that was updated later than its copy
+      start = Timer::getTimeMs();
+      for(unsigned int i = 0; i < count; i += 10)
+      {
+         serverDb.updateContact(aorFor(i), contactFor(i, now, 7200));
+      }
+      ok = waitFor(counter, (UInt64)count + updates, 600);
+      updateMs = Timer::getTimeMs() - start;
+   }
+
+   client.shutdown();
+   client.join();
+   serverThread.shutdown();
+   serverThread.join();
+   clientDb.removeHandler(&counter);
+
+   // expiry times are carried relative to the server's clock when a frame
+   // is encoded, so they come out later on the client by however long the
+   // frame waited to be read
+   UInt64 slack = (syncMs + updateMs) / 1000 + 2;
+   unsigned int mismatches = 0;
+   for(unsigned int i = 0; ok && i < count; i += (count / 1000 + 1))
+   {
+      ContactList serverContacts;
+      ContactList clientContacts;
+      serverDb.getContacts(aorFor(i), serverContacts);
+      clientDb.getContacts(aorFor(i), clientContacts);
+      if(clientContacts.size() != 1 || !(clientContacts.front() == serverContacts.front()) ||
+         clientContacts.front().mInstance != serverContacts.front().mInstance ||
+         !(clientContacts.front().mReceivedFrom == serverContacts.front().mReceivedFrom) ||
+         clientContacts.front().mRegExpires + 1 < serverContacts.front().mRegExpires ||
+         clientContacts.front().mRegExpires > serverContacts.front().mRegExpires + slack)
+      {
+         cerr << "contacts of " << aorFor(i) << " differ" << endl;
+         mismatches++;
+      }
+   }
+
+   cout << name << ": initial sync of " << count << " contacts " << syncMs << "ms ("
+        << (syncMs ? (UInt64)count * 1000 / syncMs : 0) << "/s), "
+        << updates << " updates " << updateMs << "ms ("
+        << (updateMs ? (UInt64)updates * 1000 / updateMs : 0) << "/s)" << endl;
+   return ok && mismatches == 0;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   unsigned int contacts = argc > 1 ? Data(argv[1]).convertUnsignedLong() : 1000000;
+   unsigned int xmlContacts = argc > 2 ? Data(argv[2]).convertUnsignedLong() : 100000;
+   int port = argc > 3 ? Data(argv[3]).convertInt() : 15089;
+
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   bool ok = true;
+   if(xmlContacts > 0)
+   {
+      ok = run("xml", xmlContacts, port, false) && ok;
+   }
+   ok = run("binary", contacts, port, true) && ok;
+   return ok ? 0 : 1;
+}
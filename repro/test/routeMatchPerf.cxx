@@ -0,0 +1,344 @@
+// Measures RouteStore::process and FilterStore::process against large rule
+// sets (10000 of each by default), and checks that they give the same
+// answers as evaluating every rule in order, the way they used to.
+//
+// usage: routeMatchPerf [rules] [requests]
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "resip/stack/Uri.hxx"
+
+#include "repro/AbstractDb.hxx"
+#include "repro/FilterStore.hxx"
+#include "repro/RouteStore.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
+
+namespace
+{
+
+// Just enough of a database to back the stores
+class MemoryDb : public AbstractDb
+{
+   public:
+      virtual bool isSane() { return true; }
+
+   protected:
+      typedef map<Data, Data> Records;
+
+      virtual bool dbWriteRecord(const Table table, const Data& key, const Data& data)
+      {
+         mTables[table][key] = data;
+         return true;
+      }
+      virtual bool dbReadRecord(const Table table, const Data& key, Data& data) const
+      {
+         Records::const_iterator it = mTables[table].find(key);
+         if(it == mTables[table].end())
+         {
+            return false;
+         }
+         data = it->second;
+         return true;
+      }
+      virtual void dbEraseRecord(const Table table, const Data& key, bool isSecondaryKey)
+      {
+         mTables[table].erase(key);
+      }
+      virtual Data dbNextKey(const Table table, bool first)
+      {
+         if(first)
+         {
+            mCursors[table] = mTables[table].begin();
+         }
+         if(mCursors[table] == mTables[table].end())
+         {
+            return Data::Empty;
+         }
+         return (mCursors[table]++)->first;
+      }
+      virtual bool dbNextRecord(const Table table, const Data& key, Data& data, bool forUpdate, bool first)
+      {
+         return false;
+      }
+      virtual bool dbBeginTransaction(const Table table) { return true; }
+      virtual bool dbCommitTransaction(const Table table) { return true; }
+      virtual bool dbRollbackTransaction(const Table table) { return true; }
+
+   private:
+      Records mTables[MaxTable];
+      Records::iterator mCursors[MaxTable];
+};
+
+// The old behaviour: every rule, in order
+class ReferenceRoutes
+{
+   public:
+      void add(const Data& method, const Data& event, const Data& pattern, const Data& rewrite)
+      {
+         Rule rule;
+         rule.mMethod = method;
+         rule.mEvent = event;
+         rule.mRewrite = rewrite;
+         rule.mRegex.reset(new regex_t);
+         regcomp(rule.mRegex.get(), pattern.c_str(), REG_EXTENDED | REG_NOSUB);
+         mRules.push_back(rule);
+      }
+      RouteStore::UriList process(const Uri& ruri, const Data& method, const Data& event) const
+      {
+         RouteStore::UriList targets;
+         Data uri(Data::from(ruri));
+         for(size_t i = 0; i < mRules.size(); i++)
+         {
+            const Rule& rule = mRules[i];
+            if((rule.mMethod.empty() || isEqualNoCase(rule.mMethod, method)) &&
+               (rule.mEvent.empty() || isEqualNoCase(rule.mEvent, event)) &&
+               regexec(rule.mRegex.get(), uri.c_str(), 0, 0, 0) == 0)
+            {
+               targets.push_back(Uri(rule.mRewrite));
+            }
+         }
+         return targets;
+      }
+
+   private:
+      struct Rule
+      {
+         Data mMethod;
+         Data mEvent;
+         Data mRewrite;
+         std::shared_ptr<regex_t> mRegex;
+      };
+      vector<Rule> mRules;
+};
+
+Data
+number(unsigned int i)
+{
+   Data n(i);
+   while(n.size() < 5)
+   {
+      n = "0" + n;
+   }
+   return n;
+}
+
+SipMessage*
+makeInvite(const Data& user, const Data& from)
+{
+   Data raw("INVITE sip:" + user + "@example.com SIP/2.0\r\n"
+            "Via: SIP/2.0/UDP 192.0.2.1:5060;branch=z9hG4bK-perf\r\n"
+            "Max-Forwards: 70\r\n"
+            "To: <sip:" + user + "@example.com>\r\n"
+            "From: <sip:" + from + "@example.net>;tag=1\r\n"
+            "Call-ID: perf@192.0.2.1\r\n"
+            "CSeq: 1 INVITE\r\n"
+            "Content-Length: 0\r\n\r\n");
+   return SipMessage::make(raw);
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   unsigned int rules = argc > 1 ? Data(argv[1]).convertUnsignedLong() : 10000;
+   unsigned int requests = argc > 2 ? Data(argv[2]).convertUnsignedLong() : 2000;
+   if(rules > 32767)
+   {
+      rules = 32767;  // orders are shorts
+   }
+
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   // Rules are loaded into the db first and read in by the stores, as repro
+   // does at startup; adding them one at a time rebuilds the index each time
+   MemoryDb db;
+   ReferenceRoutes reference;
+
+   // A dial plan: one route per number, plus method/event specific routes,
+   // domain routes and a few patterns (1%) the index can't use
+   for(unsigned int i = 0; i < rules; i++)
+   {
+      AbstractDb::RouteRecord route;
+      route.mRewriteExpression = "sip:" + number(i) + "@192.0.2." + Data(i % 250 + 1);
+      route.mOrder = (short)i;  // the reference keeps insertion order
+      switch(i % 100 == 3 ? 10 : i % 10)
+      {
+         case 0:
+            route.mMethod = "SUBSCRIBE";
+            route.mEvent = "presence";
+            route.mMatchingPattern = "^sip:" + number(i) + "@";
+            break;
+         case 1:
+            route.mMatchingPattern = "^sip:" + number(i) + "[0-9]*@example\\.com$";
+            break;
+         case 2:
+            route.mMatchingPattern = "@host" + number(i) + "\\.example\\.org$";
+            break;
+         case 10:
+            route.mMatchingPattern = "sip:.*" + number(i);  // not anchored, every request tries these
+            break;
+         default:
+            route.mMethod = i % 2 ? "INVITE" : "";
+            route.mMatchingPattern = "^sip:" + number(i) + "@example\\.com$";
+            break;
+      }
+      // RouteStore's key format
+      db.addRoute(";" + Data(i) + ":" + route.mMethod + " : " + route.mEvent + " : " + route.mMatchingPattern, route);
+      reference.add(route.mMethod, route.mEvent, route.mMatchingPattern, route.mRewriteExpression);
+
+      AbstractDb::FilterRecord filter;
+      filter.mCondition1Header = "From";
+      filter.mCondition1Regex = "^<sip:spam" + number(i) + "@";
+      filter.mMethod = i % 3 ? "INVITE" : "";
+      filter.mAction = FilterStore::Reject;
+      filter.mActionData = "403, Go away";
+      filter.mOrder = (short)i;
+      db.addFilter(filter.mCondition1Header + ":" + filter.mCondition1Regex + ":::" + filter.mMethod + ":", filter);
+   }
+
+   UInt64 start = Timer::getTimeMs();
+   RouteStore routes(db);
+   FilterStore filters(db);
+   cout << "loaded " << rules << " routes and filters in " << Timer::getTimeMs() - start << "ms" << endl;
+
+   // Check the index against the reference
+   unsigned int mismatches = 0;
+   for(unsigned int i = 0; i < rules && i < 2000; i++)
+   {
+      Uri ruri(i % 2 ? "sip:" + number(i) + "@example.com" : "sip:alice@host" + number(i) + ".example.org");
+      const char* methods[] = { "INVITE", "SUBSCRIBE", "MESSAGE" };
+      for(int m = 0; m < 3; m++)
+      {
+         Data event(m == 1 ? "presence" : "");
+         RouteStore::UriList got = routes.process(ruri, methods[m], event);
+         RouteStore::UriList want = reference.process(ruri, methods[m], event);
+         if(got.size() != want.size() || !equal(got.begin(), got.end(), want.begin()))
+         {
+            cerr << "route mismatch for " << ruri << " " << methods[m] << ": "
+                 << got.size() << " targets, expected " << want.size() << endl;
+            mismatches++;
+         }
+      }
+   }
+
+   start = Timer::getTimeMs();
+   unsigned int matched = 0;
+   for(unsigned int i = 0; i < requests; i++)
+   {
+      Uri ruri("sip:" + number((i * 7919) % (rules + rules / 10)) + "@example.com");
+      matched += routes.process(ruri, "INVITE", Data::Empty).size();
+   }
+   UInt64 indexedMs = Timer::getTimeMs() - start;
+
+   start = Timer::getTimeMs();
+   unsigned int referenceMatched = 0;
+   for(unsigned int i = 0; i < requests; i++)
+   {
+      Uri ruri("sip:" + number((i * 7919) % (rules + rules / 10)) + "@example.com");
+      referenceMatched += reference.process(ruri, "INVITE", Data::Empty).size();
+   }
+   UInt64 referenceMs = Timer::getTimeMs() - start;
+   if(matched != referenceMatched)
+   {
+      cerr << "route targets differ: " << matched << " vs " << referenceMatched << endl;
+      mismatches++;
+   }
+
+   cout << rules << " routes, " << requests << " requests: indexed " << indexedMs << "ms ("
+        << (indexedMs ? requests * 1000 / indexedMs : 0) << "/s), every rule "
+        << referenceMs << "ms (" << (referenceMs ? requests * 1000 / referenceMs : 0) << "/s)" << endl;
+
+   start = Timer::getTimeMs();
+   unsigned int rejected = 0;
+   for(unsigned int i = 0; i < requests; i++)
+   {
+      unsigned int n = (i * 7919) % (rules * 2);
+      std::unique_ptr<SipMessage> invite(makeInvite(number(i % rules),
+                                                    (n < rules ? "spam" : "friend") + number(n % rules)));
+      short action;
+      Data actionData;
+      if(filters.process(*invite, action, actionData))
+      {
+         if(n >= rules || action != FilterStore::Reject)
+         {
+            cerr << "unexpected filter match for " << invite->header(h_From) << endl;
+            mismatches++;
+         }
+         rejected++;
+      }
+      else if(n < rules)
+      {
+         cerr << "missed filter match for " << invite->header(h_From) << endl;
+         mismatches++;
+      }
+   }
+   UInt64 filterMs = Timer::getTimeMs() - start;
+   cout << rules << " filters, " << requests << " requests: " << filterMs << "ms ("
+        << (filterMs ? requests * 1000 / filterMs : 0) << "/s, including parsing), "
+        << rejected << " rejected" << endl;
+
+   if(mismatches)
+   {
+      cerr << mismatches << " mismatches" << endl;
+      return 1;
+   }
+   return 0;
+}
+
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
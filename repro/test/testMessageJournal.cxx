@@ -0,0 +1,308 @@
+// Checks MessageJournal: records come out in order across segments, popped
+// but uncommitted records are popped again, and the journal recovers from a
+// torn last record, a record whose CRC does not check out, and a consumer
+// whose committed offset went further than what survived a crash.
+//
+// usage: testMessageJournal [directory]
+//   directory  where the queues go (default ./testMessageJournal.tmp), emptied first
+
+#include <iostream>
+#include <vector>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "rutil/Data.hxx"
+#include "rutil/FileSystem.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ResipAssert.h"
+
+#include "repro/MessageJournal.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+namespace
+{
+
+Data
+recordFor(unsigned int i)
+{
+   return "{\"EventId\":4,\"EventName\":\"Session Established\",\"Datetime\":" + Data(1700000000 + i) +
+          ",\"CallId\":\"" + Data(i) + "-a84b4c76e66710@192.0.2.4\",\"Request\":{\"Uri\":\"sip:bob@example.com\"}}";
+}
+
+size_t
+frameSize()
+{
+   // every record is the same size
+   return (8 + recordFor(0).size() + 3) & ~(size_t)3;
+}
+
+void
+pushRange(const Data& baseDir, const Data& queueName, unsigned int first, unsigned int last,
+          unsigned int segmentSize = 4096)
+{
+   MessageJournalEnqueue producer(baseDir, segmentSize);
+   resip_assert(producer.init(true, queueName));
+   for(unsigned int i = first; i < last; i++)
+   {
+      resip_assert(producer.push(recordFor(i)));
+   }
+}
+
+vector<Data>
+popAll(MessageJournalDequeue& consumer)
+{
+   vector<Data> records;
+   vector<Data> all;
+   while(consumer.pop(5, records, true) && !records.empty())
+   {
+      all.insert(all.end(), records.begin(), records.end());
+   }
+   return all;
+}
+
+void
+checkRange(const vector<Data>& all, unsigned int first, unsigned int last)
+{
+   if(all.size() != last - first)
+   {
+      cerr << "expected " << last - first << " records, got " << all.size() << endl;
+      resip_assert(0);
+   }
+   for(unsigned int i = 0; i < all.size(); i++)
+   {
+      if(all[i] != recordFor(first + i))
+      {
+         cerr << "record " << i << " is " << all[i] << endl;
+         resip_assert(0);
+      }
+   }
+}
+
+void
+checkQueue(const Data& baseDir, const Data& queueName, unsigned int first, unsigned int last)
+{
+   MessageJournalDequeue consumer(baseDir);
+   resip_assert(consumer.init(true, queueName));
+   checkRange(popAll(consumer), first, last);
+}
+
+#ifndef WIN32
+int
+openLastSegment(const Data& directory)
+{
+   Data last;
+   FileSystem::Directory dir(directory);
+   for(FileSystem::Directory::iterator it = dir.begin(); it != dir.end(); ++it)
+   {
+      if(it->prefix("journal.") && (last.empty() || it->size() > last.size() || (it->size() == last.size() && *it > last)))
+      {
+         last = *it;
+      }
+   }
+   int fd = open((directory + "/" + last).c_str(), O_RDWR);
+   resip_assert(fd >= 0);
+   return fd;
+}
+
+// leaves a record at offset whose length made it to disk but whose payload
+// did not
+void
+tearLastSegment(const Data& directory, size_t offset)
+{
+   int fd = openLastSegment(directory);
+   const UInt32 torn[3] = { 100, 0xdeadbeef, 0x41414141 };
+   resip_assert(pwrite(fd, torn, sizeof(torn), offset) == sizeof(torn));
+   close(fd);
+}
+
+// flips a payload byte of the record at offset, leaving its length alone
+void
+corruptLastSegment(const Data& directory, size_t offset)
+{
+   int fd = openLastSegment(directory);
+   char c;
+   resip_assert(pread(fd, &c, 1, offset + 20) == 1);
+   c ^= 0x20;
+   resip_assert(pwrite(fd, &c, 1, offset + 20) == 1);
+   close(fd);
+}
+
+// as if the OS crashed before anything from offset on reached the disk
+void
+loseLastSegmentFrom(const Data& directory, size_t offset)
+{
+   int fd = openLastSegment(directory);
+   struct stat st;
+   fstat(fd, &st);
+   resip_assert(ftruncate(fd, offset) == 0);
+   resip_assert(ftruncate(fd, st.st_size) == 0);
+   close(fd);
+}
+#endif
+
+void
+emptyDirectory(const Data& baseDir)
+{
+   FileSystem::Directory dir(baseDir);
+   dir.create();
+   for(FileSystem::Directory::iterator it = dir.begin(); it != dir.end(); ++it)
+   {
+      if(it.is_directory() && !it->prefix("."))
+      {
+         FileSystem::Directory queueDir(baseDir + "/" + *it);
+         for(FileSystem::Directory::iterator file = queueDir.begin(); file != queueDir.end(); ++file)
+         {
+            if(!file.is_directory())
+            {
+               unlink((baseDir + "/" + *it + "/" + *file).c_str());
+            }
+         }
+      }
+   }
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Data baseDir(argc > 1 ? argv[1] : "./testMessageJournal.tmp");
+   Log::initialize(Log::Cerr, Log::Warning, argv[0]);
+   emptyDirectory(baseDir);
+
+   {
+      cerr << "!! in order across segments" << endl;
+      Data queueName("orderqueue");
+      MessageJournalEnqueue producer(baseDir, 4096);
+      MessageJournalDequeue consumer(baseDir);
+      resip_assert(producer.init(true, queueName) && consumer.init(true, queueName));
+
+      vector<Data> records;
+      resip_assert(consumer.pop(5, records, true) && records.empty());
+      // enough for several segments
+      const unsigned int count = (unsigned int)(10 * 4096 / frameSize());
+      for(unsigned int i = 0; i < count; i++)
+      {
+         resip_assert(producer.push(recordFor(i)));
+      }
+      resip_assert(producer.flush());
+
+      // popped without a commit, then aborted: the same records again
+      resip_assert(consumer.pop(3, records, false) && records.size() == 3);
+      consumer.abort();
+      checkRange(popAll(consumer), 0, count);
+      resip_assert(consumer.pop(5, records, true) && records.empty());
+
+      resip_assert(producer.push(recordFor(count)));
+      resip_assert(consumer.pop(5, records, true));
+      checkRange(records, count, count + 1);
+   }
+
+   {
+      cerr << "!! a new consumer starts from the committed offset" << endl;
+      Data queueName("recoveryqueue");
+      pushRange(baseDir, queueName, 0, 10);
+      {
+         // takes 4, commits, then takes 3 more without committing
+         MessageJournalDequeue consumer(baseDir);
+         vector<Data> records;
+         resip_assert(consumer.init(true, queueName));
+         resip_assert(consumer.pop(4, records, false) && records.size() == 4);
+         resip_assert(consumer.commit());
+         resip_assert(consumer.pop(3, records, false) && records.size() == 3);
+      }
+#ifndef WIN32
+      cerr << "!! torn last record" << endl;
+      // the ten records all fit in the first segment
+      tearLastSegment(baseDir + "/" + queueName, 10 * frameSize());
+#endif
+      pushRange(baseDir, queueName, 10, 20);
+      checkQueue(baseDir, queueName, 4, 20);
+   }
+
+#ifndef WIN32
+   {
+      cerr << "!! record with a bad CRC" << endl;
+      Data queueName("crcqueue");
+      pushRange(baseDir, queueName, 0, 10);
+      corruptLastSegment(baseDir + "/" + queueName, 6 * frameSize());
+      {
+         // a consumer stops at the bad record rather than hand it out
+         MessageJournalDequeue consumer(baseDir);
+         resip_assert(consumer.init(true, queueName));
+         checkRange(popAll(consumer), 0, 6);
+      }
+      // the producer's recovery ends the segment before it, losing the rest
+      pushRange(baseDir, queueName, 10, 20);
+      checkQueue(baseDir, queueName, 10, 20);
+   }
+
+   {
+      // The consumer commits records that the OS then loses in a crash, so
+      // its offset ends up past what the producer recovers.  The consumer
+      // must not get stuck there, but carry on with what is pushed next.
+      cerr << "!! consumer ahead of the recovered journal" << endl;
+      Data queueName("aheadqueue");
+      pushRange(baseDir, queueName, 0, 10);
+      checkQueue(baseDir, queueName, 0, 10);
+      loseLastSegmentFrom(baseDir + "/" + queueName, 6 * frameSize());
+      pushRange(baseDir, queueName, 10, 20);
+      // 6 to 9 went with the crash
+      checkQueue(baseDir, queueName, 10, 20);
+   }
+#endif
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
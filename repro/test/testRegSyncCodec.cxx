@@ -0,0 +1,271 @@
+// Checks the binary registration sync encoding: frames and AOR records
+// survive a round trip, and truncated or malformed input is refused rather
+// than read past.
+
+#include <iostream>
+
+#include "resip/dum/ContactInstanceRecord.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "resip/stack/Uri.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/ResipAssert.h"
+
+#include "repro/RegSyncCodec.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+namespace
+{
+
+RegSyncCodec::HeaderStatus
+decode(const Data& frame, RegSyncCodec::FrameType& type, UInt8& flags, Data::size_type& frameSize)
+{
+   return RegSyncCodec::decodeFrameHeader(frame.data(), frame.size(), type, flags, frameSize);
+}
+
+// a header claiming length bytes after the length field
+Data
+header(UInt32 length, RegSyncCodec::FrameType type)
+{
+   const char bytes[RegSyncCodec::HeaderSize] = { (char)(length >> 24), (char)(length >> 16),
+                                                  (char)(length >> 8), (char)length, (char)type, 0 };
+   return Data(bytes, RegSyncCodec::HeaderSize);
+}
+
+ContactList
+contacts(UInt64 serverNow)
+{
+   ContactList list;
+   ContactInstanceRecord rec;
+   rec.mContact = NameAddr("<sip:alice@192.0.2.10:5070;transport=tcp>");
+   rec.mRegExpires = serverNow + 3600;
+   rec.mLastUpdated = serverNow - 10;
+   rec.mReceivedFrom = Tuple("192.0.2.10", 5070, TCP);
+   rec.mSipPath.push_back(NameAddr("<sip:edge.example.com;lr>"));
+   rec.mInstance = "<urn:uuid:00000000-0000-1000-8000-000a95a0e128>";
+   rec.mRegId = 1;
+   rec.mUserAgent = "phone/1.0";
+   list.push_back(rec);
+
+   // static registrations and flow-bound contacts are not replicated
+   ContactInstanceRecord fixed;
+   fixed.mContact = NameAddr("<sip:alice@192.0.2.11>");
+   fixed.mRegExpires = NeverExpire;
+   list.push_back(fixed);
+   return list;
+}
+
+}
+
+int
+main()
+{
+   const UInt64 serverNow = 1000000;
+   const UInt64 now = 5000;
+   const Uri aor("sip:alice@example.com");
+
+   {
+      cerr << "!! round trip" << endl;
+      Data out;
+      Data::size_type start = RegSyncCodec::startFrame(out, RegSyncCodec::ContactBatch);
+      RegSyncCodec::encodeVarint(out, serverNow);
+      RegSyncCodec::encodeVarint(out, 42);
+      RegSyncCodec::encodeVarint(out, 1);
+      resip_assert(RegSyncCodec::encodeAor(out, aor, contacts(serverNow)));
+      RegSyncCodec::finishFrame(out, start);
+      // a second frame straight after, and the start of a third
+      start = RegSyncCodec::startFrame(out, RegSyncCodec::SnapshotDone);
+      RegSyncCodec::encodeVarint(out, 0xFFFFFFFFFFFFFFFFULL);
+      RegSyncCodec::finishFrame(out, start);
+      out += header(10, RegSyncCodec::Snapshot);
+
+      RegSyncCodec::FrameType type;
+      UInt8 flags;
+      Data::size_type frameSize;
+      resip_assert(decode(out, type, flags, frameSize) == RegSyncCodec::HeaderComplete);
+      resip_assert(type == RegSyncCodec::ContactBatch && flags == 0);
+      RegSyncCodec::Reader reader(out.data() + RegSyncCodec::HeaderSize, frameSize - RegSyncCodec::HeaderSize);
+      UInt64 value;
+      resip_assert(reader.readVarint(value) && value == serverNow);
+      resip_assert(reader.readVarint(value) && value == 42);
+      resip_assert(reader.readVarint(value) && value == 1);
+      Uri decodedAor;
+      ContactList decoded;
+      resip_assert(reader.readAor(decodedAor, decoded, serverNow, now));
+      resip_assert(reader.atEnd());
+      resip_assert(decodedAor == aor);
+      resip_assert(decoded.size() == 1);
+      const ContactInstanceRecord& rec = decoded.front();
+      const ContactList origs = contacts(serverNow);
+      const ContactInstanceRecord& orig = origs.front();
+      resip_assert(rec.mContact.uri() == orig.mContact.uri());
+      resip_assert(rec.mRegExpires == now + 3600);
+      resip_assert(rec.mLastUpdated == now - 10);
+      resip_assert(rec.mReceivedFrom == orig.mReceivedFrom);
+      resip_assert(rec.mSipPath.size() == 1 && rec.mSipPath.front().uri() == orig.mSipPath.front().uri());
+      resip_assert(rec.mInstance == orig.mInstance);
+      resip_assert(rec.mRegId == 1);
+      resip_assert(rec.mUserAgent == "phone/1.0");
+
+      Data rest = out.substr(frameSize);
+      resip_assert(decode(rest, type, flags, frameSize) == RegSyncCodec::HeaderComplete);
+      resip_assert(type == RegSyncCodec::SnapshotDone);
+      RegSyncCodec::Reader done(rest.data() + RegSyncCodec::HeaderSize, frameSize - RegSyncCodec::HeaderSize);
+      resip_assert(done.readVarint(value) && value == 0xFFFFFFFFFFFFFFFFULL && done.atEnd());
+      rest = rest.substr(frameSize);
+      resip_assert(decode(rest, type, flags, frameSize) == RegSyncCodec::HeaderIncomplete);
+
+      // an AOR with nothing to replicate is left out
+      ContactList none;
+      none.push_back(contacts(serverNow).back());
+      Data empty;
+      resip_assert(!RegSyncCodec::encodeAor(empty, aor, none));
+      resip_assert(empty.empty());
+   }
+
+   if(RegSyncCodec::compressionSupported())
+   {
+      cerr << "!! compressed round trip" << endl;
+      Data out;
+      Data::size_type start = RegSyncCodec::startFrame(out, RegSyncCodec::Snapshot);
+      RegSyncCodec::encodeVarint(out, serverNow);
+      RegSyncCodec::encodeVarint(out, 200);
+      for(int i = 0; i < 200; i++)
+      {
+         resip_assert(RegSyncCodec::encodeAor(out, Uri("sip:user" + Data(i) + "@example.com"), contacts(serverNow)));
+      }
+      Data::size_type plainSize = out.size();
+      RegSyncCodec::finishFrame(out, start, true);
+      resip_assert(out.size() < plainSize);
+
+      RegSyncCodec::FrameType type;
+      UInt8 flags;
+      Data::size_type frameSize;
+      resip_assert(decode(out, type, flags, frameSize) == RegSyncCodec::HeaderComplete);
+      resip_assert(type == RegSyncCodec::Snapshot && (flags & RegSyncCodec::Compressed));
+      Data payload;
+      resip_assert(RegSyncCodec::uncompress(out.data() + RegSyncCodec::HeaderSize, frameSize - RegSyncCodec::HeaderSize, payload));
+      RegSyncCodec::Reader reader(payload.data(), payload.size());
+      UInt64 value;
+      resip_assert(reader.readVarint(value) && value == serverNow);
+      resip_assert(reader.readVarint(value) && value == 200);
+      for(int i = 0; i < 200; i++)
+      {
+         Uri decodedAor;
+         ContactList decoded;
+         resip_assert(reader.readAor(decodedAor, decoded, serverNow, now));
+         resip_assert(decodedAor.user() == "user" + Data(i) && decoded.size() == 1);
+      }
+      resip_assert(reader.atEnd());
+
+      // a corrupt deflate stream is refused
+      Data corrupt(out.data() + RegSyncCodec::HeaderSize, frameSize - RegSyncCodec::HeaderSize);
+      corrupt[corrupt.size() / 2] ^= 0x55;
+      Data ignored;
+      resip_assert(!RegSyncCodec::uncompress(corrupt.data(), corrupt.size(), ignored));
+   }
+
+   {
+      cerr << "!! malformed headers" << endl;
+      RegSyncCodec::FrameType type;
+      UInt8 flags;
+      Data::size_type frameSize;
+
+      resip_assert(decode(Data::Empty, type, flags, frameSize) == RegSyncCodec::HeaderIncomplete);
+      resip_assert(decode(header(2, RegSyncCodec::SnapshotDone).substr(0, 5), type, flags, frameSize) == RegSyncCodec::HeaderIncomplete);
+      // an empty payload is fine
+      resip_assert(decode(header(2, RegSyncCodec::SnapshotDone), type, flags, frameSize) == RegSyncCodec::HeaderComplete);
+      resip_assert(frameSize == RegSyncCodec::HeaderSize);
+      // shorter than the header itself
+      resip_assert(decode(header(0, RegSyncCodec::SnapshotDone), type, flags, frameSize) == RegSyncCodec::HeaderMalformed);
+      resip_assert(decode(header(1, RegSyncCodec::SnapshotDone), type, flags, frameSize) == RegSyncCodec::HeaderMalformed);
+      // the largest frame is waited for, anything larger is refused straight away
+      resip_assert(decode(header(RegSyncCodec::MaxFrameSize, RegSyncCodec::Snapshot), type, flags, frameSize) == RegSyncCodec::HeaderIncomplete);
+      resip_assert(decode(header(RegSyncCodec::MaxFrameSize + 1, RegSyncCodec::Snapshot), type, flags, frameSize) == RegSyncCodec::HeaderMalformed);
+      resip_assert(decode(header(0xFFFFFFFF, RegSyncCodec::Snapshot), type, flags, frameSize) == RegSyncCodec::HeaderMalformed);
+   }
+
+   {
+      cerr << "!! truncated payloads" << endl;
+      Data aorRecord;
+      resip_assert(RegSyncCodec::encodeAor(aorRecord, aor, contacts(serverNow)));
+      for(Data::size_type size = 0; size < aorRecord.size(); size++)
+      {
+         RegSyncCodec::Reader reader(aorRecord.data(), size);
+         Uri decodedAor;
+         ContactList decoded;
+         resip_assert(!reader.readAor(decodedAor, decoded, serverNow, now));
+         resip_assert(reader.atEnd());
+      }
+
+      // a varint running off the end, or longer than 64 bits
+      const char unterminated[] = { (char)0x80, (char)0x80 };
+      RegSyncCodec::Reader shortVarint(unterminated, sizeof(unterminated));
+      UInt64 value;
+      resip_assert(!shortVarint.readVarint(value) && shortVarint.atEnd());
+      Data longVarint(11, Data::Preallocate);
+      for(int i = 0; i < 10; i++)
+      {
+         longVarint += (char)0xFF;
+      }
+      longVarint += (char)0x01;
+      RegSyncCodec::Reader tooLong(longVarint.data(), longVarint.size());
+      resip_assert(!tooLong.readVarint(value) && tooLong.atEnd());
+
+      // a string claiming more bytes than there are
+      Data string;
+      RegSyncCodec::encodeString(string, "sip:alice@example.com");
+      RegSyncCodec::Reader shortString(string.data(), string.size() - 1);
+      Data decoded;
+      resip_assert(!shortString.readString(decoded) && shortString.atEnd());
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
@@ -0,0 +1,174 @@
+// Checks which literals RegexRuleIndex pulls out of route and filter
+// patterns, and which rules candidates() offers for a request.
+
+#include <iostream>
+
+#include "rutil/Data.hxx"
+#include "rutil/ResipAssert.h"
+
+#include "repro/RegexRuleIndex.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+namespace
+{
+
+void
+checkLiterals(const char* pattern, const char* prefix, const char* suffix)
+{
+   Data p;
+   Data s;
+   RegexRuleIndex::getLiterals(pattern, p, s);
+   if(p != prefix || s != suffix)
+   {
+      cerr << pattern << ": got prefix '" << p << "' suffix '" << s
+           << "', expected '" << prefix << "' '" << suffix << "'" << endl;
+      resip_assert(0);
+   }
+}
+
+void
+checkCandidates(const RegexRuleIndex& index,
+                const char* method,
+                const char* event,
+                const char* subject,
+                const char* expected)
+{
+   RegexRuleIndex::PositionList positions;
+   positions.push_back(99);  // candidates() appends
+   index.candidates(method, event, subject, positions);
+   Data got;
+   for(RegexRuleIndex::PositionList::const_iterator it = positions.begin() + 1; it != positions.end(); ++it)
+   {
+      got += Data((UInt64)*it);
+      got += ' ';
+   }
+   if(positions.front() != 99 || got != expected)
+   {
+      cerr << method << "/" << event << " " << subject << ": got '" << got
+           << "', expected '" << expected << "'" << endl;
+      resip_assert(0);
+   }
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   // anchors
+   checkLiterals("^sip:1234@example\\.com$", "sip:1234@example.com", "sip:1234@example.com");
+   checkLiterals("^sip:1234@", "sip:1234@", "");
+   checkLiterals("@example\\.com$", "", "@example.com");
+   checkLiterals("sip:1234@", "", "");
+   checkLiterals("^sip:12.*\\$$", "sip:12", "$");
+   checkLiterals("^sip:1^2", "sip:1", "");
+
+   // escapes: only ERE specials are literal
+   checkLiterals("^sip:\\+1\\(2\\)\\\\", "sip:+1(2)\\", "");
+   checkLiterals("^sip:12\\d+@", "sip:12", "");
+   checkLiterals("^sip:a\\/b", "sip:a", "");
+   checkLiterals("^sip:a\\-b$", "sip:a", "b");
+
+   // GNU anchors make a pattern unindexed
+   checkLiterals("^sip:\\<1234@host$", "", "");
+   checkLiterals("^sip:1234\\>@host$", "", "");
+   checkLiterals("\\`sip:1234@host$", "", "");
+   checkLiterals("^sip:1234@host\\'", "", "");
+   checkLiterals("^sip:(1234\\>)@host$", "", "");
+
+   // alternation
+   checkLiterals("^sip:1@host$|^sip:2@host$", "", "");
+   checkLiterals("^sip:(1|2)@host$", "sip:", "@host");
+   checkLiterals("^(?i)sip:1@host$", "", "");
+
+   // repetition
+   checkLiterals("^a+b", "a", "");
+   checkLiterals("^ab?c", "a", "");
+   checkLiterals("^ab{2}c$", "a", "c");
+   checkLiterals("^abc*$", "ab", "");
+
+   // bracket expressions
+   checkLiterals("^sip:[0-9]+@host$", "sip:", "@host");
+   checkLiterals("^sip:[]|]x$", "sip:", "x");
+   checkLiterals("^sip:[[:digit:]]x$", "sip:", "x");
+   checkLiterals("^sip:[\\d]x$", "", "");
+   checkLiterals("^sip:[0-9", "", "");
+
+   RegexRuleIndex index;
+   index.add(0, "INVITE", "", "^sip:1@");
+   index.add(1, "", "", "@example\\.com$");
+   index.add(2, "invite", "", "^sip:2@");
+   index.add(3, "", "", "sip:");
+   index.add(4, "SUBSCRIBE", "presence", "^sip:1@");
+   index.add(5, "", "", "^sip:\\<1@");
+   index.add(6, "", "", "^sip:(1|2)@");
+   checkCandidates(index, "INVITE", "", "sip:1@example.com", "");  // not built yet
+   index.build();
+
+   checkCandidates(index, "INVITE", "", "sip:1@example.com", "0 1 3 5 6 ");
+   checkCandidates(index, "INVITE", "", "sip:2@example.org", "2 3 5 6 ");
+   checkCandidates(index, "Invite", "", "sip:2@example.org", "2 3 5 6 ");
+   checkCandidates(index, "BYE", "", "sip:1@example.com", "1 3 5 6 ");
+   checkCandidates(index, "subscribe", "Presence", "sip:1@example.org", "3 4 5 6 ");
+   checkCandidates(index, "SUBSCRIBE", "", "sip:1@example.org", "3 5 6 ");
+   checkCandidates(index, "SUBSCRIBE", "dialog", "sip:1@example.org", "3 5 6 ");
+   checkCandidates(index, "", "", "sip:", "3 5 6 ");
+   checkCandidates(index, "", "", "", "3 5 ");
+
+   // rebuilt from scratch
+   index.clear();
+   checkCandidates(index, "INVITE", "", "sip:1@example.com", "");
+   index.add(0, "", "", "^sip:1@");
+   index.build();
+   checkCandidates(index, "INVITE", "", "sip:1@example.com", "0 ");
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
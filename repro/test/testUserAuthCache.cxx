@@ -0,0 +1,336 @@
+// Checks UserAuthCache against a fake database: concurrent misses sharing one
+// query, LRU eviction within a shard, TTL expiry, empty answers not being
+// cached, and invalidation while a query is in flight.
+
+#include <iostream>
+#include <map>
+#include <thread>
+#ifdef WIN32
+#include <windows.h>
+#define usleep(x) Sleep((x)/1000)
+#else
+#include <unistd.h>
+#endif
+
+#include "rutil/Condition.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ParseBuffer.hxx"
+#include "rutil/ResipAssert.h"
+
+#include "repro/AbstractDb.hxx"
+#include "repro/UserAuthCache.hxx"
+
+using namespace resip;
+using namespace repro;
+using namespace std;
+
+namespace
+{
+
+// answers getUserAuthInfo from a map and counts the queries; while blocked,
+// queries wait (holding the answer they read on the way in) until unblocked
+class FakeDb : public AbstractDb
+{
+   public:
+      FakeDb() : mBlocked(false), mQueries(0) {}
+
+      virtual bool isSane() { return true; }
+
+      virtual Data getUserAuthInfo(const Key& key) const
+      {
+         Lock lock(mMutex);
+         mQueries++;
+         mCondition.broadcast();
+         map<Data, Data>::const_iterator it = mA1s.find(key);
+         Data a1 = it == mA1s.end() ? Data::Empty : it->second;
+         while(mBlocked)
+         {
+            mCondition.wait(mMutex);
+         }
+         return a1;
+      }
+
+      void set(const Data& key, const Data& a1)
+      {
+         Lock lock(mMutex);
+         mA1s[key] = a1;
+      }
+
+      void block()
+      {
+         Lock lock(mMutex);
+         mBlocked = true;
+      }
+
+      void unblock()
+      {
+         Lock lock(mMutex);
+         mBlocked = false;
+         mCondition.broadcast();
+      }
+
+      void waitForQueries(int count) const
+      {
+         Lock lock(mMutex);
+         while(mQueries < count)
+         {
+            mCondition.wait(mMutex);
+         }
+      }
+
+      int queries() const
+      {
+         Lock lock(mMutex);
+         return mQueries;
+      }
+
+   protected:
+      virtual bool dbWriteRecord(const Table, const Data&, const Data&) { return false; }
+      virtual bool dbReadRecord(const Table, const Data&, Data&) const { return false; }
+      virtual void dbEraseRecord(const Table, const Data&, bool) {}
+      virtual Data dbNextKey(const Table, bool) { return Data::Empty; }
+      virtual bool dbNextRecord(const Table, const Data&, Data&, bool, bool) { return false; }
+      virtual bool dbBeginTransaction(const Table) { return true; }
+      virtual bool dbCommitTransaction(const Table) { return true; }
+      virtual bool dbRollbackTransaction(const Table) { return true; }
+
+   private:
+      mutable Mutex mMutex;
+      mutable Condition mCondition;
+      map<Data, Data> mA1s;
+      bool mBlocked;
+      mutable int mQueries;
+};
+
+Data
+stat(const UserAuthCache& cache, const char* name)
+{
+   Data stats;
+   {
+      DataStream ds(stats);
+      cache.encodeStats(ds);
+   }
+   ParseBuffer pb(stats);
+   const Data label = Data(name) + ": ";
+   while(!pb.eof())
+   {
+      const char* start = pb.position();
+      pb.skipToChar('\n');
+      Data line;
+      pb.data(line, start);
+      if(line.prefix(label))
+      {
+         return line.substr(label.size());
+      }
+      pb.skipChar();
+   }
+   resip_assert(0);
+   return Data::Empty;
+}
+
+void
+waitForStat(const UserAuthCache& cache, const char* name, const char* value)
+{
+   for(int i = 0; stat(cache, name) != value; i++)
+   {
+      resip_assert(i < 5000);
+      usleep(1000);
+   }
+}
+
+// keys that land in the given shard; the cache has 16 of them
+Data
+keyInShard(unsigned int shard, int n)
+{
+   for(int i = 0; ; i++)
+   {
+      Data key = "user" + Data(i) + "@example.com";
+      if(key.hash() % 16 == shard && n-- == 0)
+      {
+         return key;
+      }
+   }
+}
+
+}
+
+int
+main()
+{
+   {
+      cerr << "!! concurrent misses share one query" << endl;
+      FakeDb db;
+      db.set("alice@example.com", "a1alice");
+      UserAuthCache cache(60, 100);
+
+      db.block();
+      Data results[3];
+      thread first([&]() { results[0] = cache.getUserAuthInfo(db, "alice@example.com"); });
+      db.waitForQueries(1);
+      thread second([&]() { results[1] = cache.getUserAuthInfo(db, "alice@example.com"); });
+      thread third([&]() { results[2] = cache.getUserAuthInfo(db, "alice@example.com"); });
+      waitForStat(cache, "CoalescedMisses", "2");
+      db.unblock();
+      first.join();
+      second.join();
+      third.join();
+
+      for(int i = 0; i < 3; i++)
+      {
+         resip_assert(results[i] == "a1alice");
+      }
+      resip_assert(db.queries() == 1);
+      resip_assert(cache.getUserAuthInfo(db, "alice@example.com") == "a1alice");
+      resip_assert(db.queries() == 1);
+      resip_assert(stat(cache, "Hits") == "1");
+      resip_assert(stat(cache, "Misses") == "1");
+   }
+
+   {
+      cerr << "!! empty answers are not cached" << endl;
+      FakeDb db;
+      UserAuthCache cache(60, 100);
+
+      resip_assert(cache.getUserAuthInfo(db, "nobody@example.com").empty());
+      resip_assert(cache.getUserAuthInfo(db, "nobody@example.com").empty());
+      resip_assert(db.queries() == 2);
+
+      // a failed query looks the same; the user shows up once the db is back
+      db.set("bob@example.com", "");
+      resip_assert(cache.getUserAuthInfo(db, "bob@example.com").empty());
+      db.set("bob@example.com", "a1bob");
+      resip_assert(cache.getUserAuthInfo(db, "bob@example.com") == "a1bob");
+      resip_assert(cache.getUserAuthInfo(db, "bob@example.com") == "a1bob");
+      resip_assert(db.queries() == 4);
+      resip_assert(stat(cache, "Entries") == "1");
+   }
+
+   {
+      cerr << "!! LRU eviction within a shard" << endl;
+      FakeDb db;
+      UserAuthCache cache(60, 32);  // two entries per shard
+      const Data a = keyInShard(3, 0);
+      const Data b = keyInShard(3, 1);
+      const Data c = keyInShard(3, 2);
+      const Data other = keyInShard(4, 0);
+      db.set(a, "a1a");
+      db.set(b, "a1b");
+      db.set(c, "a1c");
+      db.set(other, "a1other");
+
+      cache.getUserAuthInfo(db, a);
+      cache.getUserAuthInfo(db, b);
+      cache.getUserAuthInfo(db, other);
+      cache.getUserAuthInfo(db, a);  // b is now the least recently used
+      resip_assert(db.queries() == 3);
+      cache.getUserAuthInfo(db, c);
+      resip_assert(db.queries() == 4);
+      resip_assert(stat(cache, "Evicted") == "1");
+
+      resip_assert(cache.getUserAuthInfo(db, a) == "a1a");
+      resip_assert(cache.getUserAuthInfo(db, c) == "a1c");
+      resip_assert(cache.getUserAuthInfo(db, other) == "a1other");
+      resip_assert(db.queries() == 4);
+      resip_assert(cache.getUserAuthInfo(db, b) == "a1b");
+      resip_assert(db.queries() == 5);
+      resip_assert(stat(cache, "Evicted") == "2");
+      resip_assert(stat(cache, "Entries") == "3");
+   }
+
+   {
+      cerr << "!! TTL expiry" << endl;
+      FakeDb db;
+      db.set("carol@example.com", "a1carol");
+      UserAuthCache cache(1, 100);
+
+      cache.getUserAuthInfo(db, "carol@example.com");
+      cache.getUserAuthInfo(db, "carol@example.com");
+      resip_assert(db.queries() == 1);
+      db.set("carol@example.com", "a1carol2");
+      usleep(1100*1000);
+      resip_assert(cache.getUserAuthInfo(db, "carol@example.com") == "a1carol2");
+      resip_assert(db.queries() == 2);
+      resip_assert(stat(cache, "Expired") == "1");
+   }
+
+   {
+      cerr << "!! invalidated while loading" << endl;
+      FakeDb db;
+      db.set("dave@example.com", "old");
+      UserAuthCache cache(60, 100);
+
+      db.block();
+      Data loading;
+      Data waiting;
+      thread first([&]() { loading = cache.getUserAuthInfo(db, "dave@example.com"); });
+      db.waitForQueries(1);
+      thread second([&]() { waiting = cache.getUserAuthInfo(db, "dave@example.com"); });
+      waitForStat(cache, "CoalescedMisses", "1");
+
+      db.set("dave@example.com", "new");
+      cache.invalidate("dave@example.com");
+      // a caller arriving after the invalidation does not join the stale query
+      Data later;
+      thread third([&]() { later = cache.getUserAuthInfo(db, "dave@example.com"); });
+      db.waitForQueries(2);
+      db.unblock();
+      first.join();
+      second.join();
+      third.join();
+
+      resip_assert(loading == "old");
+      resip_assert(waiting == "old");
+      resip_assert(later == "new");
+      resip_assert(cache.getUserAuthInfo(db, "dave@example.com") == "new");
+      resip_assert(db.queries() == 2);
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
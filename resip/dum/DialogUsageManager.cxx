@@ -32,6 +32,7 @@
 #include "resip/dum/DumException.hxx"
 #include "resip/dum/DumShutdownHandler.hxx"
 #include "resip/dum/DumFeatureMessage.hxx"
+#include "resip/dum/DumShardSet.hxx"
 #include "resip/dum/ExternalMessageBase.hxx"
 #include "resip/dum/ExternalMessageHandler.hxx"
 #include "resip/dum/InviteSessionCreator.hxx"
@@ -116,6 +117,9 @@ DialogUsageManager::DialogUsageManager(SipStack& stack, bool createDefaultFeatur
    mStack(stack),
    mDumShutdownHandler(0),
    mShutdownState(Running),
+   mShardIndex(0),
+   mShardCount(1),
+   mShardSet(0),
    mThreadDebugKey(0),
    mHiddenThreadDebugKey(0)
 {
@@ -207,6 +211,67 @@ DialogUsageManager::name() const
    return n;
 }
 
+bool
+DialogUsageManager::isForMe(const SipMessage& msg) const
+{
+   if (mShardSet && msg.isRequest())
+   {
+      if (mShardSet->shardForRequest(msg) != mShardIndex)
+      {
+         return false;
+      }
+   }
+   else if (mShardCount > 1)
+   {
+      // requests without a usable Call-ID go to the first shard, which will
+      // reject them
+      Data callId;
+      if (msg.exists(h_CallId) && msg.header(h_CallId).isWellFormed())
+      {
+         callId = msg.header(h_CallId).value();
+      }
+      if (callId.empty() ? mShardIndex != 0 : !ownsCallId(callId))
+      {
+         return false;
+      }
+   }
+   return TransactionUser::isForMe(msg);
+}
+
+void
+DialogUsageManager::setShard(unsigned int index, unsigned int count, DumShardSet* shardSet)
+{
+   resip_assert(count > 0 && index < count);
+   mShardIndex = index;
+   mShardCount = count;
+   mShardSet = shardSet;
+   InfoLog(<< "DialogUsageManager is shard " << index << " of " << count);
+}
+
+unsigned int
+DialogUsageManager::shardFor(const Data& callId, unsigned int count)
+{
+   return count > 1 ? (unsigned int)(callId.hash() % count) : 0;
+}
+
+bool
+DialogUsageManager::ownsCallId(const Data& callId) const
+{
+   return shardFor(callId, mShardCount) == mShardIndex;
+}
+
+Data
+DialogUsageManager::makeCallId() const
+{
+   // Call-IDs are random, so this takes mShardCount tries on average
+   Data callId(Helper::computeCallId());
+   while (!ownsCallId(callId))
+   {
+      callId = Helper::computeCallId();
+   }
+   return callId;
+}
+
 void
 DialogUsageManager::addTransport( TransportType protocol,
                                   int port,
@@ -1269,6 +1334,11 @@ DialogUsageManager::findInviteSession(CallId replaces)
    //486/481/603 decision making logic where?  App may not wish to keep track of
    //invitesession state
    //Logic is here for now.
+   if (!ownsCallId(replaces.value()))
+   {
+      WarningLog(<< "Replaces " << replaces.value() << " belongs to shard " << shardFor(replaces.value(), mShardCount)
+                 << ", not this one (" << mShardIndex << "); use DumShardSet to post to it");
+   }
    InviteSessionHandle is = findInviteSession(DialogId(replaces.value(),
                                                        replaces.param(p_toTag),
                                                        replaces.param(p_fromTag)));
@@ -2140,6 +2210,10 @@ DialogUsageManager::processRequest(const SipMessage& request)
                //StackLog ( << "Before: " << Inserter(mDialogSetMap) );
                mDialogSetMap[dset->getId()] = dset;
                StackLog ( << "DialogSetMap: " << InserterP(mDialogSetMap) );
+               if (mShardSet)
+               {
+                  mShardSet->claimCallId(dset->getId().getCallId());
+               }
 
                dset->dispatch(request);
             }
@@ -2351,7 +2425,10 @@ DialogUsageManager::removeDialogSet(const DialogSetId& dsId)
 {
    StackLog ( << "************* Removing DialogSet ***************: " << dsId);
    //StackLog ( << "Before: " << Inserter(mDialogSetMap) );
-   mDialogSetMap.erase(dsId);
+   if (mDialogSetMap.erase(dsId) && mShardSet)
+   {
+      mShardSet->releaseCallId(dsId.getCallId());
+   }
    StackLog ( << "DialogSetMap: " << InserterP(mDialogSetMap) );
    if (mRedirectManager)
    {
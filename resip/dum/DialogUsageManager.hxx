@@ -76,6 +76,7 @@ class ExternalMessageHandler;
 
 class DialogEventStateManager;
 class DialogEventHandler;
+class DumShardSet;
 
 class DialogUsageManager : public HandleManager, public TransactionUser
 {
@@ -143,6 +144,20 @@ class DialogUsageManager : public HandleManager, public TransactionUser
 
       void setKeepAliveManager(std::unique_ptr<KeepAliveManager> keepAlive);
 
+      /// Makes this DUM shard index of count DUMs registered with the same
+      /// SipStack (see DumShardSet). It is then only offered new requests
+      /// whose Call-ID hashes to index (or that shardSet routes to it), and
+      /// gives the requests it creates Call-IDs that do, so every dialog
+      /// stays on one shard. Must be called before the stack hands this DUM
+      /// any requests.
+      void setShard(unsigned int index, unsigned int count, DumShardSet* shardSet=0);
+      unsigned int getShardIndex() const { return mShardIndex; }
+      unsigned int getShardCount() const { return mShardCount; }
+      static unsigned int shardFor(const Data& callId, unsigned int count);
+      bool ownsCallId(const Data& callId) const;
+      /// a new Call-ID that routes to this shard
+      Data makeCallId() const;
+
       //There is a default RedirectManager.  Setting one may cause the old one
       //to be deleted. 
       void setRedirectManager(std::unique_ptr<RedirectManager> redirect);
@@ -368,6 +383,7 @@ class DialogUsageManager : public HandleManager, public TransactionUser
       virtual void onAllHandlesDestroyed();      
       //TransactionUser virtuals
       virtual const Data& name() const;
+      virtual bool isForMe(const SipMessage& msg) const;
       friend class DumThread;
 
       DumFeatureChain::FeatureList mIncomingFeatureList;
@@ -551,6 +567,10 @@ class DialogUsageManager : public HandleManager, public TransactionUser
       } ShutdownState;
       ShutdownState mShutdownState;
 
+      unsigned int mShardIndex;
+      unsigned int mShardCount;
+      DumShardSet* mShardSet;
+
       // from ETag -> ServerPublication
       typedef std::map<Data, ServerPublication*> ServerPublications;
       ServerPublications mServerPublications;
@@ -0,0 +1,236 @@
+#include "resip/dum/DumShardSet.hxx"
+#include "resip/dum/DialogSetId.hxx"
+#include "resip/dum/DialogUsageManager.hxx"
+#include "resip/dum/DumCommand.hxx"
+#include "resip/dum/DumThread.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ResipAssert.h"
+#include "rutil/Timer.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::DUM
+
+using namespace resip;
+
+DumShardSet::DumShardSet(unsigned int count) :
+   mCount(count)
+{
+   resip_assert(count > 0);
+}
+
+DumShardSet::~DumShardSet()
+{
+   shutdown();
+   join();
+}
+
+void
+DumShardSet::add(DialogUsageManager& dum)
+{
+   resip_assert(mShards.size() < mCount);
+   resip_assert(mShards.empty() || &mShards.front()->getSipStack() == &dum.getSipStack());
+   dum.setShard((unsigned int)mShards.size(), mCount, this);
+   mShards.push_back(&dum);
+}
+
+DialogUsageManager&
+DumShardSet::shard(unsigned int index) const
+{
+   resip_assert(index < mShards.size());
+   return *mShards[index];
+}
+
+DialogUsageManager&
+DumShardSet::shardFor(const Data& callId) const
+{
+   resip_assert(mShards.size() == mCount);
+   return *mShards[DialogUsageManager::shardFor(callId, mCount)];
+}
+
+DialogUsageManager&
+DumShardSet::shardFor(const DialogSetId& id) const
+{
+   return shardFor(id.getCallId());
+}
+
+void
+DumShardSet::post(const Data& callId, DumCommand* command)
+{
+   shardFor(callId).post(command);
+}
+
+unsigned int
+DumShardSet::shardForRequest(const SipMessage& request)
+{
+   // requests without a usable Call-ID go to the first shard, which will
+   // reject them
+   if (!request.exists(h_CallId) || !request.header(h_CallId).isWellFormed() ||
+       request.header(h_CallId).value().empty())
+   {
+      return 0;
+   }
+   const Data& callId = request.header(h_CallId).value();
+   const MethodTypes method = request.method();
+
+   if (method == REGISTER && request.exists(h_To) && request.header(h_To).isWellFormed())
+   {
+      return DialogUsageManager::shardFor(request.header(h_To).uri().getAor(), mCount);
+   }
+   if (method == PUBLISH)
+   {
+      return DialogUsageManager::shardFor(request.header(h_RequestLine).uri().getAor(), mCount);
+   }
+
+   const unsigned int hashed = DialogUsageManager::shardFor(callId, mCount);
+   unsigned int shard = hashed;
+   bool starting = request.exists(h_To) && request.header(h_To).isWellFormed() &&
+                   !request.header(h_To).exists(p_tag);
+   if (starting && method == INVITE && request.exists(h_Replaces) && request.header(h_Replaces).isWellFormed())
+   {
+      shard = DialogUsageManager::shardFor(request.header(h_Replaces).value(), mCount);
+   }
+   else if (starting && method == SUBSCRIBE)
+   {
+      shard = DialogUsageManager::shardFor(request.header(h_RequestLine).uri().getAor(), mCount);
+   }
+   else
+   {
+      starting = false;
+   }
+
+   Lock lock(mPinMutex);
+   HashMap<Data, Pin>::iterator it = mPins.find(callId);
+   if (it != mPins.end())
+   {
+      if (starting && it->second.mDialogSets == 0)
+      {
+         // a retry, say after a challenge; keep the pin a while longer
+         it->second.mExpires = Timer::getTimeMs() + 64*Timer::T1;
+         mPinExpiries.push_back(std::make_pair(it->second.mExpires, callId));
+      }
+      return it->second.mShard;
+   }
+   if (shard == hashed)
+   {
+      return shard;
+   }
+
+   const UInt64 now = Timer::getTimeMs();
+   while (!mPinExpiries.empty() && mPinExpiries.front().first <= now)
+   {
+      HashMap<Data, Pin>::iterator old = mPins.find(mPinExpiries.front().second);
+      if (old != mPins.end() && old->second.mDialogSets == 0 && old->second.mExpires <= now)
+      {
+         mPins.erase(old);
+      }
+      mPinExpiries.pop_front();
+   }
+   Pin& pin = mPins[callId];
+   pin.mShard = shard;
+   pin.mExpires = now + 64*Timer::T1;
+   mPinExpiries.push_back(std::make_pair(pin.mExpires, callId));
+   DebugLog(<< "Pinned " << request.brief() << " to shard " << shard << " rather than " << hashed);
+   return shard;
+}
+
+void
+DumShardSet::claimCallId(const Data& callId)
+{
+   Lock lock(mPinMutex);
+   HashMap<Data, Pin>::iterator it = mPins.find(callId);
+   if (it != mPins.end())
+   {
+      it->second.mDialogSets++;
+   }
+}
+
+void
+DumShardSet::releaseCallId(const Data& callId)
+{
+   Lock lock(mPinMutex);
+   HashMap<Data, Pin>::iterator it = mPins.find(callId);
+   if (it != mPins.end() && it->second.mDialogSets > 0 && --it->second.mDialogSets == 0)
+   {
+      mPins.erase(it);
+   }
+}
+
+void
+DumShardSet::run()
+{
+   resip_assert(mShards.size() == mCount);
+   resip_assert(mThreads.empty());
+   InfoLog(<< "Starting " << mCount << " DUM shard threads");
+   for (std::vector<DialogUsageManager*>::iterator it = mShards.begin(); it != mShards.end(); ++it)
+   {
+      DumThread* thread = new DumThread(**it);
+      mThreads.push_back(thread);
+      thread->run();
+   }
+}
+
+void
+DumShardSet::shutdown()
+{
+   for (std::vector<DumThread*>::iterator it = mThreads.begin(); it != mThreads.end(); ++it)
+   {
+      (*it)->shutdown();
+   }
+}
+
+void
+DumShardSet::join()
+{
+   for (std::vector<DumThread*>::iterator it = mThreads.begin(); it != mThreads.end(); ++it)
+   {
+      (*it)->join();
+      delete *it;
+   }
+   mThreads.clear();
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
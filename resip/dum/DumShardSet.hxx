@@ -0,0 +1,156 @@
+#if !defined(RESIP_DumShardSet_hxx)
+#define RESIP_DumShardSet_hxx
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/HashMap.hxx"
+#include "rutil/Mutex.hxx"
+
+namespace resip
+{
+
+class DialogSetId;
+class DialogUsageManager;
+class DumCommand;
+class DumThread;
+class SipMessage;
+
+/**
+   Splits dialog processing over several DialogUsageManagers (shards) on one
+   SipStack, each with its own DumThread.
+
+   Every shard is a complete DUM - its own profiles, handlers, timers and
+   KeepAliveManager - owning the dialogs whose Call-ID hashes to it (see
+   DialogUsageManager::setShard). The stack offers each new request,
+   in-dialog requests, ACK and CANCEL included, to the shard that owns its
+   Call-ID, and responses go back to the shard that sent the request, so
+   each shard's handlers keep seeing only their own dialogs, on one thread.
+
+   Some requests belong with state that is not keyed by their Call-ID, and
+   are routed by shardForRequest() instead:
+   - REGISTER goes to the shard owning its To AOR, so that refreshes and
+     registrations for one AOR from different Call-IDs meet on one shard.
+   - PUBLISH goes to the shard owning its Request-URI AOR, so that an ETag
+     refresh sent under a new Call-ID finds its ServerPublication.
+   - An out-of-dialog SUBSCRIBE goes to the shard owning its Request-URI
+     AOR, next to the PUBLISHes for that resource, so that a presence
+     server's applyToServerSubscriptions() sees every subscriber.
+   - An INVITE with Replaces goes to the shard owning the dialog it
+     replaces, where findInviteSession(CallId) can find it.
+   The last two start dialogs whose Call-ID may hash elsewhere, so that
+   Call-ID is pinned to the chosen shard until the shard has no dialog set
+   for it left (or, if none was ever made, for 64*T1). Requests for an
+   unpinned Call-ID follow the hash as usual.
+
+   This does not cover everything. An out-of-dialog SUBSCRIBE must not
+   reuse the Call-ID of a live dialog (RFC 3261 asks for a new one anyway);
+   if it does, later requests for that Call-ID follow the SUBSCRIBE. Other
+   work on another shard's dialog (a REFER naming a dialog elsewhere, or a
+   dialog the application looks up itself) has to be posted to the owning
+   shard as a DumCommand with post(). Anything the shards share, such as a
+   RegistrationPersistenceManager, must be thread safe.
+*/
+class DumShardSet
+{
+   public:
+      /// count shards are then added with add()
+      DumShardSet(unsigned int count);
+      ~DumShardSet();
+
+      /// makes dum the next shard; it must be on the same SipStack as the
+      /// others, and be added before the stack starts handing it requests
+      void add(DialogUsageManager& dum);
+
+      unsigned int size() const { return (unsigned int)mShards.size(); }
+      DialogUsageManager& shard(unsigned int index) const;
+      DialogUsageManager& shardFor(const Data& callId) const;
+      DialogUsageManager& shardFor(const DialogSetId& id) const;
+
+      /// runs command on the thread of the shard owning callId; takes ownership
+      void post(const Data& callId, DumCommand* command);
+
+      /// the shard a request from the wire goes to; called by the shards'
+      /// isForMe() on the stack thread, pinning the Call-ID if need be
+      unsigned int shardForRequest(const SipMessage& request);
+      /// a shard made, or destroyed, a UAS dialog set for callId
+      void claimCallId(const Data& callId);
+      void releaseCallId(const Data& callId);
+
+      /// starts a DumThread for each shard
+      void run();
+      void shutdown();
+      void join();
+
+   private:
+      class Pin
+      {
+         public:
+            Pin() : mShard(0), mDialogSets(0), mExpires(0) {}
+            unsigned int mShard;
+            unsigned int mDialogSets;  // no expiry while there are any
+            UInt64 mExpires;
+      };
+
+      unsigned int mCount;
+      std::vector<DialogUsageManager*> mShards;
+      std::vector<DumThread*> mThreads;
+
+      Mutex mPinMutex;
+      HashMap<Data, Pin> mPins;
+      std::deque<std::pair<UInt64, Data> > mPinExpiries;  // in expiry order
+
+      // no value semantics
+      DumShardSet(const DumShardSet&);
+      DumShardSet& operator=(const DumShardSet&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
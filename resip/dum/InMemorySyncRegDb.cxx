@@ -1,4 +1,6 @@
 #include "resip/dum/InMemorySyncRegDb.hxx"
+#include "rutil/RWMutex.hxx"
+#include "rutil/ThreadIf.hxx"
 #include "rutil/Timer.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/WinLeakCheck.hxx"
@@ -53,19 +55,221 @@ contactsRemoveIfRequired(ContactList& contacts, UInt64& now,
 #endif
 }
 
-InMemorySyncRegDb::InMemorySyncRegDb(unsigned int removeLingerSecs) : 
-   mRemoveLingerSecs(removeLingerSecs)
+/**
+   One AOR's bindings, plus the lockRecord()/unlockRecord() state for it.
+   All members are protected by mMutex, which is only ever taken while
+   holding the owning shard's lock (in either mode), except by lockRecord()
+   callers waiting on mUnlocked; those have pinned the record so it cannot
+   be erased underneath them.
+*/
+class InMemorySyncRegDb::AorRecord
 {
+   public:
+      AorRecord() : mContacts(0), mLocked(false), mPins(0) {}
+      ~AorRecord() { delete mContacts; }
+
+      Mutex mMutex;
+      Condition mUnlocked;
+      // 0 if the AOR has no bindings
+      ContactList* mContacts;
+      bool mLocked;
+      // Number of lockRecord() callers that hold or wait for the lock.  Only
+      // changed with the shard lock held as well, so it is stable while the
+      // shard is write locked.
+      unsigned int mPins;
+
+      bool unused() const { return mContacts == 0 && mPins == 0; }
+};
+
+class InMemorySyncRegDb::Shard
+{
+   public:
+      ~Shard()
+      {
+         for (RecordMap::iterator it = mRecords.begin(); it != mRecords.end(); ++it)
+         {
+            delete it->second;
+         }
+      }
+
+      typedef std::map<Uri, AorRecord*> RecordMap;
+      // write locked only to insert or erase entries
+      RWMutex mMutex;
+      RecordMap mRecords;
+};
+
+/**
+   Delivers onAorModified() callbacks from its own thread.  Pending changes
+   are kept in the order they were made; a change replaces the pending one
+   for the same AOR if that is the most recent and has the same sync flag.
+*/
+class InMemorySyncRegDb::Notifier : public ThreadIf
+{
+   public:
+      Notifier(InMemorySyncRegDb& db) : mDb(db), mDelivering(false) {}
+
+      void post(bool sync, const Uri& aor, const ContactList& contacts)
+      {
+         Lock lock(mMutex);
+         LatestMap::iterator i = mLatest.find(aor);
+         if (i != mLatest.end() && i->second->mSync == sync)
+         {
+            i->second->mContacts = contacts;
+            return;
+         }
+         mPending.push_back(Change(sync, aor, contacts));
+         mLatest[aor] = --mPending.end();
+         mPosted.signal();
+      }
+
+      /// waits until everything posted so far has been delivered
+      void flush()
+      {
+         Lock lock(mMutex);
+         while (!mPending.empty() || mDelivering)
+         {
+            mDelivered.wait(mMutex);
+         }
+      }
+
+      virtual void shutdown()
+      {
+         Lock lock(mMutex);
+         ThreadIf::shutdown();
+         mPosted.signal();
+      }
+
+      virtual void thread()
+      {
+         for (;;)
+         {
+            ChangeList batch;
+            {
+               Lock lock(mMutex);
+               while (mPending.empty() && !isShutdown())
+               {
+                  mPosted.wait(mMutex);
+               }
+               if (mPending.empty())
+               {
+                  break;  // shut down, and nothing left to deliver
+               }
+               batch.swap(mPending);
+               mLatest.clear();
+               mDelivering = true;
+            }
+
+            {
+               Lock lock(mDb.mHandlerMutex);
+               for (ChangeList::const_iterator it = batch.begin(); it != batch.end(); ++it)
+               {
+                  mDb.notifyAorModified(it->mSync, it->mAor, it->mContacts);
+               }
+            }
+
+            Lock lock(mMutex);
+            mDelivering = false;
+            mDelivered.broadcast();
+         }
+      }
+
+   private:
+      struct Change
+      {
+         Change(bool sync, const Uri& aor, const ContactList& contacts) :
+            mSync(sync), mAor(aor), mContacts(contacts) {}
+         bool mSync;
+         Uri mAor;
+         ContactList mContacts;
+      };
+      typedef std::list<Change> ChangeList;
+      typedef std::map<Uri, ChangeList::iterator> LatestMap;
+
+      InMemorySyncRegDb& mDb;
+      Mutex mMutex;
+      Condition mPosted;
+      Condition mDelivered;
+      ChangeList mPending;
+      LatestMap mLatest;
+      bool mDelivering;
+};
+
+InMemorySyncRegDb::InMemorySyncRegDb(unsigned int removeLingerSecs,
+                                     bool asyncNotify,
+                                     unsigned int numShards) : 
+   mRemoveLingerSecs(removeLingerSecs),
+   mNotifier(0)
+{
+   mShards.resize(resipMax(numShards, 1u));
+   for (std::vector<Shard*>::iterator it = mShards.begin(); it != mShards.end(); ++it)
+   {
+      *it = new Shard;
+   }
+   if (asyncNotify)
+   {
+      mNotifier = new Notifier(*this);
+      mNotifier->run();
+   }
 }
 
 InMemorySyncRegDb::~InMemorySyncRegDb()
 {
-   for( database_map_t::const_iterator it = mDatabase.begin();
-        it != mDatabase.end(); it++)
+   if (mNotifier)
+   {
+      // delivers whatever is still pending before the thread exits
+      mNotifier->shutdown();
+      mNotifier->join();
+      delete mNotifier;
+   }
+   for (std::vector<Shard*>::iterator it = mShards.begin(); it != mShards.end(); ++it)
+   {
+      delete *it;
+   }
+   mShards.clear();
+}
+
+InMemorySyncRegDb::Shard&
+InMemorySyncRegDb::getShard(const Uri& aor) const
+{
+   // Uri ordering compares the user part exactly, so equal AORs always
+   // hash to the same shard.
+   return *mShards[aor.user().hash() % mShards.size()];
+}
+
+InMemorySyncRegDb::AorRecord*
+InMemorySyncRegDb::findRecord(Shard& shard, const Uri& aor) const
+{
+   Shard::RecordMap::const_iterator i = shard.mRecords.find(aor);
+   return i == shard.mRecords.end() ? 0 : i->second;
+}
+
+InMemorySyncRegDb::AorRecord&
+InMemorySyncRegDb::createRecord(Shard& shard, const Uri& aor)
+{
+   // Caller holds the shard write lock.
+   std::pair<Shard::RecordMap::iterator, bool> res =
+      shard.mRecords.insert(Shard::RecordMap::value_type(aor, 0));
+   if (res.second)
+   {
+      // Uri comparison parses and canonicalizes lazily; do it now, while we
+      // are alone, rather than in concurrent finds under the read lock.
+      (void)(res.first->first < res.first->first);
+      res.first->second = new AorRecord;
+   }
+   return *res.first->second;
+}
+
+void
+InMemorySyncRegDb::eraseIfUnused(Shard& shard, const Uri& aor)
+{
+   WriteLock g(shard.mMutex);
+   Shard::RecordMap::iterator i = shard.mRecords.find(aor);
+   // nobody else can be using the record while we hold the write lock
+   if (i != shard.mRecords.end() && i->second->unused())
    {
-      delete it->second;
+      delete i->second;
+      shard.mRecords.erase(i);
    }
-   mDatabase.clear();
 }
 
 void 
@@ -92,7 +296,18 @@ InMemorySyncRegDb::removeHandler(InMemorySyncRegDbHandler* handler)
 void 
 InMemorySyncRegDb::invokeOnAorModified(bool sync, const resip::Uri& aor, const ContactList& contacts)
 {
+   if (mNotifier)
+   {
+      mNotifier->post(sync, aor, contacts);
+      return;
+   }
    Lock lock(mHandlerMutex);
+   notifyAorModified(sync, aor, contacts);
+}
+
+void 
+InMemorySyncRegDb::notifyAorModified(bool sync, const resip::Uri& aor, const ContactList& contacts)
+{
    for(HandlerList::iterator it = mHandlers.begin(); it != mHandlers.end(); it++)
    {
       // If handler mode is all, then send notification, otherwise handler mode is sync and we check the passed
@@ -120,18 +335,28 @@ InMemorySyncRegDb::invokeOnInitialSyncAor(unsigned int connectionId, const resip
 void 
 InMemorySyncRegDb::initialSync(unsigned int connectionId)
 {
-   Lock g(mDatabaseMutex);
+   if (mNotifier)
+   {
+      // so that the peer does not get older changes after the full state
+      mNotifier->flush();
+   }
    UInt64 now = Timer::getTimeSecs();
-   for(database_map_t::iterator it = mDatabase.begin(); it != mDatabase.end(); it++)
+   for (std::vector<Shard*>::iterator s = mShards.begin(); s != mShards.end(); ++s)
    {
-      if(it->second)
+      ReadLock g((*s)->mMutex);
+      for (Shard::RecordMap::iterator it = (*s)->mRecords.begin(); it != (*s)->mRecords.end(); it++)
       {
-         ContactList& contacts = *(it->second);
-         if(mRemoveLingerSecs > 0) 
+         AorRecord& record = *it->second;
+         Lock r(record.mMutex);
+         if(record.mContacts)
          {
-            contactsRemoveIfRequired(contacts, now, mRemoveLingerSecs);
+            ContactList& contacts = *record.mContacts;
+            if(mRemoveLingerSecs > 0) 
+            {
+               contactsRemoveIfRequired(contacts, now, mRemoveLingerSecs);
+            }
+            invokeOnInitialSyncAor(connectionId, it->first, contacts);
          }
-         invokeOnInitialSyncAor(connectionId, it->first, contacts);
       }
    }
 }
@@ -140,22 +365,31 @@ void
 InMemorySyncRegDb::addAor(const Uri& aor,
                           const ContactList& contacts)
 {
-   Lock g(mDatabaseMutex);
-   database_map_t::iterator it = mDatabase.find(aor);
-   if(it != mDatabase.end())
+   Shard& shard = getShard(aor);
    {
-       if(it->second)
-       {
-           *(it->second) = contacts;
-       }
-       else
-       {
-           it->second = new ContactList(contacts);
-       }
+      ReadLock g(shard.mMutex);
+      AorRecord* record = findRecord(shard, aor);
+      if (record)
+      {
+         addAor(*record, aor, contacts);
+         return;
+      }
+   }
+   WriteLock g(shard.mMutex);
+   addAor(createRecord(shard, aor), aor, contacts);
+}
+
+void
+InMemorySyncRegDb::addAor(AorRecord& record, const Uri& aor, const ContactList& contacts)
+{
+   Lock r(record.mMutex);
+   if(record.mContacts)
+   {
+      *record.mContacts = contacts;
    }
    else
    {
-       mDatabase[aor] = new ContactList(contacts);
+      record.mContacts = new ContactList(contacts);
    }
    invokeOnAorModified(true /* sync? */, aor, contacts);
 }
@@ -163,48 +397,61 @@ InMemorySyncRegDb::addAor(const Uri& aor,
 void 
 InMemorySyncRegDb::removeAor(const Uri& aor)
 {
-  database_map_t::iterator i;
-
-  Lock g(mDatabaseMutex);
-  i = mDatabase.find(aor);
-  //DebugLog (<< "Removing registration bindings " << aor);
-  if (i != mDatabase.end())
-  {
-     if (i->second)
-     {
-        if(mRemoveLingerSecs > 0)
-        {
-           ContactList& contacts = *(i->second);
-           UInt64 now = Timer::getTimeSecs();
-           for(ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
-           {
-              // Don't delete record - set expires to 0
-              it->mRegExpires = 0;
-              it->mLastUpdated = now;
-           }
-           invokeOnAorModified(true /* sync? */, aor, contacts);
-        }
-        else
-        {
-           delete i->second;
-           // Setting this to 0 causes it to be removed when we unlock the AOR.
-           i->second = 0;
-           ContactList emptyList;
-           invokeOnAorModified(true /* sync? */, aor, emptyList);
-        }
-     }
-  }
+   Shard& shard = getShard(aor);
+   bool erase = false;
+   {
+      ReadLock g(shard.mMutex);
+      AorRecord* record = findRecord(shard, aor);
+      //DebugLog (<< "Removing registration bindings " << aor);
+      if (!record)
+      {
+         return;
+      }
+      Lock r(record->mMutex);
+      if (record->mContacts)
+      {
+         if(mRemoveLingerSecs > 0)
+         {
+            ContactList& contacts = *record->mContacts;
+            UInt64 now = Timer::getTimeSecs();
+            for(ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
+            {
+               // Don't delete record - set expires to 0
+               it->mRegExpires = 0;
+               it->mLastUpdated = now;
+            }
+            invokeOnAorModified(true /* sync? */, aor, contacts);
+         }
+         else
+         {
+            delete record->mContacts;
+            // If the record is locked, this causes it to be removed when
+            // the last lock is released.
+            record->mContacts = 0;
+            ContactList emptyList;
+            invokeOnAorModified(true /* sync? */, aor, emptyList);
+            erase = record->unused();
+         }
+      }
+   }
+   if (erase)
+   {
+      eraseIfUnused(shard, aor);
+   }
 }
 
 void
 InMemorySyncRegDb::getAors(InMemorySyncRegDb::UriList& container)
 {
    container.clear();
-   Lock g(mDatabaseMutex);
-   for( database_map_t::const_iterator it = mDatabase.begin();
-        it != mDatabase.end(); it++)
+   for (std::vector<Shard*>::iterator s = mShards.begin(); s != mShards.end(); ++s)
    {
-      container.push_back(it->first);
+      ReadLock g((*s)->mMutex);
+      for (Shard::RecordMap::const_iterator it = (*s)->mRecords.begin();
+           it != (*s)->mRecords.end(); it++)
+      {
+         container.push_back(it->first);
+      }
    }
 }
 
@@ -217,14 +464,21 @@ InMemorySyncRegDb::aorIsRegistered(const Uri& aor)
 bool 
 InMemorySyncRegDb::aorIsRegistered(const Uri& aor, UInt64* maxExpires)
 {
-   Lock g(mDatabaseMutex);
+   Shard& shard = getShard(aor);
+   ReadLock g(shard.mMutex);
+   AorRecord* record = findRecord(shard, aor);
+   if (!record)
+   {
+      return false;
+   }
+
+   Lock r(record->mMutex);
    bool registered = false;
-   database_map_t::iterator i = mDatabase.find(aor);
-   if (i != mDatabase.end() && i->second != 0)
+   if (record->mContacts != 0)
    {
       if (mRemoveLingerSecs > 0 || maxExpires)
       {
-         ContactList& contacts = *(i->second);
+         ContactList& contacts = *record->mContacts;
          UInt64 now = Timer::getTimeSecs();
          for(ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
          {
@@ -253,72 +507,94 @@ InMemorySyncRegDb::aorIsRegistered(const Uri& aor, UInt64* maxExpires)
 void
 InMemorySyncRegDb::lockRecord(const Uri& aor)
 {
-   Lock g2(mLockedRecordsMutex);
-
    DebugLog(<< "InMemorySyncRegDb::lockRecord:  aor=" << aor << " threadid=" << ThreadIf::selfId());
 
+   Shard& shard = getShard(aor);
+   AorRecord* record = 0;
+   {
+      ReadLock g(shard.mMutex);
+      record = findRecord(shard, aor);
+      if (record)
+      {
+         Lock r(record->mMutex);
+         ++record->mPins;
+      }
+   }
+   if (!record)
    {
-      Lock g1(mDatabaseMutex);
       // This forces insertion if the record does not yet exist.
-      mDatabase[aor];
+      WriteLock g(shard.mMutex);
+      record = &createRecord(shard, aor);
+      Lock r(record->mMutex);
+      ++record->mPins;
    }
 
-   while (mLockedRecords.count(aor))
+   // The pin keeps the record in the map, so it is safe to wait without
+   // holding the shard lock.
+   Lock r(record->mMutex);
+   while (record->mLocked)
    {
-      mRecordUnlocked.wait(mLockedRecordsMutex);
+      record->mUnlocked.wait(record->mMutex);
    }
-
-   mLockedRecords.insert(aor);
+   record->mLocked = true;
 }
 
 void
 InMemorySyncRegDb::unlockRecord(const Uri& aor)
 {
-   Lock g2(mLockedRecordsMutex);
-
    DebugLog(<< "InMemorySyncRegDb::unlockRecord:  aor=" << aor << " threadid=" << ThreadIf::selfId());
 
+   Shard& shard = getShard(aor);
+   bool erase = false;
    {
-      Lock g1(mDatabaseMutex);
-      // If the pointer is null, we remove the record from the map.
-      database_map_t::iterator i = mDatabase.find(aor);
+      ReadLock g(shard.mMutex);
+      AorRecord* record = findRecord(shard, aor);
 
       // The record must have been inserted when we locked it in the first place
-      resip_assert (i != mDatabase.end());
-
-      if (i->second == 0)
-      {
-         mDatabase.erase(i);
-      }
+      resip_assert(record);
+
+      Lock r(record->mMutex);
+      resip_assert(record->mLocked && record->mPins > 0);
+      record->mLocked = false;
+      --record->mPins;
+      // If there are no contacts left, we remove the record from the map.
+      erase = record->unused();
+      record->mUnlocked.signal();
+   }
+   if (erase)
+   {
+      eraseIfUnused(shard, aor);
    }
-
-   mLockedRecords.erase(aor);
-   mRecordUnlocked.broadcast();
 }
 
 RegistrationPersistenceManager::update_status_t 
 InMemorySyncRegDb::updateContact(const resip::Uri& aor, 
                                  const ContactInstanceRecord& rec) 
 {
-   ContactList *contactList = 0;
-
+   Shard& shard = getShard(aor);
    {
-      Lock g(mDatabaseMutex);
-
-      database_map_t::iterator i;
-      i = mDatabase.find(aor);
-      if (i == mDatabase.end() || i->second == 0)
+      ReadLock g(shard.mMutex);
+      AorRecord* record = findRecord(shard, aor);
+      if (record)
       {
-         contactList = new ContactList();
-         mDatabase[aor] = contactList;
-      }
-      else
-      {
-         contactList = i->second;
+         return updateContact(*record, aor, rec);
       }
    }
-   
-   resip_assert(contactList);
+   WriteLock g(shard.mMutex);
+   return updateContact(createRecord(shard, aor), aor, rec);
+}
+
+RegistrationPersistenceManager::update_status_t 
+InMemorySyncRegDb::updateContact(AorRecord& record,
+                                 const resip::Uri& aor, 
+                                 const ContactInstanceRecord& rec) 
+{
+   Lock r(record.mMutex);
+   if (record.mContacts == 0)
+   {
+      record.mContacts = new ContactList();
+   }
+   ContactList* contactList = record.mContacts;
 
    ContactList::iterator j;
 
@@ -354,65 +630,85 @@ void
 InMemorySyncRegDb::removeContact(const Uri& aor, 
                                  const ContactInstanceRecord& rec)
 {
-   ContactList *contactList = 0;
-
+   Shard& shard = getShard(aor);
+   bool erase = false;
    {
-      Lock g(mDatabaseMutex);
-
-      database_map_t::iterator i;
-      i = mDatabase.find(aor);
-      if (i == mDatabase.end() || i->second == 0)
+      ReadLock g(shard.mMutex);
+      AorRecord* record = findRecord(shard, aor);
+      if (!record)
+      {
+         return;
+      }
+      Lock r(record->mMutex);
+      ContactList* contactList = record->mContacts;
+      if (contactList == 0)
       {
          return;
       }
-      contactList = i->second;
-   }
 
-   ContactList::iterator j;
+      ContactList::iterator j;
 
-   // See if the contact is present. We use URI matching rules here.
-   for (j = contactList->begin(); j != contactList->end(); j++)
-   {
-      if (*j == rec)
+      // See if the contact is present. We use URI matching rules here.
+      for (j = contactList->begin(); j != contactList->end(); j++)
       {
-         if(mRemoveLingerSecs > 0)
+         if (*j == rec)
          {
-            j->mRegExpires = 0;
-            j->mLastUpdated = Timer::getTimeSecs();
-            // Only pass sync as true if this update didn't just come from an inbound sync operation
-            invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *contactList);
-         }
-         else
-         {
-            contactList->erase(j);
-            if (contactList->empty())
+            if(mRemoveLingerSecs > 0)
             {
-               removeAor(aor);
+               j->mRegExpires = 0;
+               j->mLastUpdated = Timer::getTimeSecs();
+               // Only pass sync as true if this update didn't just come from an inbound sync operation
+               invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *contactList);
             }
             else
             {
-               // Only pass sync as true if this update didn't just come from an inbound sync operation
-               invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *contactList);
+               contactList->erase(j);
+               if (contactList->empty())
+               {
+                  // Same as removeAor(), which we cannot call with the
+                  // record mutex held.
+                  delete record->mContacts;
+                  record->mContacts = 0;
+                  ContactList emptyList;
+                  invokeOnAorModified(true /* sync? */, aor, emptyList);
+                  erase = record->unused();
+               }
+               else
+               {
+                  // Only pass sync as true if this update didn't just come from an inbound sync operation
+                  invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *contactList);
+               }
             }
+            break;
          }
-         return;
       }
    }
+   if (erase)
+   {
+      eraseIfUnused(shard, aor);
+   }
 }
 
 void
 InMemorySyncRegDb::getContacts(const Uri& aor, ContactList& container)
 {
-   Lock g(mDatabaseMutex);
-   database_map_t::iterator i = mDatabase.find(aor);
-   if (i == mDatabase.end() || i->second == 0)
+   Shard& shard = getShard(aor);
+   ReadLock g(shard.mMutex);
+   AorRecord* record = findRecord(shard, aor);
+   if (!record)
+   {
+      container.clear();
+      return;
+   }
+   Lock r(record->mMutex);
+   if (record->mContacts == 0)
    {
       container.clear();
       return;
    }
    if(mRemoveLingerSecs > 0)
    {
-      ContactList& contacts = *(i->second);
+      ContactList& contacts = *record->mContacts;
       UInt64 now = Timer::getTimeSecs();
       contactsRemoveIfRequired(contacts, now, mRemoveLingerSecs);
       container.clear();
@@ -426,21 +722,28 @@ InMemorySyncRegDb::getContacts(const Uri& aor, ContactList& container)
    }
    else
    {
-      container = *(i->second);
+      container = *record->mContacts;
    }
 }
 
 void
 InMemorySyncRegDb::getContactsFull(const Uri& aor, ContactList& container)
 {
-   Lock g(mDatabaseMutex);
-   database_map_t::iterator i = mDatabase.find(aor);
-   if (i == mDatabase.end() || i->second == 0)
+   Shard& shard = getShard(aor);
+   ReadLock g(shard.mMutex);
+   AorRecord* record = findRecord(shard, aor);
+   if (!record)
+   {
+      container.clear();
+      return;
+   }
+   Lock r(record->mMutex);
+   if (record->mContacts == 0)
    {
       container.clear();
       return;
    }
-   ContactList& contacts = *(i->second);
+   ContactList& contacts = *record->mContacts;
    if(mRemoveLingerSecs > 0)
    {
       UInt64 now = Timer::getTimeSecs();
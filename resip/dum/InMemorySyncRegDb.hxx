@@ -1,9 +1,8 @@
 #if !defined(RESIP_INMEMORYSYNCREGDB_HXX)
 #define RESIP_INMEMORYSYNCREGDB_HXX
 
-#include <map>
-#include <set>
 #include <list>
+#include <vector>
 
 #include "resip/dum/RegistrationPersistenceManager.hxx"
 #include "rutil/Mutex.hxx"
@@ -48,12 +47,30 @@ protected:
   transport registration bindings to a remote peer for replication.
   See the RegSyncClient and RegSyncServer implementations in the repro
   project.
+
+  AORs are spread over numShards shards by a hash of their user part, each
+  with its own read/write lock; lookups only take a shard's read lock, and
+  the write lock is needed only to add or drop an AOR entry. Each AOR
+  entry carries its own mutex, which protects its contacts and its
+  lockRecord()/unlockRecord() state, so registrations for different AORs
+  never wait on one another.
+
+  If asyncNotify is set, onAorModified() is not called on the thread that
+  made the change but from a notification thread, in batches. Changes are
+  delivered in the order they were made; a pending notification for an AOR
+  is replaced by a later one with the same sync flag, so handlers may see
+  only the most recent contact list of an AOR that changed several times
+  in quick succession. initialSync() waits for pending notifications to be
+  delivered before it walks the database.
 */
 class InMemorySyncRegDb : public RegistrationPersistenceManager
 {
    public:
+      static const unsigned int DefaultShards = 64;
 
-      InMemorySyncRegDb(unsigned int removeLingerSecs = 0);
+      InMemorySyncRegDb(unsigned int removeLingerSecs = 0,
+                        bool asyncNotify = false,
+                        unsigned int numShards = DefaultShards);
       virtual ~InMemorySyncRegDb();
       
       virtual void addHandler(InMemorySyncRegDbHandler* handler);
@@ -81,20 +98,34 @@ class InMemorySyncRegDb : public RegistrationPersistenceManager
       virtual void getAors(UriList& container);
       
    protected:
-      typedef std::map<Uri,ContactList *> database_map_t;
-      database_map_t mDatabase;
-      Mutex mDatabaseMutex;
+      class AorRecord;
+      class Shard;
+      class Notifier;
+
+      Shard& getShard(const Uri& aor) const;
+      AorRecord* findRecord(Shard& shard, const Uri& aor) const;
+      AorRecord& createRecord(Shard& shard, const Uri& aor);
+      void eraseIfUnused(Shard& shard, const Uri& aor);
 
-      std::set<Uri> mLockedRecords;
-      Mutex mLockedRecordsMutex;
-      Condition mRecordUnlocked;
+      void addAor(AorRecord& record, const Uri& aor, const ContactList& contacts);
+      update_status_t updateContact(AorRecord& record, const resip::Uri& aor,
+                                    const ContactInstanceRecord& rec);
 
       void invokeOnAorModified(bool sync, const resip::Uri& aor, const ContactList& contacts);
       void invokeOnInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts);
+      // caller holds mHandlerMutex
+      void notifyAorModified(bool sync, const resip::Uri& aor, const ContactList& contacts);
+
+      std::vector<Shard*> mShards;
       unsigned int mRemoveLingerSecs;
       typedef std::list<InMemorySyncRegDbHandler*> HandlerList;
       HandlerList mHandlers;  // use list over set to preserve add order
       Mutex mHandlerMutex;
+      Notifier* mNotifier;  // 0 unless asyncNotify
+
+   private:
+      InMemorySyncRegDb(const InMemorySyncRegDb&);
+      InMemorySyncRegDb& operator=(const InMemorySyncRegDb&);
 };
 
 }
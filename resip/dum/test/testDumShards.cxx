@@ -0,0 +1,299 @@
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "resip/dum/ClientPagerMessage.hxx"
+#include "resip/dum/DialogUsageManager.hxx"
+#include "resip/dum/DumCommand.hxx"
+#include "resip/dum/DumShardSet.hxx"
+#include "resip/dum/MasterProfile.hxx"
+#include "resip/dum/PagerMessageHandler.hxx"
+#include "resip/dum/ServerPagerMessage.hxx"
+#include "resip/stack/PlainContents.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "resip/stack/SipStack.hxx"
+#include "resip/stack/Uri.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Log.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+static const int ServerPort = 25160;
+static const int ClientPort = 25162;
+static const unsigned int NumShards = 3;
+static const unsigned int NumMessages = 30;
+
+// Records the Call-IDs of the MESSAGEs one DUM receives and sends
+class PagerHandler : public ServerPagerMessageHandler, public ClientPagerMessageHandler
+{
+   public:
+      PagerHandler() : mSent(0), mFailed(0) {}
+
+      virtual void onMessageArrived(ServerPagerMessageHandle handle, const SipMessage& message)
+      {
+         mReceived.push_back(message.header(h_CallId).value());
+         handle->send(handle->accept());
+      }
+      virtual void onSuccess(ClientPagerMessageHandle handle, const SipMessage& status)
+      {
+         mSentCallIds.push_back(status.header(h_CallId).value());
+         mSent++;
+         handle->end();
+      }
+      virtual void onFailure(ClientPagerMessageHandle handle, const SipMessage& status, std::unique_ptr<Contents> contents)
+      {
+         mFailed++;
+         handle->end();
+      }
+
+      vector<Data> mReceived;
+      vector<Data> mSentCallIds;
+      unsigned int mSent;
+      unsigned int mFailed;
+};
+
+class FlagCommand : public DumCommandAdapter
+{
+   public:
+      FlagCommand(bool& flag) : mFlag(flag) {}
+      virtual void executeCommand() { mFlag = true; }
+      virtual EncodeStream& encodeBrief(EncodeStream& strm) const { return strm << "FlagCommand"; }
+
+   private:
+      bool& mFlag;
+};
+
+static void
+setUp(DialogUsageManager& dum, PagerHandler& handler, const Data& user, int port)
+{
+   auto profile = std::make_shared<MasterProfile>();
+   profile->setDefaultFrom(NameAddr("sip:" + user + "@127.0.0.1:" + Data(port)));
+   profile->addSupportedMethod(MESSAGE);
+   profile->addSupportedMimeType(MESSAGE, Mime("text", "plain"));
+   dum.setMasterProfile(profile);
+   dum.setServerPagerMessageHandler(&handler);
+   dum.setClientPagerMessageHandler(&handler);
+}
+
+static unique_ptr<SipMessage>
+makeRequest(const Data& method, const Data& callId, const Data& uri, const Data& toTag = Data::Empty,
+            const Data& extra = Data::Empty)
+{
+   Data raw(method + " " + uri + " SIP/2.0\r\n"
+            "To: <" + uri + ">" + (toTag.empty() ? Data::Empty : ";tag=" + toTag) + "\r\n"
+            "From: <sip:caller@example.com>;tag=f1\r\n"
+            "Call-ID: " + callId + "\r\n"
+            "CSeq: 1 " + method + "\r\n"
+            "Via: SIP/2.0/UDP 192.0.2.1;branch=z9hG4bK-" + callId + "\r\n"
+            "Max-Forwards: 70\r\n" + extra +
+            "Content-Length: 0\r\n\r\n");
+   return unique_ptr<SipMessage>(SipMessage::make(raw));
+}
+
+static unsigned int
+route(DumShardSet& shards, const Data& method, const Data& callId, const Data& uri,
+      const Data& toTag = Data::Empty, const Data& extra = Data::Empty)
+{
+   unique_ptr<SipMessage> request(makeRequest(method, callId, uri, toTag, extra));
+   assert(request.get());
+   return shards.shardForRequest(*request);
+}
+
+static void
+sendMessage(DialogUsageManager& dum, int port)
+{
+   ClientPagerMessageHandle pager = dum.makePagerMessage(NameAddr("sip:peer@127.0.0.1:" + Data(port)));
+   pager->page(unique_ptr<Contents>(new PlainContents(Data("hello"))));
+}
+
+int main(int argc, const char* argv[])
+{
+   Log::initialize(Log::Cout, argc > 1 ? Log::toLevel(argv[1]) : Log::Warning, argv[0]);
+
+   SipStack serverStack;
+   serverStack.addTransport(UDP, ServerPort, V4, StunDisabled, "127.0.0.1");
+   DumShardSet shards(NumShards);
+   vector<unique_ptr<DialogUsageManager> > serverDums;
+   PagerHandler serverHandlers[NumShards];
+   for (unsigned int i = 0; i < NumShards; i++)
+   {
+      serverDums.push_back(unique_ptr<DialogUsageManager>(new DialogUsageManager(serverStack)));
+      setUp(*serverDums.back(), serverHandlers[i], "server", ServerPort);
+      shards.add(*serverDums.back());
+   }
+
+   SipStack clientStack;
+   clientStack.addTransport(UDP, ClientPort, V4, StunDisabled, "127.0.0.1");
+   DialogUsageManager clientDum(clientStack);
+   PagerHandler clientHandler;
+   setUp(clientDum, clientHandler, "client", ClientPort);
+
+   // every shard makes Call-IDs the others would not take
+   for (unsigned int i = 0; i < NumShards; i++)
+   {
+      for (int n = 0; n < 10; n++)
+      {
+         Data callId = shards.shard(i).makeCallId();
+         assert(&shards.shardFor(callId) == &shards.shard(i));
+         for (unsigned int j = 0; j < NumShards; j++)
+         {
+            assert(shards.shard(j).ownsCallId(callId) == (i == j));
+         }
+      }
+   }
+
+   // requests from outside go to the shard owning their Call-ID, and the
+   // responses to requests a shard sends come back to it
+   for (unsigned int n = 0; n < NumMessages; n++)
+   {
+      sendMessage(clientDum, ServerPort);
+   }
+   for (unsigned int i = 0; i < NumShards; i++)
+   {
+      sendMessage(shards.shard(i), ClientPort);
+   }
+
+   UInt64 deadline = Timer::getTimeMs() + 10000;
+   unsigned int sentByShards = 0;
+   while ((clientHandler.mSent + clientHandler.mFailed < NumMessages || sentByShards < NumShards) &&
+          Timer::getTimeMs() < deadline)
+   {
+      clientStack.process(5);
+      while (clientDum.process());
+      serverStack.process(5);
+      sentByShards = 0;
+      for (unsigned int i = 0; i < NumShards; i++)
+      {
+         while (shards.shard(i).process());
+         sentByShards += serverHandlers[i].mSent + serverHandlers[i].mFailed;
+      }
+   }
+
+   assert(clientHandler.mSent == NumMessages);
+   assert(clientHandler.mFailed == 0);
+   assert(clientHandler.mReceived.size() == NumShards);
+   unsigned int received = 0;
+   for (unsigned int i = 0; i < NumShards; i++)
+   {
+      cerr << "shard " << i << " received " << serverHandlers[i].mReceived.size() << " messages" << endl;
+      assert(!serverHandlers[i].mReceived.empty());
+      for (vector<Data>::iterator it = serverHandlers[i].mReceived.begin(); it != serverHandlers[i].mReceived.end(); ++it)
+      {
+         assert(DialogUsageManager::shardFor(*it, NumShards) == i);
+      }
+      received += (unsigned int)serverHandlers[i].mReceived.size();
+
+      assert(serverHandlers[i].mSent == 1);
+      assert(serverHandlers[i].mFailed == 0);
+      assert(DialogUsageManager::shardFor(serverHandlers[i].mSentCallIds.front(), NumShards) == i);
+   }
+   assert(received == NumMessages);
+
+   // REGISTER and PUBLISH go by AOR, whatever their Call-ID
+   {
+      const Data aor("sip:alice@example.com");
+      const unsigned int owner = DialogUsageManager::shardFor(Uri(aor).getAor(), NumShards);
+      for (unsigned int i = 0; i < NumShards; i++)
+      {
+         assert(route(shards, "REGISTER", shards.shard(i).makeCallId(), aor) == owner);
+         assert(route(shards, "PUBLISH", shards.shard(i).makeCallId(), aor, Data::Empty,
+                      "Event: presence\r\nSIP-If-Match: etag1\r\n") == owner);
+      }
+   }
+
+   // an INVITE with Replaces goes to the replaced dialog's shard, and the
+   // new dialog's Call-ID stays pinned there while it has a dialog set
+   {
+      const Data replaced = shards.shard(1).makeCallId();
+      const Data callId = shards.shard(2).makeCallId();
+      const Data uri("sip:bob@example.com");
+      assert(route(shards, "INVITE", callId, uri, Data::Empty,
+                   "Replaces: " + replaced + ";to-tag=a;from-tag=b\r\n") == 1);
+      assert(route(shards, "CANCEL", callId, uri) == 1);
+      shards.claimCallId(callId);
+      assert(route(shards, "ACK", callId, uri, "t1") == 1);
+      assert(route(shards, "BYE", callId, uri, "t1") == 1);
+      shards.releaseCallId(callId);
+      assert(route(shards, "BYE", callId, uri, "t1") == 2);
+
+      // a Replaces naming the shard the Call-ID hashes to needs no pin
+      assert(route(shards, "INVITE", callId, uri, Data::Empty,
+                   "Replaces: " + shards.shard(2).makeCallId() + ";to-tag=a;from-tag=b\r\n") == 2);
+   }
+
+   // an out-of-dialog SUBSCRIBE goes to the shard of the resource it names
+   {
+      const Data uri("sip:presentity@example.com");
+      const unsigned int owner = DialogUsageManager::shardFor(Uri(uri).getAor(), NumShards);
+      const Data callId = shards.shard((owner + 1) % NumShards).makeCallId();
+      assert(route(shards, "SUBSCRIBE", callId, uri, Data::Empty, "Event: presence\r\n") == owner);
+      shards.claimCallId(callId);
+      assert(route(shards, "SUBSCRIBE", callId, "sip:watcher@192.0.2.1", "t1", "Event: presence\r\n") == owner);
+      assert(route(shards, "NOTIFY", callId, "sip:watcher@192.0.2.1", "t1", "Event: presence\r\n") == owner);
+      shards.releaseCallId(callId);
+
+      // everything else follows its Call-ID
+      assert(route(shards, "MESSAGE", callId, uri) == (owner + 1) % NumShards);
+      assert(route(shards, "INVITE", callId, uri) == (owner + 1) % NumShards);
+   }
+
+   // commands for another shard's dialog run on that shard
+   Data callId = shards.shard(1).makeCallId();
+   bool executed = false;
+   shards.post(callId, new FlagCommand(executed));
+   while (shards.shard(0).process());
+   while (shards.shard(2).process());
+   assert(!executed);
+   while (shards.shard(1).process());
+   assert(executed);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
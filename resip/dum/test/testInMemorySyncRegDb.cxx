@@ -0,0 +1,239 @@
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "resip/dum/InMemorySyncRegDb.hxx"
+#include "resip/stack/NameAddr.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+static ContactInstanceRecord
+makeContact(const Data& user, int n, UInt64 expires, bool sync = false)
+{
+   ContactInstanceRecord rec;
+   rec.mContact = NameAddr("sip:" + user + "@10.0.0.1:" + Data(5060 + n));
+   rec.mRegExpires = expires;
+   rec.mLastUpdated = Timer::getTimeSecs();
+   rec.mSyncContact = sync;
+   return rec;
+}
+
+static Uri
+makeAor(int n)
+{
+   return Uri("sip:user" + Data(n) + "@example.com");
+}
+
+class RecordingHandler : public InMemorySyncRegDbHandler
+{
+   public:
+      RecordingHandler(HandlerMode mode) : InMemorySyncRegDbHandler(mode), mCalls(0) {}
+
+      virtual void onAorModified(const Uri& aor, const ContactList& contacts)
+      {
+         Lock lock(mMutex);
+         ++mCalls;
+         mLast[aor] = contacts.size();
+      }
+
+      Mutex mMutex;
+      int mCalls;
+      std::map<Uri, size_t> mLast;  // contact count last seen per AOR
+};
+
+static void
+testBasics(bool asyncNotify)
+{
+   UInt64 expires = Timer::getTimeSecs() + 3600;
+   RecordingHandler sync(InMemorySyncRegDbHandler::SyncServer);
+   RecordingHandler all(InMemorySyncRegDbHandler::AllChanges);
+   {
+      InMemorySyncRegDb db(0, asyncNotify, 4);
+      db.addHandler(&sync);
+      db.addHandler(&all);
+
+      Uri aor = makeAor(1);
+      ContactList contacts;
+
+      // locking an unknown AOR must not leave it behind
+      db.lockRecord(aor);
+      db.unlockRecord(aor);
+      InMemorySyncRegDb::UriList aors;
+      db.getAors(aors);
+      assert(aors.empty());
+      assert(!db.aorIsRegistered(aor));
+
+      db.lockRecord(aor);
+      assert(db.updateContact(aor, makeContact("user1", 0, expires)) == RegistrationPersistenceManager::CONTACT_CREATED);
+      assert(db.updateContact(aor, makeContact("user1", 1, expires)) == RegistrationPersistenceManager::CONTACT_CREATED);
+      assert(db.updateContact(aor, makeContact("user1", 1, expires)) == RegistrationPersistenceManager::CONTACT_UPDATED);
+      db.unlockRecord(aor);
+
+      assert(db.aorIsRegistered(aor));
+      UInt64 maxExpires = 0;
+      assert(db.aorIsRegistered(aor, &maxExpires) && maxExpires == expires);
+      db.getContacts(aor, contacts);
+      assert(contacts.size() == 2);
+
+      // a change from a peer is not replicated back to it
+      db.updateContact(makeAor(2), makeContact("user2", 0, expires, true));
+      db.getAors(aors);
+      assert(aors.size() == 2);
+
+      db.removeContact(aor, makeContact("user1", 0, expires));
+      db.getContacts(aor, contacts);
+      assert(contacts.size() == 1);
+      db.removeContact(aor, makeContact("user1", 1, expires));
+      db.getContacts(aor, contacts);
+      assert(contacts.empty());
+      assert(!db.aorIsRegistered(aor));
+      db.getAors(aors);
+      assert(aors.size() == 1 && aors.front() == makeAor(2));
+
+      db.removeAor(makeAor(2));
+      db.getAors(aors);
+      assert(aors.empty());
+      // destroying the db delivers anything still pending
+   }
+
+   // 6 sync changes (5 for user1, 1 for user2) plus the change from the
+   // peer; asynchronous delivery may coalesce consecutive changes to an AOR
+   if (asyncNotify)
+   {
+      assert(sync.mCalls >= 2 && sync.mCalls <= 6);
+      assert(all.mCalls >= 3 && all.mCalls <= 7);
+   }
+   else
+   {
+      assert(sync.mCalls == 6);
+      assert(all.mCalls == 7);
+   }
+   assert(sync.mLast[makeAor(1)] == 0);
+   assert(sync.mLast[makeAor(2)] == 0);
+   assert(all.mLast[makeAor(1)] == 0);
+   assert(all.mLast[makeAor(2)] == 0);
+}
+
+static void
+testLinger()
+{
+   UInt64 expires = Timer::getTimeSecs() + 3600;
+   InMemorySyncRegDb db(3600);
+   Uri aor = makeAor(1);
+   ContactList contacts;
+
+   db.updateContact(aor, makeContact("user1", 0, expires));
+   db.removeAor(aor);
+   assert(!db.aorIsRegistered(aor));
+   db.getContacts(aor, contacts);
+   assert(contacts.empty());
+   db.getContactsFull(aor, contacts);
+   assert(contacts.size() == 1 && contacts.front().mRegExpires == 0);
+
+   // refreshing a lingering contact counts as creating it
+   assert(db.updateContact(aor, makeContact("user1", 0, expires)) == RegistrationPersistenceManager::CONTACT_CREATED);
+   assert(db.aorIsRegistered(aor));
+}
+
+static const int NumAors = 64;
+
+class Registrar : public ThreadIf
+{
+   public:
+      Registrar(InMemorySyncRegDb& db, std::vector<int>& inside, int id, int rounds) :
+         mDb(db), mInside(inside), mId(id), mRounds(rounds) {}
+
+      virtual void thread()
+      {
+         UInt64 expires = Timer::getTimeSecs() + 3600;
+         ContactList contacts;
+         for (int i = 0; i < mRounds; ++i)
+         {
+            int n = (i * 7 + mId) % NumAors;
+            Uri aor = makeAor(n);
+            mDb.lockRecord(aor);
+            // nobody else may be in here for this AOR
+            assert(++mInside[n] == 1);
+            mDb.updateContact(aor, makeContact("user" + Data(n), mId, expires));
+            mDb.getContacts(aor, contacts);
+            assert(!contacts.empty());
+            if (i % 3 == 0)
+            {
+               mDb.removeContact(aor, makeContact("user" + Data(n), mId, expires));
+            }
+            assert(--mInside[n] == 0);
+            mDb.unlockRecord(aor);
+
+            // lookups without the record lock, as the location server does
+            mDb.getContacts(makeAor((n + 1) % NumAors), contacts);
+         }
+      }
+
+   private:
+      InMemorySyncRegDb& mDb;
+      std::vector<int>& mInside;
+      int mId;
+      int mRounds;
+};
+
+static void
+testConcurrency(bool asyncNotify)
+{
+   const int numThreads = 8;
+   const int rounds = 10000;
+   RecordingHandler sync(InMemorySyncRegDbHandler::SyncServer);
+   UInt64 start = Timer::getTimeMs();
+   {
+      InMemorySyncRegDb db(0, asyncNotify);
+      db.addHandler(&sync);
+      std::vector<int> inside(NumAors, 0);
+      std::vector<Registrar*> threads;
+      for (int t = 0; t < numThreads; ++t)
+      {
+         threads.push_back(new Registrar(db, inside, t, rounds));
+         threads.back()->run();
+      }
+      for (int t = 0; t < numThreads; ++t)
+      {
+         threads[t]->join();
+         delete threads[t];
+      }
+
+      // every handler saw the final state of every AOR
+      ContactList contacts;
+      InMemorySyncRegDb::UriList aors;
+      db.getAors(aors);
+      db.initialSync(1);  // flushes pending notifications
+      Lock lock(sync.mMutex);
+      for (int n = 0; n < NumAors; ++n)
+      {
+         db.getContacts(makeAor(n), contacts);
+         assert(sync.mLast[makeAor(n)] == contacts.size());
+      }
+   }
+   // With a handler this cheap, async notify only adds the hand-off to the
+   // notification thread, so it is expected to be slower than sync here
+   UInt64 elapsed = Timer::getTimeMs() - start;
+   cerr << (asyncNotify ? "async" : "sync") << " notify: "
+        << numThreads * rounds << " lock/update/unlock in " << elapsed << " ms, "
+        << sync.mCalls << " notifications" << endl;
+}
+
+int main(int argc, const char* argv[])
+{
+   testBasics(false);
+   testBasics(true);
+   testLinger();
+   testConcurrency(false);
+   testConcurrency(true);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
@@ -37,9 +37,12 @@ Connection::Connection(Transport* transport,const Tuple& who, Socket socket,
    : ConnectionBase(transport,who,compression),
      mFirstWriteAfterConnectedPending(false),
      mInWritable(false),
+     mReadable(true),
      mFlowTimerEnabled(false),
      mPollItemHandle(0),
-     mIsServer(isServer)
+     mIsServer(isServer),
+     mWsFrameHeaderLen(0),
+     mWsFramedSend(0)
 {
    mWho.mFlowKey=(FlowKey)socket;
    InfoLog (<< "Connection::Connection: new connection created to who: " << mWho << ", is server = " << mIsServer);
@@ -79,6 +82,11 @@ Connection::requestWrite(SendData* sendData)
 void 
 Connection::removeFrontOutstandingSend()
 {
+   if (mWsFramedSend == mOutstandingSends.front())
+   {
+      mWsFramedSend = 0;
+      mWsFrameHeaderLen = 0;
+   }
    delete mOutstandingSends.front();
    mOutstandingSends.pop_front();
 
@@ -140,6 +148,11 @@ Connection::performWrite()
       break;
    }
 
+   if (mOutstandingSends.front()->gather && !canWriteGather())
+   {
+      mOutstandingSends.front()->flatten();
+   }
+
    const Data& sigcompId = mOutstandingSends.front()->sigcompId;
 
    if(mSendingTransmissionFormat == Unknown)
@@ -156,64 +169,27 @@ Connection::performWrite()
    else if(mSendingTransmissionFormat == WebSocketHandshake)
    {
       mSendingTransmissionFormat = WebSocketData;
+      // the handshake response itself goes out as it is
+      mWsFramedSend = mOutstandingSends.front();
+      mWsFrameHeaderLen = 0;
    }
-   else if(mSendingTransmissionFormat == WebSocketData)
+   else if(mSendingTransmissionFormat == WebSocketData &&
+           mWsFramedSend != mOutstandingSends.front())
    {
-      SendData *dataWs, *oldSd;
-      const Data& dataRaw = mOutstandingSends.front()->data;
-      UInt64 dataSize = 1 + 1 + dataRaw.size();
-      UInt64 lSize = (UInt64)dataRaw.size();
-      UInt8* uBuffer;
-
-      if(lSize > 0x7D && lSize <= 0xFFFF)
-      {
-         dataSize += 2;
-      }
-      else if(lSize > 0xFFFF)
-      {
-         dataSize += 8;
-      }
-
-      oldSd = mOutstandingSends.front();
-      dataWs = new SendData(oldSd->destination,
-            Data(Data::Take, new char[(int)dataSize], (Data::size_type)dataSize),
-            oldSd->transactionId,
-            oldSd->sigcompId,
-            false);
-      resip_assert(dataWs && dataWs->data.data());
-      uBuffer = (UInt8*)dataWs->data.data();
-
-      uBuffer[0] = 0x82;
-      if(lSize <= 0x7D)
+      // Frame each message once, however many writes it takes
+      SendData* sendData = mOutstandingSends.front();
+      UInt64 size = sendData->gather ? sendData->gather->size() : sendData->data.size();
+      mWsFrameHeaderLen = WsFrameExtractor::makeFrameHeader(size, mWsFrameHeader);
+      mWsFramedSend = sendData;
+      if (!canWriteGather())
       {
-         uBuffer[1] = (UInt8)lSize;
-         uBuffer = &uBuffer[2];
+         // no writev() (ie: TLS), so the frame has to be in one piece
+         Data frame(Data::size_type(mWsFrameHeaderLen + size), Data::Preallocate);
+         frame.append((const char*)mWsFrameHeader, (Data::size_type)mWsFrameHeaderLen);
+         frame.append(sendData->data.data(), sendData->data.size());
+         sendData->data.takeBuf(frame);
+         mWsFrameHeaderLen = 0;
       }
-      else if(lSize <= 0xFFFF)
-      {
-         uBuffer[1] = 0x7E;
-         uBuffer[2] = (UInt8)((lSize >> 8) & 0xFF);
-         uBuffer[3] = (UInt8)(lSize & 0xFF);
-         uBuffer = &uBuffer[4];
-      }
-      else
-      {
-         uBuffer[1] = 0x7F;
-         uBuffer[2] = (UInt8)((lSize >> 56) & 0xFF);
-         uBuffer[3] = (UInt8)((lSize >> 48) & 0xFF);
-         uBuffer[4] = (UInt8)((lSize >> 40) & 0xFF);
-         uBuffer[5] = (UInt8)((lSize >> 32) & 0xFF);
-         uBuffer[6] = (UInt8)((lSize >> 24) & 0xFF);
-         uBuffer[7] = (UInt8)((lSize >> 16) & 0xFF);
-         uBuffer[8] = (UInt8)((lSize >> 8) & 0xFF);
-         uBuffer[9] = (UInt8)(lSize & 0xFF);
-         uBuffer = &uBuffer[10];
-      }
-
-      memcpy(uBuffer, dataRaw.data(), dataRaw.size());
-      mOutstandingSends.front() = dataWs;
-      dataWs = 0;
-      delete oldSd;
    }
 
 #ifdef USE_SIGCOMP
@@ -221,6 +197,7 @@ Connection::performWrite()
    if (mSendingTransmissionFormat == Compressed
        && !(mOutstandingSends.front()->isAlreadyCompressed))
    {
+      mOutstandingSends.front()->flatten();
       const Data& uncompressed = mOutstandingSends.front()->data;
       osc::SigcompMessage *sm = 
         mSigcompStack->compressMessage(uncompressed.data(), uncompressed.size(),
@@ -259,10 +236,28 @@ Connection::performWrite()
       }
    }
 
-   const Data& data = mOutstandingSends.front()->data;
-   int nBytes = write(data.data() + mSendPos,int(data.size() - mSendPos));
+   const SendData& sendData = *mOutstandingSends.front();
+   Data::size_type total;
+   int nBytes;
+   if (mWsFrameHeaderLen > 0)
+   {
+      nBytes = writeWsFrame(sendData, total);
+   }
+   else if (sendData.gather)
+   {
+      int first;
+      size_t skip;
+      int count = sendData.gather->remaining(mSendPos, first, skip);
+      total = (Data::size_type)sendData.gather->size();
+      nBytes = writeGather(sendData.gather->segments() + first, count, skip);
+   }
+   else
+   {
+      total = sendData.data.size();
+      nBytes = write(sendData.data.data() + mSendPos, int(total - mSendPos));
+   }
 
-   //DebugLog (<< "Tried to send " << data.size() - mSendPos << " bytes, sent " << nBytes << " bytes");
+   //DebugLog (<< "Tried to send " << total - mSendPos << " bytes, sent " << nBytes << " bytes");
 
    if (nBytes < 0)
    {
@@ -281,7 +276,7 @@ Connection::performWrite()
       // Safe because of the conditional above ( < 0 ).
       Data::size_type bytesWritten = static_cast<Data::size_type>(nBytes);
       mSendPos += bytesWritten;
-      if (mSendPos == data.size())
+      if (mSendPos == total)
       {
          mSendPos = 0;
          removeFrontOutstandingSend();
@@ -307,6 +302,44 @@ Connection::performWrites(unsigned int max)
    return true;
 }
 
+int
+Connection::writeWsFrame(const SendData& sendData, Data::size_type& total)
+{
+   // The frame header goes out as a segment of its own, in front of the
+   // message, rather than being copied together with it
+   Data::size_type size = (Data::size_type)(sendData.gather ? sendData.gather->size() : sendData.data.size());
+   total = (Data::size_type)mWsFrameHeaderLen + size;
+   if (mSendPos >= mWsFrameHeaderLen)
+   {
+      size_t offset = mSendPos - mWsFrameHeaderLen;
+      if (sendData.gather)
+      {
+         int first;
+         size_t skip;
+         int count = sendData.gather->remaining(offset, first, skip);
+         return writeGather(sendData.gather->segments() + first, count, skip);
+      }
+      return write(sendData.data.data() + offset, int(size - offset));
+   }
+
+   GatherData::Segment segs[GatherData::MaxSegments + 1];
+   int count = 1;
+   segs[0].iov_base = mWsFrameHeader;
+   segs[0].iov_len = mWsFrameHeaderLen;
+   if (sendData.gather)
+   {
+      memcpy(&segs[1], sendData.gather->segments(), sendData.gather->count()*sizeof(GatherData::Segment));
+      count += sendData.gather->count();
+   }
+   else if (size > 0)
+   {
+      segs[1].iov_base = const_cast<char*>(sendData.data.data());
+      segs[1].iov_len = size;
+      count++;
+   }
+   return writeGather(segs, count, mSendPos);
+}
+
 void 
 Connection::ensureWritable()
 {
@@ -319,6 +352,16 @@ Connection::ensureWritable()
    }
 }
 
+void
+Connection::setReadable(bool readable)
+{
+   if (mReadable != readable)
+   {
+      mReadable = readable;
+      getConnectionManager().updateReadable(this);
+   }
+}
+
 ConnectionManager&
 Connection::getConnectionManager() const
 {
@@ -82,6 +82,10 @@ class Connection : public ConnectionBase,
       /// ensure that we are on the writeable list if required
       void ensureWritable();
 
+      /// stop or resume watching the socket for reads (eg: while a worker
+      /// thread owns the TLS handshake and a read could only be deferred)
+      void setReadable(bool readable);
+
       /** move data from the connection to the buffer; move this to front of
           least recently used list. when the message is complete,
           it is delivered via mTransport->pushRxMsgUp()
@@ -109,6 +113,12 @@ class Connection : public ConnectionBase,
       virtual int read(char* /* buffer */, const int /* count */) { return 0; }
       /// pure virtual, but need concrete Connection for book-ends of lists
       virtual int write(const char* /* buffer */, const int /* count */) { return 0; }
+      /// true if writeGather() can send a gather-encoded SendData as is
+      virtual bool canWriteGather() const { return false; }
+      /** Writes count segments (at most GatherData::MaxSegments, plus one
+          for a WebSocket frame header), starting skip bytes into the first
+          one. Returns the number of bytes written, as write() does. */
+      virtual int writeGather(const GatherData::Segment* /* segs */, int /* count */, size_t /* skip */) { return 0; }
       virtual void onDoubleCRLF();
       virtual void onSingleCRLF();
 
@@ -120,7 +130,10 @@ class Connection : public ConnectionBase,
    private:
       ConnectionManager& getConnectionManager() const;
       void removeFrontOutstandingSend();
+      /// writes the front SendData behind mWsFrameHeader
+      int writeWsFrame(const SendData& sendData, Data::size_type& total);
       bool mInWritable;
+      bool mReadable;
       bool mFlowTimerEnabled;
       FdPollItemHandle mPollItemHandle;
       
@@ -131,6 +144,12 @@ class Connection : public ConnectionBase,
       Connection(const Connection&);
       Connection& operator=(const Connection&);
       bool mIsServer;
+
+      // WebSocket frame header of mWsFramedSend, the SendData at the front
+      // of mOutstandingSends, if it is to be written ahead of it
+      UInt8 mWsFrameHeader[WsFrameExtractor::MaxUnmaskedHeaderLen];
+      size_t mWsFrameHeaderLen;
+      const SendData* mWsFramedSend;
 };
 
 EncodeStream& 
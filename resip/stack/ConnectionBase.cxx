@@ -105,7 +105,7 @@ ConnectionBase::~ConnectionBase()
       delete sendData;
       mOutstandingSends.pop_front();
    }
-   delete [] mBuffer;
+   MsgHeaderScanner::freeSlabBuffer(mBuffer);
    delete mMessage;
 #ifdef USE_SIGCOMP
    delete mSigcompStack;
@@ -153,7 +153,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             }
             else
             {
-               delete [] mBuffer;
+               MsgHeaderScanner::freeSlabBuffer(mBuffer);
                mBuffer = 0;
                return true;
             }
@@ -170,7 +170,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             }
             else
             {
-               delete [] mBuffer;
+               MsgHeaderScanner::freeSlabBuffer(mBuffer);
                mBuffer = 0;
                return true;
             }
@@ -208,7 +208,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
          {
             //.jacob. Not a terribly informative warning.
             WarningLog(<< "Discarding preparse!");
-            delete [] mBuffer;
+            MsgHeaderScanner::freeSlabBuffer(mBuffer);
             mBuffer = 0;
             delete mMessage;
             mMessage = 0;
@@ -219,7 +219,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
          if (mMsgHeaderScanner.getHeaderCount() > 1024)
          {
             WarningLog(<< "Discarding preparse; too many headers");
-            delete [] mBuffer;
+            MsgHeaderScanner::freeSlabBuffer(mBuffer);
             mBuffer = 0;
             delete mMessage;
             mMessage = 0;
@@ -235,7 +235,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
          {
             WarningLog(<< "Discarding preparse; header-field-value (or "
                         "header name) too long");
-            delete [] mBuffer;
+            MsgHeaderScanner::freeSlabBuffer(mBuffer);
             mBuffer = 0;
             delete mMessage;
             mMessage = 0;
@@ -255,7 +255,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             char* newBuffer = 0;
             try
             {
-               newBuffer=MsgHeaderScanner::allocateBuffer((int)size);
+               newBuffer=MsgHeaderScanner::allocateSlabBuffer((int)size);
             }
             catch(std::bad_alloc&)
             {
@@ -263,7 +263,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
                return false;
             }
             memcpy(newBuffer, unprocessedCharPtr, numUnprocessedChars);
-            delete [] mBuffer;
+            MsgHeaderScanner::freeSlabBuffer(mBuffer);
             mBuffer = newBuffer;
             mBufferPos = numUnprocessedChars;
             mBufferSize = size;
@@ -271,7 +271,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             return true;
          }
 
-         mMessage->addBuffer(mBuffer);
+         mMessage->addSlabBuffer(mBuffer, chunkLength);
          mBuffer=0;
 
          if (scanChunkResult == MsgHeaderScanner::scrNextChunk)
@@ -284,7 +284,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
                //DebugLog(<< "Data assigned, not fragmented, not complete");
                try
                {
-                  mBuffer = MsgHeaderScanner::allocateBuffer(ChunkSize);
+                  mBuffer = MsgHeaderScanner::allocateSlabBuffer(ChunkSize);
                }
                catch(std::bad_alloc&)
                {
@@ -305,7 +305,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
                char* newBuffer = 0;
                try
                {
-                  newBuffer = MsgHeaderScanner::allocateBuffer((int)size);
+                  newBuffer = MsgHeaderScanner::allocateSlabBuffer((int)size);
                }
                catch(std::bad_alloc&)
                {
@@ -362,7 +362,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
                size_t newSize=resipMin(resipMax((size_t)numUnprocessedChars*3/2,
                                              (size_t)ConnectionBase::ChunkSize),
                                     contentLength);
-               char* newBuffer = MsgHeaderScanner::allocateBuffer((int)newSize);
+               char* newBuffer = MsgHeaderScanner::allocateSlabBuffer((int)newSize);
                memcpy(newBuffer, unprocessedCharPtr, numUnprocessedChars);
                mBufferPos = numUnprocessedChars;
                mBufferSize = newSize;
@@ -387,7 +387,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
                   {
                      size = ConnectionBase::ChunkSize;
                   }
-                  char* newBuffer = MsgHeaderScanner::allocateBuffer((int)size);
+                  char* newBuffer = MsgHeaderScanner::allocateSlabBuffer((int)size);
                   memcpy(newBuffer,
                          unprocessedCharPtr + contentLength,
                          overHang);
@@ -461,7 +461,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             WarningLog(<<"Malformed Content-Length in connection-based transport"
                         ". Not much we can do to fix this. " << e);
             // .bwc. Bad Content-Length. We are hosed.
-            delete [] mBuffer;
+            MsgHeaderScanner::freeSlabBuffer(mBuffer);
             mBuffer = 0;
             delete mMessage;
             mMessage = 0;
@@ -475,7 +475,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             int overHang = mBufferPos - (int)contentLength;
             char *overHangStart = mBuffer + contentLength;
 
-            mMessage->addBuffer(mBuffer);
+            mMessage->addSlabBuffer(mBuffer, (size_t)contentLength);
             mMessage->setBody(mBuffer, (UInt32)contentLength);
             mConnState = NewMessage;
             mBuffer = 0;
@@ -488,7 +488,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
                 {
                     size = ConnectionBase::ChunkSize;
                 }
-                char* newBuffer = MsgHeaderScanner::allocateBuffer((int)size);
+                char* newBuffer = MsgHeaderScanner::allocateSlabBuffer((int)size);
                 memcpy(newBuffer, overHangStart, overHang);
                 mBuffer = newBuffer;
                 mBufferPos = 0;
@@ -553,7 +553,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             char* newBuffer = 0;
             try
             {
-               newBuffer=new char[newSize];
+               newBuffer=MsgHeaderScanner::allocateSlabBuffer((int)newSize);
             }
             catch(std::bad_alloc&)
             {
@@ -562,7 +562,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             }
             memcpy(newBuffer, mBuffer, mBufferSize);
             mBufferSize=newSize;
-            delete [] mBuffer;
+            MsgHeaderScanner::freeSlabBuffer(mBuffer);
             mBuffer = newBuffer;
          }
          break;
@@ -804,26 +804,46 @@ bool ConnectionBase::isUsingSecWebSocketKey()
 bool
 ConnectionBase::wsProcessData(int bytesRead)
 {
+   // Frames are unmasked and put together in mBuffer itself; a complete
+   // message is parsed where it lies, and the SipMessage takes the buffer.
+   size_t end = mBufferPos + bytesRead;
    bool dropConnection = false;
-   // Always consumes the whole buffer:
-   std::unique_ptr<Data> msg = mWsFrameExtractor.processBytes((UInt8*)mBuffer, bytesRead, dropConnection);
 
-   while(msg.get())
+   while(mBuffer && mWsFrameExtractor.processBytes(mBuffer, end, dropConnection))
    {
-      // mWsBuffer should now contain a discrete SIP message, let the
-      // stack go to work on it
+      char *sipBuffer = mBuffer + mWsFrameExtractor.messageStart();
+      Data::size_type msg_len = (Data::size_type)mWsFrameExtractor.messageSize();
 
-      if(msg->size() == 4 && memcmp(msg->data(), "\r\n\r\n", 4) == 0)
+      if(msg_len == 4 && memcmp(sipBuffer, "\r\n\r\n", 4) == 0)
       {
          // sending a keep alive reply now
          StackLog(<<"got a SIP ping embedded in WebSocket frame, replying");
          onDoubleCRLF();
-         msg = mWsFrameExtractor.processBytes(0, 0, dropConnection);
          continue;
       }
 
+      // whatever came in after the message goes to a new buffer; this one
+      // is handed over to the message
+      char* messageBuffer = mBuffer;
+      size_t consumed = mWsFrameExtractor.consumed();
+      end -= consumed;
+      if(end > 0)
+      {
+         mBufferSize = resipMax(end, (size_t)ConnectionBase::ChunkSize);
+         mBuffer = MsgHeaderScanner::allocateSlabBuffer((int)mBufferSize);
+         memcpy(mBuffer, messageBuffer + consumed, end);
+      }
+      else
+      {
+         // an idle connection holds no buffer; getWriteBuffer() makes one
+         mBuffer = 0;
+         mBufferSize = 0;
+      }
+      mWsFrameExtractor.rebase(consumed);
+
       resip_assert(mTransport);
       mMessage = new SipMessage(&mTransport->getTuple());
+      mMessage->addSlabBuffer(messageBuffer, sipBuffer + msg_len - messageBuffer);
 
       mMessage->setSource(mWho);
       mMessage->setTlsDomain(mTransport->tlsDomain());
@@ -846,10 +866,6 @@ ConnectionBase::wsProcessData(int bytesRead)
          mMessage->setWsCookieContext(wsConnectionBase->getWsCookieContext());
       }
 
-      Data::size_type msg_len = msg->size();
-      // cast permitted, as it is borrowed:
-      char *sipBuffer = (char *)msg->data();
-      mMessage->addBuffer(sipBuffer);
       mMsgHeaderScanner.prepareForMessage(mMessage);
       char *unprocessedCharPtr;
       if (mMsgHeaderScanner.scanChunk(sipBuffer,
@@ -887,7 +903,6 @@ ConnectionBase::wsProcessData(int bytesRead)
          // Something wrong...
          ErrLog(<< "We don't have a valid SIP message, maybe drop the connection?");
       }
-      msg = mWsFrameExtractor.processBytes(0, 0, dropConnection);
    }
 
    if(dropConnection)
@@ -895,6 +910,30 @@ ConnectionBase::wsProcessData(int bytesRead)
       return false;
    }
 
+   if(mBuffer)
+   {
+      // Keep only what is still needed, at the start of the buffer, and
+      // make sure the buffer can take the rest of the frame being read
+      size_t keepFrom = mWsFrameExtractor.keepFrom();
+      if(keepFrom > 0)
+      {
+         memmove(mBuffer, mBuffer + keepFrom, end - keepFrom);
+         end -= keepFrom;
+         mWsFrameExtractor.rebase(keepFrom);
+      }
+      size_t required = mWsFrameExtractor.required();
+      if(required > mBufferSize)
+      {
+         DebugLog(<< "Growing WebSocket receive buffer to " << required << " bytes");
+         char* buffer = MsgHeaderScanner::allocateSlabBuffer((int)required);
+         memcpy(buffer, mBuffer, end);
+         MsgHeaderScanner::freeSlabBuffer(mBuffer);
+         mBuffer = buffer;
+         mBufferSize = required;
+      }
+   }
+   mBufferPos = end;
+
    return true;
 }
 
@@ -935,7 +974,7 @@ ConnectionBase::decompressNewBytes(int bytesRead)
 
     char *sipBuffer = new char[bytesUncompressed];
     memmove(sipBuffer, uncompressed, bytesUncompressed);
-    mMessage->addBuffer(sipBuffer);
+    mMessage->addBuffer(sipBuffer, bytesUncompressed);
     mMsgHeaderScanner.prepareForMessage(mMessage);
     char *unprocessedCharPtr;
     if (mMsgHeaderScanner.scanChunk(sipBuffer,
@@ -1039,16 +1078,21 @@ ConnectionBase::decompressNewBytes(int bytesRead)
 std::pair<char*, size_t> 
 ConnectionBase::getWriteBuffer()
 {
-   if (mConnState == NewMessage)
+   if (mConnState == NewMessage || mConnState == WebSocket)
    {
       if (!mBuffer)
       {
          DebugLog (<< "Creating buffer for " << *this);
 
-         mBuffer = MsgHeaderScanner::allocateBuffer(ConnectionBase::ChunkSize);
+         mBuffer = MsgHeaderScanner::allocateSlabBuffer(ConnectionBase::ChunkSize);
          mBufferSize = ConnectionBase::ChunkSize;
+         mBufferPos = 0;
+      }
+      // a WebSocket message can be spread over several reads
+      if (mConnState == NewMessage)
+      {
+         mBufferPos = 0;
       }
-      mBufferPos = 0;
    }
    return getCurrentWriteBuffer();
 }
@@ -1068,9 +1112,9 @@ ConnectionBase::getWriteBufferForExtraBytes(int bytesRead, int extraBytes)
       if (((size_t)currentPos + (size_t)extraBytes) > mBufferSize)
       {
          mBufferSize = currentPos + extraBytes;
-         char* buffer = MsgHeaderScanner::allocateBuffer((int)mBufferSize);
+         char* buffer = MsgHeaderScanner::allocateSlabBuffer((int)mBufferSize);
          memcpy(buffer, mBuffer, currentPos);
-         delete[] mBuffer;
+         MsgHeaderScanner::freeSlabBuffer(mBuffer);
          mBuffer = buffer;
       }
       return &mBuffer[currentPos];
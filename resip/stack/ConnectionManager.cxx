@@ -157,7 +157,8 @@ ConnectionManager::addToWritable(Connection* conn)
 {
    if ( mPollGrp ) 
    {
-      mPollGrp->modPollItem(conn->mPollItemHandle, FPEM_Read|FPEM_Write|FPEM_Error);
+      mPollGrp->modPollItem(conn->mPollItemHandle,
+                            (conn->mReadable ? FPEM_Read : 0)|FPEM_Write|FPEM_Error);
    } 
    else 
    {
@@ -170,7 +171,8 @@ ConnectionManager::removeFromWritable(Connection* conn)
 {
    if ( mPollGrp ) 
    {
-      mPollGrp->modPollItem(conn->mPollItemHandle, FPEM_Read|FPEM_Error);
+      mPollGrp->modPollItem(conn->mPollItemHandle,
+                            (conn->mReadable ? FPEM_Read : 0)|FPEM_Error);
    }
    else
    {
@@ -179,6 +181,25 @@ ConnectionManager::removeFromWritable(Connection* conn)
    }
 }
 
+void
+ConnectionManager::updateReadable(Connection* conn)
+{
+   if ( mPollGrp ) 
+   {
+      mPollGrp->modPollItem(conn->mPollItemHandle,
+                            (conn->mReadable ? FPEM_Read : 0)|
+                            (conn->mInWritable ? FPEM_Write : 0)|FPEM_Error);
+   }
+   else if (conn->mReadable)
+   {
+      mReadHead->push_back(conn);
+   }
+   else
+   {
+      conn->ConnectionReadList::remove();
+   }
+}
+
 void
 ConnectionManager::addConnection(Connection* connection)
 {
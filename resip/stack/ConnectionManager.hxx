@@ -52,6 +52,7 @@ class ConnectionManager
    private:
       void addToWritable(Connection* conn); // add the specified conn to end
       void removeFromWritable(Connection* conn); // remove the current mWriteMark
+      void updateReadable(Connection* conn); // follow conn->mReadable
 
       typedef std::map<Tuple, Connection*> AddrMap;
       typedef std::map<Socket, Connection*> IdMap;
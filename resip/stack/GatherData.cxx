@@ -0,0 +1,307 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include "resip/stack/GatherData.hxx"
+#include "rutil/ResipAssert.h"
+#include "rutil/SlabAllocator.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+// Remove warning about 'this' use in initiator list - pointer is only stored
+#if defined(WIN32) && !defined(__GNUC__)
+#pragma warning( disable : 4355 ) // using this in base member initializer list 
+#endif
+
+using namespace resip;
+
+ReceiveBuffers::ReceiveBuffers()
+{
+   mFirst.mBuf = 0;
+   mFirst.mSize = 0;
+   mFirst.mSlab = false;
+}
+
+ReceiveBuffers::ReceiveBuffers(const std::shared_ptr<const ReceiveBuffers>& original)
+   : mOriginal(original)
+{
+   mFirst.mBuf = 0;
+   mFirst.mSize = 0;
+   mFirst.mSlab = false;
+}
+
+ReceiveBuffers::~ReceiveBuffers()
+{
+   release(mFirst);
+   for (std::vector<Buffer>::iterator i = mMore.begin(); i != mMore.end(); ++i)
+   {
+      release(*i);
+   }
+}
+
+void
+ReceiveBuffers::release(const Buffer& b)
+{
+   if (b.mSlab)
+   {
+      SlabAllocator::deallocate(b.mBuf);
+   }
+   else
+   {
+      delete [] b.mBuf;
+   }
+}
+
+void
+ReceiveBuffers::add(char* buf, size_t size, bool slab)
+{
+   Buffer b;
+   b.mBuf = buf;
+   b.mSize = size;
+   b.mSlab = slab;
+   if (mFirst.mBuf == 0)
+   {
+      mFirst = b;
+   }
+   else
+   {
+      mMore.push_back(b);
+   }
+}
+
+bool
+ReceiveBuffers::contains(const char* start, size_t len) const
+{
+   if (start >= mFirst.mBuf && start + len <= mFirst.mBuf + mFirst.mSize)
+   {
+      return true;
+   }
+   for (std::vector<Buffer>::const_iterator i = mMore.begin(); i != mMore.end(); ++i)
+   {
+      if (start >= i->mBuf && start + len <= i->mBuf + i->mSize)
+      {
+         return true;
+      }
+   }
+   return mOriginal && mOriginal->contains(start, len);
+}
+
+GatherData::GatherData(const std::shared_ptr<ReceiveBuffers>& buffers,
+                       size_t reserve)
+   : mBuffers(buffers),
+     mRenderedMark(0),
+     mRenderedMask(0),
+     mSize(0)
+{
+   mRendered.reserve((Data::size_type)reserve);
+   if (mBuffers)
+   {
+      mSegments.reserve(MaxSegments);
+   }
+}
+
+bool
+GatherData::canReference(const char* start, size_t len) const
+{
+   // a reference can add two segments, itself and the rendered run before
+   // it, and leave room for the rendered run that finish() may add
+   return (mBuffers &&
+           mSegments.size() + 3 <= MaxSegments &&
+           mBuffers->contains(start, len));
+}
+
+void
+GatherData::addRendered(size_t end)
+{
+   resip_assert(end >= mRenderedMark);
+   if (end > mRenderedMark)
+   {
+      resip_assert(mSegments.size() < MaxSegments);
+      Segment seg;
+      seg.iov_base = (void*)mRenderedMark;
+      seg.iov_len = end - mRenderedMark;
+      mRenderedMask |= (UInt32)1 << mSegments.size();
+      mSegments.push_back(seg);
+      mRenderedMark = end;
+   }
+}
+
+void
+GatherData::addReference(const char* start, size_t len)
+{
+   if (!mSegments.empty() &&
+       (mRenderedMask & ((UInt32)1 << (mSegments.size() - 1))) == 0 &&
+       (const char*)mSegments.back().iov_base + mSegments.back().iov_len == start)
+   {
+      mSegments.back().iov_len += len;
+      return;
+   }
+   Segment seg;
+   seg.iov_base = const_cast<char*>(start);
+   seg.iov_len = len;
+   mSegments.push_back(seg);
+}
+
+void
+GatherData::finish(size_t end)
+{
+   addRendered(end);
+
+   mSize = 0;
+   for (size_t i = 0; i < mSegments.size(); ++i)
+   {
+      if (mRenderedMask & ((UInt32)1 << i))
+      {
+         mSegments[i].iov_base = const_cast<char*>(mRendered.data()) + (size_t)mSegments[i].iov_base;
+      }
+      mSize += mSegments[i].iov_len;
+   }
+   mRenderedMask = 0;
+}
+
+void
+GatherData::flatten(Data& out) const
+{
+   out.reserve((Data::size_type)(out.size() + mSize));
+   for (size_t i = 0; i < mSegments.size(); ++i)
+   {
+      out.append((const char*)mSegments[i].iov_base,
+                 (Data::size_type)mSegments[i].iov_len);
+   }
+}
+
+Data
+GatherData::flatten() const
+{
+   Data out;
+   flatten(out);
+   return out;
+}
+
+int
+GatherData::remaining(size_t offset, int& first, size_t& skip) const
+{
+   first = 0;
+   while (first < count() && offset >= mSegments[first].iov_len)
+   {
+      offset -= mSegments[first].iov_len;
+      ++first;
+   }
+   skip = offset;
+   return count() - first;
+}
+
+GatherBuffer::GatherBuffer(GatherData& gather)
+   : DataBuffer(gather.mRendered),
+     mGather(gather)
+{
+}
+
+GatherBuffer::~GatherBuffer()
+{
+}
+
+size_t
+GatherBuffer::renderedSize()
+{
+#ifdef RESIP_USE_STL_STREAMS
+   // commit the put area to mStr
+   sync();
+#endif
+   return mStr.size();
+}
+
+void
+GatherBuffer::finish()
+{
+   mGather.finish(renderedSize());
+}
+
+#ifdef RESIP_USE_STL_STREAMS
+std::streamsize
+GatherBuffer::xsputn(const char* s, std::streamsize count)
+{
+   if (count >= (std::streamsize)GatherData::MinReferenceSize &&
+       mGather.canReference(s, (size_t)count))
+   {
+      mGather.addRendered(renderedSize());
+      mGather.addReference(s, (size_t)count);
+      return count;
+   }
+   return DataBuffer::xsputn(s, count);
+}
+#else
+size_t
+GatherBuffer::writebuf(const char* s, size_t count)
+{
+   if (count >= GatherData::MinReferenceSize &&
+       mGather.canReference(s, count))
+   {
+      mGather.addRendered(renderedSize());
+      mGather.addReference(s, count);
+      return count;
+   }
+   return DataBuffer::writebuf(s, count);
+}
+#endif
+
+oGatherStream::oGatherStream(GatherData& gather)
+   : GatherBuffer(gather),
+     EncodeStream(this)
+{
+}
+
+oGatherStream::~oGatherStream()
+{
+   flush();
+   finish();
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,220 @@
+#ifndef RESIP_GatherData_hxx
+#define RESIP_GatherData_hxx
+
+#include <memory>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
+
+#include "rutil/compat.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+
+namespace resip
+{
+
+/**
+   @internal
+   The raw buffers a SipMessage was parsed from. The message owns them
+   through a shared pointer so that a GatherData encoded from it can keep
+   referring to them after the message has been deleted, and so that a copy
+   of the message can keep referring to them as well.
+*/
+class ReceiveBuffers
+{
+   public:
+      ReceiveBuffers();
+      /// for a copy of a message: shares all of the original's buffers
+      explicit ReceiveBuffers(const std::shared_ptr<const ReceiveBuffers>& original);
+      ~ReceiveBuffers();
+
+      /** Takes ownership of buf, allocated with new[] or, if slab is set,
+          with the SlabAllocator. size is the number of valid bytes, or 0 if
+          not known; only buffers of known size can be referenced by a
+          GatherData. */
+      void add(char* buf, size_t size, bool slab=false);
+
+      /// true if [start, start+len) lies inside one buffer of known size
+      bool contains(const char* start, size_t len) const;
+
+   private:
+      struct Buffer
+      {
+         char* mBuf;
+         size_t mSize;
+         bool mSlab;
+      };
+      static void release(const Buffer& b);
+      // nearly every message has exactly one buffer
+      Buffer mFirst;
+      std::vector<Buffer> mMore;
+      std::shared_ptr<const ReceiveBuffers> mOriginal;
+
+      ReceiveBuffers(const ReceiveBuffers&);
+      ReceiveBuffers& operator=(const ReceiveBuffers&);
+};
+
+/**
+   @internal
+   A SipMessage encoded as a list of segments suitable for sendmsg() or
+   writev(). Runs of at least MinReferenceSize bytes that are still exactly
+   as they were received (unparsed or unmodified header field values and
+   the body) point into the message's ReceiveBuffers, which are kept alive
+   for as long as the GatherData is; everything else is rendered into a
+   buffer owned by the GatherData.
+
+   Filled in by encoding the message into an oGatherStream; immutable
+   afterwards, so it can be shared between the SendData copies kept for
+   retransmission.
+*/
+class GatherData
+{
+   public:
+#ifdef WIN32
+      struct Segment
+      {
+         void* iov_base;
+         size_t iov_len;
+      };
+#else
+      typedef struct iovec Segment;
+#endif
+
+      /// references shorter than this are cheaper to copy
+      static const size_t MinReferenceSize = 64;
+      /// keeps the segment count well clear of IOV_MAX
+      static const size_t MaxSegments = 32; // bits in mRenderedMask
+
+      GatherData(const std::shared_ptr<ReceiveBuffers>& buffers,
+                 size_t reserve);
+
+      const Segment* segments() const { return mSegments.empty() ? 0 : &mSegments[0]; }
+      int count() const { return (int)mSegments.size(); }
+      size_t size() const { return mSize; }
+
+      /// appends the whole message to out as contiguous bytes
+      void flatten(Data& out) const;
+      Data flatten() const;
+
+      /** Number of segments, starting at first, needed to cover the bytes
+          from offset onwards (offset is counted from the start of the
+          message); skip is set to how far into segments()[first] that
+          offset falls. Used to resume a partial writev(). */
+      int remaining(size_t offset, int& first, size_t& skip) const;
+
+   private:
+      friend class GatherBuffer;
+
+      bool canReference(const char* start, size_t len) const;
+      void addRendered(size_t end);
+      void addReference(const char* start, size_t len);
+      void finish(size_t end);
+
+      std::shared_ptr<const ReceiveBuffers> mBuffers;
+      Data mRendered;
+      size_t mRenderedMark;
+      std::vector<Segment> mSegments;
+      // while building, rendered segments hold an offset into mRendered
+      // (which may still move) and have their bit set here; finish()
+      // turns them into pointers
+      UInt32 mRenderedMask;
+      size_t mSize;
+
+      GatherData(const GatherData&);
+      GatherData& operator=(const GatherData&);
+};
+
+/**
+   @internal
+   Stream buffer behind oGatherStream: writes are rendered into the
+   GatherData's buffer unless they can be referenced in place.
+*/
+class GatherBuffer : public DataBuffer
+{
+   public:
+      GatherBuffer(GatherData& gather);
+      virtual ~GatherBuffer();
+
+   protected:
+#ifdef RESIP_USE_STL_STREAMS
+      virtual std::streamsize xsputn(const char* s, std::streamsize count);
+#else
+      virtual size_t writebuf(const char* s, size_t count);
+#endif
+      size_t renderedSize();
+      void finish();
+
+      GatherData& mGather;
+};
+
+/**
+   @brief An ostream that encodes into a GatherData.
+
+   The GatherData is complete once the stream has been destroyed.
+*/
+class oGatherStream : private GatherBuffer, public EncodeStream
+{
+   public:
+      oGatherStream(GatherData& gather);
+      ~oGatherStream();
+
+   private:
+      oGatherStream(const oGatherStream&);
+      oGatherStream& operator=(const oGatherStream&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
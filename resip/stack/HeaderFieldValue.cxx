@@ -6,6 +6,7 @@
 
 #include "resip/stack/UnknownParameter.hxx"
 #include "resip/stack/ExistsParameter.hxx"
+#include "resip/stack/GatherData.hxx"
 #include "resip/stack/HeaderFieldValue.hxx"
 #include "resip/stack/MsgHeaderScanner.hxx"
 #include "resip/stack/ParserCategory.hxx"
@@ -22,6 +23,26 @@ using namespace resip;
 
 const HeaderFieldValue HeaderFieldValue::Empty;
 
+static thread_local const ReceiveBuffers* sharedBuffers = 0;
+
+HeaderFieldValue::ShareBuffers::ShareBuffers(const ReceiveBuffers* buffers)
+   : mPrevious(sharedBuffers)
+{
+   sharedBuffers = buffers;
+}
+
+HeaderFieldValue::ShareBuffers::~ShareBuffers()
+{
+   sharedBuffers = mPrevious;
+}
+
+bool
+HeaderFieldValue::canShare(const HeaderFieldValue& rhs)
+{
+   return sharedBuffers && rhs.mFieldLength &&
+          sharedBuffers->contains(rhs.mField, rhs.mFieldLength);
+}
+
 HeaderFieldValue::HeaderFieldValue(const char* field, unsigned int fieldLength)
    : mField(field),
      mFieldLength(fieldLength),
@@ -33,7 +54,12 @@ HeaderFieldValue::HeaderFieldValue(const HeaderFieldValue& hfv)
      mFieldLength(hfv.mFieldLength),
      mMine(true)
 {
-   if(mFieldLength)
+   if(canShare(hfv))
+   {
+      mField=hfv.mField;
+      mMine=false;
+   }
+   else if(mFieldLength)
    {
       char* newField = new char[mFieldLength];
       memcpy(newField, hfv.mField, mFieldLength);
@@ -49,7 +75,12 @@ HeaderFieldValue::operator=(const HeaderFieldValue& rhs)
       mFieldLength=rhs.mFieldLength;
       if(mMine) delete [] mField;
       mMine=true;
-      if(mFieldLength)
+      if(canShare(rhs))
+      {
+         mField=rhs.mField;
+         mMine=false;
+      }
+      else if(mFieldLength)
       {
          char* newField = new char[mFieldLength];
          memcpy(newField, rhs.mField, mFieldLength);
@@ -72,7 +103,13 @@ HeaderFieldValue::copyWithPadding(const HeaderFieldValue& rhs)
       mFieldLength=rhs.mFieldLength;
       if(mMine) delete [] mField;
       mMine=true;
-      if(mFieldLength)
+      if(canShare(rhs))
+      {
+         // a receive buffer is padded already
+         mField=rhs.mField;
+         mMine=false;
+      }
+      else if(mFieldLength)
       {
          char* newField = MsgHeaderScanner::allocateBuffer(mFieldLength);
          memcpy(newField, rhs.mField, mFieldLength);
@@ -92,6 +129,12 @@ HeaderFieldValue::HeaderFieldValue(const HeaderFieldValue& hfv, CopyPaddingEnum
      mFieldLength(hfv.mFieldLength),
      mMine(true)
 {
+   if(canShare(hfv))
+   {
+      mField=hfv.mField;
+      mMine=false;
+      return;
+   }
    char* newField = MsgHeaderScanner::allocateBuffer(mFieldLength);
    memcpy(newField, hfv.mField, mFieldLength);
    mField=newField;
@@ -13,6 +13,7 @@ namespace resip
 class ParserCategory;
 class UnknownParameter;
 class ParseBuffer;
+class ReceiveBuffers;
 
 /**
    @internal
@@ -32,6 +33,25 @@ class HeaderFieldValue
          NoOwnership
       };
 
+      /**
+         While one of these is in scope, copies made on this thread of values
+         that lie in buffers refer to them instead of taking copies of their
+         own. SipMessage uses this for copies made with ShareReceiveBuffers,
+         which keep the original's receive buffers alive while they live.
+      */
+      class ShareBuffers
+      {
+         public:
+            explicit ShareBuffers(const ReceiveBuffers* buffers);
+            ~ShareBuffers();
+
+         private:
+            const ReceiveBuffers* mPrevious;
+
+            ShareBuffers(const ShareBuffers&);
+            ShareBuffers& operator=(const ShareBuffers&);
+      };
+
       HeaderFieldValue()
          : mField(0), //this must be initialized to 0 or ParserCategory will parse
            mFieldLength(0),
@@ -87,7 +107,9 @@ class HeaderFieldValue
       }
 
    private:
-      
+      // true if a copy of rhs can refer to its value (see ShareBuffers)
+      static bool canShare(const HeaderFieldValue& rhs);
+
       const char* mField;
       unsigned int mFieldLength;
       bool mMine;
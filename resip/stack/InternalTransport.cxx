@@ -133,6 +133,23 @@ InternalTransport::bind()
    DebugLog (<< "Binding to " << Tuple::inet_ntop(mTuple)); 
 #endif
 
+   if (mTransportFlags & RESIP_TRANSPORT_FLAG_REUSEPORT)
+   {
+#if defined(SO_REUSEPORT)
+      int on = 1;
+      if ( ::setsockopt(mFd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) )
+      {
+         int e = getErrno();
+         InfoLog (<< "Couldn't set sockoptions SO_REUSEPORT: " << strerror(e));
+         error(e);
+         throw Transport::Exception("Failed setsockopt", __FILE__,__LINE__);
+      }
+#else
+      ErrLog (<< "SO_REUSEPORT not supported on this platform");
+      throw Transport::Exception("SO_REUSEPORT not supported", __FILE__,__LINE__);
+#endif
+   }
+
    if ( ::bind( mFd, &mTuple.getMutableSockaddr(), mTuple.length()) == SOCKET_ERROR )
    {
       int e = getErrno();
@@ -18,6 +18,7 @@ class KeepAlivePong : public TransactionMessage
       {
       }
       virtual const Data& getTransactionId() const { resip_assert(0); return Data::Empty; }
+      virtual bool hasTransactionId() const { return false; }
       virtual bool isClientTransaction() const { resip_assert(0); return false; }
       virtual Message* clone() const { return new KeepAlivePong(mFlow); }
       virtual EncodeStream& encode(EncodeStream& strm) const { return encodeBrief(strm); }
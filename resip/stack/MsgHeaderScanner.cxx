@@ -8,8 +8,23 @@
 #include "resip/stack/HeaderTypes.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/MsgHeaderScanner.hxx"
+#include "rutil/ResipAssert.h"
+#include "rutil/SlabAllocator.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
+#if !defined(RESIP_MSG_HEADER_SCANNER_DEBUG) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define RESIP_MSG_HEADER_SCANNER_SSE2
+#include <emmintrin.h>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RESIP_MSG_HEADER_SCANNER_AVX2
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
 namespace resip 
 {
 
@@ -45,6 +60,18 @@ MsgHeaderScanner::allocateBuffer(int size)
    return new char[size + MaxNumCharsChunkOverflow];
 }
 
+char*
+MsgHeaderScanner::allocateSlabBuffer(int size)
+{
+   return static_cast<char*>(SlabAllocator::allocate(size + MaxNumCharsChunkOverflow));
+}
+
+void
+MsgHeaderScanner::freeSlabBuffer(char* buffer)
+{
+   SlabAllocator::deallocate(buffer);
+}
+
 struct CharInfo
 {
       CharCategory category;
@@ -412,6 +439,188 @@ static void initStateMachine()
                   sMsgStart); // Arbitrary but possibly handy.
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//   Vector scanning.  In the states that scan the bulk of a message header
+//   (the status line, values, and quoted or bracketed text in multi-values)
+//   nearly every character leaves the state unchanged and takes no action.
+//   For each such state, the few characters that do anything else are
+//   derived from the state machine; the characters in between are skipped a
+//   vector at a time, collecting their text properties on the way.  The
+//   state machine then resumes at the character that stopped the skip.
+//   States with too many stop characters to test for are left alone.
+
+enum { maxStopChars = 6 };
+
+struct SkipInfo
+{
+      int numStopChars;       // 0: the state is not skipped
+      char stopChars[maxStopChars];
+      int numPropChars;       // characters with text properties that can
+      char propChars[8];      // be skipped in this state
+      MsgHeaderScanner::TextPropBitMask propBits[8];
+};
+
+static SkipInfo skipInfoArray[numStates];
+
+static void initSkipInfoArray()
+{
+   for (int state = 0; state < numStates; ++state)
+   {
+      SkipInfo& info = skipInfoArray[state];
+      info.numStopChars = 0;
+      info.numPropChars = 0;
+      bool tooMany = false;
+      for (unsigned int charIndex = 0; charIndex <= UCHAR_MAX; ++charIndex)
+      {
+         const CharInfo& charInfo = charInfoArray[charIndex];
+         const TransitionInfo& transition =
+            stateMachine[state][c2i(charInfo.category)];
+         if (transition.action != taNone || transition.nextState != state)
+         {
+            if (info.numStopChars == maxStopChars)
+            {
+               tooMany = true;
+               break;
+            }
+            info.stopChars[info.numStopChars++] = (char)charIndex;
+         }
+         else if (charInfo.textPropBitMask)
+         {
+            resip_assert(info.numPropChars < 8);
+            info.propChars[info.numPropChars] = (char)charIndex;
+            info.propBits[info.numPropChars++] = charInfo.textPropBitMask;
+         }
+      }
+      if (tooMany)
+      {
+         info.numStopChars = 0;
+      }
+   }
+}
+
+// Returns the first stop character at or after charPtr, or where it left
+// off if it got within a vector of lastCharPtr (which must be readable).
+typedef char* (*SkipFunction)(char* charPtr,
+                              const char* lastCharPtr,
+                              const SkipInfo& info,
+                              MsgHeaderScanner::TextPropBitMask& textPropBitMask);
+
+#if defined(RESIP_MSG_HEADER_SCANNER_SSE2)
+
+static inline unsigned int firstBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+   unsigned long index;
+   _BitScanForward(&index, mask);
+   return index;
+#else
+   return __builtin_ctz(mask);
+#endif
+}
+
+static char*
+skipSse2(char* charPtr,
+         const char* lastCharPtr,
+         const SkipInfo& info,
+         MsgHeaderScanner::TextPropBitMask& textPropBitMask)
+{
+   __m128i stop[maxStopChars];
+   for (int i = 0; i < info.numStopChars; ++i)
+   {
+      stop[i] = _mm_set1_epi8(info.stopChars[i]);
+   }
+   while (lastCharPtr - charPtr >= 16 - 1)
+   {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(charPtr));
+      __m128i hits = _mm_cmpeq_epi8(block, stop[0]);
+      for (int i = 1; i < info.numStopChars; ++i)
+      {
+         hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, stop[i]));
+      }
+      unsigned int stopMask = (unsigned int)_mm_movemask_epi8(hits);
+      unsigned int runMask = stopMask ? (stopMask & (0u - stopMask)) - 1 : 0xFFFFu;
+      for (int i = 0; i < info.numPropChars; ++i)
+      {
+         if (!(textPropBitMask & info.propBits[i]) &&
+             ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(info.propChars[i]))) & runMask))
+         {
+            textPropBitMask |= info.propBits[i];
+         }
+      }
+      if (stopMask)
+      {
+         return charPtr + firstBit(stopMask);
+      }
+      charPtr += 16;
+   }
+   return charPtr;
+}
+
+#if defined(RESIP_MSG_HEADER_SCANNER_AVX2)
+
+__attribute__((target("avx2")))
+static char*
+skipAvx2(char* charPtr,
+         const char* lastCharPtr,
+         const SkipInfo& info,
+         MsgHeaderScanner::TextPropBitMask& textPropBitMask)
+{
+   __m256i stop[maxStopChars];
+   for (int i = 0; i < info.numStopChars; ++i)
+   {
+      stop[i] = _mm256_set1_epi8(info.stopChars[i]);
+   }
+   while (lastCharPtr - charPtr >= 32 - 1)
+   {
+      __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(charPtr));
+      __m256i hits = _mm256_cmpeq_epi8(block, stop[0]);
+      for (int i = 1; i < info.numStopChars; ++i)
+      {
+         hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, stop[i]));
+      }
+      unsigned int stopMask = (unsigned int)_mm256_movemask_epi8(hits);
+      unsigned int runMask = stopMask ? (stopMask & (0u - stopMask)) - 1 : 0xFFFFFFFFu;
+      for (int i = 0; i < info.numPropChars; ++i)
+      {
+         if (!(textPropBitMask & info.propBits[i]) &&
+             ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(info.propChars[i]))) & runMask))
+         {
+            textPropBitMask |= info.propBits[i];
+         }
+      }
+      if (stopMask)
+      {
+         return charPtr + firstBit(stopMask);
+      }
+      charPtr += 32;
+   }
+   // finish off what is left of a short run, if it fits in a half vector
+   return skipSse2(charPtr, lastCharPtr, info, textPropBitMask);
+}
+
+#endif
+#endif
+
+static SkipFunction bestSkipFunction()
+{
+#if defined(RESIP_MSG_HEADER_SCANNER_AVX2)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+   {
+      return skipAvx2;
+   }
+#endif
+#if defined(RESIP_MSG_HEADER_SCANNER_SSE2)
+   return skipSse2;
+#else
+   return 0;
+#endif
+}
+
+static SkipFunction skipFunction = 0;
+static bool vectorScanEnabled = true;
+
+
 // Debug follows
 #if defined(RESIP_MSG_HEADER_SCANNER_DEBUG)  
 
@@ -917,6 +1126,8 @@ MsgHeaderScanner::scanChunk(char * chunk,
    MsgHeaderScanner::ScanChunkResult result;
    CharInfo* localCharInfoArray = charInfoArray;
    TransitionInfo (*localStateMachine)[numCharCategories] = stateMachine;
+   SkipInfo* localSkipInfoArray = skipInfoArray;
+   SkipFunction localSkipFunction = vectorScanEnabled ? skipFunction : 0;
    State localState = mState;
    char *charPtr = chunk + mPrevScanChunkNumSavedTextChars;
    char *termCharPtr = chunk + chunkLength;
@@ -950,7 +1161,19 @@ MsgHeaderScanner::scanChunk(char * chunk,
       printStateTransition(localState, *charPtr, transitionAction);
 #endif
       localState = transitionInfo->nextState;
-      if (transitionAction == taNone) continue;
+      if (transitionAction == taNone)
+      {
+         if (localSkipFunction &&
+             localSkipInfoArray[(unsigned)localState].numStopChars)
+         {
+            // The loop starts by advancing "charPtr", so pre-adjust it.
+            charPtr = localSkipFunction(charPtr + 1,
+                                        termCharPtr,
+                                        localSkipInfoArray[(unsigned)localState],
+                                        localTextPropBitMask) - 1;
+         }
+         continue;
+      }
       // END message header character scan block END
       // The loop remainder is executed about 4-5 times per message header line.
       switch (transitionAction)
@@ -1067,9 +1290,30 @@ MsgHeaderScanner::initialize()
 {
    initCharInfoArray();
    initStateMachine();
+   initSkipInfoArray();
+   skipFunction = bestSkipFunction();
    return true;
 }
 
+void
+MsgHeaderScanner::setVectorScan(bool enabled)
+{
+   vectorScanEnabled = enabled;
+}
+
+const char*
+MsgHeaderScanner::vectorScanName()
+{
+   SkipFunction best = bestSkipFunction();
+#if defined(RESIP_MSG_HEADER_SCANNER_AVX2)
+   if (best == skipAvx2)
+   {
+      return "avx2";
+   }
+#endif
+   return best ? "sse2" : "none";
+}
+
 
 } //namespace resip
 
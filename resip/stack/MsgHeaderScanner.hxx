@@ -54,6 +54,10 @@ class MsgHeaderScanner
    public:
       enum { MaxNumCharsChunkOverflow = 5 };
       static char* allocateBuffer(int size);
+      /// As allocateBuffer(), but from the SlabAllocator. Release with
+      /// freeSlabBuffer() or hand over with SipMessage::addSlabBuffer().
+      static char* allocateSlabBuffer(int size);
+      static void freeSlabBuffer(char* buffer);
       
       enum TextPropBitMaskEnum 
       {
@@ -121,6 +125,15 @@ class MsgHeaderScanner
       // !ah! for documentation generation
       static int dumpStateMachine(int fd); 
 
+      // Runs of ordinary characters in the start line and in values are
+      // skipped 32 (AVX2) or 16 (SSE2) characters at a time when the CPU
+      // has the instructions.  Turning this off forces the scan back to one
+      // character at a time, for testing and benchmarking.  Call before
+      // scanning; it is not synchronized.
+      static void setVectorScan(bool enabled);
+      // "avx2", "sse2", or "none" when there is no vector scan to use.
+      static const char* vectorScanName();
+
    private:
 
 
@@ -1,7 +1,10 @@
 #ifndef RESIP_SendData_HXX
 #define RESIP_SendData_HXX
 
+#include <memory>
+
 #include "rutil/Data.hxx"
+#include "resip/stack/GatherData.hxx"
 #include "resip/stack/Tuple.hxx"
 
 namespace resip
@@ -56,15 +59,30 @@ class SendData
       void clear()
       {
          data.clear();
+         gather.reset();
       }
 
       bool empty() const
       {
-         return data.empty();
+         return data.empty() && !gather;
+      }
+
+      /// Converts a gather-encoded message into data, for senders that
+      /// need it contiguous.
+      void flatten()
+      {
+         if (gather)
+         {
+            gather->flatten(data);
+            gather.reset();
+         }
       }
 
       Tuple destination;
       Data data;
+      // If set, the message is here rather than in data; see
+      // TransportSelector::transmit and Transport::supportsGather()
+      std::shared_ptr<const GatherData> gather;
       Data transactionId;
       Data sigcompId;
       bool isAlreadyCompressed;
@@ -4,6 +4,7 @@
 
 #include "resip/stack/Contents.hxx"
 #include "resip/stack/Embedded.hxx"
+#include "resip/stack/GatherData.hxx"
 #include "resip/stack/OctetContents.hxx"
 #include "resip/stack/HeaderFieldValueList.hxx"
 #include "resip/stack/SipMessage.hxx"
@@ -65,6 +66,18 @@ SipMessage::SipMessage(const SipMessage& from)
    init(from);
 }
 
+SipMessage::SipMessage(const SipMessage& from, ShareReceiveBuffersEnum)
+   : mHeaders(StlPoolAllocator<HeaderFieldValueList*, PoolBase >(&mPool)),
+#ifndef __SUNPRO_CC
+     mUnknownHeaders(StlPoolAllocator<std::pair<Data, HeaderFieldValueList*>, PoolBase >(&mPool)),
+#else
+     mUnknownHeaders(),
+#endif
+     mCreatedTime(Timer::getTimeMicroSec())
+{
+   init(from, true);
+}
+
 Message*
 SipMessage::clone() const
 {
@@ -110,7 +123,7 @@ SipMessage::clear(bool leaveResponseStuff)
       
       // !bwc! The "invalid" 0 index.
       mHeaders.push_back(getEmptyHfvl());
-      mBufferList.clear();
+      mBuffers.reset();
    }
 
    mUnknownHeaders.clear();
@@ -124,7 +137,7 @@ SipMessage::clear(bool leaveResponseStuff)
 }
 
 void
-SipMessage::init(const SipMessage& rhs)
+SipMessage::init(const SipMessage& rhs, bool shareBuffers)
 {
    clear();
    mIsDecorated = rhs.mIsDecorated;
@@ -147,6 +160,17 @@ SipMessage::init(const SipMessage& rhs)
    }
    mTlsDomain = rhs.mTlsDomain;
 
+   // When asked to, values that are still as received keep pointing into
+   // the original's receive buffers, so that the copy can still be sent
+   // straight out of them
+   const ReceiveBuffers* shared = 0;
+   if (shareBuffers && rhs.mBuffers)
+   {
+      mBuffers = std::make_shared<ReceiveBuffers>(rhs.mBuffers);
+      shared = rhs.mBuffers.get();
+   }
+   HeaderFieldValue::ShareBuffers share(shared);
+
    memcpy(&mHeaderIndices,&rhs.mHeaderIndices,sizeof(mHeaderIndices));
 
    // .bwc. Clear out the pesky invalid 0 index.
@@ -232,12 +256,7 @@ SipMessage::freeMem(bool leaveResponseStuff)
    if(!leaveResponseStuff)
    {
       clearHeaders();
-
-      for (vector<char*>::iterator i = mBufferList.begin();
-           i != mBufferList.end(); i++)
-      {
-         delete [] *i;
-      }
+      mBuffers.reset();
    }
 
    if(mStartLine)
@@ -277,7 +296,7 @@ SipMessage::make(const Data& data, bool isExternal)
    size_t len = data.size();
    char *buffer = new char[len + 5];
 
-   msg->addBuffer(buffer);
+   msg->addBuffer(buffer, len);
    memcpy(buffer,data.data(), len);
    MsgHeaderScanner msgHeaderScanner;
    msgHeaderScanner.prepareForMessage(msg);
@@ -861,9 +880,23 @@ SipMessage::encodeEmbedded(EncodeStream& str) const
 }
 
 void
-SipMessage::addBuffer(char* buf)
+SipMessage::addBuffer(char* buf, size_t size)
+{
+   if (!mBuffers)
+   {
+      mBuffers = std::make_shared<ReceiveBuffers>();
+   }
+   mBuffers->add(buf, size);
+}
+
+void
+SipMessage::addSlabBuffer(char* buf, size_t size)
 {
-   mBufferList.push_back(buf);
+   if (!mBuffers)
+   {
+      mBuffers = std::make_shared<ReceiveBuffers>();
+   }
+   mBuffers->add(buf, size, true);
 }
 
 void 
@@ -25,12 +25,14 @@
 #include "rutil/StlPoolAllocator.hxx"
 #include "rutil/Timer.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
+#include "rutil/SlabAllocator.hxx"
 
 namespace resip
 {
 
 class Contents;
 class ExtensionHeader;
+class ReceiveBuffers;
 class SecurityAttributes;
 
 /**
@@ -154,15 +156,36 @@ class SipMessage : public TransactionMessage
 {
    public:
       RESIP_HeapCount(SipMessage);
+#ifndef RESIP_HEAP_COUNT
+      // Messages come and go at a high rate, and are often freed on a
+      // different thread than the one that made them
+      static void* operator new(size_t size) { return SlabAllocator::allocate(size); }
+      static void* operator new(size_t, void* p) { return p; }
+      static void operator delete(void* ptr) { SlabAllocator::deallocate(ptr); }
+      static void operator delete(void*, void*) {}
+#endif
 #ifndef __SUNPRO_CC
       typedef std::list< std::pair<Data, HeaderFieldValueList*>, StlPoolAllocator<std::pair<Data, HeaderFieldValueList*>, PoolBase > > UnknownHeaders;
 #else
       typedef std::list< std::pair<Data, HeaderFieldValueList*> > UnknownHeaders;
 #endif
 
+      enum ShareReceiveBuffersEnum
+      {
+         ShareReceiveBuffers
+      };
+
       explicit SipMessage(const Tuple *receivedTransport = 0);
       /// @todo .dlb. public, allows pass by value to compile.
       SipMessage(const SipMessage& message);
+      /**
+         Copies message, but leaves whatever is still as received pointing
+         into message's receive buffers, so that the copy can be sent
+         straight out of them. The copy keeps those buffers alive, so only
+         use this for copies that go away once sent (eg: when a proxy
+         forwards a message); a plain copy owns all of its data.
+      */
+      SipMessage(const SipMessage& message, ShareReceiveBuffersEnum);
 
       /// @todo .dlb. sure would be nice to have overloaded return value here..
       virtual Message* clone() const;
@@ -533,7 +556,16 @@ class SipMessage : public TransactionMessage
       void setDestination(const Tuple& tuple) { mDestination = tuple; }
       Tuple& getDestination() { return mDestination; }
 
-      void addBuffer(char* buf);
+      /** Hands a receive buffer (allocated with new[]) over to the message.
+          size is the number of valid bytes in it; if it is given, encoding
+          into a GatherData can reference header values and the body in place.
+      */
+      void addBuffer(char* buf, size_t size=0);
+      /// As addBuffer(), for a buffer from MsgHeaderScanner::allocateSlabBuffer()
+      void addSlabBuffer(char* buf, size_t size);
+
+      /// The buffers this message was parsed from; empty if none
+      const std::shared_ptr<ReceiveBuffers>& getReceiveBuffers() const { return mBuffers; }
 
       UInt64 getCreatedTimeMicroSec() const {return mCreatedTime;}
 
@@ -587,7 +619,7 @@ class SipMessage : public TransactionMessage
       
       // !bwc! Initializes members. Will not free heap-allocated memory.
       // Will begin by calling clear().
-      void init(const SipMessage& rhs);
+      void init(const SipMessage& rhs, bool shareBuffers=false);
    
    private:
       void compute2543TransactionHash() const;
@@ -691,8 +723,9 @@ class SipMessage : public TransactionMessage
       // Used by the TU to specify where a message is to go
       Tuple mDestination;
       
-      // Raw buffers coming from the Transport. message manages the memory
-      std::vector<char*> mBufferList;
+      // Raw buffers coming from the Transport. message manages the memory,
+      // shared with any GatherData still referencing it
+      std::shared_ptr<ReceiveBuffers> mBuffers;
 
       // special case for the first line of message
       StartLine* mStartLine;
@@ -35,6 +35,7 @@
 #include "resip/stack/TransactionUserMessage.hxx"
 #include "resip/stack/TransactionControllerThread.hxx"
 #include "resip/stack/TransportSelectorThread.hxx"
+#include "resip/stack/TransportThread.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 #ifdef USE_SSL
@@ -104,6 +105,7 @@ SipStack::SipStack(Security* pSecurity,
    mStatsManager(*this),
    mTransactionController(new TransactionController(*this, mAsyncProcessHandler, useDnsVip)),
    mTransactionControllerThread(0),
+   mStateMacFifoRingSize(0),
    mTransportSelectorThread(0),
    mInternalThreadsRunning(false),
    mProcessingHasStarted(false),
@@ -207,6 +209,7 @@ SipStack::init(const SipStackOptions& options)
    mTransactionController = new TransactionController(*this, mAsyncProcessHandler, options.mUseDnsVip);
    mTransactionController->transportSelector().setPollGrp(mPollGrp);
    mTransactionControllerThread = 0;
+   mStateMacFifoRingSize = 0;
    mTransportSelectorThread = 0;
 
    mInternalThreadsRunning = false;
@@ -219,6 +222,15 @@ SipStack::init(const SipStackOptions& options)
    Timer::getTimeMs(); // initalize time offsets
    Random::initialize();
    initNetwork();
+
+   if (options.mTransactionShards > 1)
+   {
+      setTransactionShards(options.mTransactionShards);
+   }
+   if (options.mStateMacFifoRingSize)
+   {
+      setLockFreeStateMacFifo(options.mStateMacFifoRingSize);
+   }
 }
 
 SipStack::~SipStack()
@@ -226,13 +238,33 @@ SipStack::~SipStack()
    DebugLog (<< "SipStack::~SipStack()");
    shutdownAndJoinThreads();
 
+   // transport threads must go before the transports they drive
+   for(TransportShardMap::iterator it = mTransportShards.begin(); it != mTransportShards.end(); ++it)
+   {
+      stopShardThreads(it->second);
+   }
+   mTransportShards.clear();
+
    delete mDnsThread;
    mDnsThread=0;
    delete mTransactionControllerThread;
    mTransactionControllerThread=0;
+   for(std::vector<TransactionControllerThread*>::iterator it = mTransactionShardThreads.begin();
+       it != mTransactionShardThreads.end(); ++it)
+   {
+      delete *it;
+   }
+   mTransactionShardThreads.clear();
    delete mTransportSelectorThread;
    mTransportSelectorThread=0;
 
+   // shards share mTransactionController's TransportSelector, so go first
+   for(std::vector<TransactionController*>::iterator it = mTransactionShards.begin();
+       it != mTransactionShards.end(); ++it)
+   {
+      delete *it;
+   }
+   mTransactionShards.clear();
    delete mTransactionController;
 #ifdef USE_SSL
    delete mSecurity;
@@ -271,11 +303,96 @@ SipStack::run()
    mTransactionControllerThread=new TransactionControllerThread(*mTransactionController);
    mTransactionControllerThread->run();
 
+   for(std::vector<TransactionController*>::iterator it = mTransactionShards.begin();
+       it != mTransactionShards.end(); ++it)
+   {
+      mTransactionShardThreads.push_back(new TransactionControllerThread(**it));
+      mTransactionShardThreads.back()->run();
+   }
+
    delete mTransportSelectorThread;
    mTransportSelectorThread=new TransportSelectorThread(mTransactionController->transportSelector());
    mTransportSelectorThread->run();
 }
 
+void
+SipStack::setTransactionShards(unsigned int numShards)
+{
+   resip_assert(numShards >= 1);
+   resip_assert(mTransactionShards.empty());
+   resip_assert(!mProcessingHasStarted && !mInternalThreadsRunning);
+   if(numShards <= 1)
+   {
+      return;
+   }
+
+   mTransactionShardFifos.push_back(&mTransactionController->stateMacFifo());
+   for(unsigned int i = 1; i < numShards; ++i)
+   {
+      TransactionController* shard = new TransactionController(*this, mAsyncProcessHandler, *mTransactionController);
+      if(mStateMacFifoRingSize)
+      {
+         shard->stateMacFifo().setLockFree(mStateMacFifoRingSize);
+      }
+      if(mCongestionManager)
+      {
+         shard->setCongestionManager(mCongestionManager);
+      }
+      mTransactionShards.push_back(shard);
+      mTransactionShardFifos.push_back(&shard->stateMacFifo());
+   }
+   mTransactionController->transportSelector().setTransactionShards(mTransactionShardFifos);
+   InfoLog (<< "Transaction processing split over " << numShards << " shards");
+}
+
+void
+SipStack::setLockFreeStateMacFifo(unsigned int capacity)
+{
+   resip_assert(mStateMacFifoRingSize == 0);
+   resip_assert(!mProcessingHasStarted && !mInternalThreadsRunning);
+   if(capacity == 0)
+   {
+      return;
+   }
+
+   mStateMacFifoRingSize = capacity;
+   mTransactionController->stateMacFifo().setLockFree(capacity);
+   for(std::vector<TransactionController*>::iterator it = mTransactionShards.begin();
+       it != mTransactionShards.end(); ++it)
+   {
+      (*it)->stateMacFifo().setLockFree(capacity);
+   }
+   InfoLog (<< "Transaction state machine fifo is lock-free, ring size " << capacity);
+}
+
+TransactionController&
+SipStack::transactionShardFor(const TransactionMessage& msg)
+{
+   unsigned int shard = msg.getShardIndex(getTransactionShards());
+   return shard == 0 ? *mTransactionController : *mTransactionShards[shard - 1];
+}
+
+TransactionController&
+SipStack::transactionShardFor(const Data& tid)
+{
+   unsigned int shard = TransactionMessage::getShardIndex(tid, getTransactionShards());
+   return shard == 0 ? *mTransactionController : *mTransactionShards[shard - 1];
+}
+
+bool
+SipStack::transactionShardsIdle() const
+{
+   for(std::vector<TransactionController*>::const_iterator it = mTransactionShards.begin();
+       it != mTransactionShards.end(); ++it)
+   {
+      if((*it)->getTransactionFifoSize() != 0)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
 void
 SipStack::shutdown()
 {
@@ -288,6 +405,11 @@ SipStack::shutdown()
    }
 
    mTransactionController->shutdown();
+   for(std::vector<TransactionController*>::iterator it = mTransactionShards.begin();
+       it != mTransactionShards.end(); ++it)
+   {
+      (*it)->shutdown();
+   }
 }
 
 void 
@@ -305,11 +427,27 @@ SipStack::shutdownAndJoinThreads()
       mTransactionControllerThread->join();
    }
 
+   for(std::vector<TransactionControllerThread*>::iterator it = mTransactionShardThreads.begin();
+       it != mTransactionShardThreads.end(); ++it)
+   {
+      (*it)->shutdown();
+      (*it)->join();
+   }
+
    if(mTransportSelectorThread)
    {
       mTransportSelectorThread->shutdown();
       mTransportSelectorThread->join();
    }
+
+   for(TransportShardMap::iterator it = mTransportShards.begin(); it != mTransportShards.end(); ++it)
+   {
+      for(std::vector<TransportThread*>::iterator t = it->second.mThreads.begin(); t != it->second.mThreads.end(); ++t)
+      {
+         (*t)->shutdown();
+         (*t)->join();
+      }
+   }
    mInternalThreadsRunning=false;
 }
 
@@ -343,10 +481,23 @@ SipStack::addTransport( TransportType protocol,
                         bool useEmailAsSIP,
                         std::shared_ptr<WsConnectionValidator> wsConnectionValidator,
                         std::shared_ptr<WsCookieContextFactory> wsCookieContextFactory,
-                        const Data& netNs)
+                        const Data& netNs,
+                        unsigned int numShards)
 {
    resip_assert(!mShuttingDown);
 
+   if(numShards > 1)
+   {
+      if((protocol != UDP && protocol != TCP) || (transportFlags & RESIP_TRANSPORT_FLAG_NOBIND))
+      {
+         ErrLog(<< "Failed to create transport, numShards=" << numShards 
+                << " requires a listening UDP or TCP transport: " << Tuple::toData(protocol));
+         throw Transport::Exception("Transport sharding requires a listening UDP or TCP transport", __FILE__,__LINE__);
+      }
+      // The stack runs a thread per shard, see below
+      transportFlags |= RESIP_TRANSPORT_FLAG_REUSEPORT | RESIP_TRANSPORT_FLAG_OWNTHREAD;
+   }
+
    // If address is specified, ensure it is valid
    if(!ipInterface.empty())
    {
@@ -486,6 +637,46 @@ SipStack::addTransport( TransportType protocol,
       throw;
    }
    addTransport(std::unique_ptr<Transport>(transport));
+
+   if(numShards > 1)
+   {
+      TransportShards& shards = mTransportShards[transport->getKey()];
+      shards.mThreads.push_back(new TransportThread(*transport));
+      try
+      {
+         for(unsigned int i = 1; i < numShards; ++i)
+         {
+            // Bind to the port the primary actually got, in case it was 0
+            InternalTransport* shard = 0;
+            if(protocol == UDP)
+            {
+               shard = new UdpTransport(stateMacFifo, transport->port(), version, stun, ipInterface, mSocketFunc, *mCompression, transportFlags);
+            }
+            else
+            {
+               shard = new TcpTransport(stateMacFifo, transport->port(), version, ipInterface, mSocketFunc, *mCompression, transportFlags, netNs);
+            }
+            shard->setKey(mNextTransportKey++);
+            shard->setShardOf(transport->getKey());
+            shards.mShardKeys.push_back(shard->getKey());
+            shards.mThreads.push_back(new TransportThread(*shard));
+            addTransportToSelector(std::unique_ptr<Transport>(shard));
+         }
+      }
+      catch (BaseException& e)
+      {
+         ErrLog(<< "Failed to create transport shard for " << transport->getTuple() << ": " << e);
+         removeTransport(transport->getKey());
+         throw;
+      }
+
+      for(std::vector<TransportThread*>::iterator it = shards.mThreads.begin(); it != shards.mThreads.end(); ++it)
+      {
+         (*it)->run();
+      }
+      InfoLog(<< "Added " << numShards << " SO_REUSEPORT shards for " << transport->getTuple());
+   }
+
    return transport;
 }
 
@@ -562,6 +753,12 @@ SipStack::addTransport(std::unique_ptr<Transport> transport)
       mPorts[transport->port()]++;  // add port / increment reference count
    }
 
+   addTransportToSelector(std::move(transport));
+}
+
+void
+SipStack::addTransportToSelector(std::unique_ptr<Transport> transport)
+{
    // Add to CongestionManager if required
    if(mCongestionManager)
    {
@@ -574,6 +771,11 @@ SipStack::addTransport(std::unique_ptr<Transport> transport)
        transport->setSipMessageLoggingHandler(mTransportSipMessageLoggingHandler);
    }
 
+   if(!mTransactionShardFifos.empty())
+   {
+       transport->setTransactionShards(mTransactionShardFifos);
+   }
+
    if(mProcessingHasStarted)
    {
        // Stack is running.  Need to queue add request for TransactionController Thread
@@ -623,6 +825,27 @@ SipStack::removeTransport(unsigned int transportKey)
       return;
    }
 
+   // Tear down any SO_REUSEPORT shards along with their primary. Their
+   // threads must be stopped before TransportSelector deletes them.
+   TransportShardMap::iterator itShards = mTransportShards.find(transportKey);
+   if(itShards != mTransportShards.end())
+   {
+      stopShardThreads(itShards->second);
+      for(std::vector<unsigned int>::iterator it = itShards->second.mShardKeys.begin(); 
+          it != itShards->second.mShardKeys.end(); ++it)
+      {
+         if(mProcessingHasStarted)
+         {
+            mTransactionController->removeTransport(*it);
+         }
+         else
+         {
+            mTransactionController->transportSelector().removeTransport(*it);
+         }
+      }
+      mTransportShards.erase(itShards);
+   }
+
    if(mSecureTransports.size() == 0 && mNonSecureTransports.size() == 0)
    {
       // If we have no more transports we can just clear out the mDomains map and mUri
@@ -682,6 +905,27 @@ SipStack::removeTransport(unsigned int transportKey)
    }
 }
 
+void
+SipStack::stopShardThreads(TransportShards& shards)
+{
+   // ~TransportThread tears down its poll group before ~ThreadIf would stop
+   // the thread, so every thread has to be stopped and joined first
+   std::vector<TransportThread*>::iterator it;
+   for(it = shards.mThreads.begin(); it != shards.mThreads.end(); ++it)
+   {
+      (*it)->shutdown();
+   }
+   for(it = shards.mThreads.begin(); it != shards.mThreads.end(); ++it)
+   {
+      (*it)->join();
+   }
+   for(it = shards.mThreads.begin(); it != shards.mThreads.end(); ++it)
+   {
+      delete *it;
+   }
+   shards.mThreads.clear();
+}
+
 Fifo<TransactionMessage>&
 SipStack::stateMacFifo()
 {
@@ -848,7 +1092,7 @@ SipStack::send(const SipMessage& msg, TransactionUser* tu)
    }
    toSend->setFromTU();
 
-   mTransactionController->send(toSend);
+   transactionShardFor(*toSend).send(toSend);
 }
 
 void
@@ -862,7 +1106,8 @@ SipStack::send(std::unique_ptr<SipMessage> msg, TransactionUser* tu)
    }
    msg->setFromTU();
 
-   mTransactionController->send(msg.release());
+   TransactionController& shard = transactionShardFor(*msg);
+   shard.send(msg.release());
 }
 
 void
@@ -872,7 +1117,8 @@ SipStack::sendTo(std::unique_ptr<SipMessage> msg, const Uri& uri, TransactionUse
    msg->setForceTarget(uri);
    msg->setFromTU();
 
-   mTransactionController->send(msg.release());
+   TransactionController& shard = transactionShardFor(*msg);
+   shard.send(msg.release());
 }
 
 void
@@ -884,7 +1130,8 @@ SipStack::sendTo(std::unique_ptr<SipMessage> msg, const Tuple& destination, Tran
    msg->setDestination(destination);
    msg->setFromTU();
 
-   mTransactionController->send(msg.release());
+   TransactionController& shard = transactionShardFor(*msg);
+   shard.send(msg.release());
 }
 
 // this is only if you want to send to a destination not in the route. You
@@ -899,7 +1146,7 @@ SipStack::sendTo(const SipMessage& msg, const Uri& uri, TransactionUser* tu)
    toSend->setForceTarget(uri);
    toSend->setFromTU();
 
-   mTransactionController->send(toSend);
+   transactionShardFor(*toSend).send(toSend);
 }
 
 // this is only if you want to send to a destination not in the route. You
@@ -914,7 +1161,7 @@ SipStack::sendTo(const SipMessage& msg, const Tuple& destination, TransactionUse
    toSend->setDestination(destination);
    toSend->setFromTU();
 
-   mTransactionController->send(toSend);
+   transactionShardFor(*toSend).send(toSend);
 }
 
 void
@@ -989,13 +1236,13 @@ SipStack::postMS( std::unique_ptr<ApplicationMessage> message,
 void
 SipStack::abandonServerTransaction(const Data& tid)
 {
-   mTransactionController->abandonServerTransaction(tid);
+   transactionShardFor(tid).abandonServerTransaction(tid);
 }
 
 void
 SipStack::cancelClientInviteTransaction(const Data& tid, const Tokens* reasons)
 {
-   mTransactionController->cancelClientInviteTransaction(tid, reasons);
+   transactionShardFor(tid).cancelClientInviteTransaction(tid, reasons);
 }
 
 bool
@@ -1069,6 +1316,11 @@ SipStack::processTimers()
    if(!mTransactionControllerThread)
    {
       mTransactionController->process();
+      for(std::vector<TransactionController*>::iterator it = mTransactionShards.begin();
+          it != mTransactionShards.end(); ++it)
+      {
+         (*it)->process();
+      }
    }
 
    if(!mDnsThread)
@@ -1116,6 +1368,14 @@ SipStack::getTimeTillNextProcessMS()
                            INT_MAX : mDnsStub->getTimeTillNextProcessMS());
    unsigned int tcNextProcess = mTransactionControllerThread ? INT_MAX : 
                            mTransactionController->getTimeTillNextProcessMS();
+   if(!mTransactionControllerThread)
+   {
+      for(std::vector<TransactionController*>::iterator it = mTransactionShards.begin();
+          it != mTransactionShards.end(); ++it)
+      {
+         tcNextProcess = resipMin(tcNextProcess, (*it)->getTimeTillNextProcessMS());
+      }
+   }
    unsigned int tsNextProcess = mTransportSelectorThread ? INT_MAX : mTransactionController->transportSelector().getTimeTillNextProcessMS();
 
    return resipMin(Timer::getMaxSystemTimeWaitMs(),
@@ -6,6 +6,7 @@
 #endif
 
 #include <set>
+#include <vector>
 #include <iosfwd>
 
 #include "rutil/CongestionManager.hxx"
@@ -46,6 +47,7 @@ class Tuple;
 class Uri;
 class TransactionControllerThread;
 class TransportSelectorThread;
+class TransportThread;
 class TransactionUser;
 class AsyncProcessHandler;
 class Compression;
@@ -111,7 +113,8 @@ class SipStackOptions
          : mSecurity(0), mExtraNameserverList(0),
            mAsyncProcessHandler(0), mStateless(false),
            mSocketFunc(0), mCompression(0), mPollGrp(0),
-           mUseDnsVip(false)
+           mUseDnsVip(false), mTransactionShards(1),
+           mStateMacFifoRingSize(0)
       {
       }
 
@@ -123,6 +126,10 @@ class SipStackOptions
       Compression *mCompression;
       FdPollGrp* mPollGrp;
       bool mUseDnsVip;
+      /// @see SipStack::setTransactionShards()
+      unsigned int mTransactionShards;
+      /// @see SipStack::setLockFreeStateMacFifo()
+      unsigned int mStateMacFifoRingSize;
 };
 
 
@@ -235,6 +242,39 @@ class SipStack : public FdSetIOObserver
       */
       void run();
 
+      /**
+         @brief Splits transaction processing over numShards
+         TransactionControllers, each with its own state machine fifo,
+         transaction maps and timer queue, and (once run() is called) its own
+         thread.
+
+         @details Messages are assigned to a shard by a hash of their
+         transaction id (normally the top Via branch), so a transaction, its
+         retransmissions, responses, CANCEL and timers all stay on one shard.
+         Transports hand received messages straight to the right shard.  The
+         shards share one TransportSelector, which then locks around
+         transport lookups and transmission.
+
+         Must be called before any transport is added and before the stack
+         is given any cycles.  The default is one shard.
+         @see SipStackOptions::mTransactionShards
+      */
+      void setTransactionShards(unsigned int numShards);
+      unsigned int getTransactionShards() const { return (unsigned int)mTransactionShards.size() + 1; }
+
+      /**
+         Switches the transaction state machine fifo (of every shard) to the
+         lock-free ring backend of the given capacity; see
+         Fifo::setLockFree().  Transports, the TU and timers then hand
+         messages to the transaction layer without taking the fifo mutex
+         unless the transaction thread is parked waiting for work.
+
+         Must be called before any transport is added and before the stack
+         is given any cycles.  0 (the default) keeps the mutex-based fifo.
+         @see SipStackOptions::mStateMacFifoRingSize
+      */
+      void setLockFreeStateMacFifo(unsigned int capacity);
+
       /** 
          @brief perform orderly shutdown
          @details Inform the transaction state machine processor that it should not
@@ -353,6 +393,14 @@ class SipStack : public FdSetIOObserver
          @param netNs                 Set the network namespace (netns) in which the Transport is
                                       to bind the the given address and port.
 
+         @param numShards             UDP and TCP only.  If greater than 1, open this many
+                                      SO_REUSEPORT sockets on the same address and port, and
+                                      let the kernel spread inbound traffic across them.  Each
+                                      socket gets its own TransportThread and FdPollGrp, run by
+                                      the stack.  The returned Transport (and its key) is the
+                                      primary; it is used for all new outbound traffic, and
+                                      removeTransport() on its key removes the whole group.
+
       */
       Transport* addTransport(TransportType protocol,
                               int port,
@@ -368,7 +416,8 @@ class SipStack : public FdSetIOObserver
                               bool useEmailAsSIP = false,
                               std::shared_ptr<WsConnectionValidator> = nullptr,
                               std::shared_ptr<WsCookieContextFactory> = nullptr,
-                              const Data& netNs = Data::Empty
+                              const Data& netNs = Data::Empty,
+                              unsigned int numShards = 1
                              );
 
       /**
@@ -966,6 +1015,10 @@ class SipStack : public FdSetIOObserver
       void setFixBadDialogIdentifiers(bool pFixBadDialogIdentifiers) 
       {
          mTransactionController->mFixBadDialogIdentifiers = pFixBadDialogIdentifiers;
+         for(size_t i = 0; i < mTransactionShards.size(); ++i)
+         {
+            mTransactionShards[i]->mFixBadDialogIdentifiers = pFixBadDialogIdentifiers;
+         }
       }
 
       inline bool getFixBadCSeqNumbers() const
@@ -976,6 +1029,10 @@ class SipStack : public FdSetIOObserver
       inline void setFixBadCSeqNumbers(bool pFixBadCSeqNumbers)
       {
          mTransactionController->setFixBadCSeqNumbers(pFixBadCSeqNumbers);
+         for(size_t i = 0; i < mTransactionShards.size(); ++i)
+         {
+            mTransactionShards[i]->setFixBadCSeqNumbers(pFixBadCSeqNumbers);
+         }
       }
 
       bool setUdpOnlyOnNumeric(bool value)
@@ -1053,6 +1110,10 @@ class SipStack : public FdSetIOObserver
       void setCongestionManager ( CongestionManager *manager )
       {
          mTransactionController->setCongestionManager(manager);
+         for(size_t i = 0; i < mTransactionShards.size(); ++i)
+         {
+            mTransactionShards[i]->setCongestionManager(manager);
+         }
          mTuSelector.setCongestionManager(manager);
          if(mCongestionManager)
          {
@@ -1158,6 +1219,20 @@ class SipStack : public FdSetIOObserver
       TransactionController* mTransactionController;
 
       TransactionControllerThread* mTransactionControllerThread;
+
+      /** @brief Transaction controller shards after the first
+          (mTransactionController), and their threads; empty unless
+          setTransactionShards() was called. mTransactionShardFifos holds
+          every shard's state machine fifo, the first shard's included. */
+      std::vector<TransactionController*> mTransactionShards;
+      std::vector<TransactionControllerThread*> mTransactionShardThreads;
+      std::vector<Fifo<TransactionMessage>*> mTransactionShardFifos;
+      /// ring capacity of every shard's state machine fifo; 0 if not lock-free
+      unsigned int mStateMacFifoRingSize;
+      TransactionController& transactionShardFor(const TransactionMessage& msg);
+      TransactionController& transactionShardFor(const Data& tid);
+      bool transactionShardsIdle() const;
+
       TransportSelectorThread* mTransportSelectorThread;
       bool mInternalThreadsRunning;
       bool mProcessingHasStarted; 
@@ -1192,6 +1267,19 @@ class SipStack : public FdSetIOObserver
 
       unsigned int mNextTransportKey;
 
+      /** SO_REUSEPORT groups created by addTransport() with numShards > 1,
+          keyed by the primary transport's key.  mThreads has one
+          TransportThread per member of the group, primary included. */
+      struct TransportShards
+      {
+         std::vector<unsigned int> mShardKeys;
+         std::vector<TransportThread*> mThreads;
+      };
+      typedef std::map<unsigned int, TransportShards> TransportShardMap;
+      TransportShardMap mTransportShards;
+      void addTransportToSelector(std::unique_ptr<Transport> transport);
+      void stopShardThreads(TransportShards& shards);
+
       std::shared_ptr<Transport::SipMessageLoggingHandler> mTransportSipMessageLoggingHandler;
 
       friend class Executive;
@@ -2,6 +2,7 @@
 #include "config.h"
 #endif
 
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "resip/stack/StatisticsManager.hxx"
 #include "resip/stack/SipMessage.hxx"
@@ -34,17 +35,22 @@ StatisticsManager::setInterval(unsigned long intervalSecs)
    mInterval = intervalSecs * 1000;
 }
 
+Mutex*
+StatisticsManager::countersMutex()
+{
+   return mStack.mTransactionShards.empty() ? 0 : &mCountersMutex;
+}
+
+void
+StatisticsManager::zeroOut()
+{
+   PtrLock lock(countersMutex());
+   StatisticsMessage::Payload::zeroOut();
+}
+
 void 
 StatisticsManager::poll()
 {
-   // get snapshot data now..
-   tuFifoSize = mStack.mTransactionController->getTuFifoSize();
-   transportFifoSizeSum = mStack.mTransactionController->sumTransportFifoSizes();
-   transactionFifoSize = mStack.mTransactionController->getTransactionFifoSize();
-   activeTimers = mStack.mTransactionController->getTimerQueueSize();
-   activeClientTransactions = mStack.mTransactionController->getNumClientTransactions();
-   activeServerTransactions = mStack.mTransactionController->getNumServerTransactions();
-
    // .kw. At last check payload was > 146kB, which seems too large
    // to alloc on stack. Also, the post'd message has reference
    // to the appStats, so not safe queue as ref to stack element.
@@ -54,7 +60,32 @@ StatisticsManager::poll()
        mPublicPayload = new StatisticsMessage::AtomicPayload;
        // re-used each time, free'd in destructor
    }
-   mPublicPayload->loadIn(*this);
+
+   {
+      PtrLock lock(countersMutex());
+
+      // get snapshot data now..
+      tuFifoSize = mStack.mTransactionController->getTuFifoSize();
+      transportFifoSizeSum = mStack.mTransactionController->sumTransportFifoSizes();
+      transactionFifoSize = mStack.mTransactionController->getTransactionFifoSize();
+      activeTimers = mStack.mTransactionController->getTimerQueueSize();
+      activeClientTransactions = mStack.mTransactionController->getNumClientTransactions();
+      activeServerTransactions = mStack.mTransactionController->getNumServerTransactions();
+      for(std::vector<TransactionController*>::const_iterator it = mStack.mTransactionShards.begin();
+          it != mStack.mTransactionShards.end(); ++it)
+      {
+         transactionFifoSize += (*it)->getTransactionFifoSize();
+         activeTimers += (*it)->getTimerQueueSize();
+         activeClientTransactions += (*it)->getNumClientTransactions();
+         activeServerTransactions += (*it)->getNumServerTransactions();
+      }
+      rxBatches = rxBatchMsgs = txBatches = txBatchMsgs = 0;
+      mStack.mTransactionController->sumTransportBatchCounts(rxBatches, rxBatchMsgs, txBatches, txBatchMsgs);
+      tlsHandshakes = tlsResumed = 0;
+      mStack.mTransactionController->sumTransportTlsCounts(tlsHandshakes, tlsResumed);
+
+      mPublicPayload->loadIn(*this);
+   }
 
    bool postToStack = true;
    StatisticsMessage msg(*mPublicPayload);
@@ -93,6 +124,8 @@ StatisticsManager::process()
 bool
 StatisticsManager::sent(SipMessage* msg)
 {
+   PtrLock lock(countersMutex());
+
    MethodTypes met = msg->method();
 
    if (msg->isRequest())
@@ -121,6 +154,8 @@ StatisticsManager::retransmitted(MethodTypes met,
                                  bool request, 
                                  unsigned int code)
 {
+   PtrLock lock(countersMutex());
+
    if(request)
    {
       ++requestsRetransmitted;
@@ -138,6 +173,8 @@ StatisticsManager::retransmitted(MethodTypes met,
 bool
 StatisticsManager::received(SipMessage* msg)
 {
+   PtrLock lock(countersMutex());
+
    MethodTypes met = msg->header(h_CSeq).method();
 
    if (msg->isRequest())
@@ -3,6 +3,7 @@
 
 #include "rutil/Timer.hxx"
 #include "rutil/Data.hxx"
+#include "rutil/Mutex.hxx"
 #include "resip/stack/StatisticsMessage.hxx"
 #include "resip/stack/StatisticsHandler.hxx"
 
@@ -55,10 +56,15 @@ class StatisticsManager : public StatisticsMessage::Payload
       bool sent(SipMessage* msg);
       bool retransmitted(MethodTypes type, bool request, unsigned int code);
       bool received(SipMessage* msg);
+      void zeroOut();
 
       void poll(); // force an update
 
       SipStack& mStack;
+      // Protects the counters when several transaction controller shards
+      // update them concurrently; only taken in that case.
+      Mutex mCountersMutex;
+      Mutex* countersMutex();
       UInt64 mInterval;
       UInt64 mNextPoll;
 
@@ -89,6 +89,18 @@ StatisticsMessage::Payload::sumErrOut(MethodTypes method) const
    return ret;
 }
 
+double
+StatisticsMessage::Payload::avgRxBatchSize() const
+{
+   return rxBatches ? (double)rxBatchMsgs / rxBatches : 0.0;
+}
+
+double
+StatisticsMessage::Payload::avgTxBatchSize() const
+{
+   return txBatches ? (double)txBatchMsgs / txBatches : 0.0;
+}
+
 void 
 StatisticsMessage::logStats(const resip::Subsystem& subsystem, 
                             const StatisticsMessage::Payload& stats)
@@ -121,6 +133,12 @@ StatisticsMessage::Payload::zeroOut()
    activeClientTransactions = 0;
    activeServerTransactions = 0;
    pendingDnsQueries = 0;
+   rxBatches = 0;
+   rxBatchMsgs = 0;
+   txBatches = 0;
+   txBatchMsgs = 0;
+   tlsHandshakes = 0;
+   tlsResumed = 0;
    requestsSent = 0;
    responsesSent = 0;
    requestsRetransmitted = 0;
@@ -154,6 +172,13 @@ StatisticsMessage::Payload::operator=(const StatisticsMessage::Payload& rhs)
       activeServerTransactions = rhs.activeServerTransactions;
       pendingDnsQueries = rhs.pendingDnsQueries;
 
+      rxBatches = rhs.rxBatches;
+      rxBatchMsgs = rhs.rxBatchMsgs;
+      txBatches = rhs.txBatches;
+      txBatchMsgs = rhs.txBatchMsgs;
+      tlsHandshakes = rhs.tlsHandshakes;
+      tlsResumed = rhs.tlsResumed;
+
       requestsSent = rhs.requestsSent;
       responsesSent = rhs.responsesSent;
       requestsRetransmitted = rhs.requestsRetransmitted;
@@ -220,8 +245,20 @@ resip::operator<<(EncodeStream& strm, const StatisticsMessage::Payload& stats)
         << " CLIENTTX " << stats.activeClientTransactions
         << " SERVERTX " << stats.activeServerTransactions
         << " TIMERS " << stats.activeTimers
-        << std::endl
-        << "Transaction summary: reqi " << stats.requestsReceived
+        << std::endl;
+   if (stats.rxBatches || stats.txBatches)
+   {
+      strm << "Batch summary: rx " << stats.rxBatches << " avg " << stats.avgRxBatchSize()
+           << " tx " << stats.txBatches << " avg " << stats.avgTxBatchSize()
+           << std::endl;
+   }
+   if (stats.tlsHandshakes)
+   {
+      strm << "TLS summary: handshakes " << stats.tlsHandshakes
+           << " resumed " << stats.tlsResumed
+           << std::endl;
+   }
+   strm << "Transaction summary: reqi " << stats.requestsReceived
         << " reqo " << stats.requestsSent
         << " rspi " << stats.responsesReceived
         << " rspo " << stats.responsesSent
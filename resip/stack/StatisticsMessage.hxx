@@ -36,6 +36,18 @@ class StatisticsMessage : public ApplicationMessage
             unsigned int activeServerTransactions;
             unsigned int pendingDnsQueries; // .dlb. not implemented
 
+            // RESIP_TRANSPORT_FLAG_BATCH: system calls made and messages
+            // they carried, summed over all transports
+            UInt64 rxBatches;
+            UInt64 rxBatchMsgs;
+            UInt64 txBatches;
+            UInt64 txBatchMsgs;
+
+            // TLS and WSS transports: completed handshakes, and how many
+            // of them resumed a cached session or ticket
+            UInt64 tlsHandshakes;
+            UInt64 tlsResumed;
+
             unsigned int requestsSent; // includes retransmissions
             unsigned int responsesSent; // includes retransmissions
             unsigned int requestsRetransmitted; // counts each retransmission
@@ -60,6 +72,8 @@ class StatisticsMessage : public ApplicationMessage
             unsigned int sumErrIn(MethodTypes method) const;
             unsigned int sum2xxOut(MethodTypes method) const;
             unsigned int sumErrOut(MethodTypes method) const;
+            double avgRxBatchSize() const;
+            double avgTxBatchSize() const;
             void zeroOut();
 
             Payload& operator=(const Payload& payload);
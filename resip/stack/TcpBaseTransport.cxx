@@ -393,7 +393,7 @@ TcpBaseTransport::process()
    {
        processAllWriteRequests();
    }
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 void
@@ -412,7 +412,7 @@ TcpBaseTransport::process(FdSet& fdSet)
       processListen();
    }
 
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 void
@@ -108,6 +108,50 @@ TcpConnection::write( const char* buf, const int count )
    return bytesWritten;
 }
 
+bool
+TcpConnection::canWriteGather() const
+{
+#if defined(WIN32)
+   return false;
+#else
+   return true;
+#endif
+}
+
+int
+TcpConnection::writeGather(const GatherData::Segment* segs, int count, size_t skip)
+{
+#if defined(WIN32)
+   resip_assert(0);
+   return -1;
+#else
+   // one more than a GatherData has, for a WebSocket frame header
+   resip_assert(count > 0 && count <= (int)GatherData::MaxSegments + 1);
+
+   // the first segment may have been partly written already
+   GatherData::Segment iov[GatherData::MaxSegments + 1];
+   memcpy(iov, segs, count*sizeof(GatherData::Segment));
+   iov[0].iov_base = (char*)iov[0].iov_base + skip;
+   iov[0].iov_len -= skip;
+
+   int bytesWritten = (int)::writev(getSocket(), iov, count);
+
+   if (bytesWritten == INVALID_SOCKET)
+   {
+      int e = getErrno();
+      if (e == EAGAIN || e == EWOULDBLOCK)
+      {
+          return 0;
+      }
+      InfoLog (<< "Failed writev on " << getSocket() << " " << strerror(e));
+      Transport::error(e);
+      return -1;
+   }
+
+   return bytesWritten;
+#endif
+}
+
 bool 
 TcpConnection::hasDataToRead()
 {
@@ -46,6 +46,16 @@ TcpTransport::~TcpTransport()
 {
 }
 
+bool
+TcpTransport::supportsGather() const
+{
+#if defined(WIN32)
+   return false;
+#else
+   return true;
+#endif
+}
+
 Connection*
 TcpTransport::createConnection(const Tuple& who, Socket fd, bool server)
 {
@@ -33,22 +33,22 @@ DtlsTimerQueue::DtlsTimerQueue( Fifo<DtlsMessage>& fifo )
 
 DtlsTimerQueue::~DtlsTimerQueue()
 {
-   while(!mTimers.empty())
+   TimerVector timers;
+   removeAll(timers);
+   for(TimerVector::iterator i = timers.begin(); i != timers.end(); ++i)
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete i->getMessage();
    }
 }
 
 #endif
 
-UInt64
+TimerHandle
 TransactionTimerQueue::add(Timer::Type type, const Data& transactionId, unsigned long msOffset)
 {
    TransactionTimer t(msOffset, type, transactionId);
-   mTimers.push(t);
    DebugLog (<< "Adding timer: " << Timer::toData(type) << " tid=" << transactionId << " ms=" << msOffset);
-   return mTimers.top().getWhen();
+   return insert(t);
 }
 
 #ifdef USE_DTLS
@@ -57,18 +57,19 @@ UInt64
 DtlsTimerQueue::add( SSL *ssl, unsigned long msOffset )
 {
    TimerWithPayload t( msOffset, new DtlsMessage( ssl ) ) ;
-   mTimers.push( t ) ;
-   return mTimers.top().getWhen();
+   insert( t ) ;
+   return nextExpiry();
 }
 
 #endif
 
 BaseTimeLimitTimerQueue::~BaseTimeLimitTimerQueue()
 {
-   while(!mTimers.empty())
+   TimerVector timers;
+   removeAll(timers);
+   for(TimerVector::iterator i = timers.begin(); i != timers.end(); ++i)
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete i->getMessage();
    }
 }
 
@@ -77,8 +78,8 @@ BaseTimeLimitTimerQueue::add(unsigned int timeMs,Message* payload)
 {
    resip_assert(payload);
    DebugLog(<< "Adding application timer: " << payload->brief() << " ms=" << timeMs);
-   mTimers.push(TimerWithPayload(timeMs,payload));
-   return mTimers.top().getWhen();
+   insert(TimerWithPayload(timeMs,payload));
+   return nextExpiry();
 }
 
 void
@@ -110,10 +111,11 @@ TuSelectorTimerQueue::TuSelectorTimerQueue(TuSelector& sel) : mFifoSelector(sel)
 
 TuSelectorTimerQueue::~TuSelectorTimerQueue()
 {
-   while(!mTimers.empty())
+   TimerVector timers;
+   removeAll(timers);
+   for(TimerVector::iterator i = timers.begin(); i != timers.end(); ++i)
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete i->getMessage();
    }
 }
 
@@ -122,8 +124,8 @@ TuSelectorTimerQueue::add(unsigned int timeMs,Message* payload)
 {
    resip_assert(payload);
    DebugLog(<< "Adding application timer: " << payload->brief() << " ms=" << timeMs);
-   mTimers.push(TimerWithPayload(timeMs,payload));
-   return mTimers.top().getWhen();
+   insert(TimerWithPayload(timeMs,payload));
+   return nextExpiry();
 }
 
 void
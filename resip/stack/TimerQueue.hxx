@@ -8,6 +8,10 @@
 #include <functional>
 #include <queue>
 #include <set>
+#include <vector>
+#include <new>
+#include <type_traits>
+#include <limits.h>
 #include <iosfwd>
 #include "resip/stack/TimerMessage.hxx"
 #include "resip/stack/DtlsMessage.hxx"
@@ -15,10 +19,6 @@
 #include "rutil/TimeLimitFifo.hxx"
 #include "rutil/Timer.hxx"
 
-// .dlb. 
-// to do: timer wheel for transaction-bound timers and a heap for
-// everything longer.
-
 namespace resip
 {
 
@@ -26,31 +26,82 @@ class Message;
 class TransactionMessage;
 class TuSelector;
 
+/**
+  * @internal
+  * @brief Identifies a timer queued in a TimerQueue, so that it can be
+  * cancelled. A handle stays safe to use after its timer has fired or been
+  * cancelled (it just stops referring to anything), but must not outlive the
+  * TimerQueue that issued it.
+  */
+class TimerHandle
+{
+   public:
+      TimerHandle() : mNode(0), mSerial(0) {}
+      bool isSet() const { return mNode != 0; }
+
+   private:
+      template <class T> friend class TimerQueue;
+      TimerHandle(void* node, UInt32 serial) : mNode(node), mSerial(serial) {}
+
+      void* mNode;
+      UInt32 mSerial;
+};
+
 /**
   * @internal
   * @brief This class takes a fifo as a place to where you can write your stuff.
   * When using this in the main loop, call process() on this.
   * During Transaction processing, TimerMessages and SIP messages are generated.
-  * 
-    @todo .dlb. timer wheel for transaction-bound timers and a heap for 
-      everything longer.
+  *
+  * Timers are kept in a hierarchical timing wheel: Levels wheels of
+  * SlotsPerLevel slots each, with 1 ms slots on the first wheel and each
+  * further wheel's slots spanning a whole turn of the wheel below it (about
+  * 49 days in total; anything further out sits on an overflow list). A timer
+  * goes on the lowest wheel whose current turn contains its expiry, and
+  * trickles down a wheel every time the wheel above ticks into its slot.
+  * Adding and cancelling are O(1); process() only visits occupied slots.
   */
 template <class T>
 class TimerQueue
 {
    public:
+      TimerQueue()
+         : mNow(Timer::getTimeMs()),
+           mSize(0),
+           mFreeNodes(0),
+           mEarliest(0),
+           mEarliestValid(true)
+      {
+         for(int level = 0; level < Levels; ++level)
+         {
+            for(int index = 0; index < SlotsPerLevel; ++index)
+            {
+               mSlots[level][index].mHead = 0;
+               mSlots[level][index].mTail = 0;
+            }
+            for(int word = 0; word < OccupiedWords; ++word)
+            {
+               mOccupied[level][word] = 0;
+            }
+         }
+         mOverflow.mHead = 0;
+         mOverflow.mTail = 0;
+         mDue.mHead = 0;
+         mDue.mTail = 0;
+      }
+
       // This is the logic that runs when a timer goes off. This is the only
       // thing subclasses must implement.
       virtual void processTimer(const T& timer)=0;
 
-      /// @brief deletes the message associated with the timer as well.
+      /// @brief subclasses that own a payload must removeAll() and free it
       virtual ~TimerQueue()
       {
-         //xkd-2004-11-4
-         // delete the message associated with the timer
-         while (!mTimers.empty())
+         TimerVector discarded;
+         removeAll(discarded);
+         for(typename std::vector<Node*>::iterator i = mChunks.begin(); i != mChunks.end(); ++i)
          {
-            mTimers.pop();
+            delete [] *i;
          }
       }
 
@@ -61,9 +112,9 @@ class TimerQueue
       ///
       unsigned int msTillNextTimer()
       {
-         if (!mTimers.empty())
+         if (mSize)
          {
-            UInt64 next = mTimers.top().getWhen();
+            UInt64 next = earliest()->mWhen;
             UInt64 now = Timer::getTimeMs();
             if (now > next) 
             {
@@ -91,41 +142,78 @@ class TimerQueue
 
       /// @brief gets the set of timers that have fired, and inserts TimerMsg into the state
       /// machine fifo and application messages into the TU fifo
+      /// @return when the next timer fires, or 0 if there are none left
       virtual UInt64 process()
       {
-         if (!mTimers.empty())
+         UInt64 now=Timer::getTimeMs();
+         fire(mDue);
+         while (mSize && mNow <= now)
          {
-            UInt64 now=Timer::getTimeMs();
-            while (!mTimers.empty() && !(mTimers.top().getWhen() > now))
-            {
-               processTimer(mTimers.top());
-               mTimers.pop();
-            }
+            fire(mSlots[0][mNow & SlotMask]);
+            // anything processTimer() added that was already due
+            fire(mDue);
+            advance(now);
+         }
+
+         if (mNow <= now)
+         {
+            // nothing queued, so nothing to cascade on the way
+            mNow = now + 1;
+         }
+         return mSize ? earliest()->mWhen : 0;
+      }
 
-            if(!mTimers.empty())
+      /**
+         Removes a timer before it fires. The timer (and any payload it
+         carries) is discarded without processTimer() being called; the
+         handle is reset.
+         @return false if the timer had already fired or been cancelled
+      */
+      bool cancel(TimerHandle& handle)
+      {
+         bool pending = isPending(handle);
+         if (pending)
+         {
+            Node* node = static_cast<Node*>(handle.mNode);
+            unlink(node);
+            if (node == mEarliest)
             {
-               return mTimers.top().getWhen();
+               mEarliestValid = false;
             }
+            release(node);
          }
-         return 0;
+         handle = TimerHandle();
+         return pending;
+      }
+
+      bool isPending(const TimerHandle& handle) const
+      {
+         const Node* node = static_cast<const Node*>(handle.mNode);
+         return node && node->mSerial == handle.mSerial && node->mSlot;
+      }
+
+      /// @return when the next timer fires, or 0 if there are none
+      UInt64 nextExpiry() const
+      {
+         return mSize ? earliest()->mWhen : 0;
       }
 
       int size() const
       {
-         return (int)mTimers.size();
+         return (int)mSize;
       }
 
       bool empty() const
       {
-         return mTimers.empty();
+         return mSize == 0;
       }
 
       std::ostream& encode(std::ostream& str) const
       {
-         if(mTimers.size() > 0)
+         if(mSize > 0)
          {
-            return str << "TimerQueue[ size =" << mTimers.size() 
-                       << " top=" << mTimers.top() << "]" ;
+            return str << "TimerQueue[ size =" << mSize 
+                       << " top=" << earliest()->timer() << "]" ;
          }
          else
          {
@@ -136,10 +224,10 @@ class TimerQueue
 #ifndef RESIP_USE_STL_STREAMS
       EncodeStream& encode(EncodeStream& str) const
       {
-         if(mTimers.size() > 0)
+         if(mSize > 0)
          {
-            return str << "TimerQueue[ size =" << mTimers.size() 
-                       << " top=" << mTimers.top() << "]" ;
+            return str << "TimerQueue[ size =" << mSize 
+                       << " top=" << earliest()->timer() << "]" ;
          }
          else
          {
@@ -150,7 +238,358 @@ class TimerQueue
 
    protected:
       typedef std::vector<T, std::allocator<T> > TimerVector;
-      std::priority_queue<T, TimerVector, std::greater<T> > mTimers;
+
+      TimerHandle insert(const T& timer)
+      {
+         Node* node = allocate();
+         new (&node->mStorage) T(timer);
+         node->mWhen = timer.getWhen();
+         link(node);
+         ++mSize;
+         if (mEarliestValid && (!mEarliest || node->mWhen < mEarliest->mWhen))
+         {
+            mEarliest = node;
+         }
+         return TimerHandle(node, node->mSerial);
+      }
+
+      /// @brief empties the queue, handing back every timer that was in it
+      void removeAll(TimerVector& removed)
+      {
+         for(int level = 0; level < Levels; ++level)
+         {
+            for(int index = 0; index < SlotsPerLevel; ++index)
+            {
+               removeAll(mSlots[level][index], removed);
+            }
+         }
+         removeAll(mOverflow, removed);
+         removeAll(mDue, removed);
+      }
+
+   private:
+      enum
+      {
+         LevelBits = 8,
+         SlotsPerLevel = 1 << LevelBits,
+         SlotMask = SlotsPerLevel - 1,
+         Levels = 4,
+         OccupiedWords = SlotsPerLevel / 64,
+         NodesPerChunk = 256
+      };
+
+      struct Slot;
+
+      struct Node
+      {
+         Node* mNext;
+         Node* mPrev;
+         // 0 unless queued
+         Slot* mSlot;
+         UInt64 mWhen;
+         // bumped whenever the node is recycled, so stale handles can tell
+         UInt32 mSerial;
+         typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type mStorage;
+
+         T& timer() { return *reinterpret_cast<T*>(&mStorage); }
+         const T& timer() const { return *reinterpret_cast<const T*>(&mStorage); }
+      };
+
+      struct Slot
+      {
+         Node* mHead;
+         Node* mTail;
+      };
+
+      // Every wheel timer before mNow has fired; the first wheel's slot for
+      // mNow has not been processed yet.
+      UInt64 mNow;
+      size_t mSize;
+      Slot mSlots[Levels][SlotsPerLevel];
+      UInt64 mOccupied[Levels][OccupiedWords];
+      Slot mOverflow;
+      // timers added with an expiry before mNow; the next process() fires
+      // them rather than the wheel slot for mNow, which may be a tick away
+      Slot mDue;
+
+      // Nodes are never freed before the queue is, so that stale handles
+      // can always be checked against them.
+      std::vector<Node*> mChunks;
+      Node* mFreeNodes;
+
+      // cached result of earliest(); recomputed lazily once the earliest
+      // timer fires or is cancelled
+      mutable const Node* mEarliest;
+      mutable bool mEarliestValid;
+
+      Node* allocate()
+      {
+         if (!mFreeNodes)
+         {
+            Node* chunk = new Node[NodesPerChunk];
+            mChunks.push_back(chunk);
+            for(int i = 0; i < NodesPerChunk; ++i)
+            {
+               chunk[i].mSlot = 0;
+               chunk[i].mSerial = 1;
+               chunk[i].mNext = mFreeNodes;
+               mFreeNodes = &chunk[i];
+            }
+         }
+         Node* node = mFreeNodes;
+         mFreeNodes = node->mNext;
+         return node;
+      }
+
+      void release(Node* node)
+      {
+         node->timer().~T();
+         node->mSlot = 0;
+         if (++node->mSerial == 0)
+         {
+            node->mSerial = 1;
+         }
+         node->mNext = mFreeNodes;
+         mFreeNodes = node;
+      }
+
+      void link(Node* node)
+      {
+         const UInt64 when = node->mWhen;
+         Slot* slot = when < mNow ? &mDue : &mOverflow;
+         for(int level = 0; slot != &mDue && level < Levels; ++level)
+         {
+            const unsigned int shift = LevelBits*(level+1);
+            if ((when >> shift) == (mNow >> shift))
+            {
+               const unsigned int index = (unsigned int)(when >> (LevelBits*level)) & SlotMask;
+               slot = &mSlots[level][index];
+               mOccupied[level][index/64] |= (UInt64(1) << (index%64));
+               break;
+            }
+         }
+
+         node->mSlot = slot;
+         node->mNext = 0;
+         node->mPrev = slot->mTail;
+         if (slot->mTail)
+         {
+            slot->mTail->mNext = node;
+         }
+         else
+         {
+            slot->mHead = node;
+         }
+         slot->mTail = node;
+      }
+
+      void unlink(Node* node)
+      {
+         Slot* slot = node->mSlot;
+         if (node->mPrev)
+         {
+            node->mPrev->mNext = node->mNext;
+         }
+         else
+         {
+            slot->mHead = node->mNext;
+         }
+         if (node->mNext)
+         {
+            node->mNext->mPrev = node->mPrev;
+         }
+         else
+         {
+            slot->mTail = node->mPrev;
+         }
+         node->mSlot = 0;
+         --mSize;
+
+         if (!slot->mHead && slot != &mOverflow && slot != &mDue)
+         {
+            const size_t pos = slot - &mSlots[0][0];
+            const size_t index = pos % SlotsPerLevel;
+            mOccupied[pos / SlotsPerLevel][index/64] &= ~(UInt64(1) << (index%64));
+         }
+      }
+
+      void fire(Slot& slot)
+      {
+         while (slot.mHead)
+         {
+            Node* node = slot.mHead;
+            unlink(node);
+            if (node == mEarliest)
+            {
+               mEarliestValid = false;
+            }
+            processTimer(node->timer());
+            release(node);
+         }
+      }
+
+      void removeAll(Slot& slot, TimerVector& removed)
+      {
+         while (slot.mHead)
+         {
+            Node* node = slot.mHead;
+            unlink(node);
+            removed.push_back(node->timer());
+            release(node);
+         }
+         mEarliest = 0;
+         mEarliestValid = true;
+      }
+
+      // re-files every timer in slot relative to the current mNow
+      void relink(Slot& slot)
+      {
+         Node* node = slot.mHead;
+         slot.mHead = 0;
+         slot.mTail = 0;
+         if (&slot != &mOverflow)
+         {
+            const size_t pos = &slot - &mSlots[0][0];
+            const size_t index = pos % SlotsPerLevel;
+            mOccupied[pos / SlotsPerLevel][index/64] &= ~(UInt64(1) << (index%64));
+         }
+         while (node)
+         {
+            Node* next = node->mNext;
+            link(node);
+            node = next;
+         }
+      }
+
+      static int lowestBit(UInt64 word)
+      {
+#if defined(__GNUC__)
+         return __builtin_ctzll(word);
+#else
+         int bit = 0;
+         while (!(word & 1))
+         {
+            word >>= 1;
+            ++bit;
+         }
+         return bit;
+#endif
+      }
+
+      /// @return the first occupied slot on level at or after from, or -1
+      int findOccupied(int level, unsigned int from) const
+      {
+         for(unsigned int word = from/64; word < (unsigned int)OccupiedWords; ++word)
+         {
+            UInt64 bits = mOccupied[level][word];
+            if (word == from/64)
+            {
+               bits &= ~UInt64(0) << (from%64);
+            }
+            if (bits)
+            {
+               return (int)(word*64 + lowestBit(bits));
+            }
+         }
+         return -1;
+      }
+
+      /// @return the start of the first occupied slot after mNow on level
+      UInt64 slotTime(int level, int index) const
+      {
+         const unsigned int shift = LevelBits*(level+1);
+         return ((mNow >> shift) << shift) | (UInt64(index) << (LevelBits*level));
+      }
+
+      /// @return the next time after mNow something has to fire or cascade
+      UInt64 nextEvent() const
+      {
+         for(int level = 0; level < Levels; ++level)
+         {
+            const unsigned int index = (unsigned int)(mNow >> (LevelBits*level)) & SlotMask;
+            int found = findOccupied(level, index + 1);
+            if (found >= 0)
+            {
+               return slotTime(level, found);
+            }
+         }
+         if (mOverflow.mHead)
+         {
+            const unsigned int shift = LevelBits*Levels;
+            return ((mNow >> shift) + 1) << shift;
+         }
+         return UInt64(-1);
+      }
+
+      // Moves mNow on to the next event, but no further than now + 1,
+      // cascading whatever wheels that ticks over.
+      void advance(UInt64 now)
+      {
+         UInt64 next = nextEvent();
+         mNow = next <= now ? next : now + 1;
+         if (mNow & SlotMask)
+         {
+            return;
+         }
+
+         int top = 1;
+         while (top < Levels && ((mNow >> (LevelBits*top)) & SlotMask) == 0)
+         {
+            ++top;
+         }
+         if (top == Levels)
+         {
+            relink(mOverflow);
+            top = Levels - 1;
+         }
+         for(int level = top; level > 0; --level)
+         {
+            relink(mSlots[level][(mNow >> (LevelBits*level)) & SlotMask]);
+         }
+      }
+
+      static const Node* earliestIn(const Slot& slot)
+      {
+         const Node* best = slot.mHead;
+         for(const Node* node = slot.mHead; node; node = node->mNext)
+         {
+            if (node->mWhen < best->mWhen)
+            {
+               best = node;
+            }
+         }
+         return best;
+      }
+
+      // Only the lowest occupied slot (in expiry order) has to be searched;
+      // everything in later slots expires after it.
+      const Node* earliest() const
+      {
+         if (!mEarliestValid)
+         {
+            mEarliest = earliestIn(mDue);
+            int found = findOccupied(0, (unsigned int)(mNow & SlotMask));
+            if (!mEarliest && found >= 0)
+            {
+               mEarliest = earliestIn(mSlots[0][found]);
+            }
+            for(int level = 1; !mEarliest && level < Levels; ++level)
+            {
+               const unsigned int index = (unsigned int)(mNow >> (LevelBits*level)) & SlotMask;
+               found = findOccupied(level, index + 1);
+               if (found >= 0)
+               {
+                  mEarliest = earliestIn(mSlots[level][found]);
+               }
+            }
+            if (!mEarliest)
+            {
+               mEarliest = earliestIn(mOverflow);
+            }
+            mEarliestValid = true;
+         }
+         return mEarliest;
+      }
 };
 
 /**
@@ -203,7 +642,8 @@ class TransactionTimerQueue : public TimerQueue<TransactionTimer>
 {
    public:
       TransactionTimerQueue(Fifo<TimerMessage>& fifo);
-      UInt64 add(Timer::Type type, const Data& transactionId, unsigned long msOffset);
+      /// @return a handle the TransactionState can cancel the timer with
+      TimerHandle add(Timer::Type type, const Data& transactionId, unsigned long msOffset);
       virtual void processTimer(const TransactionTimer& timer);
    private:
       Fifo<TimerMessage>& mFifo;
@@ -48,11 +48,12 @@ TransactionController::TransactionController(SipStack& stack,
    mStateMacFifoOutBuffer(mStateMacFifo),
    mCongestionManager(0),
    mTuSelector(stack.mTuSelector),
-   mTransportSelector(mStateMacFifo,
-                      stack.getSecurity(),
-                      stack.getDnsStub(),
-                      stack.getCompression(),
-                      useDnsVip),
+   mOwnedTransportSelector(new TransportSelector(mStateMacFifo,
+                                                 stack.getSecurity(),
+                                                 stack.getDnsStub(),
+                                                 stack.getCompression(),
+                                                 useDnsVip)),
+   mTransportSelector(*mOwnedTransportSelector),
    mTimers(mTimerFifo),
    mShuttingDown(false),
    mStatsManager(stack.mStatsManager),
@@ -61,6 +62,26 @@ TransactionController::TransactionController(SipStack& stack,
    mStateMacFifo.setDescription("TransactionController::mStateMacFifo");
 }
 
+TransactionController::TransactionController(SipStack& stack, 
+                                             AsyncProcessHandler* handler,
+                                             TransactionController& first) :
+   mStack(stack),
+   mDiscardStrayResponses(first.mDiscardStrayResponses),
+   mFixBadDialogIdentifiers(first.mFixBadDialogIdentifiers),
+   mFixBadCSeqNumbers(first.mFixBadCSeqNumbers),
+   mStateMacFifo(handler),
+   mStateMacFifoOutBuffer(mStateMacFifo),
+   mCongestionManager(0),
+   mTuSelector(stack.mTuSelector),
+   mTransportSelector(first.mTransportSelector),
+   mTimers(mTimerFifo),
+   mShuttingDown(false),
+   mStatsManager(stack.mStatsManager),
+   mHostname(first.mHostname)
+{
+   mStateMacFifo.setDescription("TransactionController::mStateMacFifo");
+}
+
 #if defined(WIN32) && !defined(__GNUC__)
 #pragma warning( default : 4355 )
 #endif
@@ -89,16 +110,22 @@ void
 TransactionController::shutdown()
 {
    mShuttingDown = true;
-   mTransportSelector.shutdown();
+   if(mOwnedTransportSelector.get())
+   {
+      mTransportSelector.shutdown();
+   }
 }
 
 void
 TransactionController::process(int timeout)
 {
+   // Only the first shard reports shutdown, once every shard is drained.
    if (mShuttingDown && 
+       mOwnedTransportSelector.get() &&
        //mTimers.empty() && 
        !mStateMacFifoOutBuffer.messageAvailable() && // !dcm! -- see below 
        !mStack.mTUFifo.messageAvailable() &&
+       mStack.transactionShardsIdle() &&
        mTransportSelector.isFinished())
 // !dcm! -- why would one wait for the Tu's fifo to be empty before delivering a
 // shutdown message?
@@ -118,7 +145,7 @@ TransactionController::process(int timeout)
 
       // Check if Statistics Manager needs to be polled - note:  all statistic manager polls should happen from the 
       // TransactionController thread / process loop
-      if(mStack.mStatisticsManagerEnabled)
+      if(mStack.mStatisticsManagerEnabled && mOwnedTransportSelector.get())
       {
          mStatsManager.process();
       }
@@ -204,6 +231,19 @@ TransactionController::sumTransportFifoSizes() const
    return mTransportSelector.sumTransportFifoSizes();
 }
 
+void
+TransactionController::sumTransportBatchCounts(UInt64& rxBatches, UInt64& rxMsgs,
+                                               UInt64& txBatches, UInt64& txMsgs) const
+{
+   mTransportSelector.sumTransportBatchCounts(rxBatches, rxMsgs, txBatches, txMsgs);
+}
+
+void
+TransactionController::sumTransportTlsCounts(UInt64& handshakes, UInt64& resumed) const
+{
+   mTransportSelector.sumTransportTlsCounts(handshakes, resumed);
+}
+
 unsigned int 
 TransactionController::getTransactionFifoSize() const
 {
@@ -28,6 +28,9 @@ class TransactionController
       static unsigned int MaxTUFifoTimeDepthSecs;
 
       TransactionController(SipStack& stack, AsyncProcessHandler* handler, bool useDnsVip);
+      /** Creates an additional shard that shares the TransportSelector of
+          first (see SipStack::setTransactionShards()). */
+      TransactionController(SipStack& stack, AsyncProcessHandler* handler, TransactionController& first);
       ~TransactionController();
 
       void process(int timeout=0);
@@ -45,6 +48,9 @@ class TransactionController
 
       unsigned int getTuFifoSize() const;
       unsigned int sumTransportFifoSizes() const;
+      void sumTransportBatchCounts(UInt64& rxBatches, UInt64& rxMsgs,
+                                   UInt64& txBatches, UInt64& txMsgs) const;
+      void sumTransportTlsCounts(UInt64& handshakes, UInt64& resumed) const;
       unsigned int getTransactionFifoSize() const;
       unsigned int getNumClientTransactions() const;
       unsigned int getNumServerTransactions() const;
@@ -54,7 +60,10 @@ class TransactionController
       
       void setCongestionManager( CongestionManager *manager ) 
       { 
-         mTransportSelector.setCongestionManager(manager);
+         if(mOwnedTransportSelector.get())
+         {
+            mTransportSelector.setCongestionManager(manager);
+         }
          if(mCongestionManager)
          {
             mCongestionManager->unregisterFifo(&mStateMacFifo);
@@ -105,6 +114,8 @@ class TransactionController
 
       void invokeAfterSocketCreationFunc(TransportType type);
 
+      Fifo<TransactionMessage>& stateMacFifo() { return mStateMacFifo; }
+
    private:
       TransactionController(const TransactionController& rhs);
       TransactionController& operator=(const TransactionController& rhs);
@@ -139,17 +150,21 @@ class TransactionController
       // from the sipstack (for convenience)
       TuSelector& mTuSelector;
 
-      // Used to decide which transport to send a sip message on. 
-      TransportSelector mTransportSelector;
+      // Used to decide which transport to send a sip message on. Owned by
+      // the first shard; any further shards share it.
+      std::unique_ptr<TransportSelector> mOwnedTransportSelector;
+      TransportSelector& mTransportSelector;
+
+      // timers associated with the transactions. When a timer fires, it is
+      // placed in the mStateMacFifo. Declared ahead of the transaction maps
+      // since TransactionStates still left in them cancel their timers when
+      // the maps delete them.
+      TransactionTimerQueue  mTimers;
 
       // stores all of the transactions that are currently active in this stack 
       TransactionMap mClientTransactionMap;
       TransactionMap mServerTransactionMap;
 
-      // timers associated with the transactions. When a timer fires, it is
-      // placed in the mStateMacFifo
-      TransactionTimerQueue  mTimers;
-
       bool mShuttingDown;
       
       StatisticsManager& mStatsManager;
@@ -2,6 +2,7 @@
 #define RESIP_TransactionMessage_hxx
 
 #include "rutil/ResipAssert.h"
+#include "rutil/BaseException.hxx"
 #include "resip/stack/Message.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 
@@ -19,6 +20,41 @@ class TransactionMessage : public Message
       // purpose of determining which TransactionMap to use
       virtual bool isClientTransaction() const = 0; 
 
+      // false for messages that concern a flow rather than a transaction, and
+      // for which getTransactionId() must not be called
+      virtual bool hasTransactionId() const { return true; }
+
+      // Picks which of numShards transaction controller shards handles this
+      // message (see SipStack::setTransactionShards()). All messages of one
+      // transaction hash to the same shard; anything without a usable
+      // transaction id goes to shard 0.
+      unsigned int getShardIndex(unsigned int numShards) const
+      {
+         if(numShards <= 1 || !hasTransactionId())
+         {
+            return 0;
+         }
+
+         try
+         {
+            return getShardIndex(getTransactionId(), numShards);
+         }
+         catch(BaseException&)
+         {
+            // shard 0 will drop it, just as it would unsharded
+            return 0;
+         }
+      }
+
+      static unsigned int getShardIndex(const Data& tid, unsigned int numShards)
+      {
+         if(numShards <= 1 || tid.empty())
+         {
+            return 0;
+         }
+         return (unsigned int)(tid.caseInsensitiveTokenHash() % numShards);
+      }
+
       virtual Message* clone() const {resip_assert(false); return NULL;}
 };
 
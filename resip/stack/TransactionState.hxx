@@ -6,6 +6,7 @@
 #include "rutil/dns/DnsHandler.hxx"
 #include "resip/stack/MethodTypes.hxx"
 #include "resip/stack/SipMessage.hxx"
+#include "resip/stack/TimerQueue.hxx"
 #include "resip/stack/Transport.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 
@@ -121,6 +122,9 @@ class TransactionState : public DnsHandler
       const Data& tid(SipMessage* sip) const;
 
       void startServerNonInviteTimerTrying(SipMessage& sip, const Data& tid);
+      /// queues a timer for this transaction, remembering it so it can be
+      /// cancelled when the transaction is destroyed
+      void startTimer(Timer::Type type, unsigned long ms);
 
       static TransactionState* makeCancelTransaction(TransactionState* tran, Machine machine, const Data& tid);
       static void handleInternalCancel(SipMessage* cancel,
@@ -194,6 +198,12 @@ class TransactionState : public DnsHandler
       int mFailureSubCode;
       bool mTcpConnectTimerStarted;
 
+      // Timers this transaction has queued in mController.mTimers. More than
+      // a handful are rarely outstanding at once (e.g. A, B, D, CleanUp and
+      // TcpConnect on a client INVITE); any beyond that are left to fire.
+      enum { MaxTimers = 6 };
+      TimerHandle mTimerHandles[MaxTimers];
+
       static UInt32 StatelessIdCounter;
       
       friend EncodeStream& operator<<(EncodeStream& strm, const TransactionState& state);
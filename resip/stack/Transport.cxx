@@ -44,7 +44,8 @@ Transport::Transport(Fifo<TransactionMessage>& rxFifo,
    mTlsDomain(tlsDomain),
    mSocketFunc(socketFunc),
    mCompression(compression),
-   mTransportFlags(0)
+   mTransportFlags(0),
+   mShardOf(0)
 {
 #ifdef USE_NETNS
    // Needs to be implemented for NETNS
@@ -70,12 +71,40 @@ Transport::Transport(Fifo<TransactionMessage>& rxFifo,
    mTlsDomain(tlsDomain),
    mSocketFunc(socketFunc),
    mCompression(compression),
-   mTransportFlags(transportFlags)
+   mTransportFlags(transportFlags),
+   mShardOf(0)
 {
 }
 
 Transport::~Transport()
 {
+   for(std::vector<ProducerFifoBuffer<TransactionMessage>*>::iterator it = mShardFifos.begin();
+       it != mShardFifos.end(); ++it)
+   {
+      delete *it;
+   }
+}
+
+void
+Transport::setTransactionShards(const std::vector<Fifo<TransactionMessage>*>& fifos)
+{
+   resip_assert(mShardFifos.empty());
+   resip_assert(!fifos.empty() && fifos[0] == &mStateMachineFifo.getFifo());
+   for(size_t i = 1; i < fifos.size(); ++i)
+   {
+      mShardFifos.push_back(new ProducerFifoBuffer<TransactionMessage>(*fifos[i], mStateMachineFifo.getBufferSize()));
+   }
+}
+
+ProducerFifoBuffer<TransactionMessage>&
+Transport::stateMacFifoFor(const TransactionMessage& msg)
+{
+   if(mShardFifos.empty())
+   {
+      return mStateMachineFifo;
+   }
+   unsigned int shard = msg.getShardIndex((unsigned int)mShardFifos.size() + 1);
+   return shard == 0 ? mStateMachineFifo : *mShardFifos[shard - 1];
 }
 
 void
@@ -224,7 +253,8 @@ Transport::fail(const Data& tid, TransportFailure::FailureReason reason, int sub
 {
    if (!tid.empty())
    {
-      mStateMachineFifo.add(new TransportFailure(tid, reason, subCode));
+      TransportFailure* failure = new TransportFailure(tid, reason, subCode);
+      stateMacFifoFor(*failure).add(failure);
    }
 }
 
@@ -233,7 +263,8 @@ Transport::setTcpConnectState(const Data& tid, TcpConnectState::State state)
 {
     if (!tid.empty())
     {
-        mStateMachineFifo.add(new TcpConnectState(tid, state));
+        TcpConnectState* connectState = new TcpConnectState(tid, state);
+        stateMacFifoFor(*connectState).add(connectState);
     }
 }
 
@@ -453,7 +484,7 @@ Transport::pushRxMsgUp(SipMessage* message)
        handler->inboundMessage(message->getSource(), message->getReceivedTransportTuple(), *message);
    }
 
-   mStateMachineFifo.add(message);
+   stateMacFifoFor(*message).add(message);
 }
 
 bool
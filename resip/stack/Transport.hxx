@@ -14,6 +14,7 @@
 
 #include <memory>
 #include <utility>
+#include <vector>
 
 namespace resip
 {
@@ -55,6 +56,18 @@ class FdPollGrp;
  *    Specifies whether this Transport object has its own thread (ie; if
  *    set, the TransportSelector should not run the select/poll loop for
  *    this transport, since that is another thread's job)
+ * BATCH:
+ *    On datagram transports that support it (UDP, where the platform
+ *    provides recvmmsg()/sendmmsg()), receive and transmit up to
+ *    UdpTransport::MaxBatchSize datagrams per system call, using a ring
+ *    of pre-allocated receive buffers. Combine with RXALL/TXALL to keep
+ *    issuing batches until the socket (or transmit fifo) is drained.
+ *    Ignored, with a warning, where unsupported.
+ * REUSEPORT:
+ *    Set SO_REUSEPORT on the socket before binding, so that several
+ *    transports can listen on the same ip:port and the kernel spreads
+ *    inbound datagrams/connections across them. Normally set by
+ *    SipStack::addTransport() when numShards > 1, rather than directly.
  */
 #define RESIP_TRANSPORT_FLAG_NOBIND      (1<<0)
 #define RESIP_TRANSPORT_FLAG_RXALL       (1<<1)
@@ -62,6 +75,8 @@ class FdPollGrp;
 #define RESIP_TRANSPORT_FLAG_KEEP_BUFFER (1<<3)
 #define RESIP_TRANSPORT_FLAG_TXNOW       (1<<4)
 #define RESIP_TRANSPORT_FLAG_OWNTHREAD   (1<<5)
+#define RESIP_TRANSPORT_FLAG_BATCH       (1<<6)
+#define RESIP_TRANSPORT_FLAG_REUSEPORT   (1<<7)
 
 /**
    @brief The base class for Transport classes.
@@ -285,6 +300,13 @@ class Transport : public FdSetIOObserver
       */
       virtual bool hasSpecificContact() const { return false; }
 
+      /**
+         @return true if send() accepts SendData that carries the message
+         in SendData::gather rather than SendData::data. The
+         TransportSelector only gather-encodes for such transports.
+      */
+      virtual bool supportsGather() const { return false; }
+
       /**
          Perform basic sanity checks on message. Return false
          if there is a problem eg) no Vias.
@@ -356,6 +378,21 @@ class Transport : public FdSetIOObserver
       //# queued messages on this transport
       virtual unsigned int getFifoSize() const=0;
 
+      /** Adds this transport's batched socket I/O counters (number of
+          batch system calls, and number of messages they carried) to the
+          values passed in. Transports that do not batch add nothing.
+          May be called from a thread other than the transport's own.
+      */
+      virtual void addBatchCounts(UInt64& rxBatches, UInt64& rxMsgs,
+                                  UInt64& txBatches, UInt64& txMsgs) const {}
+
+      /** Adds this transport's TLS handshake counters (completed
+          handshakes, and how many of those resumed an earlier session) to
+          the values passed in. Non-TLS transports add nothing.
+          May be called from a thread other than the transport's own.
+      */
+      virtual void addTlsCounts(UInt64& handshakes, UInt64& resumed) const {}
+
       void callSocketFunc(Socket sock);
       virtual void invokeAfterSocketCreationFunc() const = 0;  //used to invoke the after socket creation func immeidately for all existing sockets - can be used to modify QOS settings at runtime
 
@@ -376,6 +413,11 @@ class Transport : public FdSetIOObserver
       void flushStateMacFifo()
       {
           mStateMachineFifo.flush();
+          for(std::vector<ProducerFifoBuffer<TransactionMessage>*>::iterator it = mShardFifos.begin();
+              it != mShardFifos.end(); ++it)
+          {
+             (*it)->flush();
+          }
       }
 
       UInt32 getExpectedWaitForIncoming() const
@@ -392,6 +434,24 @@ class Transport : public FdSetIOObserver
       inline unsigned int getKey() const {return mTuple.mTransportKey;} 
       inline void setKey(unsigned int pKey) { mTuple.mTransportKey = pKey;} // should only be called once after creation
 
+      /** Non-zero if this transport is an additional SO_REUSEPORT shard of
+          the transport with the returned key. Shards have their own key, so
+          that replies leave from the socket (or connection) a request came
+          in on, but are never chosen for new outbound traffic; that always
+          goes through the primary.
+          @see SipStack::addTransport
+      */
+      inline unsigned int getShardOf() const { return mShardOf; }
+      inline void setShardOf(unsigned int primaryKey) { mShardOf = primaryKey; } // should only be called once after creation
+
+      /** Spreads the TransactionMessages this transport produces over the
+          stack's transaction controller shards, by transaction id.
+          fifos[0] must be the rxFifo this transport was constructed with.
+          Must be called before the transport starts processing.
+          @see SipStack::setTransactionShards
+      */
+      void setTransactionShards(const std::vector<Fifo<TransactionMessage>*>& fifos);
+
    protected:
 
       Data mInterface;
@@ -399,8 +459,13 @@ class Transport : public FdSetIOObserver
 
       CongestionManager* mCongestionManager;
       ProducerFifoBuffer<TransactionMessage> mStateMachineFifo; // passed in
+      // one per transaction shard after the first (which is mStateMachineFifo);
+      // empty unless the stack runs more than one shard
+      std::vector<ProducerFifoBuffer<TransactionMessage>*> mShardFifos;
       bool mShuttingDown;
 
+      ProducerFifoBuffer<TransactionMessage>& stateMacFifoFor(const TransactionMessage& msg);
+
       void setTlsDomain(const Data& domain) { mTlsDomain = domain; }
    private:
       static const Data transportNames[MAX_TRANSPORT];
@@ -413,6 +478,7 @@ class Transport : public FdSetIOObserver
       AfterSocketCreationFuncPtr mSocketFunc;
       Compression &mCompression;
       unsigned mTransportFlags;
+      unsigned int mShardOf;
 };
 
 EncodeStream& operator<<(EncodeStream& strm, const Transport& rhs);
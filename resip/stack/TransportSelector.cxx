@@ -18,6 +18,7 @@
 
 #include "resip/stack/ExtensionParameter.hxx"
 #include "resip/stack/Compression.hxx"
+#include "resip/stack/GatherData.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/TransactionState.hxx"
 #include "resip/stack/TransportFailure.hxx"
@@ -32,6 +33,7 @@
 #include "rutil/DataStream.hxx"
 #include "rutil/DnsUtil.hxx"
 #include "rutil/Inserter.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/Socket.hxx"
 #include "rutil/FdPoll.hxx"
@@ -145,6 +147,7 @@ TransportSelector::~TransportSelector()
 void
 TransportSelector::shutdown()
 {
+   PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
    for(TransportKeyMap::iterator it = mTransports.begin(); it != mTransports.end(); it++)
    {
        it->second->shutdown();
@@ -154,6 +157,7 @@ TransportSelector::shutdown()
 bool
 TransportSelector::isFinished() const
 {
+   PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
    for(TransportKeyMap::const_iterator it = mTransports.begin(); it != mTransports.end(); it++)
    {
       if (!it->second->isFinished())
@@ -164,9 +168,36 @@ TransportSelector::isFinished() const
    return true;
 }
 
+void
+TransportSelector::setTransactionShards(const std::vector<Fifo<TransactionMessage>*>& fifos)
+{
+   resip_assert(mTransports.empty());
+   resip_assert(!fifos.empty() && fifos[0] == &mStateMacFifo);
+   mShardFifos = fifos;
+   if(mShardFifos.size() > 1)
+   {
+      mShardMutex.reset(new RWMutex);
+      mSourceInterfaceMutex.reset(new Mutex);
+   }
+}
+
+void
+TransportSelector::postToTransactionShard(TransactionMessage* msg)
+{
+   if(mShardFifos.size() > 1)
+   {
+      mShardFifos[msg->getShardIndex((unsigned int)mShardFifos.size())]->add(msg);
+   }
+   else
+   {
+      mStateMacFifo.add(msg);
+   }
+}
+
 void
 TransportSelector::addTransport(std::unique_ptr<Transport> autoTransport, bool isStackRunning)
 {
+   PtrLock lock(mShardMutex.get(), VOCAL_WRITELOCK);
    Transport* transport = autoTransport.release();
 
    // !bwc! This is a multimap from TransportType/IpVersion to Transport*.
@@ -208,6 +239,20 @@ TransportSelector::addTransport(std::unique_ptr<Transport> autoTransport, bool i
       resip_assert(0);
    }
 
+   if(transport->getShardOf())
+   {
+      // SO_REUSEPORT shards share their primary's tuple, so they stay out of
+      // the tuple maps (and DNS transport counts) and are only ever found by
+      // key, ie: when replying to something they received.
+      resip_assert(!transport->shareStackProcessAndSelect());
+      mHasOwnProcessTransports.push_back(transport);
+      mHasOwnProcessTransports.back()->startOwnProcessing();
+      mTransports[transport->getKey()] = transport;
+      InfoLog(<< "TransportSelector::addTransport:  added shard of key=" << transport->getShardOf() 
+              << " for tuple=" << transport->getTuple() << ", key=" << transport->getKey());
+      return;
+   }
+
    Tuple tuple(transport->interfaceName(), transport->port(),
                transport->ipVersion(), transport->transport(),
                Data::Empty, // Domain
@@ -297,6 +342,7 @@ TransportSelector::addTransport(std::unique_ptr<Transport> autoTransport, bool i
 void
 TransportSelector::removeTransport(unsigned int transportKey)
 {
+   PtrLock lock(mShardMutex.get(), VOCAL_WRITELOCK);
    Transport* transportToRemove = 0;
 
    // Find transport in global map and remove it
@@ -315,38 +361,42 @@ TransportSelector::removeTransport(unsigned int transportKey)
       // notify transport to shutdown
       transportToRemove->shutdown();
 
-      if(!isSecure(transportToRemove->transport()))
+      // Shards were never added to the tuple maps, see addTransport
+      if(!transportToRemove->getShardOf())
       {
-         // Ensure transport is removed from all containers
-         mExactTransports.erase(transportToRemove->getTuple());
-         mAnyInterfaceTransports.erase(transportToRemove->getTuple());
+         if(!isSecure(transportToRemove->transport()))
+         {
+            // Ensure transport is removed from all containers
+            mExactTransports.erase(transportToRemove->getTuple());
+            mAnyInterfaceTransports.erase(transportToRemove->getTuple());
 
-         // In the AnyPort maps 2 transports can end up overwriting each other in these maps - then when we remove one, there may be none left - even though we should have an
-         // entry.  The rebuilt method will dig through all transports again and rebuild these maps.
-         rebuildAnyPortTransportMaps();
-      }
-      else
-      {
-         Tuple tlsRemoveTuple = transportToRemove->getTuple();
-         tlsRemoveTuple.setTargetDomain(transportToRemove->tlsDomain());
-         TlsTransportKey tlsKey(tlsRemoveTuple);
-         mTlsTransports.erase(tlsKey);
-      }
+            // In the AnyPort maps 2 transports can end up overwriting each other in these maps - then when we remove one, there may be none left - even though we should have an
+            // entry.  The rebuilt method will dig through all transports again and rebuild these maps.
+            rebuildAnyPortTransportMaps();
+         }
+         else
+         {
+            Tuple tlsRemoveTuple = transportToRemove->getTuple();
+            tlsRemoveTuple.setTargetDomain(transportToRemove->tlsDomain());
+            TlsTransportKey tlsKey(tlsRemoveTuple);
+            mTlsTransports.erase(tlsKey);
+         }
 
-      // mTypeToTransportMap is a multimap - make sure to delete only this instance by looking up transportKey, instead of using 
-      // mTypeToTransportMap.erase(transportToRemove->getTuple()); which might end up deleting more than 1 transport
-      for (TypeToTransportMap::iterator itTypeToTransport = mTypeToTransportMap.begin(); itTypeToTransport != mTypeToTransportMap.end(); itTypeToTransport++)
-      {
-          if (itTypeToTransport->second->getKey() == transportKey)
-          {
-              mTypeToTransportMap.erase(itTypeToTransport);
-              break;
-          }
-      }
+         // mTypeToTransportMap is a multimap - make sure to delete only this instance by looking up transportKey, instead of using 
+         // mTypeToTransportMap.erase(transportToRemove->getTuple()); which might end up deleting more than 1 transport
+         for (TypeToTransportMap::iterator itTypeToTransport = mTypeToTransportMap.begin(); itTypeToTransport != mTypeToTransportMap.end(); itTypeToTransport++)
+         {
+             if (itTypeToTransport->second->getKey() == transportKey)
+             {
+                 mTypeToTransportMap.erase(itTypeToTransport);
+                 break;
+             }
+         }
 
-      // Remove transport types from Dns list of supported protocols
-      // Note:  DNS tracks use counts so that we will only remove this transport type if this is the last of the type to be removed
-      mDns.removeTransportType(transportToRemove->transport(), transportToRemove->ipVersion());
+         // Remove transport types from Dns list of supported protocols
+         // Note:  DNS tracks use counts so that we will only remove this transport type if this is the last of the type to be removed
+         mDns.removeTransportType(transportToRemove->transport(), transportToRemove->ipVersion());
+      }
 
       if (transportToRemove->shareStackProcessAndSelect())
       {
@@ -386,7 +436,7 @@ TransportSelector::rebuildAnyPortTransportMaps()
 
     for (TransportKeyMap::iterator it = mTransports.begin(); it != mTransports.end(); it++)
     {
-        if (!isSecure(it->second->transport()))
+        if (!isSecure(it->second->transport()) && !it->second->getShardOf())
         {
             // Store the transport in the ANY interface maps if the tuple specifies ANY
             // interface. Store the transport in the specific interface maps if the tuple
@@ -533,6 +583,7 @@ TransportSelector::checkTransportAddRemoveQueue()
 void 
 TransportSelector::poke()
 {
+   PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
    for(TransportList::iterator it = mHasOwnProcessTransports.begin(); it != mHasOwnProcessTransports.end(); it++)
    {
       try
@@ -578,6 +629,8 @@ void
 TransportSelector::dnsResolve(DnsResult* result,
                               SipMessage* msg)
 {
+   PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
+
    // Picking the target destination:
    //   - for request, use forced target if set
    //     otherwise use loose routing behaviour (route or, if none, request-uri)
@@ -758,6 +811,7 @@ TransportSelector::findTransportByVia(SipMessage* msg, const Tuple& target, Tupl
 Tuple
 TransportSelector::determineSourceInterface(SipMessage* msg, const Tuple& target) const
 {
+   PtrLock lock(mSourceInterfaceMutex.get());
    resip_assert(msg->exists(h_Vias));
    resip_assert(!msg->header(h_Vias).empty());
    const Via& via = msg->header(h_Vias).front();
@@ -928,6 +982,7 @@ TransportSelector::TransmitState
 TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
 {
    resip_assert(msg);
+   PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
 
    if(msg->mIsDecorated)
    {
@@ -1317,22 +1372,48 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
                                                    msg->getTransactionId(),
                                                    remoteSigcompId));
 
-         send->data.reserve(mAvgBufferSize + mAvgBufferSize/4);
+         int avgBufferSize = mAvgBufferSize.load(std::memory_order_relaxed);
+         size_t encodedSize;
+
+         if (msg->getReceiveBuffers() &&
+             remoteSigcompId.empty() &&
+             transport->supportsGather())
+         {
+            // A message that came off the wire (ie: one we are forwarding);
+            // whatever is still as received gets sent straight out of the
+            // receive buffers instead of being copied.
+            std::shared_ptr<GatherData> gather =
+               std::make_shared<GatherData>(msg->getReceiveBuffers(),
+                                            avgBufferSize + avgBufferSize/4);
+            {
+               oGatherStream str(*gather);
+               msg->encode(str);
+            }
+            encodedSize = gather->size();
+            send->gather = gather;
+         }
+         else
+         {
+            send->data.reserve(avgBufferSize + avgBufferSize/4);
 
-         DataStream str(send->data);
-         msg->encode(str);
-         str.flush();
+            DataStream str(send->data);
+            msg->encode(str);
+            str.flush();
+            encodedSize = send->data.size();
+         }
 
          // !bwc! Moving average of message size. (Used to intelligently
          // predict how much space to reserve in the buffer, to minimize
          // dynamic resizing.)
-         mAvgBufferSize = (255*mAvgBufferSize + send->data.size()+128)/256;
+         mAvgBufferSize.store((int)((255*avgBufferSize + encodedSize+128)/256),
+                              std::memory_order_relaxed);
 
-         resip_assert(!send->data.empty());
+         resip_assert(!send->empty());
          DebugLog (<< "Transmitting to " << target
                    << " tlsDomain=" << msg->getTlsDomain()
                    << " via " << source
-                   << std::endl << std::endl << send->data.escaped()
+                   << std::endl << std::endl
+                   << (send->gather ? send->gather->flatten() : send->data).escaped()
                    << "sigcomp id=" << remoteSigcompId);
 
          if(sendData)
@@ -1346,14 +1427,14 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
       else
       {
          InfoLog (<< "tid=" << msg->getTransactionId() << " failed to find a transport to " << target);
-         mStateMacFifo.add(new TransportFailure(msg->getTransactionId(), transportFailureReason));
+         postToTransactionShard(new TransportFailure(msg->getTransactionId(), transportFailureReason));
          return Unsent;
       }
    }
    catch (Transport::Exception& )
    {
       InfoLog (<< "tid=" << msg->getTransactionId() << " no route to target: " << target);
-      mStateMacFifo.add(new TransportFailure(msg->getTransactionId(), TransportFailure::NoRoute));
+      postToTransactionShard(new TransportFailure(msg->getTransactionId(), TransportFailure::NoRoute));
       return Unsent;
    }
 }
@@ -1362,6 +1443,7 @@ void
 TransportSelector::retransmit(const SendData& data)
 {
    resip_assert(data.destination.mTransportKey);
+   PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
    Transport* transport = findTransportByDest(data.destination);
 
    // !jf! The previous call to transmit may have blocked or failed (It seems to
@@ -1393,7 +1475,16 @@ TransportSelector::retransmit(const SendData& data)
       Transport::SipMessageLoggingHandler* handler = transport->getSipMessageLoggingHandler();
       if(handler)
       {
-         handler->outboundRetransmit(transport->getTuple(), data.destination, data);
+         if (data.gather)
+         {
+            SendData flat(data);
+            flat.flatten();
+            handler->outboundRetransmit(transport->getTuple(), data.destination, flat);
+         }
+         else
+         {
+            handler->outboundRetransmit(transport->getTuple(), data.destination, data);
+         }
       }
        
       transport->send(std::unique_ptr<SendData>(data.clone()));
@@ -1403,6 +1494,7 @@ TransportSelector::retransmit(const SendData& data)
 void 
 TransportSelector::closeConnection(const Tuple& peer)
 {
+   PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
    Transport* t = findTransportByDest(peer);
    if(t)
    {
@@ -1426,6 +1518,25 @@ TransportSelector::sumTransportFifoSizes() const
    return sum;
 }
 
+void
+TransportSelector::sumTransportBatchCounts(UInt64& rxBatches, UInt64& rxMsgs,
+                                           UInt64& txBatches, UInt64& txMsgs) const
+{
+   for(TransportKeyMap::const_iterator it = mTransports.begin(); it != mTransports.end(); it++)
+   {
+      it->second->addBatchCounts(rxBatches, rxMsgs, txBatches, txMsgs);
+   }
+}
+
+void
+TransportSelector::sumTransportTlsCounts(UInt64& handshakes, UInt64& resumed) const
+{
+   for(TransportKeyMap::const_iterator it = mTransports.begin(); it != mTransports.end(); it++)
+   {
+      it->second->addTlsCounts(handshakes, resumed);
+   }
+}
+
 void 
 TransportSelector::terminateFlow(const resip::Tuple& flow)
 {
@@ -1435,6 +1546,7 @@ TransportSelector::terminateFlow(const resip::Tuple& flow)
 void 
 TransportSelector::enableFlowTimer(const resip::Tuple& flow)
 {
+   PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
    Transport* t = findTransportByDest(flow);
    if(t)
    {
@@ -1450,6 +1562,7 @@ TransportSelector::enableFlowTimer(const resip::Tuple& flow)
 void 
 TransportSelector::invokeAfterSocketCreationFunc(TransportType type)
 {
+    PtrLock lock(mShardMutex.get(), VOCAL_READLOCK);
     for (TransportKeyMap::iterator it = mTransports.begin(); it != mTransports.end(); it++)
     {
         if (type == UNKNOWN_TRANSPORT || type == it->second->transport())
@@ -5,12 +5,15 @@
 #include <sys/select.h>
 #endif
 
+#include <atomic>
 #include <map>
 #include <vector>
 #include <list>
 
 #include "rutil/Data.hxx"
 #include "rutil/Fifo.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/RWMutex.hxx"
 #include "rutil/GenericIPAddress.hxx"
 #include "resip/stack/Transport.hxx"
 #include "resip/stack/DnsInterface.hxx"
@@ -54,7 +57,10 @@ the TransactionController Thread.  The TransportSelectorThread itself is used
 to provide cycles to the actual transports for sending data in their Fifo's and
 receiving data from the wire.  The mSharedProcessTransports list is one member that
 is expected to be accessed from TransportSelector processing loop only , all other 
-members are accessed from the TransactionController processing loop.
+members are accessed from the TransactionController processing loop.  When the
+stack runs more than one TransactionController shard, they all share the first
+shard's TransportSelector; setTransactionShards() then turns on the locking
+that lets them call into it concurrently.
 */
 class TransportSelector
 {
@@ -122,10 +128,20 @@ class TransportSelector
       void closeConnection(const Tuple& peer);
 
       unsigned int sumTransportFifoSizes() const;
+      void sumTransportBatchCounts(UInt64& rxBatches, UInt64& rxMsgs,
+                                   UInt64& txBatches, UInt64& txMsgs) const;
+      void sumTransportTlsCounts(UInt64& handshakes, UInt64& resumed) const;
 
       unsigned int getTimeTillNextProcessMS();
       Fifo<TransactionMessage>& stateMacFifo() { return mStateMacFifo; }
 
+      /// Called once, before any transport is added, when the stack runs
+      /// more than one TransactionController shard. fifos[0] must be the
+      /// fifo passed to the constructor. TransportFailures are then posted to
+      /// the shard owning the transaction, and the TransactionController
+      /// entry points below lock against each other.
+      void setTransactionShards(const std::vector<Fifo<TransactionMessage>*>& fifos);
+
       void registerMarkListener(MarkListener* listener);
       void unregisterMarkListener(MarkListener* listener);
       void setEnumSuffixes(const std::vector<Data>& suffixes);
@@ -203,9 +219,18 @@ class TransportSelector
       Transport* findTlsTransport(const Data& domain,TransportType type,IpVersion ipv) const;
       Tuple determineSourceInterface(SipMessage* msg, const Tuple& dest) const;
       void rebuildAnyPortTransportMaps(void);
+      void postToTransactionShard(TransactionMessage* msg);
 
       DnsInterface mDns;
       Fifo<TransactionMessage>& mStateMacFifo;
+      // one per TransactionController shard; empty unless sharded
+      std::vector<Fifo<TransactionMessage>*> mShardFifos;
+      // Only created when sharded. Transport add/remove take it for write,
+      // everything the shards call while handling transactions takes it for
+      // read; determineSourceInterface() additionally serializes on
+      // mSourceInterfaceMutex, since it reuses one connected UDP socket.
+      std::unique_ptr<RWMutex> mShardMutex;
+      std::unique_ptr<Mutex> mSourceInterfaceMutex;
       Security* mSecurity;// for computing identity header
 
       // specific port and interface
@@ -252,7 +277,7 @@ class TransportSelector
       // epoll support, for sharedprocess transports
       FdPollGrp* mPollGrp;
 
-      int mAvgBufferSize;
+      std::atomic<int> mAvgBufferSize;
       Fifo<Transport> mTransportsToAddRemove;
       std::unique_ptr<SelectInterruptor> mSelectInterruptor;
       FdPollItemHandle mInterruptorHandle;
@@ -28,6 +28,61 @@
 using namespace std;
 using namespace resip;
 
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define RESIP_UDP_BATCH
+#endif
+
+namespace resip
+{
+
+/**
+   Scratch state for RESIP_TRANSPORT_FLAG_BATCH. mRxBuffers is a ring of
+   receive buffers that stays allocated between reads; a slot is only
+   refilled once its buffer has been absorbed into a SipMessage, so
+   keepalives, STUN and rejected datagrams do not cost an allocation.
+*/
+class UdpBatch
+{
+#ifdef RESIP_UDP_BATCH
+   public:
+      UdpBatch() : mRxDirty(UdpTransport::MaxBatchSize), mTxDone(0), mTxCount(0)
+      {
+         memset(mRxBuffers, 0, sizeof(mRxBuffers));
+         memset(mRxMsgs, 0, sizeof(mRxMsgs));
+         memset(mTxMsgs, 0, sizeof(mTxMsgs));
+      }
+      ~UdpBatch()
+      {
+         for (int i = 0; i < UdpTransport::MaxBatchSize; ++i)
+         {
+            MsgHeaderScanner::freeSlabBuffer(mRxBuffers[i]);
+         }
+         for (int i = 0; i < mTxCount; ++i)
+         {
+            delete mTxData[i];
+         }
+      }
+
+      char* mRxBuffers[UdpTransport::MaxBatchSize];
+      Tuple mRxSenders[UdpTransport::MaxBatchSize];
+      struct iovec mRxIov[UdpTransport::MaxBatchSize];
+      struct mmsghdr mRxMsgs[UdpTransport::MaxBatchSize];
+      // number of leading slots whose sender/msghdr were consumed by the
+      // last recvmmsg() and need resetting before the next one
+      int mRxDirty;
+
+      SendData* mTxData[UdpTransport::MaxBatchSize];
+      struct iovec mTxIov[UdpTransport::MaxBatchSize];
+      struct mmsghdr mTxMsgs[UdpTransport::MaxBatchSize];
+      // slots [mTxDone, mTxCount) were pulled from the fifo but not yet
+      // sent because the socket was full; they go out before anything else
+      int mTxDone;
+      int mTxCount;
+#endif
+};
+
+}
+
 UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
                            int portNum,
                            IpVersion version,
@@ -41,11 +96,13 @@ UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
      mRxBuffer(0),
      mStunSetting(stun),
      mExternalUnknownDatagramHandler(0),
-     mInWritable(false)
+     mInWritable(false),
+     mBatch(0)
 {
    mPollEventCnt = 0;
    mTxTryCnt = mTxMsgCnt = mTxFailCnt = 0;
    mRxTryCnt = mRxMsgCnt = mRxKeepaliveCnt = mRxTransactionCnt = 0;
+   mRxBatchCnt = mRxBatchMsgCnt = mTxBatchCnt = mTxBatchMsgCnt = 0;
    mTuple.setType(UDP);
    mFd = InternalTransport::socket(transport(), version);
    mTuple.mFlowKey=(FlowKey)mFd;
@@ -70,6 +127,15 @@ UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
    DebugLog (<< "No compression library available: " << *this);
 #endif
    mTxFifo.setDescription("UdpTransport::mTxFifo");
+
+   if (mTransportFlags & RESIP_TRANSPORT_FLAG_BATCH)
+   {
+#ifdef RESIP_UDP_BATCH
+      mBatch = new UdpBatch;
+#else
+      WarningLog(<< "RESIP_TRANSPORT_FLAG_BATCH not supported on this platform, ignoring: " << *this);
+#endif
+   }
 }
 
 UdpTransport::~UdpTransport()
@@ -85,14 +151,17 @@ UdpTransport::~UdpTransport()
            <<" rxmsg="<<mRxMsgCnt
            <<" rxka="<<mRxKeepaliveCnt
            <<" rxtr="<<mRxTransactionCnt
+           <<" rxbatch="<<mRxBatchCnt<<"/"<<mRxBatchMsgCnt
+           <<" txbatch="<<mTxBatchCnt<<"/"<<mTxBatchMsgCnt
            );
 #ifdef USE_SIGCOMP
    delete mSigcompStack;
 #endif
    if ( mRxBuffer )
    {
-      delete[] mRxBuffer;
+      MsgHeaderScanner::freeSlabBuffer(mRxBuffer);
    }
+   delete mBatch;
    setPollGrp(0);
 }
 
@@ -137,14 +206,14 @@ UdpTransport::process()
        updateEvents();
    }
 
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 void
 UdpTransport::updateEvents()
 {
    //assert( mPollGrp );
-   bool haveMsg = mTxFifoOutBuffer.messageAvailable();
+   bool haveMsg = txPending();
    if ( !mInWritable && haveMsg )
    {
       mPollGrp->modPollItem(mPollItemHandle, FPEM_Read|FPEM_Write);
@@ -175,7 +244,7 @@ UdpTransport::processPollEvent(FdPollEventMask mask)
    {
       processRxAll();
    }
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 /**
@@ -194,7 +263,7 @@ UdpTransport::buildFdSet( FdSet& fdset )
 {
    fdset.setRead(mFd);
 
-   if (mTxFifoOutBuffer.messageAvailable())
+   if (txPending())
    {
       fdset.setWrite(mFd);
    }
@@ -215,7 +284,7 @@ UdpTransport::process(FdSet& fdset)
    {
       processRxAll();
    }
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 /**
@@ -226,6 +295,14 @@ UdpTransport::process(FdSet& fdset)
 void
 UdpTransport::processTxAll()
 {
+   // SigComp may need to compress per message; keep that on the
+   // one-at-a-time path
+   if (mBatch && !mSigcompStack)
+   {
+      processTxBatch();
+      return;
+   }
+
    SendData *msg;
    ++mTxTryCnt;
    while ( (msg=mTxFifoOutBuffer.getNext(RESIP_FIFO_NOWAIT)) != NULL )
@@ -264,6 +341,7 @@ UdpTransport::processTxOne(SendData *data)
        sendData->sigcompId.size() > 0 &&
        !sendData->isAlreadyCompressed )
    {
+       sendData->flatten();
        osc::SigcompMessage *sm = mSigcompStack->compressMessage
          (sendData->data.data(), sendData->data.size(),
           sendData->sigcompId.data(), sendData->sigcompId.size(),
@@ -283,6 +361,21 @@ UdpTransport::processTxOne(SendData *data)
        delete sm;
    }
    else
+#endif
+#ifndef WIN32
+   if (sendData->gather)
+   {
+       const GatherData& gather = *sendData->gather;
+       msghdr hdr;
+       memset(&hdr, 0, sizeof(hdr));
+       hdr.msg_name = (void*)&addr;
+       hdr.msg_namelen = sendData->destination.length();
+       hdr.msg_iov = const_cast<GatherData::Segment*>(gather.segments());
+       hdr.msg_iovlen = gather.count();
+       expected = (int)gather.size();
+       count = (int)sendmsg(mFd, &hdr, 0);
+   }
+   else
 #endif
    {
        expected = (int)sendData->data.size();
@@ -321,6 +414,12 @@ UdpTransport::processTxOne(SendData *data)
 void
 UdpTransport::processRxAll()
 {
+   if (mBatch)
+   {
+      processRxBatch();
+      return;
+   }
+
    char *buffer = mRxBuffer;
    mRxBuffer = NULL;
    ++mRxTryCnt;
@@ -351,10 +450,218 @@ UdpTransport::processRxAll()
    }
    if ( buffer )
    {
-      delete[] buffer;
+      MsgHeaderScanner::freeSlabBuffer(buffer);
    }
 }
 
+/**
+ * RESIP_TRANSPORT_FLAG_BATCH version of processRxAll(). Reads up to
+ * MaxBatchSize datagrams per recvmmsg() into mBatch's buffer ring. With
+ * RXALL, keeps reading until a short batch says the socket is drained.
+ */
+void
+UdpTransport::processRxBatch()
+{
+#ifdef RESIP_UDP_BATCH
+   UdpBatch& b = *mBatch;
+   ++mRxTryCnt;
+   for (;;)
+   {
+      for (int i = 0; i < MaxBatchSize; ++i)
+      {
+         if (b.mRxBuffers[i] == NULL)
+         {
+            b.mRxBuffers[i] = MsgHeaderScanner::allocateSlabBuffer(MaxBufferSize);
+            b.mRxIov[i].iov_base = b.mRxBuffers[i];
+            b.mRxIov[i].iov_len = MaxBufferSize;
+         }
+         if (i >= b.mRxDirty)
+         {
+            continue;
+         }
+         b.mRxSenders[i] = mTuple;
+         msghdr& hdr = b.mRxMsgs[i].msg_hdr;
+         hdr.msg_name = &b.mRxSenders[i].getMutableSockaddr();
+         hdr.msg_namelen = b.mRxSenders[i].length();
+         hdr.msg_iov = &b.mRxIov[i];
+         hdr.msg_iovlen = 1;
+      }
+
+      int count = recvmmsg(mFd, b.mRxMsgs, MaxBatchSize, 0, NULL);
+      if (count == SOCKET_ERROR)
+      {
+         int err = getErrno();
+         if ( err != EAGAIN && err != EWOULDBLOCK )
+         {
+            error( err );
+         }
+         break;
+      }
+      if (count == 0)
+      {
+         break;
+      }
+      ++mRxBatchCnt;
+      mRxBatchMsgCnt += count;
+      b.mRxDirty = count;
+
+      for (int i = 0; i < count; ++i)
+      {
+         int len = (int)b.mRxMsgs[i].msg_len;
+         // same len-1 trick as processRxRecv() to spot truncation
+         if (len+1 >= MaxBufferSize)
+         {
+            InfoLog(<<"Datagram exceeded max length "<<MaxBufferSize);
+            continue;
+         }
+         if (len <= 0)
+         {
+            continue;
+         }
+         ++mRxMsgCnt;
+         if (processRxParse(b.mRxBuffers[i], len, b.mRxSenders[i]))
+         {
+            b.mRxBuffers[i] = NULL;
+         }
+      }
+
+      if ( count < MaxBatchSize || (mTransportFlags & RESIP_TRANSPORT_FLAG_RXALL) == 0 )
+      {
+         break;
+      }
+   }
+#endif
+}
+
+/**
+ * RESIP_TRANSPORT_FLAG_BATCH version of processTxAll(). Hands up to
+ * MaxBatchSize queued messages to each sendmmsg(); with TXALL, keeps
+ * going until the fifo is empty. A datagram that the kernel rejects is
+ * failed and skipped, and the rest of the batch is retried. If the
+ * socket is full, the unsent rest of the batch is kept in mBatch and
+ * sent first once the socket is writable again.
+ */
+void
+UdpTransport::processTxBatch()
+{
+#ifdef RESIP_UDP_BATCH
+   UdpBatch& b = *mBatch;
+   ++mTxTryCnt;
+   for (;;)
+   {
+      if (b.mTxCount == 0)
+      {
+         int count = 0;
+         SendData* msg;
+         while ( count < MaxBatchSize &&
+                 (msg=mTxFifoOutBuffer.getNext(RESIP_FIFO_NOWAIT)) != NULL )
+         {
+            if (msg->command != SendData::NoCommand)
+            {
+               // We don't handle any special SendData commands in the UDP transport yet.
+               delete msg;
+               continue;
+            }
+            resip_assert( msg->destination.getPort() != 0 );
+            b.mTxData[count] = msg;
+            msghdr& hdr = b.mTxMsgs[count].msg_hdr;
+            hdr.msg_name = (void*)&msg->destination.getSockaddr();
+            hdr.msg_namelen = msg->destination.length();
+            if (msg->gather)
+            {
+               hdr.msg_iov = const_cast<GatherData::Segment*>(msg->gather->segments());
+               hdr.msg_iovlen = msg->gather->count();
+            }
+            else
+            {
+               b.mTxIov[count].iov_base = (void*)msg->data.data();
+               b.mTxIov[count].iov_len = msg->data.size();
+               hdr.msg_iov = &b.mTxIov[count];
+               hdr.msg_iovlen = 1;
+            }
+            ++count;
+         }
+         if (count == 0)
+         {
+            break;
+         }
+         mTxMsgCnt += count;
+         b.mTxDone = 0;
+         b.mTxCount = count;
+      }
+
+      const int count = b.mTxCount;
+      int done = b.mTxDone;
+      while (done < count)
+      {
+         int sent = sendmmsg(mFd, &b.mTxMsgs[done], count - done, 0);
+         if ( sent == SOCKET_ERROR )
+         {
+            int e = getErrno();
+            if ( e == EAGAIN || e == EWOULDBLOCK )
+            {
+               // socket is full; wait until it is writable
+               break;
+            }
+            // the first datagram in the remaining batch could not be sent
+            error(e);
+            InfoLog (<< "Failed (" << e << ") sending to " << b.mTxData[done]->destination);
+            fail(b.mTxData[done]->transactionId);
+            ++mTxFailCnt;
+            ++done;
+            continue;
+         }
+         ++mTxBatchCnt;
+         mTxBatchMsgCnt += sent;
+         for (int i = done; i < done + sent; ++i)
+         {
+            size_t expected = b.mTxData[i]->gather ?
+               b.mTxData[i]->gather->size() : b.mTxData[i]->data.size();
+            if (b.mTxMsgs[i].msg_len != expected)
+            {
+               ErrLog (<< "UDPTransport - send buffer full" );
+               fail(b.mTxData[i]->transactionId);
+            }
+         }
+         done += sent;
+      }
+
+      if (done < count)
+      {
+         b.mTxDone = done;
+         break;
+      }
+
+      for (int i = 0; i < count; ++i)
+      {
+         delete b.mTxData[i];
+      }
+      b.mTxDone = b.mTxCount = 0;
+
+      if ( count < MaxBatchSize || (mTransportFlags & RESIP_TRANSPORT_FLAG_TXALL) == 0 )
+      {
+         break;
+      }
+   }
+#endif
+}
+
+/**
+ * True if there is anything to transmit: messages in the fifo, or the
+ * unsent rest of a batch that hit a full socket.
+ */
+bool
+UdpTransport::txPending() const
+{
+#ifdef RESIP_UDP_BATCH
+   if (mBatch && mBatch->mTxCount > 0)
+   {
+      return true;
+   }
+#endif
+   return mTxFifoOutBuffer.messageAvailable();
+}
+
 /*
  * Receive from socket and store results into {buffer}. Updates
  * {buffer} with actual buffer (in case allocation required),
@@ -376,7 +683,7 @@ UdpTransport::processRxRecv(char*& buffer, Tuple& sender)
    // adjust the UDP buffer as well...
    if (buffer==NULL)
    {
-      buffer = MsgHeaderScanner::allocateBuffer(MaxBufferSize);
+      buffer = MsgHeaderScanner::allocateSlabBuffer(MaxBufferSize);
    }
 
    for (;;) 
@@ -546,7 +853,7 @@ UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
          return false;
       }
 #ifdef USE_SIGCOMP
-      char* newBuffer = MsgHeaderScanner::allocateBuffer(MaxBufferSize);
+      char* newBuffer = MsgHeaderScanner::allocateSlabBuffer(MaxBufferSize);
       size_t uncompressedLength = mSigcompStack->uncompressMessage(buffer, len, newBuffer, MaxBufferSize, sc);
 
       DebugLog (<< "Uncompressed message from "
@@ -592,7 +899,7 @@ UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
 
    // Tell the SipMessage about this datagram buffer.
    // WATCHOUT: below here buffer is consumed by message
-   message->addBuffer(buffer);
+   message->addSlabBuffer(buffer, len);
 
    mMsgHeaderScanner.prepareForMessage(message);
 
@@ -773,6 +1080,27 @@ UdpTransport::setRcvBufLen(int buflen)
    setSocketRcvBufLen(mFd, buflen);
 }
 
+void
+UdpTransport::addBatchCounts(UInt64& rxBatches, UInt64& rxMsgs,
+                             UInt64& txBatches, UInt64& txMsgs) const
+{
+   rxBatches += mRxBatchCnt;
+   rxMsgs += mRxBatchMsgCnt;
+   txBatches += mTxBatchCnt;
+   txMsgs += mTxBatchMsgCnt;
+}
+
+bool
+UdpTransport::supportsGather() const
+{
+#if defined(WIN32)
+   return false;
+#else
+   // DtlsTransport needs whole datagrams to encrypt
+   return transport() == UDP;
+#endif
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0
  *
@@ -1,6 +1,7 @@
 #if !defined(RESIP_UDPTRANSPORT_HXX)
 #define RESIP_UDPTRANSPORT_HXX
 
+#include <atomic>
 #include <memory>
 #include "resip/stack/InternalTransport.hxx"
 #include "resip/stack/MsgHeaderScanner.hxx"
@@ -12,6 +13,7 @@ namespace osc { class Stack; }
 namespace resip
 {
 class UdpTransport;
+class UdpBatch;
 
 /** Interface functor for external unrecognized datagram handling.
   * User can catch datagram messages recevied that are not recognized by
@@ -75,12 +77,17 @@ public:
    virtual void buildFdSet( FdSet& fdset);
    virtual void setPollGrp(FdPollGrp *grp);
    virtual void setRcvBufLen(int buflen);
+   virtual void addBatchCounts(UInt64& rxBatches, UInt64& rxMsgs,
+                               UInt64& txBatches, UInt64& txMsgs) const;
+   virtual bool supportsGather() const;
 
    // FdPollItemIf
    // virtual Socket getPollSocket() const;
    virtual void processPollEvent(FdPollEventMask mask);
 
    static const int MaxBufferSize = 8192;
+   /// Max datagrams moved per recvmmsg()/sendmmsg() (RESIP_TRANSPORT_FLAG_BATCH)
+   static const int MaxBatchSize = 32;
 
    // STUN client functionality
    enum StunResult
@@ -106,6 +113,11 @@ protected:
    void processTxOne(SendData *data);
    void updateEvents();
 
+   // recvmmsg()/sendmmsg() variants, used when mBatch is set
+   void processRxBatch();
+   void processTxBatch();
+   bool txPending() const;
+
    osc::Stack *mSigcompStack;
 
    // statistics
@@ -117,6 +129,11 @@ protected:
    unsigned mRxMsgCnt;
    unsigned mRxKeepaliveCnt;
    unsigned mRxTransactionCnt;
+   // batch statistics; read by the StatisticsManager from another thread
+   std::atomic<UInt64> mRxBatchCnt;
+   std::atomic<UInt64> mRxBatchMsgCnt;
+   std::atomic<UInt64> mTxBatchCnt;
+   std::atomic<UInt64> mTxBatchMsgCnt;
 private:
    char* mRxBuffer;
    MsgHeaderScanner mMsgHeaderScanner;
@@ -128,6 +145,8 @@ private:
 
    ExternalUnknownDatagramHandler* mExternalUnknownDatagramHandler;
    bool mInWritable;
+   // non-null iff RESIP_TRANSPORT_FLAG_BATCH is set and supported
+   UdpBatch* mBatch;
 };
 
 }
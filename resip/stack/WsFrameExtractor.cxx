@@ -1,8 +1,18 @@
 
 #include "rutil/Logger.hxx"
+#include "rutil/ResipAssert.h"
 #include "resip/stack/WsFrameExtractor.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESIP_WS_UNMASK_SSE2
+#include <emmintrin.h>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RESIP_WS_UNMASK_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
@@ -10,244 +20,294 @@ using namespace resip;
 
 const int WsFrameExtractor::mMaxHeaderLen = 14;
 
-WsFrameExtractor::WsFrameExtractor(Data::size_type maxMessage)
-   : mMaxMessage(maxMessage),
-     mMessageSize(0),
-     mHaveHeader(false),
-     mHeaderLen(0)
+// key holds the four mask bytes, already rotated to line up with src[0], as
+// they lie in memory; dst is never after src, so working forwards never
+// overwrites bytes that have not been read yet
+typedef void (*UnmaskFunction)(char* dst, const char* src, size_t len, UInt32 key);
+
+static void
+unmaskWords(char* dst, const char* src, size_t len, UInt32 key)
 {
-   // we re-use this for multiple messages throughout
-   // the lifetime of this parser object
-   mWsHeader = new UInt8[mMaxHeaderLen];
+   // the same four bytes twice over, whichever the byte order
+   UInt64 key64 = ((UInt64)key << 32) | key;
+   for( ; len >= 8; len -= 8, src += 8, dst += 8)
+   {
+      UInt64 word;
+      memcpy(&word, src, 8);
+      word ^= key64;
+      memcpy(dst, &word, 8);
+   }
+   const UInt8* keyBytes = reinterpret_cast<const UInt8*>(&key);
+   for(size_t i = 0; i < len; i++)
+   {
+      dst[i] = (char)(src[i] ^ keyBytes[i & 3]);
+   }
 }
 
-WsFrameExtractor::~WsFrameExtractor()
+#if defined(RESIP_WS_UNMASK_SSE2)
+
+static void
+unmaskSse2(char* dst, const char* src, size_t len, UInt32 key)
 {
-   // FIXME - delete any objects left in the queues
-   delete [] mWsHeader;
+   const __m128i key128 = _mm_set1_epi32((int)key);
+   for( ; len >= 16; len -= 16, src += 16, dst += 16)
+   {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_xor_si128(block, key128));
+   }
+   // 16 is a multiple of 4, so the key still lines up
+   unmaskWords(dst, src, len, key);
+}
 
-   while(!mFrames.empty()) 
+#if defined(RESIP_WS_UNMASK_AVX2)
+
+__attribute__((target("avx2")))
+static void
+unmaskAvx2(char* dst, const char* src, size_t len, UInt32 key)
+{
+   const __m256i key256 = _mm256_set1_epi32((int)key);
+   for( ; len >= 32; len -= 32, src += 32, dst += 32)
    {
-      delete [] mFrames.front()->data();
-      delete mFrames.front();
-      mFrames.pop();
+      __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_xor_si256(block, key256));
    }
-      
-   while(!mMessages.empty())
+   unmaskWords(dst, src, len, key);
+}
+
+#endif
+#endif
+
+static UnmaskFunction
+bestUnmaskFunction()
+{
+#if defined(RESIP_WS_UNMASK_AVX2)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
    {
-      delete [] mMessages.front()->data();
-      delete mMessages.front();
-      mMessages.pop();
+      return unmaskAvx2;
    }
+#endif
+#if defined(RESIP_WS_UNMASK_SSE2)
+   return unmaskSse2;
+#else
+   return unmaskWords;
+#endif
+}
 
+WsFrameExtractor::WsFrameExtractor(Data::size_type maxMessage)
+   : mMaxMessage(maxMessage),
+     mParsePos(0),
+     mInMessage(false),
+     mMessageStart(0),
+     mMessageEnd(0),
+     mHaveHeader(false),
+     mHeaderLen(2),
+     mFinalFrame(false),
+     mMasked(false),
+     mMaskPos(0),
+     mPayloadRemaining(0)
+{
 }
 
-std::unique_ptr<Data>
-WsFrameExtractor::processBytes(UInt8 *input, Data::size_type len, bool& dropConnection)
+bool
+WsFrameExtractor::processBytes(char* buffer, size_t end, bool& dropConnection)
 {
-   std::unique_ptr<Data> ret;
    dropConnection = false;
-   Data::size_type pos = 0;
-   while(input != 0 && pos < len)
+   while(true)
    {
-      while(!mHaveHeader && pos < len)
+      if(!mHaveHeader)
       {
-         StackLog(<<"Need a header, parsing bytes...");
-         // Append bytes to the header buffer
-         int needed = parseHeader();
-         if(mHeaderLen >= mMaxHeaderLen)
-         {
-            WarningLog(<<"WS Frame header too long");
-            dropConnection = true;
-            return ret;
-         }
-         for( ; needed > 0 && pos < len; needed-- )
+         if(!parseHeader(reinterpret_cast<const UInt8*>(buffer + mParsePos), end - mParsePos, dropConnection))
          {
-            mWsHeader[mHeaderLen++] = input[pos++];
+            return false;
          }
-         if(needed > 0)
+         mParsePos += mHeaderLen;
+         mHeaderLen = 2;
+         if(!mInMessage)
          {
-            StackLog(<<"Not enough bytes available to form a full header");
-            return ret;
+            StackLog(<<"starting a new message");
+            mInMessage = true;
+            mMessageStart = mParsePos;
+            mMessageEnd = mParsePos;
          }
-      }
-      if(mHaveHeader)
-      {
-         StackLog(<<"have header, parsing payload data...");
-         // Process input bytes to output buffer, unmasking if necessary
-         if(mMessageSize + mPayloadLength > mMaxMessage)
+         if(mMessageEnd - mMessageStart + mPayloadRemaining > mMaxMessage)
          {
-            WarningLog(<<"WS frame header describes a payload size bigger than messageSizeMax, max = " << mMaxMessage 
+            WarningLog(<<"WS frame header describes a payload size bigger than messageSizeMax, max = " << mMaxMessage
                  << ", dropping connection");
             dropConnection = true;
-            return ret;
+            return false;
          }
+      }
 
-         if(mPayload == 0)
-         {
-            StackLog(<<"starting new frame buffer");
-            // Include an extra byte at the end for null terminator
-            mPayload = (UInt8*)new char[mPayloadLength + 1];
-            mPayloadPos = 0;
-         }
+      // Move the payload bytes we have up against the rest of the message,
+      // unmasking if necessary; for the first frame of a message they are
+      // already where they belong
+      size_t takeBytes = end - mParsePos;
+      if(takeBytes > mPayloadRemaining)
+      {
+         takeBytes = (size_t)mPayloadRemaining;
+      }
+      if(mMasked)
+      {
+         unmask(buffer + mMessageEnd, buffer + mParsePos, takeBytes, mWsMaskKey, mMaskPos);
+         mMaskPos = (mMaskPos + (unsigned int)takeBytes) & 3;
+      }
+      else if(mMessageEnd != mParsePos)
+      {
+         memmove(buffer + mMessageEnd, buffer + mParsePos, takeBytes);
+      }
+      mMessageEnd += takeBytes;
+      mParsePos += takeBytes;
+      mPayloadRemaining -= takeBytes;
 
-         Data::size_type takeBytes = len - pos;
-         if(takeBytes > mPayloadLength - mPayloadPos)
-         {
-            takeBytes = mPayloadLength - mPayloadPos;
-         }
+      if(mPayloadRemaining > 0)
+      {
+         StackLog(<<"frame incomplete, " << mPayloadRemaining << " bytes to come");
+         return false;
+      }
+      mHaveHeader = false;
+      if(mFinalFrame)
+      {
+         StackLog(<<"returning a message, size = " << messageSize());
+         mInMessage = false;
+         return true;
+      }
+   }
+}
 
-         if(mMasked)
-         {
-            Data::size_type endOffset = mPayloadPos + takeBytes;
-            for( ; mPayloadPos < endOffset; mPayloadPos++)
-            {
-               mPayload[mPayloadPos] = (input[pos++] ^ mWsMaskKey[(mPayloadPos & 3)]);
-            }
-         }
-         else
-         {
-            memmove(&mPayload[mPayloadPos], &input[pos], takeBytes);
-            pos += takeBytes;
-            mPayloadPos += takeBytes;
-         }
+size_t
+WsFrameExtractor::required() const
+{
+   return mParsePos + (mHaveHeader ? (size_t)mPayloadRemaining : mHeaderLen);
+}
 
-         if(mPayloadPos == mPayloadLength)
-         {
-            StackLog(<<"Got a whole frame, queueing it");
-            mMessageSize += mPayloadLength;
-            Data *mFrame = new Data(Data::Borrow, (char *)mPayload, mPayloadLength, mPayloadLength + 1);
-            mFrames.push(mFrame);
-            mHaveHeader = false;
-            mHeaderLen = 0;
-            mPayload = 0;
-            if(mFinalFrame)
-            {
-               joinFrames();
-            }
-         }
-      }
+void
+WsFrameExtractor::rebase(size_t offset)
+{
+   resip_assert(offset <= keepFrom());
+   mParsePos -= offset;
+   if(mInMessage)
+   {
+      mMessageStart -= offset;
+      mMessageEnd -= offset;
    }
-   if(mMessages.empty())
+   else
    {
-      StackLog(<<"no full messages available in queue"); 
-      return ret;
+      mMessageStart = mMessageEnd = mParsePos;
    }
-   ret = std::unique_ptr<Data>(mMessages.front());
-   mMessages.pop();
-   StackLog(<<"returning a message, size = " << ret->size());
-   return ret;
 }
 
-int
-WsFrameExtractor::parseHeader()
+size_t
+WsFrameExtractor::makeFrameHeader(UInt64 length, UInt8* header)
 {
-   if(mHeaderLen < 2)
+   header[0] = 0x82;
+   if(length <= 0x7D)
    {
-      StackLog(<< "Too short to contain ws data [0]");
-      return (2 - mHeaderLen);
+      header[1] = (UInt8)length;
+      return 2;
    }
+   if(length <= 0xFFFF)
+   {
+      header[1] = 0x7E;
+      header[2] = (UInt8)((length >> 8) & 0xFF);
+      header[3] = (UInt8)(length & 0xFF);
+      return 4;
+   }
+   header[1] = 0x7F;
+   for(int i = 0; i < 8; i++)
+   {
+      header[2 + i] = (UInt8)((length >> (56 - 8*i)) & 0xFF);
+   }
+   return 10;
+}
 
-   UInt64 hdrPos = 2;
-
-   mFinalFrame = (mWsHeader[0] >> 7) != 0;
-   mMasked = (mWsHeader[1] >> 7) != 0;
+void
+WsFrameExtractor::unmask(char* dst, const char* src, size_t len,
+                         const UInt8* key, unsigned int keyPos)
+{
+   static const UnmaskFunction unmaskFunction = bestUnmaskFunction();
+   UInt8 rotated[4];
+   for(unsigned int i = 0; i < 4; i++)
+   {
+      rotated[i] = key[(keyPos + i) & 3];
+   }
+   UInt32 key32;
+   memcpy(&key32, rotated, 4);
+   unmaskFunction(dst, src, len, key32);
+}
 
-   if(mWsHeader[0] & 0x40 || mWsHeader[0] & 0x20 || mWsHeader[0] & 0x10)
+/*
+ * Returns true once the whole header is available, and sets mHeaderLen to
+ * its size. Otherwise sets mHeaderLen to the size needed to get further.
+ */
+bool
+WsFrameExtractor::parseHeader(const UInt8* header, size_t available, bool& dropConnection)
+{
+   if(available < 2)
    {
-      WarningLog(<< "Unknown extension: " << ((mWsHeader[0] >> 4) & 0x07));
-      // do not exit
+      StackLog(<< "Too short to contain ws data [0]");
+      mHeaderLen = 2;
+      return false;
    }
 
-   mPayloadLength = mWsHeader[1] & 0x7F;
-   if(mPayloadLength == 126)
+   mFinalFrame = (header[0] >> 7) != 0;
+   mMasked = (header[1] >> 7) != 0;
+
+   UInt64 payloadLength = header[1] & 0x7F;
+   size_t hdrPos = 2;
+   if(payloadLength == 126)
    {
-      if(mHeaderLen < 4)
-      {
-         StackLog(<< "Too short to contain ws data [1]");
-         return (4 - mHeaderLen) + (mMasked ? 4 : 0);
-      }
-      mPayloadLength = (mWsHeader[hdrPos] << 8 | mWsHeader[hdrPos + 1]);
       hdrPos += 2;
    }
-   else if(mPayloadLength == 127)
+   else if(payloadLength == 127)
    {
-      if(mHeaderLen < 8)
-      {
-         StackLog(<< "Too short to contain ws data [2]");
-         return (8 - mHeaderLen) + (mMasked ? 4 : 0);
-      }
-      mPayloadLength = (((UInt64)mWsHeader[hdrPos]) << 56 | ((UInt64)mWsHeader[hdrPos + 1]) << 48 | ((UInt64)mWsHeader[hdrPos + 2]) << 40 | ((UInt64)mWsHeader[hdrPos + 3]) << 32 | ((UInt64)mWsHeader[hdrPos + 4]) << 24 | ((UInt64)mWsHeader[hdrPos + 5]) << 16 | ((UInt64)mWsHeader[hdrPos + 6]) << 8 || ((UInt64)mWsHeader[hdrPos + 7]));
       hdrPos += 8;
    }
-
-   if(mMasked)
+   mHeaderLen = hdrPos + (mMasked ? 4 : 0);
+   resip_assert(mHeaderLen <= (size_t)mMaxHeaderLen);
+   if(available < mHeaderLen)
    {
-      if((mHeaderLen - hdrPos) < 4)
-      {
-         StackLog(<< "Too short to contain ws data [3]");
-         return (int)((hdrPos + 4) - mHeaderLen);
-      }
-      mWsMaskKey[0] = mWsHeader[hdrPos];
-      mWsMaskKey[1] = mWsHeader[hdrPos + 1];
-      mWsMaskKey[2] = mWsHeader[hdrPos + 2];
-      mWsMaskKey[3] = mWsHeader[hdrPos + 3];
-      hdrPos += 4;
+      StackLog(<< "Too short to contain ws data [1], need " << mHeaderLen << " bytes");
+      return false;
    }
 
-   StackLog(<< "successfully processed a WebSocket frame header, payload length = " << mPayloadLength
-            << ", masked = "<< mMasked << ", final frame = "<< mFinalFrame);
-
-   mHaveHeader = true;
-   mPayload = 0;
-   return 0;
-}
-
-void
-WsFrameExtractor::joinFrames()
-{
-   StackLog(<<"trying to join frames");
-   if(mFrames.empty())
+   if(header[0] & 0x40 || header[0] & 0x20 || header[0] & 0x10)
    {
-      ErrLog(<<"No frames to join!");
-      return;
+      WarningLog(<< "Unknown extension: " << ((header[0] >> 4) & 0x07));
+      // do not exit
    }
 
-   Data *msg = mFrames.front();
-   mFrames.pop();
-   if(!mFrames.empty())
+   if(payloadLength == 126)
    {
-      // must expand buffer because there are multiple frames
-      // can't use Data::reserve() to increase the buffer, because the
-      // ShareEnum will change to Take when expanded
-      char *_msg = (char *)msg->data();
-      Data::size_type frameSize = msg->size();
-      delete msg;
-
-      // allow extra byte for null terminator
-      char *newBuf = new char [mMessageSize + 1]; 
-      memcpy(newBuf, _msg, frameSize);
-
-      msg = new Data(Data::Borrow, newBuf, frameSize, mMessageSize + 1);
+      payloadLength = (header[2] << 8 | header[3]);
    }
-   while(!mFrames.empty())
+   else if(payloadLength == 127)
    {
-      Data *mFrame = mFrames.front();
-      mFrames.pop();
-      msg->append(mFrame->data(), mFrame->size());
-      delete [] mFrame->data();
-      delete mFrame;
+      payloadLength = 0;
+      for(int i = 0; i < 8; i++)
+      {
+         payloadLength = (payloadLength << 8) | header[2 + i];
+      }
+      if(payloadLength >> 63)
+      {
+         WarningLog(<< "WS frame length has the most significant bit set, dropping connection");
+         dropConnection = true;
+         return false;
+      }
    }
 
-   // It is safe to cast because we used Borrow:
-   char *_msg = (char *)msg->data();
-   // MsgHeaderScanner expects space for an extra byte at the end:
-   _msg[mMessageSize] = 0;
+   if(mMasked)
+   {
+      memcpy(mWsMaskKey, header + hdrPos, 4);
+   }
 
-   mMessages.push(msg);
+   StackLog(<< "successfully processed a WebSocket frame header, payload length = " << payloadLength
+            << ", masked = "<< mMasked << ", final frame = "<< mFinalFrame);
 
-   // Ready to start examinging first frame of next message...
-   mMessageSize = 0;
+   mHaveHeader = true;
+   mPayloadRemaining = payloadLength;
+   mMaskPos = 0;
+   return true;
 }
 
 /* ====================================================================
@@ -1,22 +1,60 @@
 #ifndef RESIP_WsFrameExtractor_hxx
 #define RESIP_WsFrameExtractor_hxx
 
-#include <memory>
-#include <queue>
-
 #include "rutil/compat.hxx"
 #include "rutil/Data.hxx"
 
 namespace resip
 {
 
+/**
+   Takes WebSocket frames apart in the connection's own receive buffer:
+   payloads are unmasked where they lie, and the fragments of a message are
+   moved up against each other over the headers in between, so that a
+   complete message ends up contiguous in the buffer without being copied
+   out of it.
+
+   The extractor only keeps offsets into the buffer; the caller owns the
+   buffer, and calls rebase() whenever it moves what is left in it.
+*/
 class WsFrameExtractor
 {
    public:
 
+      /// size of the longest header makeFrameHeader() writes
+      enum { MaxUnmaskedHeaderLen = 10 };
+
       WsFrameExtractor(Data::size_type maxMessage);
-      ~WsFrameExtractor();
-      std::unique_ptr<Data> processBytes(UInt8 *input, Data::size_type len, bool& dropConnection);
+
+      /** Works through the bytes in buffer[0, end) that have not been seen
+          yet. Returns true once a message is complete, at
+          buffer[messageStart(), messageStart() + messageSize()); call again
+          (after a rebase() if the buffer was changed) to carry on with
+          whatever follows it. Returns false when it needs more bytes, with
+          dropConnection set if the peer is not keeping to the protocol or to
+          the maximum message size. */
+      bool processBytes(char* buffer, size_t end, bool& dropConnection);
+
+      size_t messageStart() const { return mMessageStart; }
+      size_t messageSize() const { return mMessageEnd - mMessageStart; }
+      /// end of the bytes processBytes() has been through
+      size_t consumed() const { return mParsePos; }
+      /// start of the bytes still needed, ie: of a message in progress
+      size_t keepFrom() const { return mInMessage ? mMessageStart : mParsePos; }
+      /// how large the buffer must be to hold the frame being read
+      size_t required() const;
+      /// the bytes from offset onwards have been moved to the start of the buffer
+      void rebase(size_t offset);
+
+      /** Writes the header of a final, unmasked binary frame carrying
+          length bytes into header, and returns its size. */
+      static size_t makeFrameHeader(UInt64 length, UInt8* header);
+
+      /** XORs len bytes from src with key, starting keyPos bytes into it,
+          and stores them at dst, which may be src or before it in the same
+          buffer. Uses SSE2/AVX2 where available. */
+      static void unmask(char* dst, const char* src, size_t len,
+                         const UInt8* key, unsigned int keyPos);
 
    private:
 
@@ -24,26 +62,24 @@ class WsFrameExtractor
 
       Data::size_type mMaxMessage;
 
-      std::queue<Data*> mFrames;
-      std::queue<Data*> mMessages;
-      // for tracking the cumulative size of all full frames
-      // not yet assembled into a message:
-      Data::size_type mMessageSize;
+      // offset of the next byte not yet looked at
+      size_t mParsePos;
+      // the message being put together, from its first fragment on
+      bool mInMessage;
+      size_t mMessageStart;
+      size_t mMessageEnd;
 
       bool mHaveHeader;
-      int mHeaderLen;
-      UInt8 *mWsHeader;
+      // bytes the header needs, once fewer than that were available
+      size_t mHeaderLen;
 
       bool mFinalFrame;
       bool mMasked;
       UInt8 mWsMaskKey[4];
-      Data::size_type mPayloadLength;
-
-      UInt8 *mPayload;
-      Data::size_type mPayloadPos;
+      unsigned int mMaskPos;
+      UInt64 mPayloadRemaining;
 
-      int parseHeader();
-      void joinFrames();
+      bool parseHeader(const UInt8* header, size_t available, bool& dropConnection);
 
 };
 
@@ -38,6 +38,17 @@ WsTransport::WsTransport(Fifo<TransactionMessage>& fifo, int portNum,
    mTxFifo.setDescription("WsTransport::mTxFifo");
 }
 
+bool
+WsTransport::supportsGather() const
+{
+   // WsConnection writes the frame header and the message with one writev()
+#if defined(WIN32)
+   return false;
+#else
+   return true;
+#endif
+}
+
 Connection*
 WsTransport::createConnection(const Tuple& who, Socket fd, bool server)
 {
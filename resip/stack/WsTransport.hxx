@@ -30,6 +30,8 @@ class WsTransport : public TcpBaseTransport, public WsBaseTransport
                    std::shared_ptr<WsConnectionValidator> = nullptr,
                    std::shared_ptr<WsCookieContextFactory> = std::make_shared<BasicWsCookieContextFactory>());
 
+      virtual bool supportsGather() const;
+
    protected:
       Connection* createConnection(const Tuple& who, Socket fd, bool server = false) override;
 };
@@ -26,6 +26,8 @@
 #include "rutil/Timer.hxx"
 #include "rutil/ParseBuffer.hxx"
 #include "rutil/FileSystem.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Mutex.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 #include "rutil/ssl/SHA1Stream.hxx"
@@ -56,6 +58,13 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 #include <openssl/ssl.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#else
+#include <openssl/hmac.h>
+#endif
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 
@@ -156,6 +165,10 @@ BaseSecurity::CipherList BaseSecurity::StrongestSuite("HIGH:-COMPLEMENTOFDEFAULT
 long BaseSecurity::OpenSSLCTXSetOptions = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3;
 long BaseSecurity::OpenSSLCTXClearOptions = 0;
 
+int BaseSecurity::TlsSessionCacheSize = SSL_SESSION_CACHE_MAX_SIZE_DEFAULT;
+int BaseSecurity::TlsSessionTimeout = 3600;
+int BaseSecurity::TlsTicketKeyLifetime = 12 * 3600;
+
 Security::Security(const CipherList& cipherSuite, const Data& defaultPrivateKeyPassPhrase, const Data& dHParamsFilename) :
    BaseSecurity(cipherSuite, defaultPrivateKeyPassPhrase, dHParamsFilename)
 {
@@ -403,6 +416,7 @@ Security::createDomainCtx(const SSL_METHOD* method, const Data& domain, const Da
    setDHParams(ctx);
    SSL_CTX_set_options(ctx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(ctx, BaseSecurity::OpenSSLCTXClearOptions);
+   setSessionCaching(ctx, domain);
 
    return ctx;
 }
@@ -1190,6 +1204,7 @@ BaseSecurity::BaseSecurity (const CipherList& cipherSuite, const Data& defaultPr
    setDHParams(mTlsCtx);
    SSL_CTX_set_options(mTlsCtx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(mTlsCtx, BaseSecurity::OpenSSLCTXClearOptions);
+   setSessionCaching(mTlsCtx, "TLSv1");
    
    mSslCtx = SSL_CTX_new( SSLv23_method() );
    resip_assert(mSslCtx);
@@ -1201,6 +1216,7 @@ BaseSecurity::BaseSecurity (const CipherList& cipherSuite, const Data& defaultPr
    setDHParams(mSslCtx);
    SSL_CTX_set_options(mSslCtx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(mSslCtx, BaseSecurity::OpenSSLCTXClearOptions);
+   setSessionCaching(mSslCtx, "SSLv23");
 }
 
 
@@ -3200,6 +3216,163 @@ BaseSecurity::setDHParams(SSL_CTX* ctx)
 
 }
 
+namespace
+{
+
+// The session ticket keys are shared by every SSL_CTX in the process, so a
+// client holding a ticket can resume on any of our transports.
+struct TicketKey
+{
+   unsigned char mName[16];
+   unsigned char mAesKey[32];
+   unsigned char mHmacKey[32];
+};
+
+Mutex TicketKeyMutex;
+TicketKey TicketKeyCurrent;
+TicketKey TicketKeyPrevious;
+bool TicketKeyHavePrevious = false;
+UInt64 TicketKeyRotateAt = 0;
+
+// called with TicketKeyMutex held; false if there is no usable key
+bool
+rotateTicketKeys()
+{
+   UInt64 now = Timer::getTimeSecs();
+   if (TicketKeyRotateAt != 0 && now < TicketKeyRotateAt)
+   {
+      return true;
+   }
+
+   TicketKey next;
+   if (RAND_bytes((unsigned char*)&next, sizeof(next)) != 1)
+   {
+      ErrLog(<< "RAND_bytes failed, not rotating the TLS session ticket key");
+      return TicketKeyRotateAt != 0;
+   }
+   // tickets under the outgoing key stay valid for one more lifetime,
+   // unless it has already been idle for longer than that
+   TicketKeyHavePrevious = TicketKeyRotateAt != 0 &&
+      now < TicketKeyRotateAt + BaseSecurity::TlsTicketKeyLifetime;
+   TicketKeyPrevious = TicketKeyCurrent;
+   TicketKeyCurrent = next;
+   TicketKeyRotateAt = now + BaseSecurity::TlsTicketKeyLifetime;
+   DebugLog(<< "rotated the TLS session ticket key");
+   return true;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+typedef EVP_MAC_CTX TicketHmacCtx;
+
+bool
+initTicketHmac(EVP_MAC_CTX* hctx, unsigned char* key)
+{
+   OSSL_PARAM params[3];
+   params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key, sizeof(TicketKey().mHmacKey));
+   params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*)"SHA256", 0);
+   params[2] = OSSL_PARAM_construct_end();
+   return EVP_MAC_CTX_set_params(hctx, params) == 1;
+}
+#else
+typedef HMAC_CTX TicketHmacCtx;
+
+bool
+initTicketHmac(HMAC_CTX* hctx, unsigned char* key)
+{
+   return HMAC_Init_ex(hctx, key, sizeof(TicketKey().mHmacKey), EVP_sha256(), 0) == 1;
+}
+#endif
+
+// see SSL_CTX_set_tlsext_ticket_key_cb(3) for the return values
+int
+ticketKeyCallback(SSL* ssl, unsigned char* keyName, unsigned char* iv,
+                  EVP_CIPHER_CTX* cctx, TicketHmacCtx* hctx, int enc)
+{
+   Lock lock(TicketKeyMutex);
+   if (!rotateTicketKeys())
+   {
+      return enc ? 0 : -1;
+   }
+
+   if (enc)
+   {
+      if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+      {
+         return 0;
+      }
+      memcpy(keyName, TicketKeyCurrent.mName, sizeof(TicketKeyCurrent.mName));
+      if (EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), 0, TicketKeyCurrent.mAesKey, iv) != 1 ||
+          !initTicketHmac(hctx, TicketKeyCurrent.mHmacKey))
+      {
+         return -1;
+      }
+      return 1;
+   }
+
+   TicketKey* key = 0;
+   if (memcmp(keyName, TicketKeyCurrent.mName, sizeof(TicketKeyCurrent.mName)) == 0)
+   {
+      key = &TicketKeyCurrent;
+   }
+   else if (TicketKeyHavePrevious &&
+            memcmp(keyName, TicketKeyPrevious.mName, sizeof(TicketKeyPrevious.mName)) == 0)
+   {
+      key = &TicketKeyPrevious;
+   }
+   if (!key)
+   {
+      // expired or from someone else, fall back to a full handshake
+      return 0;
+   }
+   if (!initTicketHmac(hctx, key->mHmacKey) ||
+       EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), 0, key->mAesKey, iv) != 1)
+   {
+      return -1;
+   }
+   // 2 asks for a fresh ticket under the current key
+   return key == &TicketKeyCurrent ? 1 : 2;
+}
+
+}
+
+void
+BaseSecurity::setSessionCaching(SSL_CTX* ctx, const Data& sessionContext)
+{
+   // required for resumption whenever client certificates are requested;
+   // the md5 hex digest is exactly SSL_MAX_SID_CTX_LENGTH long
+   Data sid = sessionContext.md5();
+   resip_assert(sid.size() <= SSL_MAX_SID_CTX_LENGTH);
+   SSL_CTX_set_session_id_context(ctx, (const unsigned char*)sid.data(), (unsigned int)sid.size());
+
+   if (TlsSessionCacheSize > 0)
+   {
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+      SSL_CTX_sess_set_cache_size(ctx, TlsSessionCacheSize);
+   }
+   else
+   {
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+   }
+   SSL_CTX_set_timeout(ctx, TlsSessionTimeout);
+
+   if (TlsTicketKeyLifetime > 0)
+   {
+      SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+      SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticketKeyCallback);
+#else
+      SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticketKeyCallback);
+#endif
+   }
+   else
+   {
+      SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+   }
+   DebugLog(<< "TLS session cache size " << TlsSessionCacheSize
+            << ", timeout " << TlsSessionTimeout
+            << "s, ticket key lifetime " << TlsTicketKeyLifetime << "s");
+}
+
 #endif
 
 
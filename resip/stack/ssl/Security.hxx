@@ -90,6 +90,22 @@ class BaseSecurity
       static long OpenSSLCTXSetOptions;
       static long OpenSSLCTXClearOptions;
 
+      /**
+       * TLS session resumption, applied to every SSL_CTX created after
+       * they are set:
+       *
+       * TlsSessionCacheSize is the number of sessions each context keeps
+       * for resumption by session id (0 disables the server-side cache).
+       * TlsSessionTimeout is how long, in seconds, a session or ticket
+       * may be resumed.  TlsTicketKeyLifetime is how often, in seconds,
+       * the key protecting session tickets is replaced (0 disables
+       * session tickets); tickets issued under the previous key are
+       * still accepted, and reissued, for one more lifetime.
+       */
+      static int TlsSessionCacheSize;
+      static int TlsSessionTimeout;
+      static int TlsTicketKeyLifetime;
+
       BaseSecurity(const CipherList& cipherSuite = StrongestSuite, const Data& defaultPrivateKeyPassPhrase = Data::Empty, const Data& dHParamsFilename = Data::Empty);
       virtual ~BaseSecurity();
 
@@ -261,6 +277,9 @@ class BaseSecurity
       static bool mAllowWildcardCertificates;
 
       void setDHParams(SSL_CTX* ctx);
+      // sessionContext keeps sessions of one context from being resumed
+      // on another
+      void setSessionCaching(SSL_CTX* ctx, const Data& sessionContext);
 };
 
 class Security : public BaseSecurity
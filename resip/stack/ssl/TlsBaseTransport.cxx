@@ -13,7 +13,9 @@
 #include "rutil/Logger.hxx"
 #include "resip/stack/ssl/TlsBaseTransport.hxx"
 #include "resip/stack/ssl/TlsConnection.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
 #include "resip/stack/ssl/Security.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
@@ -21,6 +23,8 @@
 using namespace std;
 using namespace resip;
 
+unsigned int TlsBaseTransport::HandshakeThreads = 0;
+
 TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo, 
                            int portNum, 
                            IpVersion version,
@@ -46,7 +50,11 @@ TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo,
    mCertificateFilename(certificateFilename),
    mPrivateKeyFilename(privateKeyFilename),
    mPrivateKeyPassPhrase(privateKeyPassPhrase),
-   mReloadCertificate(false)
+   mReloadCertificate(false),
+   mHandshakes(0),
+   mResumedHandshakes(0),
+   mHandshakeInterruptorHandle(0),
+   mHandshakePool(0)
 {
    setTlsDomain(sipDomain);   
    mTuple.setType(transportType);
@@ -74,11 +82,35 @@ TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo,
          throw invalid_argument("Unrecognised SecurityTypes::SSLType value");
       }
    }
+
+   // Client sessions are handed to TlsConnection::onNewSession, which keeps
+   // them in mClientSessions; OpenSSL cannot pick the session to resume
+   // itself.  The server side is set up by Security::setSessionCaching.
+   SSL_CTX* ctx = getCtx();
+   SSL_CTX_set_session_cache_mode(ctx, SSL_CTX_get_session_cache_mode(ctx) | SSL_SESS_CACHE_CLIENT);
+   SSL_CTX_sess_set_new_cb(ctx, TlsConnection::onNewSession);
+
+   if (HandshakeThreads > 0)
+   {
+      mHandshakePool = new TlsHandshakePool(HandshakeThreads, mHandshakeInterruptor);
+   }
 }
 
 
 TlsBaseTransport::~TlsBaseTransport()
 {
+   // before the connections go, along with TcpBaseTransport
+   delete mHandshakePool;
+   mHandshakePool = 0;
+   if (mPollGrp && mHandshakeInterruptorHandle)
+   {
+      mPollGrp->delPollItem(mHandshakeInterruptorHandle);
+      mHandshakeInterruptorHandle = 0;
+   }
+   for (ClientSessionMap::iterator it = mClientSessions.begin(); it != mClientSessions.end(); ++it)
+   {
+      SSL_SESSION_free(it->second);
+   }
    if (mDomainCtx)
    {
       SSL_CTX_free(mDomainCtx);mDomainCtx=0;
@@ -92,6 +124,63 @@ TlsBaseTransport::onReload()
    mReloadCertificate = true;
 }
 
+void
+TlsBaseTransport::process()
+{
+   processHandshakeCompletions();
+   TcpBaseTransport::process();
+}
+
+void
+TlsBaseTransport::process(FdSet& fdset)
+{
+   if (mHandshakePool)
+   {
+      mHandshakeInterruptor.process(fdset);
+   }
+   processHandshakeCompletions();
+   TcpBaseTransport::process(fdset);
+}
+
+void
+TlsBaseTransport::buildFdSet(FdSet& fdset)
+{
+   TcpBaseTransport::buildFdSet(fdset);
+   if (mHandshakePool)
+   {
+      mHandshakeInterruptor.buildFdSet(fdset);
+   }
+}
+
+void
+TlsBaseTransport::setPollGrp(FdPollGrp *grp)
+{
+   if (mPollGrp && mHandshakeInterruptorHandle)
+   {
+      mPollGrp->delPollItem(mHandshakeInterruptorHandle);
+      mHandshakeInterruptorHandle = 0;
+   }
+   if (grp && mHandshakePool)
+   {
+      mHandshakeInterruptorHandle = grp->addPollItem(mHandshakeInterruptor.getReadSocket(), FPEM_Read, &mHandshakeInterruptor);
+   }
+   TcpBaseTransport::setPollGrp(grp);
+}
+
+void
+TlsBaseTransport::processHandshakeCompletions()
+{
+   if (!mHandshakePool)
+   {
+      return;
+   }
+   // one at a time, as carrying on with one connection may close another
+   while (TlsConnection* conn = mHandshakePool->takeCompleted())
+   {
+      conn->onHandshakeStepDone();
+   }
+}
+
 SSL_CTX* 
 TlsBaseTransport::getCtx()
 { 
@@ -152,6 +241,66 @@ TlsBaseTransport::setPeerCertificateVerificationCallback(
    return true;
 }
 
+bool
+TlsBaseTransport::resumeClientSession(SSL* ssl, const Data& peer)
+{
+   Lock lock(mClientSessionMutex);
+   ClientSessionMap::iterator it = mClientSessions.find(peer);
+   if (it == mClientSessions.end())
+   {
+      return false;
+   }
+   return SSL_set_session(ssl, it->second) == 1;
+}
+
+void
+TlsBaseTransport::storeClientSession(const Data& peer, SSL_SESSION* session)
+{
+   Lock lock(mClientSessionMutex);
+   ClientSessionMap::iterator it = mClientSessions.find(peer);
+   if (it != mClientSessions.end())
+   {
+      SSL_SESSION_free(it->second);
+      it->second = session;
+      return;
+   }
+   if (mClientSessions.size() >= MaxClientSessions)
+   {
+      SSL_SESSION_free(mClientSessions.begin()->second);
+      mClientSessions.erase(mClientSessions.begin());
+   }
+   mClientSessions[peer] = session;
+}
+
+void
+TlsBaseTransport::forgetClientSession(const Data& peer)
+{
+   Lock lock(mClientSessionMutex);
+   ClientSessionMap::iterator it = mClientSessions.find(peer);
+   if (it != mClientSessions.end())
+   {
+      SSL_SESSION_free(it->second);
+      mClientSessions.erase(it);
+   }
+}
+
+void
+TlsBaseTransport::countHandshake(bool resumed)
+{
+   ++mHandshakes;
+   if (resumed)
+   {
+      ++mResumedHandshakes;
+   }
+}
+
+void
+TlsBaseTransport::addTlsCounts(UInt64& handshakes, UInt64& resumed) const
+{
+   handshakes += mHandshakes;
+   resumed += mResumedHandshakes;
+}
+
 Connection* 
 TlsBaseTransport::createConnection(const Tuple& who, Socket fd, bool server)
 {
@@ -10,7 +10,11 @@
 #include "resip/stack/SecurityTypes.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 #include "resip/stack/Compression.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/SelectInterruptor.hxx"
 
+#include <atomic>
+#include <map>
 #include <openssl/ssl.h>
 
 namespace resip
@@ -19,11 +23,19 @@ namespace resip
 class Connection;
 class Message;
 class Security;
+class TlsHandshakePool;
 
 class TlsBaseTransport : public TcpBaseTransport
 {
    public:
       RESIP_HeapCount(TlsBaseTransport);
+
+      /** Number of worker threads each TLS/WSS transport created afterwards
+          runs its handshakes on (see TlsHandshakePool). 0, the default,
+          runs them on the transport's own thread.
+      */
+      static unsigned int HandshakeThreads;
+
       TlsBaseTransport(Fifo<TransactionMessage>& fifo, 
                    int portNum, 
                    IpVersion version,
@@ -44,7 +56,14 @@ class TlsBaseTransport : public TcpBaseTransport
 
       void onReload();
 
+      virtual void process();
+      virtual void process(FdSet& fdset);
+      virtual void buildFdSet(FdSet& fdset);
+      virtual void setPollGrp(FdPollGrp *grp);
+
       SSL_CTX* getCtx();
+      /// 0 unless handshakes are run on worker threads
+      TlsHandshakePool* getHandshakePool() { return mHandshakePool; }
 
       SecurityTypes::TlsClientVerificationMode getClientVerificationMode() 
          { return mClientVerificationMode; };
@@ -76,8 +95,22 @@ class TlsBaseTransport : public TcpBaseTransport
          void *func,
          void *arg);
 
+      /** Offers the session last stored for peer (the target domain, or
+          address if there is none) on ssl, so an outbound connection can
+          resume instead of doing a full handshake.
+          @return true if there was a session to offer
+      */
+      bool resumeClientSession(SSL* ssl, const Data& peer);
+      /// takes over the caller's reference to session
+      void storeClientSession(const Data& peer, SSL_SESSION* session);
+      void forgetClientSession(const Data& peer);
+
+      void countHandshake(bool resumed);
+      virtual void addTlsCounts(UInt64& handshakes, UInt64& resumed) const;
+
    protected:
       Connection* createConnection(const Tuple& who, Socket fd, bool server=false);
+      void processHandshakeCompletions();
 
       Security* mSecurity;
       SecurityTypes::SSLType mSslType;
@@ -91,6 +124,23 @@ class TlsBaseTransport : public TcpBaseTransport
       const Data mPrivateKeyFilename;
       const Data mPrivateKeyPassPhrase;
       volatile bool mReloadCertificate;
+
+      // sessions of our outbound connections, by peer; one entry per peer
+      // is enough, and the limit only guards against a client that
+      // connects to a great many different addresses
+      static const size_t MaxClientSessions = 1024;
+      typedef std::map<Data, SSL_SESSION*> ClientSessionMap;
+      Mutex mClientSessionMutex;
+      ClientSessionMap mClientSessions;
+
+      std::atomic<UInt64> mHandshakes;
+      std::atomic<UInt64> mResumedHandshakes;
+
+      // the pool's workers wake our poll loop through this when a
+      // handshake step is done
+      SelectInterruptor mHandshakeInterruptor;
+      FdPollItemHandle mHandshakeInterruptorHandle;
+      TlsHandshakePool* mHandshakePool;
 };
 
 }
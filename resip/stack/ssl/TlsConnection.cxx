@@ -6,6 +6,7 @@
 
 #include "resip/stack/ssl/TlsConnection.hxx"
 #include "resip/stack/ssl/TlsTransport.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
 #include "resip/stack/ssl/Security.hxx"
 #include "rutil/Logger.hxx"
 #include "resip/stack/Uri.hxx"
@@ -125,6 +126,11 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
       }
       SSL_set_verify(mSsl, verify_mode, 0);
    }
+   else if (t->resumeClientSession(mSsl, sessionPeer()))
+   {
+      DebugLog( << "Offering cached TLS session for " << sessionPeer() );
+   }
+   SSL_set_app_data(mSsl, this);
 
    mBio = BIO_new_socket((int)fd,0/*close flag*/);
    if( !mBio )
@@ -137,6 +143,11 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
 
    mTlsState = Initial;
    mHandShakeWantsRead = false;
+   mHandshakeQueued = false;
+   mHandshakeRetry = false;
+   mHandshakeRet = 0;
+   mHandshakeErr = SSL_ERROR_NONE;
+   mHandshakeErrno = 0;
 
 #endif // USE_SSL   
 }
@@ -144,6 +155,12 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
 TlsConnection::~TlsConnection()
 {
 #if defined(USE_SSL)
+   if (mHandshakeQueued)
+   {
+      TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+      resip_assert(t && t->getHandshakePool());
+      t->getHandshakePool()->cancel(this);
+   }
    ERR_clear_error();
    int ret = SSL_shutdown(mSsl);
    if(ret < 0)
@@ -194,8 +211,14 @@ TlsConnection::checkState()
       return mTlsState;
    }
    
-   int ok=0;
-   
+   if (mHandshakeQueued)
+   {
+      // a worker has the SSL object; go again once it is done, as the
+      // socket may have become ready in the meantime
+      mHandshakeRetry = true;
+      return mTlsState;
+   }
+
    ERR_clear_error();
    
    if (mTlsState != Handshaking)
@@ -223,11 +246,95 @@ TlsConnection::checkState()
    }
 
    mHandShakeWantsRead = false;
-   ok = SSL_do_handshake(mSsl);
-      
+
+   TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+   resip_assert(t);
+   if (t->getHandshakePool())
+   {
+      mHandshakeQueued = true;
+      mHandshakeRetry = false;
+      // until the worker is done, a readable socket could only set
+      // mHandshakeRetry, and would keep waking the transport up for it
+      setReadable(false);
+      t->getHandshakePool()->submit(this);
+      return mTlsState;
+   }
+
+   handshakeStep();
+   return handshakeResult();
+#endif // USE_SSL   
+   return mTlsState;
+}
+
+void
+TlsConnection::handshakeStep()
+{
+#if defined(USE_SSL)
+   ERR_clear_error();
+   mHandshakeRet = SSL_do_handshake(mSsl);
+   mHandshakeErr = mHandshakeRet <= 0 ? SSL_get_error(mSsl, mHandshakeRet) : SSL_ERROR_NONE;
+   mHandshakeErrno = getErrno();
+   mHandshakeErrors.clear();
+   if (mHandshakeQueued && mHandshakeRet <= 0)
+   {
+      unsigned long code;
+      while ((code = ERR_get_error()) != 0)
+      {
+         char buf[256];
+         ERR_error_string_n(code, buf, sizeof(buf));
+         mHandshakeErrors.push_back(buf);
+      }
+   }
+#endif // USE_SSL   
+}
+
+void
+TlsConnection::logHandshakeErrors()
+{
+#if defined(USE_SSL)
+   if (mHandshakeErrors.empty())
+   {
+      handleOpenSSLErrorQueue(mHandshakeRet, mHandshakeErr, "SSL_do_handshake");
+      return;
+   }
+   for (std::vector<Data>::const_iterator it = mHandshakeErrors.begin(); it != mHandshakeErrors.end(); ++it)
+   {
+      ErrLog( << *it );
+   }
+   ErrLog( << "Got TLS SSL_do_handshake error=" << mHandshakeErr << " ret=" << mHandshakeRet );
+#endif // USE_SSL   
+}
+
+void
+TlsConnection::onHandshakeStepDone()
+{
+#if defined(USE_SSL)
+   resip_assert(mHandshakeQueued);
+   mHandshakeQueued = false;
+   setReadable(true);
+   if (handshakeResult() == Handshaking)
+   {
+      if (mHandshakeRetry)
+      {
+         checkState();
+      }
+      return;
+   }
+   // Up or Broken: the read path takes it from here, picking up anything
+   // the peer sent right behind its last handshake message, or closing
+   // the connection
+   performReads();
+#endif // USE_SSL   
+}
+
+TlsConnection::TlsState
+TlsConnection::handshakeResult()
+{
+#if defined(USE_SSL)
+   int ok = mHandshakeRet;
    if ( ok <= 0 )
    {
-      int err = SSL_get_error(mSsl,ok);
+      int err = mHandshakeErr;
          
       switch (err)
       {
@@ -262,7 +369,7 @@ TlsConnection::checkState()
          default:
             if(err == SSL_ERROR_SYSCALL)
             {
-               int e = getErrno();
+               int e = mHandshakeErrno;
                switch(e)
                {
                   case EINTR:
@@ -327,7 +434,13 @@ TlsConnection::checkState()
                DebugLog(<<"unrecognised/unhandled SSL_get_error result: " << err);
             }
             ErrLog( << "TLS handshake failed ");
-            handleOpenSSLErrorQueue(ok, err, "SSL_do_handshake");
+            logHandshakeErrors();
+            if (!mServer)
+            {
+               TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+               resip_assert(t);
+               t->forgetClientSession(sessionPeer());
+            }
             mBio = NULL;
             mTlsState = Broken;
             return mTlsState;
@@ -355,6 +468,9 @@ TlsConnection::checkState()
       }
       if(!matches)
       {
+         TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+         resip_assert(t);
+         t->forgetClientSession(sessionPeer());
          mTlsState = Broken;
          mBio = NULL;
          ErrLog (<< "Certificate name mismatch: trying to connect to <" 
@@ -366,7 +482,12 @@ TlsConnection::checkState()
       }
    }
 
-   InfoLog( << "TLS handshake done for peer " << getPeerNamesData()); 
+   bool resumed = SSL_session_reused(mSsl) != 0;
+   InfoLog( << "TLS handshake done for peer " << getPeerNamesData()
+            << (resumed ? " (session resumed)" : ""));
+   TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+   resip_assert(t);
+   t->countHandshake(resumed);
    mTlsState = Up;
    if (!mOutstandingSends.empty())
    {
@@ -376,6 +497,43 @@ TlsConnection::checkState()
    return mTlsState;
 }
 
+
+Data
+TlsConnection::sessionPeer()
+{
+   if (!who().getTargetDomain().empty())
+   {
+      return who().getTargetDomain();
+   }
+   Data peer(Tuple::inet_ntop(who()));
+   peer += ":";
+   peer += Data(who().getPort());
+   return peer;
+}
+
+int
+TlsConnection::onNewSession(SSL* ssl, SSL_SESSION* session)
+{
+#if defined(USE_SSL)
+   // the server side cache is OpenSSL's own
+   if (SSL_is_server(ssl))
+   {
+      return 0;
+   }
+   TlsConnection* conn = static_cast<TlsConnection*>(SSL_get_app_data(ssl));
+   if (!conn)
+   {
+      return 0;
+   }
+   TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(conn->transport());
+   resip_assert(t);
+   StackLog( << "Storing TLS session for " << conn->sessionPeer() );
+   t->storeClientSession(conn->sessionPeer(), session);
+   return 1;
+#else
+   return 0;
+#endif
+}
       
 int 
 TlsConnection::read(char* buf, int count )
@@ -494,8 +652,8 @@ TlsConnection::transportWrite()
          checkState();
          if (mTlsState == Handshaking)
          {
-            DebugLog(<< "Transportwrite--Handshaking--remove from write: " << mHandShakeWantsRead);
-            return mHandShakeWantsRead;
+            DebugLog(<< "Transportwrite--Handshaking--remove from write: " << mHandShakeWantsRead << " queued: " << mHandshakeQueued);
+            return mHandShakeWantsRead || mHandshakeQueued;
          }
          else
          {
@@ -632,7 +790,7 @@ TlsConnection::isWritable()
    switch(mTlsState)
    {
       case Handshaking:
-         return mHandShakeWantsRead ? false : true;
+         return (mHandShakeWantsRead || mHandshakeQueued) ? false : true;
       case Initial:
       case Up:
          return isGood();
@@ -22,6 +22,7 @@
 //#endif
 
 #include <openssl/ssl.h>
+#include <vector>
 
 namespace resip
 {
@@ -53,10 +54,25 @@ class TlsConnection : public Connection
       
       typedef enum TlsState { Initial, Broken, Handshaking, Up } TlsState;
       static const char * fromState(TlsState);
+
+      /// SSL_CTX_sess_set_new_cb callback, see TlsBaseTransport
+      static int onNewSession(SSL* ssl, SSL_SESSION* session);
+
+      /** Picks up after a handshake step run by the transport's
+          TlsHandshakePool. May delete this. */
+      void onHandshakeStepDone();
    
    private:
+      friend class TlsHandshakePool;
+
       /// No default c'tor
       TlsConnection();
+      /// one SSL_do_handshake(), possibly on a TlsHandshakePool worker
+      void handshakeStep();
+      TlsState handshakeResult();
+      void logHandshakeErrors();
+      /// key of this client connection in the transport's session store
+      Data sessionPeer();
       void computePeerName();
       Data getPeerNamesData() const;
       TlsState checkState();
@@ -69,6 +85,15 @@ class TlsConnection : public Connection
       TlsState mTlsState;
       bool mHandShakeWantsRead;
 
+      // handshakeStep() outcome; the OpenSSL error queue and errno are per
+      // thread, so a step on a worker keeps what handshakeResult() needs
+      bool mHandshakeQueued;
+      bool mHandshakeRetry;
+      int mHandshakeRet;
+      int mHandshakeErr;
+      int mHandshakeErrno;
+      std::vector<Data> mHandshakeErrors;
+
       SSL* mSsl;
       BIO* mBio;
       std::list<BaseSecurity::PeerName> mPeerNames;
@@ -0,0 +1,195 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#ifdef USE_SSL
+
+#include <algorithm>
+
+#include "rutil/AsyncProcessHandler.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ResipAssert.h"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
+#include "resip/stack/ssl/TlsConnection.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
+
+using namespace resip;
+
+TlsHandshakePool::TlsHandshakePool(unsigned int numThreads, AsyncProcessHandler& handler) :
+   mHandler(handler),
+   mShutdown(false)
+{
+   resip_assert(numThreads > 0);
+   for (unsigned int i = 0; i < numThreads; ++i)
+   {
+      mWorkers.push_back(new Worker(*this));
+      mWorkers.back()->run();
+   }
+   InfoLog(<< "TLS handshakes run on " << numThreads << " worker threads");
+}
+
+TlsHandshakePool::~TlsHandshakePool()
+{
+   {
+      Lock lock(mMutex);
+      mShutdown = true;
+      mWork.broadcast();
+   }
+   for (std::vector<Worker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it)
+   {
+      (*it)->shutdown();
+      (*it)->join();
+      delete *it;
+   }
+   resip_assert(mRunning.empty());
+
+   // the connections outlive us; make sure they do not come back
+   for (std::deque<TlsConnection*>::iterator it = mQueued.begin(); it != mQueued.end(); ++it)
+   {
+      (*it)->mHandshakeQueued = false;
+   }
+   for (std::deque<TlsConnection*>::iterator it = mCompleted.begin(); it != mCompleted.end(); ++it)
+   {
+      (*it)->mHandshakeQueued = false;
+   }
+}
+
+void
+TlsHandshakePool::submit(TlsConnection* conn)
+{
+   Lock lock(mMutex);
+   mQueued.push_back(conn);
+   mWork.signal();
+}
+
+TlsConnection*
+TlsHandshakePool::takeCompleted()
+{
+   Lock lock(mMutex);
+   if (mCompleted.empty())
+   {
+      return 0;
+   }
+   TlsConnection* conn = mCompleted.front();
+   mCompleted.pop_front();
+   return conn;
+}
+
+void
+TlsHandshakePool::cancel(TlsConnection* conn)
+{
+   Lock lock(mMutex);
+   remove(mQueued, conn);
+   while (isRunning(conn))
+   {
+      mStepDone.wait(mMutex);
+   }
+   remove(mCompleted, conn);
+}
+
+void
+TlsHandshakePool::work()
+{
+   while (true)
+   {
+      TlsConnection* conn;
+      {
+         Lock lock(mMutex);
+         while (mQueued.empty() && !mShutdown)
+         {
+            mWork.wait(mMutex);
+         }
+         if (mShutdown)
+         {
+            return;
+         }
+         conn = mQueued.front();
+         mQueued.pop_front();
+         mRunning.push_back(conn);
+      }
+
+      conn->handshakeStep();
+
+      bool wasIdle;
+      {
+         Lock lock(mMutex);
+         mRunning.erase(std::find(mRunning.begin(), mRunning.end(), conn));
+         wasIdle = mCompleted.empty();
+         mCompleted.push_back(conn);
+         mStepDone.broadcast();
+      }
+      if (wasIdle)
+      {
+         // otherwise the transport has yet to take the earlier ones, and
+         // will find this one with them
+         mHandler.handleProcessNotification();
+      }
+   }
+}
+
+bool
+TlsHandshakePool::isRunning(TlsConnection* conn) const
+{
+   return std::find(mRunning.begin(), mRunning.end(), conn) != mRunning.end();
+}
+
+void
+TlsHandshakePool::remove(std::deque<TlsConnection*>& queue, TlsConnection* conn)
+{
+   queue.erase(std::remove(queue.begin(), queue.end(), conn), queue.end());
+}
+
+#endif /* USE_SSL */
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
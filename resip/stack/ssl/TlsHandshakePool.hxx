@@ -0,0 +1,127 @@
+#if !defined(RESIP_TLSHANDSHAKEPOOL_HXX)
+#define RESIP_TLSHANDSHAKEPOOL_HXX
+
+#include <deque>
+#include <vector>
+
+#include "rutil/Mutex.hxx"
+#include "rutil/Condition.hxx"
+#include "rutil/ThreadIf.hxx"
+
+namespace resip
+{
+
+class AsyncProcessHandler;
+class TlsConnection;
+
+/**
+   @internal
+   Worker threads that run the SSL_do_handshake() steps of a TLS
+   transport's connections, so the certificate and key exchange crypto of
+   many concurrent handshakes does not hold up the transport thread.
+
+   The transport thread submit()s a connection whose handshake can make
+   progress; a worker runs one step and queues the connection as completed,
+   interrupting the transport's poll loop through handler if nothing was
+   completed yet. The transport thread then takes completed connections
+   one at a time and carries on with them. While a connection is submitted
+   nothing but the worker touches its SSL object.
+*/
+class TlsHandshakePool
+{
+   public:
+      TlsHandshakePool(unsigned int numThreads, AsyncProcessHandler& handler);
+      /// Waits for running steps; queued and completed ones are dropped.
+      ~TlsHandshakePool();
+
+      void submit(TlsConnection* conn);
+
+      /// @return the next connection whose step has finished, or 0
+      TlsConnection* takeCompleted();
+
+      /** Withdraws conn, waiting for its step if one is running. Called
+          by a connection that is going away while submitted. */
+      void cancel(TlsConnection* conn);
+
+   private:
+      class Worker : public ThreadIf
+      {
+         public:
+            Worker(TlsHandshakePool& pool) : mPool(pool) {}
+            virtual void thread() { mPool.work(); }
+         private:
+            TlsHandshakePool& mPool;
+      };
+
+      void work();
+      bool isRunning(TlsConnection* conn) const;
+      static void remove(std::deque<TlsConnection*>& queue, TlsConnection* conn);
+
+      AsyncProcessHandler& mHandler;
+      std::vector<Worker*> mWorkers;
+
+      Mutex mMutex;
+      Condition mWork;
+      Condition mStepDone;
+      std::deque<TlsConnection*> mQueued;
+      std::vector<TlsConnection*> mRunning;
+      std::deque<TlsConnection*> mCompleted;
+      bool mShutdown;
+
+      TlsHandshakePool(const TlsHandshakePool&);
+      TlsHandshakePool& operator=(const TlsHandshakePool&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -4,6 +4,7 @@
 #include "rutil/DataStream.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/ConnectionBase.hxx"
+#include "resip/stack/WsFrameExtractor.hxx"
 
 #include "resip/stack/Helper.hxx"
 #include "resip/stack/Uri.hxx"
@@ -124,6 +125,45 @@ class TestConnection : public ConnectionBase
       // Fifo<TransactionMessage>& mRxFifo;
 };
 
+// Goes through the WebSocket handshake, then reads frames in chunks that fit
+// the connection's buffer, as Connection::read() does
+class TestWsConnection : public ConnectionBase
+{
+   public:
+      TestWsConnection(Transport* transport,const Tuple& who, const Data& bytes) :
+         ConnectionBase(transport,who),
+         mTestStream(bytes),
+         mStreamPos(0)
+      {}
+
+      bool handshake(const Data& request)
+      {
+         std::pair<char*, size_t> writePair = getWriteBuffer();
+         assert(writePair.second >= request.size());
+         memcpy(writePair.first, request.data(), request.size());
+         bool dropConnection = false;
+         return wsProcessHandshake((int)request.size(), dropConnection);
+      }
+
+      bool read(unsigned int minChunkSize, unsigned int maxChunkSize)
+      {
+         std::pair<char*, size_t> writePair = getWriteBuffer();
+         unsigned int chunk = Random::getRandom() % maxChunkSize;
+         chunk = resipMax(chunk, minChunkSize);
+         chunk = resipMin(chunk, (unsigned int)(mTestStream.size() - mStreamPos));
+         chunk = resipMin(chunk, (unsigned int)writePair.second);
+         assert(chunk > 0);
+         memcpy(writePair.first, mTestStream.data() + mStreamPos, chunk);
+         mStreamPos += chunk;
+         assert(wsProcessData(chunk));
+         return mStreamPos != mTestStream.size();
+      }
+
+   private:
+      Data mTestStream;
+      unsigned int mStreamPos;
+};
+
 bool
 testTCPConnection()
 {
@@ -184,6 +224,159 @@ testTCPConnection()
    fake.flush();
    return testRxFifo.size() == runs * 3;
 }
+// message as frames of at most fragment bytes, masked as a client's are
+static Data
+wsFrames(const Data& message, Data::size_type fragment, bool masked)
+{
+   Data frames;
+   Data::size_type pos = 0;
+   do
+   {
+      Data::size_type len = resipMin(fragment, message.size() - pos);
+      UInt8 header[WsFrameExtractor::MaxUnmaskedHeaderLen];
+      size_t headerLen = WsFrameExtractor::makeFrameHeader(len, header);
+      if (pos > 0)
+      {
+         header[0] &= 0x80; // continuation
+      }
+      if (pos + len < message.size())
+      {
+         header[0] &= 0x7F; // not final
+      }
+      if (masked)
+      {
+         header[1] |= 0x80;
+      }
+      frames.append((const char*)header, (Data::size_type)headerLen);
+      UInt8 key[4] = { (UInt8)Random::getRandom(), (UInt8)Random::getRandom(),
+                       (UInt8)Random::getRandom(), (UInt8)Random::getRandom() };
+      if (masked)
+      {
+         frames.append((const char*)key, 4);
+      }
+      for (Data::size_type i = 0; i < len; i++)
+      {
+         frames += (char)(masked ? message[pos + i] ^ key[i & 3] : message[pos + i]);
+      }
+      pos += len;
+   } while (pos < message.size());
+   return frames;
+}
+
+bool
+testWsUnmask()
+{
+   // against the plain byte by byte XOR, at every alignment, and moving
+   // bytes down over a frame header as the extractor does
+   const UInt8 key[4] = { 0x12, 0x9a, 0x5e, 0xf1 };
+   char src[300];
+   for (unsigned int i = 0; i < sizeof(src); i++)
+   {
+      src[i] = (char)(i * 7);
+   }
+   for (unsigned int keyPos = 0; keyPos < 4; keyPos++)
+   {
+      for (unsigned int len = 0; len < 100; len += 3)
+      {
+         for (unsigned int gap = 0; gap < 15; gap += 7)
+         {
+            char buffer[300];
+            memcpy(buffer, src, sizeof(src));
+            WsFrameExtractor::unmask(buffer + 1, buffer + 1 + gap, len, key, keyPos);
+            for (unsigned int i = 0; i < len; i++)
+            {
+               if (buffer[1 + i] != (char)(src[1 + gap + i] ^ key[(keyPos + i) & 3]))
+               {
+                  return false;
+               }
+            }
+         }
+      }
+   }
+   return true;
+}
+
+bool
+testWSConnection()
+{
+   Data invite("INVITE sip:192.168.2.92:5100;q=1 SIP/2.0\r\n"
+         "To: <sip:yiwen_AT_meet2talk.com@whistler.gloo.net>\r\n"
+         "From: Jason Fischl<sip:jason_AT_meet2talk.com@whistler.gloo.net>;tag=ba1aee2d\r\n"
+         "Via: SIP/2.0/WS 192.168.2.15:5100;branch=z9hG4bK-c87542-579667358-1--c87542-;rport=5100;received=192.168.2.15\r\n"
+         "Call-ID: 6c64b42fce01b007\r\n"
+         "CSeq: 2 INVITE\r\n"
+         "Contact: <sip:192.168.2.15:5100;transport=ws>\r\n"
+         "Max-Forwards: 70\r\n"
+         "Content-Length: 0\r\n"
+         "\r\n");
+   // big enough for a 64 bit length, and to outgrow the buffer
+   Data body(70000, Data::Preallocate);
+   for (int i = 0; i < 70000; i++)
+   {
+      body += (char)('a' + i % 26);
+   }
+   Data message("MESSAGE sip:yiwen@192.168.2.92 SIP/2.0\r\n"
+         "To: <sip:yiwen@192.168.2.92>\r\n"
+         "From: <sip:jason@192.168.2.15>;tag=ba1aee2d\r\n"
+         "Via: SIP/2.0/WS 192.168.2.15:5100;branch=z9hG4bK-c87542-579667358-2--c87542-\r\n"
+         "Call-ID: 6c64b42fce01b008\r\n"
+         "CSeq: 1 MESSAGE\r\n"
+         "Max-Forwards: 70\r\n"
+         "Content-Type: text/plain\r\n"
+         "Content-Length: 70000\r\n"
+         "\r\n" + body);
+   Data handshake("GET / HTTP/1.1\r\n"
+         "Host: 192.168.2.92\r\n"
+         "Upgrade: websocket\r\n"
+         "Connection: Upgrade\r\n"
+         "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+         "Sec-WebSocket-Protocol: sip\r\n"
+         "Sec-WebSocket-Version: 13\r\n"
+         "\r\n");
+
+   Fifo<TransactionMessage> testRxFifo;
+   FakeWSTransport fake(testRxFifo, 5060, V4, Data::Empty);
+   Tuple who(fake.getTuple());
+
+   unsigned int runs = 100;
+   unsigned int received = 0;
+   for (unsigned int i=0; i < runs; i++)
+   {
+      // unmasked now and then, and in fragments of every size down to one byte
+      bool masked = (i % 10) != 0;
+      Data::size_type fragment = (Random::getRandom() % 3000) + 1;
+      Data bytes(wsFrames(invite, fragment, masked) +
+                 wsFrames("\r\n\r\n", 4, masked) + // keepalive
+                 wsFrames(message, (i % 2) ? fragment : message.size(), masked) +
+                 wsFrames(invite, fragment, masked));
+
+      TestWsConnection cBase(&fake, who, bytes);
+      assert(cBase.handshake(handshake));
+      int minChunk = (Random::getRandom() % 700)+1;
+      int maxChunk = (Random::getRandom() % 20000)+1;
+      if (maxChunk < minChunk) swap(maxChunk, minChunk);
+      while(cBase.read(minChunk, maxChunk));
+
+      fake.flush();
+      while (testRxFifo.messageAvailable())
+      {
+         std::unique_ptr<TransactionMessage> msg(testRxFifo.getNext());
+         SipMessage* sip = dynamic_cast<SipMessage*>(msg.get());
+         if (sip)
+         {
+            received++;
+            if (sip->method() == MESSAGE && (!sip->getContents() ||
+                sip->getContents()->getBodyData() != body))
+            {
+               cerr << "MESSAGE body mangled" << endl;
+               return false;
+            }
+         }
+      }
+   }
+   return received == runs * 3;
+}
+
 int
 main(int argc, char** argv)
 {
@@ -192,6 +385,12 @@ main(int argc, char** argv)
    assert(testTCPConnection());
    cerr << "testTCPConnection OK" << endl; 
 
+   assert(testWsUnmask());
+   cerr << "testWsUnmask OK" << endl;
+
+   assert(testWSConnection());
+   cerr << "testWSConnection OK" << endl;
+
    cerr << "ALL OK" << endl;
    return 0;
 }
@@ -2,23 +2,16 @@
 #include "config.h"
 #endif
 
-#if defined (HAVE_POPT_H) 
-#include <popt.h>
-#else
-#ifndef WIN32
-#warning "will not work very well without libpopt"
-#endif
-#endif
-
 #include <sys/types.h>
 #include <iostream>
 #include <memory>
 
 #include <fstream>
 
-#include "rutil/socket.hxx"
+#include "rutil/Socket.hxx"
 #include "rutil/Data.hxx"
 #include "rutil/DnsUtil.hxx"
+#include "rutil/Timer.hxx"
 #include "resip/stack/DnsInterface.hxx"
 #include "rutil/dns/QueryTypes.hxx"
 #include "rutil/dns/RROverlay.hxx"
@@ -219,10 +212,118 @@ void MyDnsSink::onDnsResult(const DNSResult<DnsAAAARecord>& result)
 #endif
 
 
+static Data
+benchName(int i, bool upper)
+{
+   Data name("host" + Data(i) + ".Example.COM");
+   if (upper)
+   {
+      name.uppercase();
+   }
+   return name;
+}
+
+// Exercises the cache on its own, without any DNS traffic: fills it with
+// host records, checks that lookups hit regardless of case and that LRU
+// eviction keeps it bounded, and times hits and misses.
+static int
+benchmark(int entries, int runs)
+{
+   RRCache cache;
+   cache.setSize(entries + 1);
+   in_addr addr;
+   addr.s_addr = htonl(0x0a000001);
+   for (int i = 0; i < entries; ++i)
+   {
+      cache.updateCacheFromHostFile(DnsHostRecord(benchName(i, false), addr));
+   }
+
+   RRCache::Result records;
+   int status = 0;
+   for (int i = 0; i < entries; ++i)
+   {
+      if (!cache.lookup(benchName(i, true), T_A, Protocol::Sip, records, status) ||
+          records.size() != 1 || status != 0)
+      {
+         cerr << "FAILED: lookup of " << benchName(i, true) << endl;
+         return -1;
+      }
+   }
+   if (cache.lookup(benchName(entries, false), T_A, Protocol::Sip, records, status) ||
+       cache.lookup(benchName(0, false), T_SRV, Protocol::Sip, records, status))
+   {
+      cerr << "FAILED: lookup of a name not in the cache" << endl;
+      return -1;
+   }
+
+   std::vector<Data> names;
+   for (int i = 0; i < entries * 2; ++i)
+   {
+      names.push_back(benchName(i, (i & 1) != 0));
+   }
+
+   UInt64 start = Timer::getTimeMicroSec();
+   int hits = 0;
+   for (int r = 0; r < runs; ++r)
+   {
+      for (int i = 0; i < entries; ++i)
+      {
+         hits += cache.lookup(names[i], T_A, Protocol::Sip, records, status);
+      }
+   }
+   UInt64 hitTime = Timer::getTimeMicroSec() - start;
+
+   start = Timer::getTimeMicroSec();
+   for (int r = 0; r < runs; ++r)
+   {
+      for (int i = entries; i < entries * 2; ++i)
+      {
+         hits += cache.lookup(names[i], T_A, Protocol::Sip, records, status);
+      }
+   }
+   UInt64 missTime = Timer::getTimeMicroSec() - start;
+
+   if (hits != entries * runs)
+   {
+      cerr << "FAILED: " << hits << " hits, expected " << entries * runs << endl;
+      return -1;
+   }
+
+   double lookups = (double)entries * runs;
+   cout << entries << " entries: hit " << hitTime * 1000.0 / lookups << " ns, miss "
+        << missTime * 1000.0 / lookups << " ns per lookup" << endl;
+
+   // a full cache evicts its least recently used entries
+   cache.setSize(entries / 2);
+   for (int i = entries; i < entries * 2; ++i)
+   {
+      cache.updateCacheFromHostFile(DnsHostRecord(names[i], addr));
+   }
+   for (int i = 0; i < entries * 2; ++i)
+   {
+      bool expected = i >= entries * 2 - entries / 2 + 1;
+      if (cache.lookup(names[i], T_A, Protocol::Sip, records, status) != expected)
+      {
+         cerr << "FAILED: eviction of " << names[i] << endl;
+         return -1;
+      }
+   }
+
+   return 0;
+}
+
 // NOTE: In order to run this test, you need to uncomment out the USE_LOCAL_DNS define in
 // ExternalDnsFactory.cxx.
-main(int argc, char* argv[])
+// With -bench [entries [runs]] it only benchmarks the cache, which needs no DNS.
+int main(int argc, char* argv[])
 {
+   if (argc > 1 && Data(argv[1]) == "-bench")
+   {
+      int entries = argc > 2 ? atoi(argv[2]) : 10000;
+      int runs = argc > 3 ? atoi(argv[3]) : 100;
+      return benchmark(entries, runs);
+   }
+
    {
       const char* const key = "yahoo.com";
       MyDnsSink sink;
@@ -0,0 +1,230 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+// Forwards a received request the way repro does, by sending a copy of it
+// made with SipMessage::ShareReceiveBuffers, and checks that the copy still
+// goes out straight from the original's receive buffers.
+
+#include <iostream>
+#include <memory>
+
+#ifndef WIN32
+#include <sys/select.h>
+#endif
+
+#include "resip/stack/EventStackThread.hxx"
+#include "resip/stack/GatherData.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "resip/stack/SipStack.hxx"
+#include "resip/stack/Transport.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/FdPoll.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/Socket.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+const int StackPort = 17230;
+
+// sees the message TransportSelector encodes: the copy that was sent
+class CopyCheck : public Transport::SipMessageLoggingHandler
+{
+   public:
+      CopyCheck() : mSeen(false), mShared(false) {}
+
+      virtual void outboundMessage(const Tuple& source, const Tuple& destination, const SipMessage& msg)
+      {
+         Lock lock(mMutex);
+         if (mSeen)
+         {
+            return;
+         }
+         mSeen = true;
+         // the body was never parsed, so it should still be where it was received
+         const HeaderFieldValue& body = msg.getRawBody();
+         mShared = msg.getReceiveBuffers() &&
+                   msg.getReceiveBuffers()->contains(body.getBuffer(), body.getLength());
+         DataStream str(mEncoded);
+         msg.encode(str);
+      }
+      virtual void inboundMessage(const Tuple& source, const Tuple& destination, const SipMessage& msg) {}
+
+      Mutex mMutex;
+      bool mSeen;
+      bool mShared;
+      Data mEncoded;
+};
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+   initNetwork();
+
+   // the next hop is a plain UDP socket
+   Socket sink = ::socket(AF_INET, SOCK_DGRAM, 0);
+   sockaddr_in sinkAddr;
+   memset(&sinkAddr, 0, sizeof(sinkAddr));
+   sinkAddr.sin_family = AF_INET;
+   sinkAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   socklen_t sinkAddrLen = sizeof(sinkAddr);
+   if (sink == INVALID_SOCKET ||
+       ::bind(sink, (sockaddr*)&sinkAddr, sizeof(sinkAddr)) != 0 ||
+       ::getsockname(sink, (sockaddr*)&sinkAddr, &sinkAddrLen) != 0)
+   {
+      cerr << "cannot bind the next hop socket" << endl;
+      return 1;
+   }
+   const int sinkPort = ntohs(sinkAddr.sin_port);
+
+   FdPollGrp* pollGrp = FdPollGrp::create("event");
+   EventThreadInterruptor* intr = new EventThreadInterruptor(*pollGrp);
+   SipStackOptions options;
+   options.mAsyncProcessHandler = intr;
+   options.mPollGrp = pollGrp;
+   SipStack* stack = new SipStack(options);
+   Transport* udp = stack->addTransport(UDP, StackPort, V4, StunDisabled, "127.0.0.1");
+   std::shared_ptr<CopyCheck> check = std::make_shared<CopyCheck>();
+   udp->setSipMessageLoggingHandler(check);
+   EventStackThread* thread = new EventStackThread(*stack, *intr, *pollGrp);
+   thread->run();
+
+   const Data body("v=0\r\n"
+                   "o=alice 2890844526 2890844526 IN IP4 192.0.2.10\r\n"
+                   "s=-\r\n"
+                   "c=IN IP4 192.0.2.10\r\n"
+                   "t=0 0\r\n"
+                   "m=audio 49170 RTP/AVP 0 8 97\r\n"
+                   "a=rtpmap:0 PCMU/8000\r\n"
+                   "a=rtpmap:8 PCMA/8000\r\n"
+                   "a=rtpmap:97 iLBC/8000\r\n");
+   const Data txt("INVITE sip:bob@127.0.0.1:" + Data(sinkPort) + " SIP/2.0\r\n"
+                  "Via: SIP/2.0/UDP 192.0.2.10:5060;branch=z9hG4bK-524287-1---a84b4c76e66710\r\n"
+                  "Max-Forwards: 70\r\n"
+                  "To: <sip:bob@example.com>\r\n"
+                  "From: Alice <sip:alice@example.com>;tag=1928301774\r\n"
+                  "Call-ID: a84b4c76e66710@192.0.2.10\r\n"
+                  "CSeq: 314159 INVITE\r\n"
+                  "Contact: <sip:alice@192.0.2.10:5060>\r\n"
+                  "User-Agent: testForwardGather, with a header value long enough to be sent in place\r\n"
+                  "Content-Type: application/sdp\r\n"
+                  "Content-Length: " + Data(body.size()) + "\r\n"
+                  "\r\n" + body);
+
+   {
+      // as a proxy forwards it
+      std::unique_ptr<SipMessage> msg(SipMessage::make(txt));
+      assert(msg.get());
+      msg->header(h_MaxForwards).value()--;
+      msg->header(h_Vias).push_front(Via());
+      stack->send(std::unique_ptr<SipMessage>(new SipMessage(*msg, SipMessage::ShareReceiveBuffers)));
+      // the copy has to keep the receive buffers alive without this
+   }
+
+   bool ok = false;
+   fd_set fds;
+   FD_ZERO(&fds);
+   FD_SET(sink, &fds);
+   timeval timeout = { 5, 0 };
+   char datagram[8192];
+   int len = -1;
+   if (::select((int)sink + 1, &fds, 0, 0, &timeout) == 1)
+   {
+      len = (int)::recv(sink, datagram, sizeof(datagram), 0);
+   }
+   if (len <= 0)
+   {
+      cerr << "nothing was forwarded" << endl;
+   }
+   else
+   {
+      Lock lock(check->mMutex);
+      Data received(datagram, len);
+      if (!check->mShared)
+      {
+         cerr << "the forwarded copy does not share the receive buffers" << endl;
+      }
+      else if (received != check->mEncoded)
+      {
+         cerr << "sent" << endl << received << endl << "but encoded" << endl << check->mEncoded << endl;
+      }
+      else if (received.find(body) == Data::npos || received.find("Max-Forwards: 69\r\n") == Data::npos)
+      {
+         cerr << "forwarded the wrong message" << endl << received << endl;
+      }
+      else
+      {
+         ok = true;
+      }
+   }
+
+   thread->shutdown();
+   thread->join();
+   stack->shutdownAndJoinThreads();
+   delete thread;
+   delete stack;
+   delete intr;
+   delete pollGrp;
+   closeSocket(sink);
+
+   if (!ok)
+   {
+      return 1;
+   }
+   cout << "ALL OK" << endl;
+   return 0;
+}
+
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ */
@@ -0,0 +1,226 @@
+#include "resip/stack/MsgHeaderScanner.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "rutil/BaseException.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/FileSystem.hxx"
+#include "rutil/Timer.hxx"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace resip;
+using namespace std;
+
+// Checks that MsgHeaderScanner's vector scan splits every message in the
+// .dat corpus exactly as the character-at-a-time scan does, whole and in
+// small chunks, then measures scanner throughput with each.
+//
+// Usage: testMsgHeaderScanner [-r <runs over the corpus>] [<corpus dir>]
+// The corpus dir defaults to $srcdir, or the current directory.
+
+struct ScanResult
+{
+   MsgHeaderScanner::ScanChunkResult result;
+   size_t offset; // of the unprocessed or erroneous character
+   unsigned int headers;
+   Data encoded;
+};
+
+static ScanResult
+scan(const Data& text, size_t chunkSize)
+{
+   ScanResult r;
+   char* buffer = MsgHeaderScanner::allocateBuffer((int)text.size());
+   memcpy(buffer, text.data(), text.size());
+   char* end = buffer + text.size();
+
+   SipMessage msg;
+   MsgHeaderScanner scanner;
+   scanner.prepareForMessage(&msg);
+   char* chunk = buffer;
+   char* chunkEnd = buffer;
+   char* unprocessed = 0;
+   do
+   {
+      chunkEnd = (size_t)(end - chunkEnd) > chunkSize ? chunkEnd + chunkSize : end;
+      try
+      {
+         r.result = scanner.scanChunk(chunk, (unsigned int)(chunkEnd - chunk), &unprocessed);
+      }
+      catch (BaseException& e)
+      {
+         r.result = MsgHeaderScanner::scrError;
+         unprocessed = chunkEnd;
+         r.encoded = e.getMessage();
+         break;
+      }
+      // as a stream transport does, carry the incomplete text unit over
+      chunk = unprocessed;
+   }
+   while (r.result == MsgHeaderScanner::scrNextChunk && chunkEnd != end);
+
+   r.offset = unprocessed - buffer;
+   r.headers = scanner.getHeaderCount();
+   if (r.result == MsgHeaderScanner::scrEnd)
+   {
+      DataStream str(r.encoded);
+      msg.encode(str);
+   }
+   delete [] buffer;
+   return r;
+}
+
+static void
+check(const Data& name, const Data& text)
+{
+   const size_t chunkSizes[] = { 1, 7, 64, 0x7fffffff };
+   for (size_t i = 0; i < sizeof(chunkSizes)/sizeof(*chunkSizes); ++i)
+   {
+      MsgHeaderScanner::setVectorScan(false);
+      ScanResult expected = scan(text, chunkSizes[i]);
+      MsgHeaderScanner::setVectorScan(true);
+      ScanResult got = scan(text, chunkSizes[i]);
+      if (got.result != expected.result ||
+          got.offset != expected.offset ||
+          got.headers != expected.headers ||
+          got.encoded != expected.encoded)
+      {
+         cerr << name << " (chunks of " << chunkSizes[i] << "): vector scan gave "
+              << got.result << "@" << got.offset << " with " << got.headers
+              << " headers, scalar scan gave " << expected.result << "@"
+              << expected.offset << " with " << expected.headers << " headers"
+              << endl;
+         assert(0);
+      }
+   }
+}
+
+static void
+measure(const vector<Data>& corpus, size_t bytes, int runs, bool vectorScan)
+{
+   MsgHeaderScanner::setVectorScan(vectorScan);
+   UInt64 start = Timer::getTimeMicroSec();
+   for (int run = 0; run < runs; ++run)
+   {
+      for (vector<Data>::const_iterator i = corpus.begin(); i != corpus.end(); ++i)
+      {
+         char* buffer = MsgHeaderScanner::allocateBuffer((int)i->size());
+         memcpy(buffer, i->data(), i->size());
+         SipMessage* msg = new SipMessage;
+         msg->addBuffer(buffer, i->size());
+         MsgHeaderScanner scanner;
+         scanner.prepareForMessage(msg);
+         char* unprocessed;
+         try
+         {
+            scanner.scanChunk(buffer, (unsigned int)i->size(), &unprocessed);
+         }
+         catch (BaseException&)
+         {
+         }
+         delete msg;
+      }
+   }
+   UInt64 elapsed = Timer::getTimeMicroSec() - start;
+   if (elapsed == 0)
+   {
+      elapsed = 1;
+   }
+   cerr << (vectorScan ? MsgHeaderScanner::vectorScanName() : "scalar") << ": "
+        << (double)bytes * runs / elapsed << " MB/s, "
+        << (double)corpus.size() * runs * 1000000 / elapsed << " msgs/s" << endl;
+}
+
+int
+main(int argc, char* argv[])
+{
+   int runs = 1000;
+   Data dir(getenv("srcdir") ? getenv("srcdir") : ".");
+   for (int i = 1; i < argc; ++i)
+   {
+      if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      {
+         runs = atoi(argv[++i]);
+      }
+      else
+      {
+         dir = argv[i];
+      }
+   }
+
+   vector<Data> corpus;
+   size_t bytes = 0;
+   FileSystem::Directory files(dir);
+   for (FileSystem::Directory::iterator i = files.begin(); i != files.end(); ++i)
+   {
+      if (i->postfix(".dat"))
+      {
+         Data text(Data::fromFile(dir + "/" + *i));
+         check(*i, text);
+         corpus.push_back(text);
+         bytes += text.size();
+      }
+   }
+   cerr << "Scanned " << corpus.size() << " messages (" << bytes
+        << " bytes) from " << dir << " both ways" << endl;
+   assert(!corpus.empty());
+
+   measure(corpus, bytes, runs, false);
+   measure(corpus, bytes, runs, true);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
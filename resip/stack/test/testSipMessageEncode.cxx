@@ -3,8 +3,11 @@
 #endif
 
 
+#include "resip/stack/GatherData.hxx"
 #include "resip/stack/SipMessage.hxx"
+#include "rutil/DataStream.hxx"
 #include <fstream>
+#include <memory>
 #include <string>
 
 using namespace resip;
@@ -14,16 +17,59 @@ class Args
 {
 public:
 
-	Args(void):runs(100000),runFs(false),runDs(true)
+	Args(void):runs(100000),runFs(false),runDs(true),runGs(true)
 	{}
 
 	int runs;
 	bool runFs;
 	bool runDs;
+	bool runGs;
 };
 
 void processArgs(int argc, char* argv[],Args &args);
 
+// The gather encoding must produce exactly the bytes the stream encoding does,
+// and send at least mustReference of them straight from the receive buffers
+bool checkGather(const SipMessage& msg, const char* what, size_t mustReference)
+{
+	Data flat;
+	{
+		DataStream str(flat);
+		msg.encode(str);
+	}
+
+	GatherData gather(msg.getReceiveBuffers(), 1024);
+	{
+		oGatherStream str(gather);
+		msg.encode(str);
+	}
+
+	if( gather.flatten() != flat || gather.size() != flat.size() )
+	{
+		cout << "\r\nError: gather encoding differs (" << what << ")\r\n";
+		return false;
+	}
+
+	size_t referenced = 0;
+	for( int i=0; i<gather.count(); i++ )
+	{
+		const char* base = (const char*)gather.segments()[i].iov_base;
+		size_t len = gather.segments()[i].iov_len;
+		if( msg.getReceiveBuffers() && msg.getReceiveBuffers()->contains(base, len) )
+		{
+			referenced += len;
+		}
+	}
+	cout << "Gather encoding (" << what << "): " << gather.count() << " segments, "
+		<< referenced << " of " << gather.size() << " bytes referenced in place\r\n";
+	if( referenced < mustReference )
+	{
+		cout << "\r\nError: expected at least " << mustReference << " bytes referenced in place\r\n";
+		return false;
+	}
+	return true;
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -31,7 +77,7 @@ main(int argc, char* argv[])
 
 	cout << "\r\n------------------------------------------------------\r\n";
 	cout << "Resiprocate resip::SipMessage encoder speed test rev 1.0\r\n";
-	cout << "Args: [-r <number of runs>] [-runfs=(yes|no)] [-runds=(yes|no)]\r\n";
+	cout << "Args: [-r <number of runs>] [-runfs=(yes|no)] [-runds=(yes|no)] [-rungs=(yes|no)]\r\n";
 	cout << "Example: -r 100000 -runfs=yes -runds=no\r\n";
 	cout << "------------------------------------------------------------\r\n";
 
@@ -73,6 +119,36 @@ main(int argc, char* argv[])
 		return -1;
 	}
 
+	const size_t bodySize = msg->getRawBody().getLength();
+	if( !checkGather(*msg, "as received", bodySize) )
+	{
+		return -1;
+	}
+	{
+		// a plain copy owns all of its data
+		std::unique_ptr<SipMessage> clone(static_cast<SipMessage*>(msg->clone()));
+		if( clone->getReceiveBuffers() || !checkGather(*clone, "clone", 0) )
+		{
+			cout << "\r\nError: a plain copy refers to the receive buffers\r\n";
+			return -1;
+		}
+		// a forwarded copy shares the receive buffers of the original, so
+		// whatever it leaves alone is still sent from there; a modified
+		// header has to be rendered
+		SipMessage copy(*msg, SipMessage::ShareReceiveBuffers);
+		copy.header(h_Vias).front().param(p_received) = "10.0.0.1";
+		if( !checkGather(copy, "forwarded copy", bodySize) )
+		{
+			return -1;
+		}
+		msg->header(h_MaxForwards).value()--;
+		msg->header(h_Vias).front().param(p_received) = "10.0.0.1";
+		if( !checkGather(*msg, "modified", bodySize) )
+		{
+			return -1;
+		}
+	}
+
 	cout << "\r\nRunning SipMsg Encoder Speed test\r\n";
 #ifdef RESIP_USE_STL_STREAMS
 	cout << "USING STL STREAMS\r\n";
@@ -127,6 +203,23 @@ main(int argc, char* argv[])
 		cout << "\r\nOutput to resip::DataStream completed, elapsed time= " << secs << " seconds.\r\n";
 	}
 
+	if( args.runGs )
+	{
+		cout << "\r\nOutput to resip::GatherData, runs = " << args.runs << ", ...\r\n";
+
+		startTime = Timer::getTimeMs();
+		for(int i=0; i<args.runs; i++)
+		{
+			GatherData gather(msg->getReceiveBuffers(), 1024);
+			oGatherStream str(gather);
+			msg->encode(str);
+		}
+		elapsed = Timer::getTimeMs() - startTime;
+		secs = ((double) elapsed / 1000.0);
+
+		cout << "\r\nOutput to resip::GatherData completed, elapsed time= " << secs << " seconds.\r\n";
+	}
+
 	cout << "Test complete.\r\n";
 
 	return 0;
@@ -170,6 +263,17 @@ void processArgs(int argc, char* argv[],Args &args)
 				args.runFs = false;
 			}
 		}
+		else if( arg.substr(0,7) == "-rungs=" )
+		{
+			if( arg.substr(7) == "yes" )
+			{
+				args.runGs = true;
+			}
+			else
+			{
+				args.runGs = false;
+			}
+		}
 		else if( arg.substr(0,7) == "-runds=" )
 		{
 			if( arg.substr(7) == "yes" )
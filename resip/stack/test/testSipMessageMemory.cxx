@@ -1,13 +1,162 @@
+#include "resip/stack/MsgHeaderScanner.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/Uri.hxx"
 #include "resip/stack/test/TestSupport.hxx"
+#include "rutil/Fifo.hxx"
+#include "rutil/SlabAllocator.hxx"
+#include "rutil/ThreadIf.hxx"
 
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <new>
 
 using namespace resip;
 using namespace std;
 
+// Count what reaches the global heap while a measurement is running
+static std::atomic<bool> counting(false);
+static std::atomic<unsigned long> heapAllocs(0);
+static std::atomic<unsigned long> heapBytes(0);
+
+void* operator new(size_t size)
+{
+   if (counting.load(std::memory_order_relaxed))
+   {
+      ++heapAllocs;
+      heapBytes += size;
+   }
+   void* p = malloc(size ? size : 1);
+   if (!p)
+   {
+      throw std::bad_alloc();
+   }
+   return p;
+}
+
+void operator delete(void* p) noexcept
+{
+   free(p);
+}
+
+void* operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void operator delete[](void* p) noexcept
+{
+   free(p);
+}
+
+// What a UDP transport does with a datagram
+static SipMessage*
+receive(const Data& datagram)
+{
+   char* buffer = MsgHeaderScanner::allocateSlabBuffer((int)datagram.size());
+   memcpy(buffer, datagram.data(), datagram.size());
+
+   SipMessage* msg = new SipMessage(0);
+   msg->addSlabBuffer(buffer, datagram.size());
+   MsgHeaderScanner scanner;
+   scanner.prepareForMessage(msg);
+   char* unprocessed;
+   if (scanner.scanChunk(buffer, (unsigned int)datagram.size(), &unprocessed) != MsgHeaderScanner::scrEnd)
+   {
+      delete msg;
+      return 0;
+   }
+   const char* body = buffer + (unprocessed - buffer);
+   msg->setBody(body, (UInt32)(datagram.size() - (body - buffer)));
+   return msg;
+}
+
+// What the stack and a proxy TU do with it afterwards
+static void
+handle(SipMessage& msg)
+{
+   msg.header(h_Vias).front().param(p_received) = "10.0.0.1";
+   msg.header(h_MaxForwards).value()--;
+   msg.header(h_RecordRoutes).push_front(NameAddr("<sip:proxy.example.com;lr>"));
+   msg.getContents();
+}
+
+// Deletes messages handed over by another thread, like the TU does with
+// messages the transports made
+class Deleter : public ThreadIf
+{
+   public:
+      void thread()
+      {
+         while (!isShutdown())
+         {
+            SipMessage* msg = mFifo.getNext(100);
+            if (msg)
+            {
+               delete msg;
+            }
+         }
+         while (mFifo.messageAvailable())
+         {
+            delete mFifo.getNext();
+         }
+      }
+      Fifo<SipMessage> mFifo;
+};
+
+static void
+measure(const Data& datagram, bool slab, bool crossThread, int runs)
+{
+   SlabAllocator::setEnabled(slab);
+   Deleter deleter;
+   if (crossThread)
+   {
+      deleter.run();
+   }
+
+   // warm up the caches, then count
+   for (int pass = 0; pass < 2; ++pass)
+   {
+      heapAllocs = 0;
+      heapBytes = 0;
+      counting = (pass == 1);
+      for (int i = 0; i < runs; ++i)
+      {
+         SipMessage* msg = receive(datagram);
+         assert(msg);
+         handle(*msg);
+         if (crossThread)
+         {
+            deleter.mFifo.add(msg);
+         }
+         else
+         {
+            delete msg;
+         }
+      }
+      counting = false;
+      if (crossThread)
+      {
+         // let the other thread catch up so the next pass can reuse blocks
+         while (deleter.mFifo.messageAvailable())
+         {
+            sleepMs(1);
+         }
+      }
+   }
+
+   if (crossThread)
+   {
+      deleter.shutdown();
+      deleter.join();
+   }
+
+   resipCerr << (slab ? "slab on, " : "slab off, ") << (crossThread ? "freed by another thread: " : "freed by same thread: ")
+             << (double)heapAllocs/runs << " heap allocations and "
+             << heapBytes/runs << " heap bytes per message" << endl;
+}
+
 int
 main()
 {
@@ -69,6 +218,54 @@ main()
       assert(message1->getRawHeader(Headers::CSeq)->getParserContainer());
    }
 
+   {
+      resipCerr << "Testing heap use per message" << endl;
+
+      // big enough to overflow the SipMessage's DinkyPool once handled
+      Data invite("INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+                  "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bKnashds8\r\n"
+                  "Via: SIP/2.0/UDP edge.atlanta.example.com;branch=z9hG4bK77ef4c2312983.1\r\n"
+                  "Max-Forwards: 70\r\n"
+                  "Record-Route: <sip:edge.atlanta.example.com;lr>\r\n"
+                  "To: Bob <sip:bob@biloxi.example.com>\r\n"
+                  "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+                  "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+                  "CSeq: 314159 INVITE\r\n"
+                  "Contact: <sip:alice@pc33.atlanta.example.com>\r\n"
+                  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO, UPDATE\r\n"
+                  "Supported: replaces, timer, 100rel\r\n"
+                  "User-Agent: testSipMessageMemory\r\n"
+                  "Content-Type: application/sdp\r\n"
+                  "Content-Length: 303\r\n"
+                  "\r\n"
+                  "v=0\r\n"
+                  "o=alice 2890844526 2890844526 IN IP4 pc33.atlanta.example.com\r\n"
+                  "s=-\r\n"
+                  "c=IN IP4 192.0.2.101\r\n"
+                  "t=0 0\r\n"
+                  "m=audio 49172 RTP/AVP 0 8 97 101\r\n"
+                  "a=rtpmap:0 PCMU/8000\r\n"
+                  "a=rtpmap:8 PCMA/8000\r\n"
+                  "a=rtpmap:97 iLBC/8000\r\n"
+                  "a=rtpmap:101 telephone-event/8000\r\n"
+                  "a=fmtp:101 0-15\r\n"
+                  "a=ptime:20\r\n"
+                  "a=sendrecv\r\n");
+
+      const int runs = 2000;
+      measure(invite, false, false, runs);
+      unsigned long before = heapAllocs;
+      measure(invite, true, false, runs);
+      unsigned long after = heapAllocs;
+      assert(after < before);
+      measure(invite, false, true, runs);
+      before = heapAllocs;
+      measure(invite, true, true, runs);
+      after = heapAllocs;
+      assert(after < before);
+      SlabAllocator::setEnabled(true);
+   }
+
    resipCout << "All OK" << endl;
    return 0;
 }
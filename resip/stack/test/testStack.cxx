@@ -603,6 +603,9 @@ main(int argc, char* argv[])
    int sendSleepMs = 0;
    int cManager=0;
    int statisticsInterval=60;
+   int numShards=1;
+   int numTcShards=1;
+   int smRingSize=0;
 
 #if defined(HAVE_POPT_H)
 
@@ -629,6 +632,9 @@ main(int argc, char* argv[])
       {"sleep",       0,   POPT_ARG_INT,    &sendSleepMs,0, "time (ms) to sleep after each sent request", 0},
       {"use-congestion-manager",0, POPT_ARG_NONE, &cManager ,   0, "use a CongestionManager", 0},
       {"statistics-interval",       0,   POPT_ARG_INT,    &statisticsInterval,0, "time in seconds between statistics logging", 0},
+      {"shards",      0,   POPT_ARG_INT,    &numShards, 0, "number of SO_REUSEPORT listener shards per receiver port", 0},
+      {"tc-shards",   0,   POPT_ARG_INT,    &numTcShards, 0, "number of transaction controller shards per stack", 0},
+      {"sm-ring",     0,   POPT_ARG_INT,    &smRingSize, 0, "lock-free transaction fifo ring size (0 for mutex-based fifo)", 0},
       POPT_AUTOHELP
       { NULL, 0, 0, NULL, 0 }
    };
@@ -655,6 +661,9 @@ main(int argc, char* argv[])
      <<" bindIf="<<bindIfAddr
      <<" listen="<<doListen
      <<" tf="<<tpFlags
+     <<" shards="<<numShards
+     <<" tc-shards="<<numTcShards
+     <<" sm-ring="<<smRingSize
      <<"." << endl;
 
    const char *eachThreadType = threadType;
@@ -691,6 +700,10 @@ main(int argc, char* argv[])
    SipStackAndThread sender(eachThreadType, commonIntr, notifyUp);
    receiver.getStack().setStatisticsInterval(statisticsInterval);
    sender.getStack().setStatisticsInterval(statisticsInterval);
+   receiver.getStack().setTransactionShards(numTcShards);
+   sender.getStack().setTransactionShards(numTcShards);
+   receiver.getStack().setLockFreeStateMacFifo(smRingSize);
+   sender.getStack().setLockFreeStateMacFifo(smRingSize);
 
    IpVersion version = (v6 ? V6 : V4);
 
@@ -743,7 +756,8 @@ main(int argc, char* argv[])
 
       // NOTE: we could also bind receive to bindIfAddr, but existing code
       // doesn't do this. Responses are sent from here, so why don't we?
-      transports.push_back(receiver->addTransport(UDP, 
+      // Sharded receivers are given their own threads by the stack.
+      Transport* udpRecv = receiver->addTransport(UDP, 
                              registrarPort+idx, 
                              version, 
                              StunDisabled,
@@ -751,9 +765,17 @@ main(int argc, char* argv[])
                              /*sipDomain*/Data::Empty, 
                              /*keypass*/Data::Empty, 
                              SecurityTypes::TLSv1,
-                             tpFlags));
-
-      transports.push_back(receiver->addTransport(TCP, 
+                             tpFlags,
+                             /*certificateFilename*/Data::Empty,
+                             /*privateKeyFilename*/Data::Empty,
+                             SecurityTypes::None,
+                             /*useEmailAsSIP*/false,
+                             /*wsConnectionValidator*/nullptr,
+                             /*wsCookieContextFactory*/nullptr,
+                             /*netNs*/Data::Empty,
+                             numShards);
+
+      Transport* tcpRecv = receiver->addTransport(TCP, 
                              registrarPort+idx, 
                              version, 
                              StunDisabled,
@@ -761,7 +783,20 @@ main(int argc, char* argv[])
                              /*sipDomain*/Data::Empty, 
                              /*keypass*/Data::Empty, 
                              SecurityTypes::TLSv1,
-                             tpFlags));
+                             tpFlags,
+                             /*certificateFilename*/Data::Empty,
+                             /*privateKeyFilename*/Data::Empty,
+                             SecurityTypes::None,
+                             /*useEmailAsSIP*/false,
+                             /*wsConnectionValidator*/nullptr,
+                             /*wsCookieContextFactory*/nullptr,
+                             /*netNs*/Data::Empty,
+                             numShards);
+      if(numShards <= 1)
+      {
+         transports.push_back(udpRecv);
+         transports.push_back(tcpRecv);
+      }
    }
 
    std::unique_ptr<CongestionManager> senderCongestionManager;
@@ -15,6 +15,20 @@ echo "Running TCP REGISTER test (threaded stack, threaded transports)"
 ./testStack --protocol=tcp --thread-type=multithreadedstack --tf=32
 echo "Running UDP REGISTER test"
 ./testStack --protocol=udp
+echo "Running UDP REGISTER test (batched rx/tx)"
+./testStack --protocol=udp --tf=70
+echo "Running UDP REGISTER test (SO_REUSEPORT shards)"
+./testStack --protocol=udp --shards=4
+echo "Running TCP REGISTER test (SO_REUSEPORT shards)"
+./testStack --protocol=tcp --shards=4
+echo "Running UDP REGISTER test (threaded stack, transaction shards)"
+./testStack --protocol=udp --thread-type=multithreadedstack --tc-shards=4
+echo "Running TCP REGISTER test (threaded stack, transaction shards)"
+./testStack --protocol=tcp --thread-type=multithreadedstack --tc-shards=4
+echo "Running UDP REGISTER test (threaded stack, lock-free transaction fifo)"
+./testStack --protocol=udp --thread-type=multithreadedstack --sm-ring=1024
+echo "Running UDP REGISTER test (lock-free transaction fifo)"
+./testStack --protocol=udp --sm-ring=1024
 echo "Running TCP REGISTER test with 50 ports"
 ./testStack --protocol=tcp --numports=50
 echo "Running TCP INVITE test"
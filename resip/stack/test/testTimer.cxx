@@ -118,6 +118,106 @@ main()
    timer.process();   
    assert(r.size() == 5);
 
+   {
+      cerr << "!! cancel" << endl;
+      Fifo<TimerMessage> fired;
+      TransactionTimerQueue queue(fired);
+
+      TimerHandle a = queue.add(Timer::TimerA, "a", 50);
+      TimerHandle b = queue.add(Timer::TimerB, "b", 100);
+      TimerHandle c = queue.add(Timer::TimerD, "c", 40000); // past the first two wheels
+      assert(queue.size() == 3);
+      assert(queue.isPending(a));
+      assert(queue.cancel(a));
+      assert(!a.isSet());
+      assert(!queue.isPending(a));
+      assert(!queue.cancel(a));
+      assert(queue.size() == 2);
+      assert(isNear(queue.msTillNextTimer(), 100, 50));
+
+      TimerHandle stale = c;
+      assert(queue.cancel(c));
+      assert(!queue.isPending(stale));
+      // the cancelled node gets reused; the old handle must not match it
+      TimerHandle d = queue.add(Timer::TimerK, "d", 40000);
+      assert(!queue.isPending(stale));
+      assert(!queue.cancel(stale));
+      assert(queue.isPending(d));
+      assert(queue.size() == 2);
+
+      usleep(200*1000);
+      queue.process();
+      assert(fired.size() == 1);
+      TimerMessage* msg = fired.getNext();
+      assert(msg->getTransactionId() == "b");
+      delete msg;
+      assert(!queue.isPending(b));
+      assert(!queue.cancel(b));
+      assert(queue.size() == 1);
+      assert(isNear(queue.msTillNextTimer(), 39800));
+      assert(queue.cancel(d));
+      assert(queue.empty());
+      assert(queue.msTillNextTimer() == INT_MAX);
+      assert(queue.process() == 0);
+   }
+
+   {
+      cerr << "!! ordering across wheels" << endl;
+      Fifo<TimerMessage> fired;
+      TransactionTimerQueue queue(fired);
+
+      const int count = 2000;
+      const UInt64 start = Timer::getTimeMs();
+      for(int i = 0; i < count; ++i)
+      {
+         // spread over the first wheel and well into the second
+         unsigned long ms = (i*7919) % 3000;
+         queue.add(Timer::TimerA, Data(i), ms);
+      }
+      assert(queue.size() == count);
+
+      unsigned long last = 0;
+      int seen = 0;
+      while(seen < count)
+      {
+         usleep(10*1000);
+         queue.process();
+         const UInt64 now = Timer::getTimeMs();
+         TimerMessage* msg;
+         while((msg = fired.getNext(-1)))
+         {
+            // never early, and (give or take the time it took to add them)
+            // in expiry order
+            assert(start + msg->getDuration() <= now);
+            assert(msg->getDuration() + 2 >= last);
+            last = msg->getDuration();
+            ++seen;
+            delete msg;
+         }
+         assert(Timer::getTimeMs() < start + 5000);
+      }
+      assert(queue.empty());
+   }
+
+   {
+      cerr << "!! already expired" << endl;
+      Fifo<TimerMessage> fired;
+      TransactionTimerQueue queue(fired);
+
+      queue.add(Timer::TimerA, "later", 1000);
+      queue.process();
+      // the wheel has moved past the current ms; this must not wait for it
+      queue.add(Timer::TimerA, "now", 0);
+      assert(queue.msTillNextTimer() == 0);
+      queue.process();
+      assert(fired.size() == 1);
+      TimerMessage* msg = fired.getNext();
+      assert(msg->getTransactionId() == "now");
+      delete msg;
+      assert(queue.size() == 1);
+      assert(isNear(queue.msTillNextTimer(), 1000));
+   }
+
    cerr << "All OK" << endl;
    return 0;
 }
@@ -0,0 +1,366 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+// Load test for TLS handshake handling: floods a TLS transport with new
+// connections, each doing a full handshake, and meanwhile sends requests
+// over a connection that is already up. Reports the rate at which the
+// transport completes handshakes and the latency with which requests on
+// the established connection reach the TU, before and during the storm.
+//
+// usage: testTlsHandshakeStorm [-t handshakeThreads] [-c stormClients]
+//                              [-s seconds] [-d certDir] [-p port]
+//
+// certDir must hold domain_cert_localhost.pem and domain_key_localhost.pem,
+// signed with a digest the local OpenSSL accepts. -t 0 handshakes on the
+// transport thread.
+
+#include <signal.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "rutil/Condition.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/Socket.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+#include "resip/stack/EventStackThread.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "resip/stack/SipStack.hxx"
+#include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsBaseTransport.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+int Port = 15061;
+
+class Notify : public AsyncProcessHandler
+{
+   public:
+      virtual void handleProcessNotification()
+      {
+         Lock lock(mMutex);
+         mCondition.signal();
+      }
+      void wait(int ms)
+      {
+         Lock lock(mMutex);
+         mCondition.wait(mMutex, ms);
+      }
+   private:
+      Mutex mMutex;
+      Condition mCondition;
+};
+
+// blocking client connection, no certificate checks and no resumption
+SSL*
+connectClient(SSL_CTX* ctx, Socket& fd)
+{
+   fd = ::socket(AF_INET, SOCK_STREAM, 0);
+   sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(Port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+   {
+      closeSocket(fd);
+      return 0;
+   }
+   SSL* ssl = SSL_new(ctx);
+   SSL_set_fd(ssl, (int)fd);
+   if (SSL_connect(ssl) != 1)
+   {
+      ERR_clear_error();
+      SSL_free(ssl);
+      closeSocket(fd);
+      return 0;
+   }
+   return ssl;
+}
+
+class StormClient : public ThreadIf
+{
+   public:
+      StormClient(SSL_CTX* ctx) : mCtx(ctx), mHandshakes(0), mFailures(0) {}
+      virtual void thread()
+      {
+         while (!isShutdown())
+         {
+            Socket fd;
+            SSL* ssl = connectClient(mCtx, fd);
+            if (!ssl)
+            {
+               ++mFailures;
+               continue;
+            }
+            ++mHandshakes;
+            SSL_free(ssl);
+            closeSocket(fd);
+         }
+      }
+      SSL_CTX* mCtx;
+      volatile unsigned int mHandshakes;
+      volatile unsigned int mFailures;
+};
+
+// sends an OPTIONS request every millisecond on an established connection
+class Prober : public ThreadIf
+{
+   public:
+      Prober(SSL* ssl) : mSsl(ssl) {}
+      virtual void thread()
+      {
+         while (!isShutdown())
+         {
+            UInt64 now = Timer::getTimeMicroSec();
+            unsigned int n;
+            {
+               Lock lock(mMutex);
+               n = (unsigned int)mSent.size();
+               mSent.push_back(now);
+            }
+            Data msg;
+            {
+               DataStream s(msg);
+               s << "OPTIONS sip:probe@localhost SIP/2.0\r\n"
+                 << "Via: SIP/2.0/TLS 127.0.0.1:5061;branch=z9hG4bK-probe-" << n << "\r\n"
+                 << "Max-Forwards: 70\r\n"
+                 << "To: <sip:probe@localhost>\r\n"
+                 << "From: <sip:storm@localhost>;tag=storm\r\n"
+                 << "Call-ID: probe-" << n << "\r\n"
+                 << "CSeq: " << n + 1 << " OPTIONS\r\n"
+                 << "Content-Length: 0\r\n\r\n";
+            }
+            if (SSL_write(mSsl, msg.data(), (int)msg.size()) <= 0)
+            {
+               cerr << "probe connection failed" << endl;
+               return;
+            }
+            sleepMs(1);
+         }
+      }
+      UInt64 sentAt(unsigned int n)
+      {
+         Lock lock(mMutex);
+         return n < mSent.size() ? mSent[n] : 0;
+      }
+   private:
+      SSL* mSsl;
+      Mutex mMutex;
+      vector<UInt64> mSent;
+};
+
+// receives the probes as the TU for ms milliseconds
+void
+collect(SipStack& stack, Notify& notify, Prober& prober, int ms, vector<UInt64>& latencies)
+{
+   UInt64 end = Timer::getTimeMs() + ms;
+   while (Timer::getTimeMs() < end)
+   {
+      SipMessage* msg = stack.receive();
+      if (!msg)
+      {
+         notify.wait(10);
+         continue;
+      }
+      UInt64 now = Timer::getTimeMicroSec();
+      const Data& callId = msg->header(h_CallId).value();
+      if (callId.prefix("probe-"))
+      {
+         UInt64 sent = prober.sentAt(callId.substr(6).convertUnsignedLong());
+         if (sent)
+         {
+            latencies.push_back(now - sent);
+         }
+      }
+      delete msg;
+   }
+}
+
+void
+report(const char* phase, vector<UInt64>& latencies)
+{
+   if (latencies.empty())
+   {
+      cout << phase << ": no probes received" << endl;
+      return;
+   }
+   sort(latencies.begin(), latencies.end());
+   cout << phase << ": " << latencies.size() << " probes, latency us"
+        << " p50 " << latencies[latencies.size() / 2]
+        << " p99 " << latencies[latencies.size() * 99 / 100]
+        << " max " << latencies.back() << endl;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   unsigned int handshakeThreads = 4;
+   int clients = 16;
+   int seconds = 5;
+   Data certDir("certs/");
+
+   for (int i = 1; i + 1 < argc; i += 2)
+   {
+      Data opt(argv[i]);
+      Data val(argv[i + 1]);
+      if (opt == "-t") handshakeThreads = val.convertUnsignedLong();
+      else if (opt == "-c") clients = val.convertInt();
+      else if (opt == "-s") seconds = val.convertInt();
+      else if (opt == "-d") certDir = val;
+      else if (opt == "-p") Port = val.convertInt();
+      else
+      {
+         cerr << "usage: " << argv[0] << " [-t handshakeThreads] [-c stormClients] [-s seconds] [-d certDir] [-p port]" << endl;
+         return 1;
+      }
+   }
+   if (!certDir.postfix("/"))
+   {
+      certDir += "/";
+   }
+
+#ifndef _WIN32
+   if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+   {
+      cerr << "Couldn't install signal handler for SIGPIPE" << endl;
+      return 1;
+   }
+#endif
+
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+   initNetwork();
+
+   TlsBaseTransport::HandshakeThreads = handshakeThreads;
+   FdPollGrp* pollGrp = FdPollGrp::create();
+   EventThreadInterruptor* interruptor = new EventThreadInterruptor(*pollGrp);
+   SipStackOptions options;
+   options.mSecurity = new Security(certDir);
+   options.mAsyncProcessHandler = interruptor;
+   options.mPollGrp = pollGrp;
+   SipStack* stack = new SipStack(options);
+   Notify notify;
+   stack->setFallbackPostNotify(&notify);
+   stack->addTransport(TLS, Port, V4, StunDisabled, "127.0.0.1", "localhost",
+                       Data::Empty, SecurityTypes::SSLv23);
+   EventStackThread* stackThread = new EventStackThread(*stack, *interruptor, *pollGrp);
+   stackThread->run();
+
+   SSL_CTX* ctx = SSL_CTX_new(SSLv23_client_method());
+   SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, 0);
+   SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+
+   Socket probeFd;
+   SSL* probeSsl = connectClient(ctx, probeFd);
+   if (!probeSsl)
+   {
+      cerr << "could not connect to the TLS transport on port " << Port << endl;
+      return 1;
+   }
+   Prober prober(probeSsl);
+   prober.run();
+
+   cout << "handshake threads " << handshakeThreads << ", storm clients " << clients
+        << ", " << seconds << "s" << endl;
+
+   vector<UInt64> idle;
+   collect(*stack, notify, prober, 1000, idle);
+   report("idle", idle);
+
+   vector<StormClient*> storm;
+   for (int i = 0; i < clients; ++i)
+   {
+      storm.push_back(new StormClient(ctx));
+      storm.back()->run();
+   }
+   UInt64 start = Timer::getTimeMs();
+   vector<UInt64> loaded;
+   collect(*stack, notify, prober, seconds * 1000, loaded);
+   UInt64 elapsed = Timer::getTimeMs() - start;
+
+   unsigned int handshakes = 0;
+   unsigned int failures = 0;
+   for (vector<StormClient*>::iterator it = storm.begin(); it != storm.end(); ++it)
+   {
+      (*it)->shutdown();
+   }
+   for (vector<StormClient*>::iterator it = storm.begin(); it != storm.end(); ++it)
+   {
+      (*it)->join();
+      handshakes += (*it)->mHandshakes;
+      failures += (*it)->mFailures;
+      delete *it;
+   }
+   prober.shutdown();
+   prober.join();
+
+   cout << "storm: " << handshakes << " handshakes (" << failures << " failed), "
+        << (handshakes * 1000.0 / elapsed) << "/s" << endl;
+   report("storm", loaded);
+
+   SSL_free(probeSsl);
+   closeSocket(probeFd);
+   SSL_CTX_free(ctx);
+
+   stackThread->shutdown();
+   stackThread->join();
+   delete stackThread;
+   delete stack;
+   delete interruptor;
+   delete pollGrp;
+
+   return (handshakes > 0 && !loaded.empty()) ? 0 : 1;
+}
+
+/* ====================================================================
+ *
+ * Copyright (c) 2013 Daniel Pocock  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. Neither the name of the author(s) nor the names of any contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR(S) OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ *
+ */
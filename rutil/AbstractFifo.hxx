@@ -429,11 +429,22 @@ class AbstractFifo : public FifoStatsInterface
       UInt32 mSize;
 
       virtual void onFifoPolled()
+      {
+         updateServiceTime(mFifo.empty());
+      }
+
+      /**
+         Folds the messages popped since the last sample into
+         mAverageServiceTimeMicroSec. drained tells whether the fifo is now
+         empty; subclasses that do not keep their messages in mFifo pass
+         their own notion of it.
+      */
+      void updateServiceTime(bool drained)
       {
          // !bwc! TODO allow this sampling frequency to be tweaked
          if(mLastSampleTakenMicroSec &&
             mCounter &&
-            (mCounter >= 64 || mFifo.empty()))
+            (mCounter >= 64 || drained))
          {
             UInt64 now(Timer::getTimeMicroSec());
             UInt64 diff = now-mLastSampleTakenMicroSec;
@@ -451,7 +462,7 @@ class AbstractFifo : public FifoStatsInterface
                      4096U);
             }
             mCounter=0;
-            if(mFifo.empty())
+            if(drained)
             {
                mLastSampleTakenMicroSec=0;
             }
@@ -3,18 +3,24 @@
 
 #include <limits>
 #include <memory>
+#include <unordered_set>
 #include <stddef.h>
 
 #include "rutil/PoolBase.hxx"
+#include "rutil/SlabAllocator.hxx"
 
 namespace resip
 {
 /**
    A dirt-simple lightweight pool allocator meant for use in short-lifetime 
    objects. This will pool-allocate at most S bytes, after which no further pool
-   allocation will be performed, and fallback to the system new/delete will be 
+   allocation will be performed, and fallback to the SlabAllocator will be 
    used (deallocating a pool allocated object will _not_ free up room in the 
    pool; the memory will be freed when the DinkyPool goes away).
+
+   Like any PoolBase, deallocate() also accepts memory that came from global 
+   operator new instead (copies of parser containers are made that way), so 
+   the overflow blocks are kept in a set to tell the two apart.
 */
 template<unsigned int S>
 class DinkyPool : public PoolBase
@@ -32,7 +38,9 @@ class DinkyPool : public PoolBase
             return result;
          }
          heapBytes += size;
-         return ::operator new(size);
+         void* block = SlabAllocator::allocate(size);
+         mOverflow.insert(block);
+         return block;
       }
 
       void deallocate(void* ptr)
@@ -41,6 +49,11 @@ class DinkyPool : public PoolBase
          {
             return;
          }
+         if(mOverflow.erase(ptr))
+         {
+            SlabAllocator::deallocate(ptr);
+            return;
+         }
          ::operator delete(ptr);
       }
 
@@ -61,6 +74,7 @@ class DinkyPool : public PoolBase
       size_t count; // 8-byte chunks alloced so far
       char mBuf[(S+7)/8][8]; // 8-byte chunks for alignment
       size_t heapBytes;
+      std::unordered_set<void*> mOverflow;
 };
 
 }
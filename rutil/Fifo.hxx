@@ -1,8 +1,11 @@
 #if !defined(RESIP_FIFO_HXX)
 #define RESIP_FIFO_HXX 
 
+#include <atomic>
+
 #include "rutil/ResipAssert.h"
 #include "rutil/AbstractFifo.hxx"
+#include "rutil/MpscRing.hxx"
 #include "rutil/SelectInterruptor.hxx"
 
 namespace resip
@@ -10,6 +13,11 @@ namespace resip
 
 /**
    @brief A templated, threadsafe message-queue class.
+
+   By default messages are kept in a std::deque guarded by a Mutex, and every
+   add() takes the lock and signals the Condition. A fifo that is only ever
+   drained by a single thread can be switched to a lock-free backend with
+   setLockFree().
 */
 template < class Msg >
 class Fifo : public AbstractFifo<Msg*>
@@ -21,8 +29,29 @@ class Fifo : public AbstractFifo<Msg*>
       using AbstractFifo<Msg*>::mFifo;
       using AbstractFifo<Msg*>::mMutex;
       using AbstractFifo<Msg*>::mCondition;
-      using AbstractFifo<Msg*>::empty;
-      using AbstractFifo<Msg*>::size;
+
+      /**
+         Switches this fifo to a bounded lock-free multi-producer/
+         single-consumer ring of (at least) capacity messages. Producers then
+         only take mMutex when the consumer is parked in getNext()/
+         getMultiple() waiting for work, or when the ring is full; in the
+         latter case messages spill into the regular deque (in order) until
+         the consumer catches up, so add() never fails or blocks on the
+         consumer.
+
+         Only one thread may consume from the fifo once this is set. Must be
+         called while the fifo is still empty and before it is shared with
+         other threads.
+      */
+      void setLockFree(unsigned int capacity);
+      bool isLockFree() const { return mRing != 0; }
+
+      bool empty() const;
+      bool messageAvailable() const;
+      virtual unsigned int size() const;
+
+      virtual size_t getCountDepth() const;
+      virtual time_t expectedWaitTimeMilliSec() const;
 
       /// Add a message to the fifo.
       size_t add(Msg* msg);
@@ -57,6 +86,25 @@ class Fifo : public AbstractFifo<Msg*>
 
    private:
       AsyncProcessHandler* mInterruptor;
+
+      // lock-free backend; see setLockFree()
+      MpscRing<Msg*>* mRing;
+      // messages in the ring plus messages spilled into mFifo; bumped before
+      // a message is published so it never undercounts
+      std::atomic<unsigned int> mRingCount;
+      // set (under mMutex) when the ring filled up; producers keep spilling
+      // into mFifo until the consumer has drained it
+      std::atomic<bool> mRingOverflowed;
+      // consumer is (about to be) waiting on mCondition
+      std::atomic<bool> mConsumerParked;
+
+      void ringPush(Msg* msg, bool& spilled);
+      void wakeConsumer();
+      bool ringPop(Msg*& msg);
+      bool ringPopLocked(Msg*& msg);
+      bool ringGetNext(int ms, Msg*& msg);
+      void onRingPopped(unsigned int num);
+
       Fifo(const Fifo& rhs);
       Fifo& operator=(const Fifo& rhs);
 };
@@ -65,7 +113,11 @@ class Fifo : public AbstractFifo<Msg*>
 template <class Msg>
 Fifo<Msg>::Fifo(AsyncProcessHandler* interruptor) : 
    AbstractFifo<Msg*>(),
-   mInterruptor(interruptor)
+   mInterruptor(interruptor),
+   mRing(0),
+   mRingCount(0),
+   mRingOverflowed(false),
+   mConsumerParked(false)
 {
 }
 
@@ -73,6 +125,7 @@ template <class Msg>
 Fifo<Msg>::~Fifo()
 {
    clear();
+   delete mRing;
 }
 
 template <class Msg>
@@ -83,11 +136,85 @@ Fifo<Msg>::setInterruptor(AsyncProcessHandler* interruptor)
    mInterruptor=interruptor;
 }
 
+template <class Msg>
+void
+Fifo<Msg>::setLockFree(unsigned int capacity)
+{
+   Lock lock(mMutex); (void)lock;
+   resip_assert(!mRing);
+   resip_assert(mFifo.empty());
+   mRing = new MpscRing<Msg*>(capacity);
+}
+
+template <class Msg>
+bool
+Fifo<Msg>::empty() const
+{
+   if(mRing)
+   {
+      return mRingCount.load() == 0;
+   }
+   return AbstractFifo<Msg*>::empty();
+}
+
+template <class Msg>
+bool
+Fifo<Msg>::messageAvailable() const
+{
+   if(mRing)
+   {
+      return mRingCount.load() != 0;
+   }
+   return AbstractFifo<Msg*>::messageAvailable();
+}
+
+template <class Msg>
+unsigned int
+Fifo<Msg>::size() const
+{
+   if(mRing)
+   {
+      return mRingCount.load();
+   }
+   return AbstractFifo<Msg*>::size();
+}
+
+template <class Msg>
+size_t
+Fifo<Msg>::getCountDepth() const
+{
+   if(mRing)
+   {
+      return mRingCount.load(std::memory_order_relaxed);
+   }
+   return AbstractFifo<Msg*>::getCountDepth();
+}
+
+template <class Msg>
+time_t
+Fifo<Msg>::expectedWaitTimeMilliSec() const
+{
+   if(mRing)
+   {
+      return ((this->mAverageServiceTimeMicroSec*(UInt64)getCountDepth())+500)/1000;
+   }
+   return AbstractFifo<Msg*>::expectedWaitTimeMilliSec();
+}
 
 template <class Msg>
 void
 Fifo<Msg>::clear()
 {
+   if(mRing)
+   {
+      Msg* msg;
+      while(ringPop(msg))
+      {
+         delete msg;
+      }
+      return;
+   }
+
    Lock lock(mMutex); (void)lock;
    while ( ! mFifo.empty() )
    {
@@ -97,11 +224,175 @@ Fifo<Msg>::clear()
    resip_assert(mFifo.empty());
 }
 
+template <class Msg>
+void
+Fifo<Msg>::ringPush(Msg* msg, bool& spilled)
+{
+   if(!spilled && !mRingOverflowed.load() && mRing->push(msg))
+   {
+      return;
+   }
+
+   if(!spilled)
+   {
+      // Released by addMultiple()/add() once done.
+      mMutex.lock();
+      spilled = true;
+   }
+   mRingOverflowed.store(true);
+   mFifo.push_back(msg);
+}
+
+template <class Msg>
+void
+Fifo<Msg>::wakeConsumer()
+{
+   // Pairs with the fence in ringGetNext(): either we see the consumer
+   // parked, or it sees our message before it goes to sleep.
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if(mConsumerParked.load(std::memory_order_relaxed))
+   {
+      Lock lock(mMutex); (void)lock;
+      mCondition.signal();
+   }
+}
+
+template <class Msg>
+bool
+Fifo<Msg>::ringPop(Msg*& msg)
+{
+   if(mRing->pop(msg))
+   {
+      --mRingCount;
+      return true;
+   }
+   if(mRingOverflowed.load())
+   {
+      Lock lock(mMutex); (void)lock;
+      return ringPopLocked(msg);
+   }
+   return false;
+}
+
+template <class Msg>
+bool
+Fifo<Msg>::ringPopLocked(Msg*& msg)
+{
+   // Anything in the ring was either pushed before the overflow began, or
+   // by a producer that raced with it; either way it goes before mFifo.
+   if(mRing->pop(msg))
+   {
+      --mRingCount;
+      return true;
+   }
+   if(!mRing->drained())
+   {
+      // A producer has claimed a cell but not published it yet. Its earlier
+      // messages must not be overtaken by ones it has since spilled.
+      return false;
+   }
+   if(!mFifo.empty())
+   {
+      msg = mFifo.front();
+      mFifo.pop_front();
+      --mRingCount;
+      return true;
+   }
+   // Spill drained; producers can go back to the ring.
+   mRingOverflowed.store(false);
+   return false;
+}
+
+template <class Msg>
+bool
+Fifo<Msg>::ringGetNext(int ms, Msg*& msg)
+{
+   this->updateServiceTime(mRingCount.load(std::memory_order_relaxed) == 0);
+   if(ringPop(msg))
+   {
+      onRingPopped(1);
+      return true;
+   }
+   if(ms < 0)
+   {
+      return false;
+   }
+
+   const UInt64 end(Timer::getTimeMs() + (unsigned int)(ms));
+   Lock lock(mMutex); (void)lock;
+   bool found = false;
+   for(;;)
+   {
+      mConsumerParked.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(ringPopLocked(msg))
+      {
+         found = true;
+         break;
+      }
+      if(ms == 0)
+      {
+         mCondition.wait(mMutex);
+         continue;
+      }
+      const UInt64 now(Timer::getTimeMs());
+      if(now >= end || !mCondition.wait(mMutex, (unsigned int)(end - now)))
+      {
+         // One last look; a producer may have published after we timed out.
+         found = ringPopLocked(msg);
+         break;
+      }
+   }
+   mConsumerParked.store(false);
+   if(found)
+   {
+      onRingPopped(1);
+   }
+   return found;
+}
+
+template <class Msg>
+void
+Fifo<Msg>::onRingPopped(unsigned int num)
+{
+   // The producer side does not timestamp the empty to non-empty transition
+   // (that would need a shared write on every add()), so service time
+   // sampling starts at the first pop instead.
+   if(!this->mLastSampleTakenMicroSec)
+   {
+      this->mLastSampleTakenMicroSec=Timer::getTimeMicroSec();
+   }
+   this->mCounter+=num;
+}
+
 template <class Msg>
 size_t
 Fifo<Msg>::add(Msg* msg)
 {
-   size_t size = AbstractFifo<Msg*>::add(msg);
+   size_t size;
+   if(mRing)
+   {
+      size = ++mRingCount;
+      bool spilled = false;
+      ringPush(msg, spilled);
+      if(spilled)
+      {
+         if(mConsumerParked.load())
+         {
+            mCondition.signal();
+         }
+         mMutex.unlock();
+      }
+      else
+      {
+         wakeConsumer();
+      }
+   }
+   else
+   {
+      size = AbstractFifo<Msg*>::add(msg);
+   }
+
    if(size==1 && mInterruptor)
    {
       // Only do this when the queue goes from empty to not empty.
@@ -115,7 +406,39 @@ size_t
 Fifo<Msg>::addMultiple(Messages& msgs)
 {
    size_t inSize = msgs.size();
-   size_t size = AbstractFifo<Msg*>::addMultiple(msgs);
+   size_t size;
+   if(mRing)
+   {
+      if(inSize == 0)
+      {
+         return mRingCount.load();
+      }
+      size = (mRingCount += (unsigned int)inSize);
+      bool spilled = false;
+      for(typename Messages::iterator i = msgs.begin(); i != msgs.end(); ++i)
+      {
+         ringPush(*i, spilled);
+      }
+      msgs.clear();
+      // one wakeup for the whole batch
+      if(spilled)
+      {
+         if(mConsumerParked.load())
+         {
+            mCondition.signal();
+         }
+         mMutex.unlock();
+      }
+      else
+      {
+         wakeConsumer();
+      }
+   }
+   else
+   {
+      size = AbstractFifo<Msg*>::addMultiple(msgs);
+   }
+
    if(size==inSize && inSize != 0 && mInterruptor)
    {
       // Only do this when the queue goes from empty to not empty.
@@ -128,6 +451,12 @@ template <class Msg>
 Msg*
 Fifo<Msg> ::getNext()
 {
+   if(mRing)
+   {
+      Msg* result(0);
+      ringGetNext(RESIP_FIFO_FOREVER, result);
+      return result;
+   }
    return AbstractFifo<Msg*>::getNext();
 }
 
@@ -136,6 +465,11 @@ Msg*
 Fifo<Msg> ::getNext(int ms)
 {
    Msg* result(0);
+   if(mRing)
+   {
+      ringGetNext(ms, result);
+      return result;
+   }
    AbstractFifo<Msg*>::getNext(ms, result);
    return result;
 }
@@ -144,14 +478,38 @@ template <class Msg>
 void
 Fifo<Msg>::getMultiple(Messages& other, unsigned int max)
 {
-   AbstractFifo<Msg*>::getMultiple(other, max);
+   getMultiple(RESIP_FIFO_FOREVER, other, max);
 }
 
 template <class Msg>
 bool
 Fifo<Msg>::getMultiple(int ms, Messages& other, unsigned int max)
 {
-   return AbstractFifo<Msg*>::getMultiple(ms, other, max);
+   if(!mRing)
+   {
+      if(ms==0)
+      {
+         AbstractFifo<Msg*>::getMultiple(other, max);
+         return true;
+      }
+      return AbstractFifo<Msg*>::getMultiple(ms, other, max);
+   }
+
+   resip_assert(other.empty());
+   Msg* msg(0);
+   if(max == 0 || !ringGetNext(ms, msg))
+   {
+      return false;
+   }
+   other.push_back(msg);
+   unsigned int num = 0;
+   while(other.size() < max && ringPop(msg))
+   {
+      other.push_back(msg);
+      ++num;
+   }
+   onRingPopped(num);
+   return true;
 }
 } // namespace resip
 
@@ -12,6 +12,9 @@
 
 #include <sys/types.h>
 #include <time.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 #include "rutil/Log.hxx"
 #include "rutil/Logger.hxx"
@@ -43,7 +46,42 @@ int Log::mPid=0;
 pid_t Log::mPid=0;
 #endif
 
-volatile short Log::touchCount = 0;
+std::atomic<unsigned int> Log::mLevelGeneration(0);
+
+namespace
+{
+// Subsystems are statics of whatever library defines them, so the registry
+// has to be usable whenever the first of them is constructed.
+Mutex&
+subsystemsMutex()
+{
+   static Mutex mutex;
+   return mutex;
+}
+
+std::vector<Subsystem*>&
+subsystems()
+{
+   static std::vector<Subsystem*> registered;
+   return registered;
+}
+
+// guarded by subsystemsMutex()
+bool levelsPublished = false;
+int maxLoggerLevel = Log::Bogus;
+
+#ifdef LOG_ENABLE_THREAD_SETTING
+// what a thread keeps of its ThreadSetting
+struct CachedThreadSetting : public Log::ThreadSetting
+{
+   CachedThreadSetting(const Log::ThreadSetting& setting, unsigned int generation)
+      : Log::ThreadSetting(setting),
+        mGeneration(generation)
+   {}
+   unsigned int mGeneration;  // of the levels mLevel is current with
+};
+#endif
+}
 
 
 /// DEPRECATED! Left for backward compatibility - use localLoggers instead
@@ -51,7 +89,7 @@ volatile short Log::touchCount = 0;
 #if defined(__APPLE__) || defined(__CYGWIN__)
 HashValueImp(ThreadIf::Id, (size_t)data);
 #endif
-HashMap<ThreadIf::Id, std::pair<Log::ThreadSetting, bool> > Log::mThreadToLevel;
+HashMap<ThreadIf::Id, Log::ThreadSetting> Log::mThreadToLevel;
 HashMap<int, std::set<ThreadIf::Id> > Log::mServiceToThreads;
 ThreadIf::TlsKey* Log::mLevelKey;
 #endif
@@ -60,6 +98,157 @@ HashMap<int, Log::Level> Log::mServiceToLevel;
 Log::LocalLoggerMap Log::mLocalLoggerMap;
 ThreadIf::TlsKey* Log::mLocalLoggerKey;
 
+/// One thread's queue of log records for the async writer. The thread that
+/// owns it is the only producer, the writer thread the only consumer.
+class Log::AsyncRing
+{
+   public:
+      /// copied into the ring in front of the message text
+      struct Record
+      {
+         UInt32 mSize;
+         Log::Level mLevel;
+         const Subsystem* mSubsystem;
+         const char* mFile;
+         int mLine;
+         UInt64 mSeconds;
+         UInt32 mMicroseconds;
+         ThreadIf::Id mThread;
+      };
+
+      /// size is rounded up to a power of two
+      AsyncRing(unsigned int size)
+         : mDropped(0),
+           mDroppedReported(0),
+           mClosed(false),
+           mHead(0),
+           mTail(0)
+      {
+         size_t capacity = 1024;
+         while (capacity < size)
+         {
+            capacity <<= 1;
+         }
+         mMask = capacity - 1;
+         mBuffer = new char[capacity];
+      }
+
+      ~AsyncRing()
+      {
+         delete [] mBuffer;
+      }
+
+      void push(const Record& rec, const char* message)
+      {
+         size_t tail = mTail.load(std::memory_order_relaxed);
+         size_t size = sizeof(Record) + rec.mSize;
+         if (size > mMask + 1 - (tail - mHead.load(std::memory_order_acquire)))
+         {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+         }
+         copyIn(tail, &rec, sizeof(Record));
+         copyIn(tail + sizeof(Record), message, rec.mSize);
+         mTail.store(tail + size, std::memory_order_release);
+      }
+
+      /// reads the next record, if any; pop() then takes it and its message
+      bool peek(Record& rec) const
+      {
+         size_t head = mHead.load(std::memory_order_relaxed);
+         if (head == mTail.load(std::memory_order_acquire))
+         {
+            return false;
+         }
+         copyOut(head, &rec, sizeof(Record));
+         return true;
+      }
+
+      void pop(const Record& rec, Data& message)
+      {
+         size_t head = mHead.load(std::memory_order_relaxed);
+         copyOut(head + sizeof(Record), message.getBuf(rec.mSize), rec.mSize);
+         mHead.store(head + sizeof(Record) + rec.mSize, std::memory_order_release);
+      }
+
+      bool empty() const
+      {
+         return mHead.load(std::memory_order_relaxed) == mTail.load(std::memory_order_acquire);
+      }
+
+      std::atomic<UInt64> mDropped;
+      UInt64 mDroppedReported;  // only used by the writer
+      std::atomic<bool> mClosed;  // the owning thread has exited
+
+   private:
+      void copyIn(size_t pos, const void* data, size_t size)
+      {
+         size_t offset = pos & mMask;
+         size_t first = std::min(size, mMask + 1 - offset);
+         memcpy(mBuffer + offset, data, first);
+         memcpy(mBuffer, static_cast<const char*>(data) + first, size - first);
+      }
+
+      void copyOut(size_t pos, void* data, size_t size) const
+      {
+         size_t offset = pos & mMask;
+         size_t first = std::min(size, mMask + 1 - offset);
+         memcpy(data, mBuffer + offset, first);
+         memcpy(static_cast<char*>(data) + first, mBuffer, size - first);
+      }
+
+      char* mBuffer;
+      size_t mMask;
+      std::atomic<size_t> mHead;
+      std::atomic<size_t> mTail;
+};
+
+/// Writes out the records of all the threads' rings, in time order.
+class Log::AsyncWriter : public ThreadIf
+{
+   public:
+      virtual void thread()
+      {
+         while (!isShutdown())
+         {
+            if (!drain())
+            {
+               waitForShutdown(10);
+            }
+         }
+      }
+
+      /// writes what is queued; false if there was nothing
+      bool drain();
+
+      static AsyncRing* createRing();
+      static UInt64 dropped();
+
+      static Mutex mControlMutex;  // serializes enableAsync() and disableAsync()
+      static std::atomic<unsigned int> mRingSize;
+
+   private:
+      void write(const AsyncRing::Record& rec, const Data& message);
+      void reportDrops(std::vector<AsyncRing*>& rings);
+
+      Data mLine;
+
+      // rings outlive the writer, so that a thread can queue to its ring
+      // while async logging is being turned off
+      static Mutex mRingsMutex;
+      static std::vector<AsyncRing*> mRings;
+      static UInt64 mReapedDropped;  // by rings of threads that have exited
+};
+
+std::atomic<bool> Log::mAsyncEnabled(false);
+Log::AsyncWriter* Log::mAsyncWriter = 0;
+ThreadIf::TlsKey* Log::mAsyncRingKey;
+Mutex Log::AsyncWriter::mControlMutex;
+std::atomic<unsigned int> Log::AsyncWriter::mRingSize(Log::DefaultAsyncRingBytes);
+Mutex Log::AsyncWriter::mRingsMutex;
+std::vector<Log::AsyncRing*> Log::AsyncWriter::mRings;
+UInt64 Log::AsyncWriter::mReapedDropped = 0;
+
 const char
 Log::mDescriptions[][32] = {"NONE", "EMERG", "ALERT", "CRIT", "ERR", "WARNING", "NOTICE", "INFO", "DEBUG", "STACK", "CERR", ""}; 
 
@@ -69,7 +258,9 @@ extern "C"
 {
    void freeThreadSetting(void* setting)
    {
-      delete static_cast<Log::ThreadSetting*>(setting);
+#ifdef LOG_ENABLE_THREAD_SETTING
+      delete static_cast<CachedThreadSetting*>(setting);
+#endif
    }
 
    void freeLocalLogger(void* pThreadData)
@@ -81,6 +272,12 @@ extern "C"
          Log::mLocalLoggerMap.decreaseUseCount((static_cast<Log::ThreadData*>(pThreadData))->id());
       }
    }
+
+   void freeAsyncRing(void* pRing)
+   {
+      // the writer deletes it once it has written what is left in it
+      static_cast<Log::AsyncRing*>(pRing)->mClosed.store(true, std::memory_order_release);
+   }
 }
 
 unsigned int LogStaticInitializer::mInstanceCounter=0;
@@ -95,6 +292,9 @@ LogStaticInitializer::LogStaticInitializer()
 
          Log::mLocalLoggerKey = new ThreadIf::TlsKey;
          ThreadIf::tlsKeyCreate(*Log::mLocalLoggerKey, freeLocalLogger);
+
+         Log::mAsyncRingKey = new ThreadIf::TlsKey;
+         ThreadIf::tlsKeyCreate(*Log::mAsyncRingKey, freeAsyncRing);
    }
 }
 LogStaticInitializer::~LogStaticInitializer()
@@ -108,6 +308,9 @@ LogStaticInitializer::~LogStaticInitializer()
 
       ThreadIf::tlsKeyDelete(*Log::mLocalLoggerKey);
       delete Log::mLocalLoggerKey;
+
+      ThreadIf::tlsKeyDelete(*Log::mAsyncRingKey);
+      delete Log::mAsyncRingKey;
    }
 }
 
@@ -280,6 +483,8 @@ Log::initialize(Type type, Level level, const Data& appName,
 #else
    mPid = getpid();
 #endif
+
+   publishLevels();
 }
 
 void
@@ -295,14 +500,16 @@ Log::initialize(Type type,
 void
 Log::setLevel(Level level)
 {
-   Lock lock(_mutex);
-   getLoggerData().mLevel = level; 
+   {
+      Lock lock(_mutex);
+      getLoggerData().mLevel = level; 
+   }
+   publishLevels();
 }
 
 void
 Log::setLevel(Level level, Subsystem& s)
 {
-   Lock lock(_mutex);
    s.setLevel(level); 
 }
 
@@ -327,6 +534,7 @@ Log::setLevel(Level level, Log::LocalLoggerId loggerId)
       Lock lock(_mutex);
       mDefaultLoggerData.mLevel = level;
    }
+   publishLevels();
 }
 
 Log::Level 
@@ -345,7 +553,6 @@ Log::level(Log::LocalLoggerId loggerId)
    }
    else
    {
-      Lock lock(_mutex);
       level = mDefaultLoggerData.mLevel;
    }
    return level;
@@ -495,15 +702,31 @@ Log::tags(Log::Level level,
           const char* pfile,
           int line,
           EncodeStream& strm)
+{
+   UInt64 seconds;
+   UInt32 microseconds;
+   now(seconds, microseconds);
+   return tags(level, subsystem, pfile, line, seconds, microseconds, ThreadIf::selfId(), strm);
+}
+
+EncodeStream &
+Log::tags(Log::Level level,
+          const Subsystem& subsystem,
+          const char* pfile,
+          int line,
+          UInt64 seconds,
+          UInt32 microseconds,
+          ThreadIf::Id thread,
+          EncodeStream& strm)
 {
    char buffer[256] = "";
    Data ts(Data::Borrow, buffer, sizeof(buffer));
 #if defined( __APPLE__ )
   strm << mDescriptions[level+1] << Log::delim
-        << timestamp(ts) << Log::delim  
+        << timestamp(ts, seconds, microseconds) << Log::delim  
         << mAppName << Log::delim
         << subsystem << Log::delim 
-        << pthread_self() << Log::delim
+        << thread << Log::delim
         << pfile << ":" << line;
 #elif defined( WIN32 )
    const char* file = pfile + strlen(pfile);
@@ -517,31 +740,31 @@ Log::tags(Log::Level level,
       ++file;
    }
    strm << mDescriptions[level+1] << Log::delim
-        << timestamp(ts) << Log::delim  
+        << timestamp(ts, seconds, microseconds) << Log::delim  
         << mAppName << Log::delim
         << subsystem << Log::delim 
-        << GetCurrentThreadId() << Log::delim
+        << thread << Log::delim
         << file << ":" << line;
 #else // #if defined( WIN32 ) || defined( __APPLE__ )
    if(resip::Log::getLoggerData().type() == Syslog)
    {
       strm // << mDescriptions[level+1] << Log::delim
-   //        << timestamp(ts) << Log::delim
+   //        << timestamp(ts, seconds, microseconds) << Log::delim
    //        << mHostname << Log::delim
    //        << mAppName << Log::delim
            << subsystem << Log::delim
    //        << mPid << Log::delim
-           << pthread_self() << Log::delim
+           << thread << Log::delim
            << pfile << ":" << line;
    }
    else
       strm << mDescriptions[level+1] << Log::delim
-           << timestamp(ts) << Log::delim  
+           << timestamp(ts, seconds, microseconds) << Log::delim  
    //        << mHostname << Log::delim  
            << mAppName << Log::delim
            << subsystem << Log::delim 
    //        << mPid << Log::delim
-           << pthread_self() << Log::delim
+           << thread << Log::delim
            << pfile << ":" << line;
 #endif
    return strm;
@@ -555,27 +778,48 @@ Log::timestamp()
    return timestamp(result);
 }
 
-Data&
-Log::timestamp(Data& res) 
+void
+Log::now(UInt64& seconds, UInt32& microseconds)
 {
-   char* datebuf = const_cast<char*>(res.data());
-   const unsigned int datebufSize = 256;
-   res.clear();
-   
 #ifdef WIN32 
-   int result = 1; 
    SYSTEMTIME systemTime;
-   struct { time_t tv_sec; int tv_usec; } tv = {0,0};
-   time(&tv.tv_sec);
+   time_t now = time(0);
    GetLocalTime(&systemTime);
-   tv.tv_usec = systemTime.wMilliseconds * 1000; 
+   seconds = (UInt64)now;
+   microseconds = systemTime.wMilliseconds * 1000; 
 #else 
-   struct tm localTimeResult;
    struct timeval tv; 
-   int result = gettimeofday (&tv, NULL);
+   if (gettimeofday(&tv, NULL) == -1)
+   {
+      seconds = 0;
+      microseconds = 0;
+      return;
+   }
+   seconds = (UInt64)tv.tv_sec;
+   microseconds = (UInt32)tv.tv_usec;
 #endif   
+}
+
+Data&
+Log::timestamp(Data& res) 
+{
+   UInt64 seconds;
+   UInt32 microseconds;
+   now(seconds, microseconds);
+   return timestamp(res, seconds, microseconds);
+}
+
+Data&
+Log::timestamp(Data& res, UInt64 seconds, UInt32 microseconds)
+{
+   char* datebuf = const_cast<char*>(res.data());
+   const unsigned int datebufSize = 256;
+   res.clear();
+#ifndef WIN32
+   struct tm localTimeResult;
+#endif
 
-   if (result == -1)
+   if (seconds == 0)
    {
       /* If we can't get the time of day, don't print a timestamp.
          Under Unix, this will never happen:  gettimeofday can fail only
@@ -587,7 +831,7 @@ Log::timestamp(Data& res)
    {
       /* The tv_sec field represents the number of seconds passed since
          the Epoch, which is exactly the argument gettimeofday needs. */
-      const time_t timeInSeconds = (time_t) tv.tv_sec;
+      const time_t timeInSeconds = (time_t) seconds;
       strftime (datebuf,
                 datebufSize,
                 "%Y%m%d-%H%M%S", /* guaranteed to fit in 256 chars,
@@ -602,7 +846,7 @@ Log::timestamp(Data& res)
    char msbuf[5];
    /* Dividing (without remainder) by 1000 rounds the microseconds
       measure to the nearest millisecond. */
-   result = snprintf(msbuf, 5, ".%3.3ld", long(tv.tv_usec / 1000));
+   int result = snprintf(msbuf, 5, ".%3.3ld", long(microseconds / 1000));
    if(result < 0)
    {
       // snprint can error (negative return code) and the compiler now generates a warning
@@ -648,26 +892,19 @@ Log::getThreadSetting()
 #ifndef LOG_ENABLE_THREAD_SETTING
    return 0;
 #else
-   ThreadSetting* setting = static_cast<ThreadSetting*>(ThreadIf::tlsGetValue(*Log::mLevelKey));
+   CachedThreadSetting* setting = static_cast<CachedThreadSetting*>(ThreadIf::tlsGetValue(*Log::mLevelKey));
    if (setting == 0)
    {
       return 0;
    }
-   if (Log::touchCount > 0)
+   if (setting->mGeneration != mLevelGeneration.load(std::memory_order_acquire))
    {
+      // some level changed since this thread last looked; see if it was ours
       Lock lock(_mutex);
-      ThreadIf::Id thread = ThreadIf::selfId();
-      HashMap<ThreadIf::Id, pair<ThreadSetting, bool> >::iterator res = Log::mThreadToLevel.find(thread);
+      HashMap<ThreadIf::Id, ThreadSetting>::iterator res = Log::mThreadToLevel.find(ThreadIf::selfId());
       resip_assert(res != Log::mThreadToLevel.end());
-      if (res->second.second)
-      {
-         setting->mLevel = res->second.first.mLevel;
-         res->second.second = false;
-         touchCount--;
-//         cerr << "**Log::getThreadSetting:touchCount: " << Log::touchCount << "**" << endl;
-
-         //cerr << "touchcount decremented" << endl;
-      }
+      setting->mLevel = res->second.mLevel;
+      setting->mGeneration = mLevelGeneration.load(std::memory_order_relaxed);
    }
    return setting;
 #endif
@@ -693,18 +930,11 @@ Log::setThreadSetting(ThreadSetting info)
 #else
    //cerr << "Log::setThreadSetting: " << "service: " << info.service << " level " << toString(info.level) << " for " << pthread_self() << endl;
    ThreadIf::Id thread = ThreadIf::selfId();
-   ThreadIf::tlsSetValue(*mLevelKey, (void *) new ThreadSetting(info));
    Lock lock(_mutex);
+   delete static_cast<CachedThreadSetting*>(ThreadIf::tlsGetValue(*mLevelKey));
+   ThreadIf::tlsSetValue(*mLevelKey, (void *) new CachedThreadSetting(info, mLevelGeneration.load(std::memory_order_relaxed)));
 
-   if (Log::mThreadToLevel.find(thread) != Log::mThreadToLevel.end())
-   {
-      if (Log::mThreadToLevel[thread].second == true)
-      {
-         touchCount--;
-      }
-   }
-   Log::mThreadToLevel[thread].first = info;
-   Log::mThreadToLevel[thread].second = false;
+   Log::mThreadToLevel[thread] = info;
    Log::mServiceToThreads[info.mService].insert(thread);
 #endif
 }
@@ -720,12 +950,11 @@ Log::setServiceLevel(int service, Level l)
    set<ThreadIf::Id>& threads = Log::mServiceToThreads[service];
    for (set<ThreadIf::Id>::iterator i = threads.begin(); i != threads.end(); i++)
    {
-      Log::mThreadToLevel[*i].first.mLevel = l;
-      Log::mThreadToLevel[*i].second = true;
+      Log::mThreadToLevel[*i].mLevel = l;
    }
-   Log::touchCount += (short)threads.size();
+   // the threads pick their new level up in getThreadSetting()
+   mLevelGeneration.fetch_add(1, std::memory_order_release);
 #endif
-//   cerr << "**Log::setServiceLevel:touchCount: " << Log::touchCount << "**" << endl;
 }
 
 Log::LocalLoggerId Log::localLoggerCreate(Log::Type type,
@@ -733,7 +962,9 @@ Log::LocalLoggerId Log::localLoggerCreate(Log::Type type,
                                           const char * logFileName,
                                           ExternalLogger* externalLogger)
 {
-   return mLocalLoggerMap.create(type, level, logFileName, externalLogger);
+   LocalLoggerId id = mLocalLoggerMap.create(type, level, logFileName, externalLogger);
+   publishLevels();
+   return id;
 }
 
 int Log::localLoggerReinitialize(Log::LocalLoggerId loggerId,
@@ -742,12 +973,16 @@ int Log::localLoggerReinitialize(Log::LocalLoggerId loggerId,
                                  const char * logFileName,
                                  ExternalLogger* externalLogger)
 {
-   return mLocalLoggerMap.reinitialize(loggerId, type, level, logFileName, externalLogger);
+   int result = mLocalLoggerMap.reinitialize(loggerId, type, level, logFileName, externalLogger);
+   publishLevels();
+   return result;
 }
 
 int Log::localLoggerRemove(Log::LocalLoggerId loggerId)
 {
-   return mLocalLoggerMap.remove(loggerId);
+   int result = mLocalLoggerMap.remove(loggerId);
+   publishLevels();
+   return result;
 }
 
 int Log::setThreadLocalLogger(Log::LocalLoggerId loggerId)
@@ -791,6 +1026,10 @@ Log::droppingPrivileges(uid_t uid, pid_t pid)
 bool
 Log::isLogging(Log::Level level, const resip::Subsystem& sub)
 {
+   if (!sub.mayLog(level))
+   {
+      return false;
+   }
    if (sub.getLevel() != Log::None)
    {
       return level <= sub.getLevel();
@@ -801,6 +1040,45 @@ Log::isLogging(Log::Level level, const resip::Subsystem& sub)
    }
 }
 
+void
+Log::publishLevels()
+{
+   // computed and stored under one lock, so that two changes made at the
+   // same time cannot leave the older levels published
+   Lock lock(subsystemsMutex());
+   maxLoggerLevel = std::max((int)mDefaultLoggerData.mLevel, (int)mLocalLoggerMap.maxLevel());
+   levelsPublished = true;
+   for (std::vector<Subsystem*>::iterator it = subsystems().begin(); it != subsystems().end(); ++it)
+   {
+      Subsystem& subsystem = **it;
+      subsystem.mMaxLevel.store(subsystem.mLevel != None ? (int)subsystem.mLevel : maxLoggerLevel,
+                                std::memory_order_relaxed);
+   }
+   mLevelGeneration.fetch_add(1, std::memory_order_release);
+}
+
+void
+Log::addSubsystem(Subsystem& subsystem)
+{
+   Lock lock(subsystemsMutex());
+   subsystems().push_back(&subsystem);
+   if (levelsPublished)
+   {
+      subsystem.mMaxLevel.store(maxLoggerLevel, std::memory_order_relaxed);
+   }
+}
+
+void
+Log::removeSubsystem(Subsystem& subsystem)
+{
+   Lock lock(subsystemsMutex());
+   std::vector<Subsystem*>::iterator it = std::find(subsystems().begin(), subsystems().end(), &subsystem);
+   if (it != subsystems().end())
+   {
+      subsystems().erase(it);
+   }
+}
+
 void
 Log::OutputToWin32DebugWindow(const Data& result)
 {
@@ -883,6 +1161,18 @@ Log::ThreadData *Log::LocalLoggerMap::getData(Log::LocalLoggerId loggerId)
    return it->second.first;
 }
 
+Log::Level Log::LocalLoggerMap::maxLevel()
+{
+   Lock lock(mLoggerInstancesMapMutex);
+   Log::Level level = Log::None;
+   for (LoggerInstanceMap::const_iterator it = mLoggerInstancesMap.begin();
+        it != mLoggerInstancesMap.end(); ++it)
+   {
+      level = std::max(level, (Log::Level)it->second.first->mLevel);
+   }
+   return level;
+}
+
 void Log::LocalLoggerMap::decreaseUseCount(Log::LocalLoggerId loggerId)
 {
    Lock lock(mLoggerInstancesMapMutex);
@@ -903,11 +1193,13 @@ Log::Guard::Guard(resip::Log::Level level,
    mSubsystem(subsystem),
    mFile(file),
    mLine(line),
+   mAsync(resip::Log::isAsync() && ThreadIf::tlsGetValue(*Log::mLocalLoggerKey) == 0),
    mData(Data::Borrow, mBuffer, sizeof(mBuffer)),
    mStream(mData.clear())
 {
 	
-   if (resip::Log::getLoggerData().mType != resip::Log::OnlyExternalNoHeaders)
+   // in async mode the writer thread adds the headers
+   if (!mAsync && resip::Log::getLoggerData().mType != resip::Log::OnlyExternalNoHeaders)
    {
       Log::tags(mLevel, mSubsystem, mFile, mLine, mStream);
       mStream << resip::Log::delim;
@@ -925,47 +1217,278 @@ Log::Guard::~Guard()
 {
    mStream.flush();
 
-   if (resip::Log::getExternal())
-   {
-      const resip::Data rest(resip::Data::Share,
-                             mData.data() + mHeaderLength,
-                             (int)mData.size() - mHeaderLength);
-      if (!(*resip::Log::getExternal())(mLevel, 
-                                        mSubsystem, 
-                                        resip::Log::getAppName(),
-                                        mFile,
-                                        mLine, 
-                                        rest, 
-                                        mData))
+   if (mAsync)
+   {
+      if (resip::Log::isAsync())
+      {
+         resip::Log::asyncAppend(mLevel, mSubsystem, mFile, mLine, mData);
+         return;
+      }
+
+      // async logging was turned off while this line was being built
+      Data message(mData);
+      mData.clear();
+      if (resip::Log::getLoggerData().mType != resip::Log::OnlyExternalNoHeaders)
+      {
+         Log::tags(mLevel, mSubsystem, mFile, mLine, mStream);
+         mStream << resip::Log::delim;
+         mStream.flush();
+      }
+      mHeaderLength = mData.size();
+      mData += message;
+   }
+
+   resip::Log::output(mLevel, mSubsystem, mFile, mLine, mData, mHeaderLength);
+}
+
+void
+Log::output(Level level,
+            const Subsystem& subsystem,
+            const char* file,
+            int line,
+            Data& messageWithHeaders,
+            Data::size_type headerLength)
+{
+   if (getExternal())
+   {
+      const Data rest(Data::Share,
+                      messageWithHeaders.data() + headerLength,
+                      messageWithHeaders.size() - headerLength);
+      if (!(*getExternal())(level, 
+                            subsystem, 
+                            getAppName(),
+                            file,
+                            line, 
+                            rest, 
+                            messageWithHeaders))
       {
          return;
       }
    }
     
-   Type logType = resip::Log::getLoggerData().mType;
+   Type logType = getLoggerData().type();
 
-   if(logType == resip::Log::OnlyExternal ||
-      logType == resip::Log::OnlyExternalNoHeaders) 
+   if(logType == OnlyExternal ||
+      logType == OnlyExternalNoHeaders) 
    {
       return;
    }
 
-   resip::Lock lock(resip::Log::_mutex);
+   Lock lock(_mutex);
    // !dlb! implement VSDebugWindow as an external logger
-   if (logType == resip::Log::VSDebugWindow)
+   if (logType == VSDebugWindow)
    {
-      mData += "\r\n";
-      OutputToWin32DebugWindow(mData);
+      messageWithHeaders += "\r\n";
+      OutputToWin32DebugWindow(messageWithHeaders);
    }
    else 
    {
       // endl is magic in syslog -- so put it here
-      std::ostream& _instance = Instance((int)mData.size()+2);
-      if (logType == resip::Log::Syslog)
+      std::ostream& _instance = Instance((int)messageWithHeaders.size()+2);
+      if (logType == Syslog)
+      {
+         _instance << level;
+      }
+      _instance << messageWithHeaders << std::endl;  
+   }
+}
+
+void
+Log::enableAsync(unsigned int ringBytesPerThread)
+{
+   Lock lock(AsyncWriter::mControlMutex);
+   // new threads get rings of the new size; existing ones keep theirs
+   AsyncWriter::mRingSize.store(ringBytesPerThread, std::memory_order_relaxed);
+   if (mAsyncWriter)
+   {
+      return;
+   }
+   static bool atexitRegistered = false;
+   if (!atexitRegistered)
+   {
+      // so that what is queued is written before the streams go away
+      atexit(disableAsync);
+      atexitRegistered = true;
+   }
+   mAsyncWriter = new AsyncWriter;
+   mAsyncWriter->run();
+   mAsyncEnabled.store(true, std::memory_order_release);
+}
+
+void
+Log::disableAsync()
+{
+   Lock lock(AsyncWriter::mControlMutex);
+   if (!mAsyncWriter)
+   {
+      return;
+   }
+   mAsyncEnabled.store(false, std::memory_order_release);
+   mAsyncWriter->shutdown();
+   mAsyncWriter->join();
+   // lines queued by threads that had already seen async logging on
+   mAsyncWriter->drain();
+   delete mAsyncWriter;
+   mAsyncWriter = 0;
+}
+
+UInt64
+Log::getAsyncDropCount()
+{
+   return AsyncWriter::dropped();
+}
+
+void
+Log::asyncAppend(Level level,
+                 const Subsystem& subsystem,
+                 const char* file,
+                 int line,
+                 const Data& message)
+{
+   AsyncRing* ring = static_cast<AsyncRing*>(ThreadIf::tlsGetValue(*mAsyncRingKey));
+   if (ring == 0)
+   {
+      ring = AsyncWriter::createRing();
+      ThreadIf::tlsSetValue(*mAsyncRingKey, ring);
+   }
+
+   AsyncRing::Record rec;
+   rec.mSize = (UInt32)message.size();
+   rec.mLevel = level;
+   rec.mSubsystem = &subsystem;
+   rec.mFile = file;
+   rec.mLine = line;
+   now(rec.mSeconds, rec.mMicroseconds);
+   rec.mThread = ThreadIf::selfId();
+   ring->push(rec, message.data());
+}
+
+Log::AsyncRing*
+Log::AsyncWriter::createRing()
+{
+   AsyncRing* ring = new AsyncRing(mRingSize.load(std::memory_order_relaxed));
+   Lock lock(mRingsMutex);
+   mRings.push_back(ring);
+   return ring;
+}
+
+UInt64
+Log::AsyncWriter::dropped()
+{
+   Lock lock(mRingsMutex);
+   UInt64 dropped = mReapedDropped;
+   for (std::vector<AsyncRing*>::const_iterator it = mRings.begin(); it != mRings.end(); ++it)
+   {
+      dropped += (*it)->mDropped.load(std::memory_order_relaxed);
+   }
+   return dropped;
+}
+
+bool
+Log::AsyncWriter::drain()
+{
+   std::vector<AsyncRing*> rings;
+   {
+      Lock lock(mRingsMutex);
+      rings = mRings;
+   }
+
+   // merge the rings by timestamp, so that the output is in the order the
+   // lines were logged as far as the clock can tell
+   std::vector<AsyncRing::Record> heads(rings.size());
+   std::vector<bool> full(rings.size());
+   for (size_t i = 0; i < rings.size(); ++i)
+   {
+      full[i] = rings[i]->peek(heads[i]);
+   }
+
+   Data message;
+   unsigned int written = 0;
+   // bounded, so that new rings and closed ones are looked at now and then
+   while (written < 10000)
+   {
+      size_t next = rings.size();
+      for (size_t i = 0; i < rings.size(); ++i)
+      {
+         if (full[i] &&
+             (next == rings.size() ||
+              heads[i].mSeconds < heads[next].mSeconds ||
+              (heads[i].mSeconds == heads[next].mSeconds &&
+               heads[i].mMicroseconds < heads[next].mMicroseconds)))
+         {
+            next = i;
+         }
+      }
+      if (next == rings.size())
+      {
+         break;
+      }
+      rings[next]->pop(heads[next], message);
+      write(heads[next], message);
+      ++written;
+      full[next] = rings[next]->peek(heads[next]);
+   }
+
+   reportDrops(rings);
+   return written > 0;
+}
+
+void
+Log::AsyncWriter::write(const AsyncRing::Record& rec, const Data& message)
+{
+   mLine.clear();
+   Data::size_type headerLength = 0;
+   if (getLoggerData().type() != OnlyExternalNoHeaders)
+   {
+      oDataStream strm(mLine);
+      tags(rec.mLevel, *rec.mSubsystem, rec.mFile, rec.mLine,
+           rec.mSeconds, rec.mMicroseconds, rec.mThread, strm);
+      strm << delim;
+      strm.flush();
+      headerLength = mLine.size();
+   }
+   mLine += message;
+   output(rec.mLevel, *rec.mSubsystem, rec.mFile, rec.mLine, mLine, headerLength);
+}
+
+void
+Log::AsyncWriter::reportDrops(std::vector<AsyncRing*>& rings)
+{
+   for (std::vector<AsyncRing*>::iterator it = rings.begin(); it != rings.end(); ++it)
+   {
+      AsyncRing* ring = *it;
+      UInt64 dropped = ring->mDropped.load(std::memory_order_relaxed);
+      if (dropped != ring->mDroppedReported)
+      {
+         AsyncRing::Record rec;
+         rec.mLevel = Warning;
+         rec.mSubsystem = &Subsystem::NONE;
+         rec.mFile = __FILE__;
+         rec.mLine = __LINE__;
+         now(rec.mSeconds, rec.mMicroseconds);
+         rec.mThread = ThreadIf::selfId();
+         write(rec, "Async logging dropped " + Data(dropped - ring->mDroppedReported) +
+               " lines, the thread's ring was full");
+         ring->mDroppedReported = dropped;
+      }
+   }
+
+   Lock lock(mRingsMutex);
+   for (std::vector<AsyncRing*>::iterator it = mRings.begin(); it != mRings.end(); )
+   {
+      // a ring is only closed after its thread's last push, so nothing is
+      // lost by checking it before emptiness
+      if ((*it)->mClosed.load(std::memory_order_acquire) && (*it)->empty() &&
+          (*it)->mDroppedReported == (*it)->mDropped.load(std::memory_order_relaxed))
+      {
+         mReapedDropped += (*it)->mDroppedReported;
+         delete *it;
+         it = mRings.erase(it);
+      }
+      else
       {
-         _instance << mLevel;
+         ++it;
       }
-      _instance << mData << std::endl;  
    }
 }
 
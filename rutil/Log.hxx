@@ -8,6 +8,7 @@
 #include <unistd.h>
 #endif
 
+#include <atomic>
 #include <set>
 
 #include "rutil/Mutex.hxx"
@@ -36,6 +37,7 @@ extern "C"
 {
    // Forward declaration to make it friend of Log class.
    void freeLocalLogger(void* pThreadData);
+   void freeAsyncRing(void* pRing);
 };
 
 
@@ -121,6 +123,7 @@ class Log
             resip::Data::size_type mHeaderLength;
             const char* mFile;
             int mLine;
+            bool mAsync;
             char mBuffer[128];
             Data mData;
             oDataStream mStream;
@@ -200,10 +203,10 @@ class Log
       /** @brief Return logging level for current thread.
       * If thread has no local logger attached, then return global logging level.
       */
-      static Level level() { Lock lock(_mutex); return getLoggerData().mLevel; }
+      static Level level() { return getLoggerData().mLevel; }
       /** Return logging level for given local logger. Use 0 to set global logging level. */
       static Level level(LocalLoggerId loggerId);
-      static LocalLoggerId id() { Lock lock(_mutex); return getLoggerData().id(); }
+      static LocalLoggerId id() { return getLoggerData().id(); }
       static void setMaxLineCount(unsigned int maxLineCount);
       static void setMaxLineCount(unsigned int maxLineCount, LocalLoggerId loggerId);
       static void setMaxByteCount(unsigned int maxByteCount);
@@ -259,15 +262,41 @@ class Log
 
       static std::ostream& Instance(unsigned int bytesToWrite);
       static bool isLogging(Log::Level level, const Subsystem&);
+
+      /** Counts the changes to logging levels (global, subsystem, local
+          logger and service levels); threads compare it against what they
+          last saw rather than taking a lock to check for changes. */
+      static unsigned int getLevelGeneration() { return mLevelGeneration.load(std::memory_order_acquire); }
       static void OutputToWin32DebugWindow(const Data& result);      
       static void reset(); ///< Frees logger stream
 #ifndef WIN32
       static void droppingPrivileges(uid_t uid, pid_t pid);
 #endif
 
+      /** @brief Moves formatting and writing of the default logger's lines
+          off the threads that log.
+
+          A log statement then only renders its message; the message is
+          queued, with its level, subsystem, file, line, time and thread, in
+          a lock-free ring belonging to the logging thread. A writer thread
+          adds the headers and writes the lines, oldest first, to the
+          logger's output and ExternalLogger (which is then called from the
+          writer thread). Lines that do not fit in their thread's ring are
+          dropped, and the writer logs how many were. Threads using a thread
+          local logger keep logging synchronously.
+         
+          @param ringBytesPerThread size of the rings created from now on
+      */
+      static void enableAsync(unsigned int ringBytesPerThread = DefaultAsyncRingBytes);
+      /// Writes out what has been queued and stops the writer thread
+      static void disableAsync();
+      static bool isAsync() { return mAsyncEnabled.load(std::memory_order_relaxed); }
+      /// Lines dropped because their thread's ring was full
+      static UInt64 getAsyncDropCount();
+      static const unsigned int DefaultAsyncRingBytes = 256 * 1024;
+
    protected:
       static Mutex _mutex;
-      static volatile short touchCount;
       static const Data delim;
 
       static unsigned int MaxLineCount;
@@ -325,7 +354,7 @@ class Log
 #ifndef WIN32
             void droppingPrivileges(uid_t uid, pid_t pid);
 #endif
-            volatile Level mLevel;
+            std::atomic<Level> mLevel;
             volatile unsigned int mMaxLineCount;
             volatile unsigned int mMaxByteCount;
             ExternalLogger* mExternalLogger;
@@ -397,6 +426,9 @@ class Log
          /// Decrease use counter for given loggerId.
          void decreaseUseCount(LocalLoggerId loggerId);
 
+         /// Most verbose level of any local logger; None if there are none.
+         Level maxLevel();
+
       protected:
          /// Storage for Thread Local loggers and their use-counts.
          typedef HashMap<LocalLoggerId, std::pair<ThreadData*, int> > LoggerInstanceMap;
@@ -407,15 +439,53 @@ class Log
          Mutex mLoggerInstancesMapMutex;
       };
 
+      static void now(UInt64& seconds, UInt32& microseconds);
+      static Data& timestamp(Data& result, UInt64 seconds, UInt32 microseconds);
+      static EncodeStream& tags(Log::Level level,
+                                const Subsystem& subsystem,
+                                const char* file,
+                                int line,
+                                UInt64 seconds,
+                                UInt32 microseconds,
+                                ThreadIf::Id thread,
+                                EncodeStream& strm);
+      /// hands a formatted line to the external logger and the log output
+      static void output(Level level,
+                         const Subsystem& subsystem,
+                         const char* file,
+                         int line,
+                         Data& messageWithHeaders,
+                         Data::size_type headerLength);
+
+      class AsyncRing;
+      class AsyncWriter;
+      friend class AsyncWriter;
+      friend void ::freeAsyncRing(void* pRing);
+      static std::atomic<bool> mAsyncEnabled;
+      static AsyncWriter* mAsyncWriter;
+      static ThreadIf::TlsKey* mAsyncRingKey;
+      static void asyncAppend(Level level,
+                              const Subsystem& subsystem,
+                              const char* file,
+                              int line,
+                              const Data& message);
+
       friend void ::freeLocalLogger(void* pThreadData);
       friend class LogStaticInitializer;
+      friend class Subsystem;
       static LocalLoggerMap mLocalLoggerMap;
       static ThreadIf::TlsKey* mLocalLoggerKey;
 
+      /// Recomputes the most verbose level any logger wants from each
+      /// subsystem (see Subsystem::mayLog()) and bumps mLevelGeneration
+      static void publishLevels();
+      static void addSubsystem(Subsystem& subsystem);
+      static void removeSubsystem(Subsystem& subsystem);
+      static std::atomic<unsigned int> mLevelGeneration;
 
       /// DEPRECATED! Left for backward compatibility - use localLoggers instead
 #ifdef LOG_ENABLE_THREAD_SETTING
-      static HashMap<ThreadIf::Id, std::pair<ThreadSetting, bool> > mThreadToLevel;
+      static HashMap<ThreadIf::Id, ThreadSetting> mThreadToLevel;
       static HashMap<int, std::set<ThreadIf::Id> > mServiceToThreads;
       static ThreadIf::TlsKey* mLevelKey;
 #endif
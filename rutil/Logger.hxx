@@ -143,7 +143,9 @@ GenericLog(RESIPROCATE_SUBSYSTEM, resip::Log::Crit, args_)
 static inline bool
 genericLogCheckLevel(resip::Log::Level level, const resip::Subsystem& sub)
 {
-   return resip::Log::isLogging(level, sub);
+   // mayLog() turns away disabled log statements without a lock or a
+   // thread-local lookup
+   return sub.mayLog(level) && resip::Log::isLogging(level, sub);
 }
 
 // do/while allows a {} block in an expression
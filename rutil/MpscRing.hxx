@@ -0,0 +1,188 @@
+#if !defined(RESIP_MpscRing_hxx)
+#define RESIP_MpscRing_hxx 
+
+#include <atomic>
+#include <cstddef>
+
+#include "rutil/ResipAssert.h"
+
+namespace resip
+{
+
+/**
+   @brief A bounded, lock-free, multi-producer/single-consumer ring.
+
+   Each cell carries a sequence number that tells producers whether the cell
+   is free for the lap they claimed, and tells the consumer whether the cell
+   has been published. Producers claim cells with a CAS on the tail; the
+   consumer owns the head and never contends with anybody.
+
+   push() may be called from any number of threads; pop() must only ever be
+   called from one thread at a time. Neither blocks: push() fails when the
+   ring is full and pop() fails when the next cell has not been published
+   (which includes the case where a producer has claimed it but not yet
+   finished writing it). Waking a parked consumer is up to the caller; see
+   Fifo::setLockFree().
+
+   @ingroup message_passing
+*/
+template <typename T>
+class MpscRing
+{
+   public:
+      /// capacity is rounded up to the next power of two
+      explicit MpscRing(unsigned int capacity)
+         : mCells(0),
+           mMask(0),
+           mTail(0),
+           mHead(0)
+      {
+         resip_assert(capacity > 0);
+         size_t size = 2;
+         while(size < capacity)
+         {
+            size <<= 1;
+         }
+         mMask = size - 1;
+         mCells = new Cell[size];
+         for(size_t i = 0; i < size; ++i)
+         {
+            mCells[i].mSequence.store(i, std::memory_order_relaxed);
+         }
+      }
+
+      ~MpscRing()
+      {
+         delete [] mCells;
+      }
+
+      /// @return false if the ring is full
+      bool push(const T& item)
+      {
+         Cell* cell;
+         size_t pos = mTail.load(std::memory_order_relaxed);
+         for(;;)
+         {
+            cell = &mCells[pos & mMask];
+            size_t seq = cell->mSequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+            if(diff == 0)
+            {
+               if(mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+               {
+                  break;
+               }
+            }
+            else if(diff < 0)
+            {
+               // consumer has not released this cell from the previous lap
+               return false;
+            }
+            else
+            {
+               pos = mTail.load(std::memory_order_relaxed);
+            }
+         }
+         cell->mItem = item;
+         cell->mSequence.store(pos + 1, std::memory_order_release);
+         return true;
+      }
+
+      /// @return false if the next cell has not been published; single consumer only
+      bool pop(T& item)
+      {
+         Cell& cell = mCells[mHead & mMask];
+         size_t seq = cell.mSequence.load(std::memory_order_acquire);
+         if((std::ptrdiff_t)seq - (std::ptrdiff_t)(mHead + 1) < 0)
+         {
+            return false;
+         }
+         item = cell.mItem;
+         cell.mSequence.store(mHead + mMask + 1, std::memory_order_release);
+         ++mHead;
+         return true;
+      }
+
+      /// true if no cell is claimed or published; single consumer only
+      bool drained() const
+      {
+         return mTail.load(std::memory_order_acquire) == mHead;
+      }
+
+      unsigned int capacity() const
+      {
+         return (unsigned int)(mMask + 1);
+      }
+
+   private:
+      struct Cell
+      {
+         std::atomic<size_t> mSequence;
+         T mItem;
+      };
+
+      Cell* mCells;
+      size_t mMask;
+      // keep the producers' tail and the consumer's head on separate cache
+      // lines; they are written by different threads on every operation
+      char mPad0[64];
+      std::atomic<size_t> mTail;
+      char mPad1[64];
+      size_t mHead;
+
+      // no value semantics
+      MpscRing(const MpscRing&);
+      MpscRing& operator=(const MpscRing&);
+};
+
+} // namespace resip
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
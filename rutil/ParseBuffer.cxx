@@ -6,6 +6,11 @@
 #include "rutil/DataStream.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RESIP_PARSEBUFFER_VECTOR_SKIP
+#include <immintrin.h>
+#endif
+
 using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::SIP
@@ -55,6 +60,300 @@ ParseBuffer::operator=(const ParseBuffer& rhs)
    return *this;
 }
 
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+namespace
+{
+
+// A set of characters laid out for lookup by nibble, which pshufb does for
+// 16 or 32 characters at once: c is in the set when bit ((c >> 4) & 7) of
+// mRows[c & 0xf] is set, for c < 0x80, or of mRows[16 + (c & 0xf)] otherwise.
+struct CharSetTable
+{
+   unsigned char mRows[32];
+   bool mHigh; // has members >= 0x80
+
+   void clear()
+   {
+      memset(mRows, 0, sizeof(mRows));
+      mHigh = false;
+   }
+
+   void add(unsigned char c)
+   {
+      mRows[(c >> 7)*16 + (c & 0xf)] |= (unsigned char)(1 << ((c >> 4) & 7));
+      mHigh = mHigh || c >= 0x80;
+   }
+
+   void add(const char* cs)
+   {
+      while (*cs)
+      {
+         add((unsigned char)*cs++);
+      }
+   }
+
+   void add(const Data& cs)
+   {
+      for (Data::size_type i = 0; i < cs.size(); i++)
+      {
+         add((unsigned char)cs[i]);
+      }
+   }
+};
+
+// Returns the first character in [pos, end) that is in the set (member) or
+// is not (!member), or end if there is none. Needs at least 16 characters
+// between the start of the buffer and end.
+typedef const char* (*SkipFunction)(const char* pos, const char* end,
+                                    const CharSetTable& set, bool member);
+
+// Bit i is set if character i of the block is (member) or is not
+// (!member) in the set. Inlined into both vector skips, so that the AVX2
+// one does not drop into legacy SSE encoding for its last 16 characters.
+__attribute__((target("ssse3"), always_inline))
+inline unsigned int
+match16(const char* pos, const CharSetTable& set, bool member)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i nibble = _mm_set1_epi8(0x0f);
+   const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                      1, 2, 4, 8, 16, 32, 64, -128);
+   __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+   __m128i low = _mm_and_si128(block, nibble);
+   __m128i high = _mm_and_si128(_mm_srli_epi16(block, 4), nibble);
+   __m128i upper = _mm_cmplt_epi8(block, zero);
+   __m128i rows = _mm_andnot_si128(upper, _mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(set.mRows)), low));
+   if (set.mHigh)
+   {
+      rows = _mm_or_si128(rows, _mm_and_si128(upper, _mm_shuffle_epi8(
+         _mm_loadu_si128(reinterpret_cast<const __m128i*>(set.mRows + 16)), low)));
+   }
+   __m128i hits = _mm_and_si128(rows, _mm_shuffle_epi8(bits, high));
+   unsigned int misses = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(hits, zero));
+   return misses ^ (member ? 0xffffu : 0);
+}
+
+// Finishes off the last (end - pos < 16) characters by matching the last 16
+// characters before end again.
+__attribute__((target("ssse3"), always_inline))
+inline const char*
+matchTail(const char* pos, const char* end, const CharSetTable& set, bool member)
+{
+   if (pos == end)
+   {
+      return end;
+   }
+   const char* last = end - 16;
+   unsigned int found = match16(last, set, member) & (0xffffu << (pos - last));
+   return found ? last + __builtin_ctz(found) : end;
+}
+
+__attribute__((target("ssse3")))
+const char*
+skipSsse3(const char* pos, const char* end, const CharSetTable& set, bool member)
+{
+   while (end - pos >= 16)
+   {
+      unsigned int found = match16(pos, set, member);
+      if (found)
+      {
+         return pos + __builtin_ctz(found);
+      }
+      pos += 16;
+   }
+   return matchTail(pos, end, set, member);
+}
+
+__attribute__((target("avx2")))
+const char*
+skipAvx2(const char* pos, const char* end, const CharSetTable& set, bool member)
+{
+   if (end - pos >= 32)
+   {
+      const __m256i lowRows = _mm256_broadcastsi128_si256(
+         _mm_loadu_si128(reinterpret_cast<const __m128i*>(set.mRows)));
+      const __m256i highRows = _mm256_broadcastsi128_si256(
+         _mm_loadu_si128(reinterpret_cast<const __m128i*>(set.mRows + 16)));
+      const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                            1, 2, 4, 8, 16, 32, 64, -128,
+                                            1, 2, 4, 8, 16, 32, 64, -128,
+                                            1, 2, 4, 8, 16, 32, 64, -128);
+      const __m256i nibble = _mm256_set1_epi8(0x0f);
+      const __m256i zero = _mm256_setzero_si256();
+      const unsigned int flip = member ? 0xffffffffu : 0;
+      do
+      {
+         __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+         __m256i low = _mm256_and_si256(block, nibble);
+         __m256i high = _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble);
+         __m256i upper = _mm256_cmpgt_epi8(zero, block);
+         __m256i rows = _mm256_andnot_si256(upper, _mm256_shuffle_epi8(lowRows, low));
+         if (set.mHigh)
+         {
+            rows = _mm256_or_si256(rows, _mm256_and_si256(upper, _mm256_shuffle_epi8(highRows, low)));
+         }
+         __m256i hits = _mm256_and_si256(rows, _mm256_shuffle_epi8(bits, high));
+         unsigned int misses = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hits, zero));
+         unsigned int found = misses ^ flip;
+         if (found)
+         {
+            return pos + __builtin_ctz(found);
+         }
+         pos += 32;
+      }
+      while (end - pos >= 32);
+   }
+   if (end - pos >= 16)
+   {
+      unsigned int found = match16(pos, set, member);
+      if (found)
+      {
+         return pos + __builtin_ctz(found);
+      }
+      pos += 16;
+   }
+   return matchTail(pos, end, set, member);
+}
+
+SkipFunction
+bestSkipFunction()
+{
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+   {
+      return skipAvx2;
+   }
+   if (__builtin_cpu_supports("ssse3"))
+   {
+      return skipSsse3;
+   }
+   return 0;
+}
+
+bool vectorSkipEnabled = true;
+
+// Below this many characters the scalar loops win (and the vector skips
+// need a whole vector to work with).
+const ptrdiff_t MinVectorSkip = 16;
+
+// The function to use for [pos, end), or 0 to use the scalar loops.
+inline SkipFunction
+vectorSkip(const char* pos, const char* end)
+{
+   static const SkipFunction best = bestSkipFunction();
+   return (end - pos >= MinVectorSkip && vectorSkipEnabled) ? best : 0;
+}
+
+// The std::bitset sets are nearly all function statics in the parsers, so
+// each thread keeps the tables for recently used sets, found by address and
+// checked against the set's current contents.
+struct CompiledBitset
+{
+   const std::bitset<256>* mKey;
+   std::bitset<256> mBits;
+   CharSetTable mTable;
+};
+
+thread_local CompiledBitset compiledBitsets[16];
+
+const CharSetTable&
+compile(const std::bitset<256>& cs)
+{
+   CompiledBitset& compiled =
+      compiledBitsets[(reinterpret_cast<size_t>(&cs) / sizeof(cs)) % 16];
+   if (compiled.mKey != &cs || compiled.mBits != cs)
+   {
+      compiled.mKey = &cs;
+      compiled.mBits = cs;
+      compiled.mTable.clear();
+      for (unsigned int c = 0; c < 256; ++c)
+      {
+         if (cs.test(c))
+         {
+            compiled.mTable.add((unsigned char)c);
+         }
+      }
+   }
+   return compiled.mTable;
+}
+
+}
+#endif
+
+void
+ParseBuffer::setVectorSkip(bool enabled)
+{
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   vectorSkipEnabled = enabled;
+#endif
+}
+
+const char*
+ParseBuffer::vectorSkipName()
+{
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   SkipFunction best = bestSkipFunction();
+   if (best == skipAvx2)
+   {
+      return "avx2";
+   }
+   if (best == skipSsse3)
+   {
+      return "ssse3";
+   }
+#endif
+   return "none";
+}
+
+ParseBuffer::CurrentPosition
+ParseBuffer::skipChars(const std::bitset<256>& cs)
+{
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   if (SkipFunction skip = vectorSkip(mPosition, mEnd))
+   {
+      mPosition = skip(mPosition, mEnd, compile(cs), false);
+      return CurrentPosition(*this);
+   }
+#endif
+   while (mPosition < mEnd)
+   {
+      if (cs.test((unsigned char)(*mPosition)))
+      {
+         mPosition++;
+      }
+      else
+      {
+         return CurrentPosition(*this);
+      }
+   }
+   return CurrentPosition(*this);
+}
+
+ParseBuffer::CurrentPosition
+ParseBuffer::skipToOneOf(const std::bitset<256>& cs)
+{
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   if (SkipFunction skip = vectorSkip(mPosition, mEnd))
+   {
+      mPosition = skip(mPosition, mEnd, compile(cs), true);
+      return CurrentPosition(*this);
+   }
+#endif
+   while (mPosition < mEnd)
+   {
+      if (cs.test((unsigned char)(*mPosition)))
+      {
+         return CurrentPosition(*this);
+      }
+      else
+      {
+         mPosition++;
+      }
+   }
+   return CurrentPosition(*this);
+}
+
 ParseBuffer::CurrentPosition
 ParseBuffer::skipChar(char c)
 {
@@ -239,71 +538,49 @@ ParseBuffer::skipToTermCRLF()
    return CurrentPosition(*this);
 }
 
-ParseBuffer::CurrentPosition
-ParseBuffer::skipToChars(const char* cs)
+// Finds the first occurrence of [sub, sub+len) in [pos, end), or end. Lets
+// memchr, which the C library vectorizes, find the candidates.
+static const char*
+findChars(const char* pos, const char* end, const char* sub, size_t len)
 {
-   resip_assert(cs);
-   unsigned int l = (unsigned int)strlen(cs);
-
-   const char* rpos;
-   const char* cpos;
-   // Checking mPosition >= mEnd - l +1 is unnecessary because there won't be
-   // enough bytes left to find [cs].
-   while (mPosition < mEnd - l + 1)
+   if (len == 0)
+   {
+      return pos;
+   }
+   while (end - pos >= (ptrdiff_t)len)
    {
-      rpos = mPosition;
-      cpos = cs;
-      for (unsigned int i = 0; i < l; i++)
+      pos = (const char*)memchr(pos, sub[0], (end - pos) - len + 1);
+      if (!pos)
       {
-         if (*cpos++ != *rpos++)
-         {
-            mPosition++;
-            goto skip;
-         }
+         break;
       }
-      return CurrentPosition(*this);
-     skip: ;
+      if (memcmp(pos + 1, sub + 1, len - 1) == 0)
+      {
+         return pos;
+      }
+      ++pos;
    }
-   // Advance to the end since we didn't find a match.
-   mPosition = mEnd;
+   return end;
+}
+
+ParseBuffer::CurrentPosition
+ParseBuffer::skipToChars(const char* cs)
+{
+   resip_assert(cs);
+   mPosition = findChars(mPosition, mEnd, cs, strlen(cs));
    return CurrentPosition(*this);
 }
 
 ParseBuffer::CurrentPosition
 ParseBuffer::skipToChars(const Data& sub)
 {
-   const char* begSub = sub.mBuf;
-   const char* endSub = sub.mBuf + sub.mSize;
-   if(begSub == endSub)
+   if(sub.empty())
    {
       fail(__FILE__, __LINE__, "ParseBuffer::skipToChars() called with an "
                                  "empty string. Don't do this!");
    }
-
-   while (true)
-   {
-next:
-     const char* searchPos = mPosition;
-     const char* subPos = sub.mBuf;
-
-     while (subPos != endSub) 
-     {
-         if (searchPos == mEnd)
-         {
-            // nope
-            mPosition = mEnd;
-            return CurrentPosition(*this);
-         }
-         if (*subPos++ != *searchPos++)
-         {
-            // nope, but try the next position
-            ++mPosition;
-            goto next;
-         }
-     }
-     // found a match
-     return CurrentPosition(*this);
-   }
+   mPosition = findChars(mPosition, mEnd, sub.data(), sub.size());
+   return CurrentPosition(*this);
 }
 
 bool 
@@ -335,6 +612,16 @@ ParseBuffer::oneOf(char c, const Data& cs)
 ParseBuffer::CurrentPosition
 ParseBuffer::skipToOneOf(const char* cs)
 {
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   if (SkipFunction skip = vectorSkip(mPosition, mEnd))
+   {
+      CharSetTable set;
+      set.clear();
+      set.add(cs);
+      mPosition = skip(mPosition, mEnd, set, true);
+      return CurrentPosition(*this);
+   }
+#endif
    while (mPosition < mEnd)
    {
       if (oneOf(*mPosition, cs))
@@ -353,6 +640,17 @@ ParseBuffer::CurrentPosition
 ParseBuffer::skipToOneOf(const char* cs1,
                          const char* cs2)
 {
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   if (SkipFunction skip = vectorSkip(mPosition, mEnd))
+   {
+      CharSetTable set;
+      set.clear();
+      set.add(cs1);
+      set.add(cs2);
+      mPosition = skip(mPosition, mEnd, set, true);
+      return CurrentPosition(*this);
+   }
+#endif
    while (mPosition < mEnd)
    {
       if (oneOf(*mPosition, cs1) ||
@@ -371,6 +669,16 @@ ParseBuffer::skipToOneOf(const char* cs1,
 ParseBuffer::CurrentPosition
 ParseBuffer::skipToOneOf(const Data& cs)
 {
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   if (SkipFunction skip = vectorSkip(mPosition, mEnd))
+   {
+      CharSetTable set;
+      set.clear();
+      set.add(cs);
+      mPosition = skip(mPosition, mEnd, set, true);
+      return CurrentPosition(*this);
+   }
+#endif
    while (mPosition < mEnd)
    {
       if (oneOf(*mPosition, cs))
@@ -389,6 +697,17 @@ ParseBuffer::CurrentPosition
 ParseBuffer::skipToOneOf(const Data& cs1,
                          const Data& cs2)
 {
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   if (SkipFunction skip = vectorSkip(mPosition, mEnd))
+   {
+      CharSetTable set;
+      set.clear();
+      set.add(cs1);
+      set.add(cs2);
+      mPosition = skip(mPosition, mEnd, set, true);
+      return CurrentPosition(*this);
+   }
+#endif
    while (mPosition < mEnd)
    {
       if (oneOf(*mPosition, cs1) ||
@@ -407,6 +726,31 @@ ParseBuffer::skipToOneOf(const Data& cs1,
 const char*
 ParseBuffer::skipToEndQuote(char quote)
 {
+#if defined(RESIP_PARSEBUFFER_VECTOR_SKIP)
+   if (SkipFunction skip = vectorSkip(mPosition, mEnd))
+   {
+      CharSetTable set;
+      set.clear();
+      set.add((unsigned char)'\\');
+      set.add((unsigned char)quote);
+      while (mPosition < mEnd)
+      {
+         mPosition = skip(mPosition, mEnd, set, true);
+         if (mPosition == mEnd)
+         {
+            break;
+         }
+         if (*mPosition == '\\')
+         {
+            mPosition += 2;
+         }
+         else
+         {
+            return mPosition;
+         }
+      }
+   }
+#endif
    while (mPosition < mEnd)
    {
       // !dlb! mark character encoding
@@ -149,37 +149,8 @@ class ParseBuffer
       CurrentPosition skipToOneOf(const Data& cs1, const Data& cs2);
 
       // std::bitset based parse function
-      CurrentPosition skipChars(const std::bitset<256>& cs)
-      {
-         while (mPosition < mEnd)
-         {
-            if (cs.test((unsigned char)(*mPosition)))
-            {
-               mPosition++;
-            }
-            else
-            {
-               return CurrentPosition(*this);
-            }
-         }
-         return CurrentPosition(*this);
-      }
-
-      CurrentPosition skipToOneOf(const std::bitset<256>& cs)
-      {
-         while (mPosition < mEnd)
-         {
-            if (cs.test((unsigned char)(*mPosition)))
-            {
-               return CurrentPosition(*this);
-            }
-            else
-            {
-               mPosition++;
-            }
-         }
-         return CurrentPosition(*this);
-      }
+      CurrentPosition skipChars(const std::bitset<256>& cs);
+      CurrentPosition skipToOneOf(const std::bitset<256>& cs);
 
       const char* skipToEndQuote(char quote = '"');
       CurrentPosition skipN(int count)
@@ -258,6 +229,15 @@ class ParseBuffer
 
       static bool oneOf(char c, const char* cs);
       static bool oneOf(char c, const Data& cs);
+
+      /// skipToOneOf(), skipChars(const std::bitset<256>&) and 
+      /// skipToEndQuote() test 32 (AVX2) or 16 (SSSE3) characters at a time
+      /// where the CPU allows; turning this off forces the scalar loops, for
+      /// testing and benchmarking. Not synchronized; call before parsing.
+      static void setVectorSkip(bool enabled);
+      /// "avx2", "ssse3", or "none" when there is no vector skip to use
+      static const char* vectorSkipName();
+
       static const char* Whitespace;
       static const char* ParamTerm;
    private:
@@ -0,0 +1,345 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <atomic>
+#include <new>
+
+#include "rutil/SlabAllocator.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ResipAssert.h"
+
+using namespace resip;
+
+namespace
+{
+
+// Size classes run 32, 48, 64, 96, 128, ... 24576, 32768: a power of two
+// and the point half way to the next one. Sizes include the BlockHeader.
+// One extra class holds a full UDP receive buffer (8192 bytes plus the
+// scanner's padding and the header), which would otherwise take a third
+// of a 12288 block more than it needs.
+const unsigned int NumGeometricClasses = 21;
+const unsigned int DatagramClass = NumGeometricClasses;
+const size_t DatagramClassSize = 8192 + 64;
+const unsigned int NumClasses = DatagramClass + 1;
+const unsigned int HeapClass = NumClasses;
+const size_t MinSlabBytes = 64*1024;
+
+inline size_t
+classSize(unsigned int c)
+{
+   if (c == DatagramClass)
+   {
+      return DatagramClassSize;
+   }
+   return (c & 1) ? ((size_t)48 << (c/2)) : ((size_t)32 << (c/2));
+}
+
+inline unsigned int
+classFor(size_t bytes)
+{
+   if (bytes <= 32)
+   {
+      return 0;
+   }
+   if (bytes > 8192 && bytes <= DatagramClassSize)
+   {
+      return DatagramClass;
+   }
+   // bytes-1 lies in [2^b, 2^(b+1))
+   unsigned int b = 0;
+   for (size_t v = bytes - 1; v > 1; v >>= 1)
+   {
+      ++b;
+   }
+   return 2*(b-5) + (bytes > ((size_t)3 << (b-1)) ? 2 : 1);
+}
+
+class ThreadCache;
+
+// Precedes every block handed out; 16 bytes keeps the payload as aligned
+// as ::operator new would have.
+struct BlockHeader
+{
+   ThreadCache* mOwner;
+   unsigned int mClass;
+   unsigned int mPad;
+};
+
+// What a free block's payload is used for
+struct FreeBlock
+{
+   FreeBlock* mNext;
+};
+
+inline BlockHeader*
+headerOf(FreeBlock* b)
+{
+   return reinterpret_cast<BlockHeader*>(b) - 1;
+}
+
+inline FreeBlock*
+payloadOf(BlockHeader* h)
+{
+   return reinterpret_cast<FreeBlock*>(h + 1);
+}
+
+class ThreadCache
+{
+   public:
+      ThreadCache() : mNextParked(0), mRemote(0)
+      {
+         for (unsigned int c = 0; c < NumClasses; ++c)
+         {
+            mFree[c] = 0;
+            mCarve[c] = 0;
+            mCarveEnd[c] = 0;
+         }
+      }
+
+      void* allocate(unsigned int c)
+      {
+         FreeBlock* b = mFree[c];
+         if (b == 0)
+         {
+            reclaimRemote();
+            b = mFree[c];
+         }
+         if (b)
+         {
+            mFree[c] = b->mNext;
+            return b;
+         }
+         return carve(c);
+      }
+
+      void freeLocal(FreeBlock* b, unsigned int c)
+      {
+         b->mNext = mFree[c];
+         mFree[c] = b;
+      }
+
+      // called by threads other than the owner
+      void freeRemote(FreeBlock* b)
+      {
+         FreeBlock* head = mRemote.load(std::memory_order_relaxed);
+         do
+         {
+            b->mNext = head;
+         }
+         while (!mRemote.compare_exchange_weak(head, b,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+      }
+
+      ThreadCache* mNextParked;
+
+   private:
+      void reclaimRemote()
+      {
+         // only the owner ever takes from mRemote, and it takes the whole
+         // list, so there is no ABA problem
+         FreeBlock* b = mRemote.exchange(0, std::memory_order_acquire);
+         while (b)
+         {
+            FreeBlock* next = b->mNext;
+            freeLocal(b, headerOf(b)->mClass);
+            b = next;
+         }
+      }
+
+      void* carve(unsigned int c)
+      {
+         size_t size = classSize(c);
+         if (mCarve[c] == mCarveEnd[c])
+         {
+            size_t slab = size*8 > MinSlabBytes ? size*8 : MinSlabBytes;
+            slab -= slab % size;
+            mCarve[c] = static_cast<char*>(::operator new(slab));
+            mCarveEnd[c] = mCarve[c] + slab;
+         }
+         BlockHeader* h = reinterpret_cast<BlockHeader*>(mCarve[c]);
+         mCarve[c] += size;
+         h->mOwner = this;
+         h->mClass = c;
+         return payloadOf(h);
+      }
+
+      FreeBlock* mFree[NumClasses];
+      // unused tail of the newest slab of each class
+      char* mCarve[NumClasses];
+      char* mCarveEnd[NumClasses];
+      std::atomic<FreeBlock*> mRemote;
+};
+
+std::atomic<bool> slabEnabled(true);
+
+// Caches of exited threads, waiting to be adopted. Neither is ever
+// destroyed: blocks may be freed into a cache during static destruction.
+Mutex* parkedMutex = new Mutex;
+ThreadCache* parkedCaches = 0;
+
+ThreadCache*
+adoptCache()
+{
+   {
+      Lock lock(*parkedMutex); (void)lock;
+      if (parkedCaches)
+      {
+         ThreadCache* cache = parkedCaches;
+         parkedCaches = cache->mNextParked;
+         cache->mNextParked = 0;
+         return cache;
+      }
+   }
+   return new ThreadCache;
+}
+
+// These have no destructors, so they stay usable while the thread's other
+// thread_local objects are destroyed (and maybe free messages) on exit.
+thread_local ThreadCache* threadCache = 0;
+thread_local bool threadCacheParked = false;
+
+// Parks the thread's cache when the thread exits. From then on, whatever
+// the thread frees takes the remote path and whatever it allocates comes
+// from ::operator new.
+struct CacheParker
+{
+   CacheParker() : mArmed(false) {}
+   ~CacheParker()
+   {
+      if (threadCache)
+      {
+         Lock lock(*parkedMutex); (void)lock;
+         threadCache->mNextParked = parkedCaches;
+         parkedCaches = threadCache;
+      }
+      threadCache = 0;
+      threadCacheParked = true;
+   }
+   bool mArmed;
+};
+
+thread_local CacheParker cacheParker;
+
+// @return 0 once the thread's cache has been parked
+inline ThreadCache*
+myCache()
+{
+   if (threadCache == 0 && !threadCacheParked)
+   {
+      threadCache = adoptCache();
+      // constructs the parker, so that its destructor runs at thread exit
+      cacheParker.mArmed = true;
+   }
+   return threadCache;
+}
+
+}
+
+void*
+SlabAllocator::allocate(size_t size)
+{
+   if (size <= MaxSlabSize && slabEnabled.load(std::memory_order_relaxed))
+   {
+      ThreadCache* cache = myCache();
+      if (cache)
+      {
+         return cache->allocate(classFor(size + sizeof(BlockHeader)));
+      }
+   }
+
+   BlockHeader* h = static_cast<BlockHeader*>(::operator new(size + sizeof(BlockHeader)));
+   h->mOwner = 0;
+   h->mClass = HeapClass;
+   return payloadOf(h);
+}
+
+void
+SlabAllocator::deallocate(void* ptr)
+{
+   if (ptr == 0)
+   {
+      return;
+   }
+
+   FreeBlock* b = static_cast<FreeBlock*>(ptr);
+   BlockHeader* h = headerOf(b);
+   if (h->mClass == HeapClass)
+   {
+      ::operator delete(h);
+      return;
+   }
+
+   resip_assert(h->mClass < NumClasses && h->mOwner);
+   if (h->mOwner == threadCache)
+   {
+      h->mOwner->freeLocal(b, h->mClass);
+   }
+   else
+   {
+      h->mOwner->freeRemote(b);
+   }
+}
+
+void
+SlabAllocator::setEnabled(bool enabled)
+{
+   slabEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool
+SlabAllocator::isEnabled()
+{
+   return slabEnabled.load(std::memory_order_relaxed);
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
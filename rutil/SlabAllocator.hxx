@@ -0,0 +1,98 @@
+#ifndef RESIP_SlabAllocator_hxx
+#define RESIP_SlabAllocator_hxx
+
+#include <stddef.h>
+
+namespace resip
+{
+
+/**
+   A size-class slab allocator with a cache per thread, meant for the
+   short-lived, fixed-ish size objects that dominate SIP message handling
+   (SipMessage itself, DinkyPool overflow, transport receive buffers).
+
+   Blocks are carved out of slabs owned by the allocating thread's cache and
+   recycled through that cache's free lists, so the common alloc/free pair
+   touches no lock and no shared cache line. A block freed by another thread
+   (a message built by a transport thread and deleted by the TU, say) is
+   pushed onto its owning cache's lock-free remote free list, which the
+   owner reclaims the next time that size class runs dry.
+
+   Slabs are never returned to the system; each cache keeps what it needed
+   at its peak. When a thread exits its cache is parked, and the next new
+   thread adopts it (including whatever other threads have freed into it
+   since).
+
+   Requests above MaxSlabSize, and all requests while disabled, go to
+   ::operator new. Every block carries a small header, so deallocate()
+   copes with blocks from either source regardless of the current setting.
+   Memory from allocate() must only be released with deallocate().
+*/
+class SlabAllocator
+{
+   public:
+      /// largest request (in bytes) served from a slab
+      static const size_t MaxSlabSize = 32768 - 16;
+
+      /// @throw std::bad_alloc as ::operator new does
+      static void* allocate(size_t size);
+      static void deallocate(void* ptr);
+
+      /** Turns slab allocation on or off for subsequent allocate() calls
+          (it is on by default). Blocks already handed out are unaffected.
+      */
+      static void setEnabled(bool enabled);
+      static bool isEnabled();
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -16,11 +16,39 @@ Subsystem Subsystem::STATS("RESIP:STATS");
 Subsystem Subsystem::REPRO("REPRO:APP");
 Subsystem Subsystem::NONE("UNDEFINED");
 
+Subsystem::Subsystem(const char* rhs) :
+   mSubsystem(rhs),
+   mLevel(Log::None),
+   mMaxLevel(Log::Bogus)
+{
+   Log::addSubsystem(*this);
+}
+
+Subsystem::Subsystem(const Data& rhs) :
+   mSubsystem(rhs),
+   mLevel(Log::None),
+   mMaxLevel(Log::Bogus)
+{
+   Log::addSubsystem(*this);
+}
+
+Subsystem::~Subsystem()
+{
+   Log::removeSubsystem(*this);
+}
+
 const Data& Subsystem::getSubsystem() const
 {
     return mSubsystem;
 }
 
+void
+Subsystem::setLevel(Log::Level level)
+{
+   mLevel = level;
+   Log::publishLevels();
+}
+
 EncodeStream& 
 resip::operator<<(EncodeStream& strm, const Subsystem& ss)
 {
@@ -1,6 +1,7 @@
 #if !defined(RESIP_SUBSYSTEM_HXX)
 #define RESIP_SUBSYSTEM_HXX 
 
+#include <atomic>
 #include <iostream>
 #include "rutil/Data.hxx"
 #include "rutil/Log.hxx"
@@ -48,16 +49,31 @@ class Subsystem
       static Subsystem STATS;
       static Subsystem REPRO;
       
+      ~Subsystem();
+
       const Data& getSubsystem() const;
       Log::Level getLevel() const { return mLevel; }
-      void setLevel(Log::Level level) { mLevel = level; }
+      void setLevel(Log::Level level);
+
+      /** False if no logger wants lines of this level from this subsystem,
+          on any thread. This is the check made at every log statement, so
+          it is a single relaxed load; Log::isLogging() makes the exact one.
+      */
+      bool mayLog(Log::Level level) const
+      {
+         return level <= mMaxLevel.load(std::memory_order_relaxed);
+      }
+
    protected:
-      explicit Subsystem(const char* rhs) : mSubsystem(rhs), mLevel(Log::None) {};
-      explicit Subsystem(const Data& rhs) : mSubsystem(rhs), mLevel(Log::None) {};
+      explicit Subsystem(const char* rhs);
+      explicit Subsystem(const Data& rhs);
       Subsystem& operator=(const Data& rhs);
 
       Data mSubsystem;
       Log::Level mLevel;
+      std::atomic<int> mMaxLevel;  // published by Log::publishLevels()
+
+      friend class Log;
 
       friend EncodeStream& operator<<(EncodeStream& strm, const Subsystem& ss);
 };
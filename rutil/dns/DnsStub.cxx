@@ -115,6 +115,10 @@ DnsStub::~DnsStub()
    {
       delete *it;
    }
+   for (set<RefreshQuery*>::iterator it = mRefreshQueries.begin(); it != mRefreshQueries.end(); ++it)
+   {
+      delete *it;
+   }
 
    setPollGrp(0);
    delete mDnsProvider;
@@ -123,7 +127,7 @@ DnsStub::~DnsStub()
 unsigned int
 DnsStub::getTimeTillNextProcessMS()
 {
-    if(mCommandFifo.size() > 0) return 0;
+    if(mCommandFifo.size() > 0 || mRRCache.refreshPending()) return 0;
     return mDnsProvider->getTimeTillNextProcessMS();
 }
 
@@ -143,6 +147,25 @@ DnsStub::processFifo()
       command->execute();
       delete command;
    }
+   refreshCache();
+}
+
+void
+DnsStub::refreshCache()
+{
+   if (!mRRCache.refreshPending())
+   {
+      return;
+   }
+   mRRCache.takeRefreshes(mRefreshes);
+   for (RRCache::RefreshList::const_iterator it = mRefreshes.begin(); it != mRefreshes.end(); ++it)
+   {
+      StackLog(<< "Refreshing cached records of type " << it->second << " for " << it->first);
+      RefreshQuery* query = new RefreshQuery(*this, it->first, it->second);
+      mRefreshQueries.insert(query);
+      lookupRecords(it->first, (unsigned short)it->second, query);
+   }
+   mRefreshes.clear();
 }
 
 void
@@ -692,6 +715,43 @@ DnsStub::Query::onDnsRaw(int status, const unsigned char* abuf, int alen)
    process(status, abuf, alen);
 }
 
+DnsStub::RefreshQuery::RefreshQuery(DnsStub& stub, const Data& target, int rrType)
+   : mStub(stub),
+     mTarget(target),
+     mRRType(rrType)
+{
+}
+
+void
+DnsStub::RefreshQuery::onDnsRaw(int status, const unsigned char* abuf, int alen)
+{
+   try
+   {
+      if (status == 0)
+      {
+         if (DNS_HEADER_ANCOUNT(abuf) != 0)
+         {
+            mStub.cache(mTarget, abuf, alen);
+         }
+      }
+      else if (status == ARES_ENODATA || status == ARES_ENOTFOUND)
+      {
+         mStub.cacheTTL(mTarget, mRRType, status, abuf, alen);
+      }
+      else
+      {
+         // the old entry stays until it expires
+         DebugLog(<< "Refresh of " << mTarget << " failed: " << mStub.errorMessage(status));
+      }
+   }
+   catch (BaseException& e)
+   {
+      ErrLog(<< "Couldn't cache refreshed records for " << mTarget << ": " << e.getMessage());
+   }
+   mStub.mRefreshQueries.erase(this);
+   delete this;
+}
+
 void
 DnsStub::Query::followCname(const unsigned char* aptr, const unsigned char*abuf, const int alen, bool& bGotAnswers, bool& bDeleteThis, Data& targetToQuery)
 {
@@ -895,6 +955,12 @@ DnsStub::setDnsCacheSize(int size)
    mRRCache.setSize(size);
 }
 
+void
+DnsStub::setDnsCacheRefreshAhead(bool enable)
+{
+   mRRCache.setRefreshAhead(enable);
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
@@ -179,6 +179,8 @@ class DnsStub : public ExternalDnsHandler
       void getDnsCacheDump(std::pair<unsigned long, unsigned long> key, GetDnsCacheDumpHandler* handler);
       void setDnsCacheTTL(int ttl);
       void setDnsCacheSize(int size);
+      /// re-query busy cache entries before they expire (on by default)
+      void setDnsCacheRefreshAhead(bool enable);
       void reloadDnsServers();
       bool checkDnsChange();
       bool supportedType(int);
@@ -213,6 +215,7 @@ class DnsStub : public ExternalDnsHandler
 
   private:
       void processFifo();
+      void refreshCache();
 
    protected:
       void cache(const Data& key, in_addr addr);
@@ -282,6 +285,20 @@ class DnsStub : public ExternalDnsHandler
             bool mFollowCname;
       };
 
+      // re-queries a cache entry on behalf of refresh-ahead; the answer only
+      // goes into the cache
+      class RefreshQuery : public DnsRawSink
+      {
+         public:
+            RefreshQuery(DnsStub& stub, const Data& target, int rrType);
+            void onDnsRaw(int status, const unsigned char* abuf, int alen);
+
+         private:
+            DnsStub& mStub;
+            Data mTarget;
+            int mRRType;
+      };
+
    private:
       DnsStub(const DnsStub&);   // disable copy ctor.
       DnsStub& operator=(const DnsStub&);
@@ -467,6 +484,8 @@ class DnsStub : public ExternalDnsHandler
       ExternalDns* mDnsProvider;
       FdPollGrp* mPollGrp;
       std::set<Query*> mQueries;
+      std::set<RefreshQuery*> mRefreshQueries;
+      RRCache::RefreshList mRefreshes;
 
       std::vector<Data> mEnumSuffixes; // where to do enum lookups
       std::map<Data,Data> mEnumDomains;
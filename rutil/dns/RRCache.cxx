@@ -23,7 +23,7 @@
 #endif
 #endif
 
-#include <set>
+#include <algorithm>
 #include <vector>
 #include <list>
 #include <map>
@@ -49,6 +49,8 @@ using namespace std;
 RRCache::RRCache() 
    : mHead(),
      mLruHead(LruListType::makeList(&mHead)),
+     mCount(0),
+     mRefreshAhead(true),
      mUserDefinedTTL(DEFAULT_USER_DEFINED_TTL),
      mSize(DEFAULT_SIZE)
 {
@@ -59,6 +61,8 @@ RRCache::RRCache()
    mFactoryMap[T_AAAA] = &mAAAARecordFactory;
 #endif
    mFactoryMap[T_A] = &mHostRecordFactory;
+
+   rehash(MIN_INDEX_SIZE);
 }
 
 RRCache::~RRCache()
@@ -66,26 +70,145 @@ RRCache::~RRCache()
    cleanup();
 }
 
+size_t
+RRCache::hash(const Data& key, int rrType)
+{
+   // DNS names are made up of token characters
+   return key.caseInsensitiveTokenHash() ^ ((size_t)rrType * 0x9e3779b9u);
+}
+
+size_t
+RRCache::findSlot(const Data& key, int rrType, size_t hash) const
+{
+   // The index is never more than half full, so this always finds either
+   // the entry or a free slot.
+   const size_t mask = mIndex.size() - 1;
+   for (size_t i = hash & mask; ; i = (i + 1) & mask)
+   {
+      const Slot& slot = mIndex[i];
+      if (slot.mList == 0 ||
+          (slot.mHash == hash &&
+           slot.mList->rrType() == rrType &&
+           isEqualNoCase(slot.mList->key(), key)))
+      {
+         return i;
+      }
+   }
+}
+
+size_t
+RRCache::findSlot(const RRList* list) const
+{
+   const size_t mask = mIndex.size() - 1;
+   size_t i = hash(list->key(), list->rrType()) & mask;
+   while (mIndex[i].mList != list)
+   {
+      resip_assert(mIndex[i].mList);
+      i = (i + 1) & mask;
+   }
+   return i;
+}
+
+void
+RRCache::insert(size_t hash, RRList* list, UInt64 refreshAt)
+{
+   if ((mCount + 1) * 2 > mIndex.size())
+   {
+      rehash(mIndex.size() * 2);
+   }
+   size_t i = findSlot(list->key(), list->rrType(), hash);
+   resip_assert(mIndex[i].mList == 0);
+   mIndex[i].mHash = hash;
+   mIndex[i].mList = list;
+   updated(mIndex[i], refreshAt);
+   ++mCount;
+   mLruHead->push_back(list);
+}
+
+void
+RRCache::updated(Slot& slot, UInt64 refreshAt)
+{
+   slot.mRefreshAt = refreshAt;
+   slot.mHits = 0;
+}
+
+void
+RRCache::erase(size_t i)
+{
+   resip_assert(mIndex[i].mList);
+   delete mIndex[i].mList; // also takes it off the LRU list
+   mIndex[i].mList = 0;
+   --mCount;
+
+   // Move back any entries after it in the same run that would no longer be
+   // found past the slot we just freed (no tombstones needed).
+   const size_t mask = mIndex.size() - 1;
+   for (size_t j = (i + 1) & mask; mIndex[j].mList; j = (j + 1) & mask)
+   {
+      size_t home = mIndex[j].mHash & mask;
+      bool reachable = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+      if (!reachable)
+      {
+         mIndex[i] = mIndex[j];
+         mIndex[j].mList = 0;
+         i = j;
+      }
+   }
+}
+
+void
+RRCache::rehash(size_t size)
+{
+   Index old;
+   old.swap(mIndex);
+   Slot empty = { 0, 0, NEVER, 0 };
+   mIndex.assign(size, empty);
+   const size_t mask = size - 1;
+   for (Index::const_iterator it = old.begin(); it != old.end(); ++it)
+   {
+      if (it->mList)
+      {
+         size_t i = it->mHash & mask;
+         while (mIndex[i].mList)
+         {
+            i = (i + 1) & mask;
+         }
+         mIndex[i] = *it;
+      }
+   }
+}
+
+UInt64
+RRCache::refreshTime(const RRList* list) const
+{
+   if (!mRefreshAhead)
+   {
+      return NEVER;
+   }
+   UInt64 now = Timer::getTimeSecs();
+   if (list->absoluteExpiry() <= now)
+   {
+      return NEVER;
+   }
+   return now + (list->absoluteExpiry() - now) * REFRESH_PERCENT / 100;
+}
+
 void 
 RRCache::updateCacheFromHostFile(const DnsHostRecord &record)
 {
-   //FactoryMap::iterator it = mFactoryMap.find(T_A);
-   RRList* key = new RRList(record, 3600);         
-   RRSet::iterator lb = mRRSet.lower_bound(key);
-   if (lb != mRRSet.end() &&
-       !(mRRSet.key_comp()(key, *lb)))
+   size_t h = hash(record.name(), T_A);
+   size_t i = findSlot(record.name(), T_A, h);
+   if (mIndex[i].mList)
    {
-      (*lb)->update(record, 3600);
-      touch(*lb);
+      mIndex[i].mList->update(record, 3600);
+      updated(mIndex[i], NEVER);
+      touch(mIndex[i].mList);
    }
    else
    {
-      RRList* val = new RRList(record, 3600);
-      mRRSet.insert(val);
-      mLruHead->push_back(val);
+      insert(h, new RRList(record, 3600), NEVER);
       purge();
    }
-   delete key;
 }
 
 void 
@@ -97,22 +220,21 @@ RRCache::updateCache(const Data& target,
    Data domain = (*begin).domain();
    FactoryMap::iterator it = mFactoryMap.find(rrType);
    resip_assert(it != mFactoryMap.end());
-   RRList* key = new RRList(domain, rrType);         
-   RRSet::iterator lb = mRRSet.lower_bound(key);
-   if (lb != mRRSet.end() &&
-       !(mRRSet.key_comp()(key, *lb)))
+   size_t h = hash(domain, rrType);
+   size_t i = findSlot(domain, rrType, h);
+   if (mIndex[i].mList)
    {
-      (*lb)->update(it->second, begin, end, mUserDefinedTTL);
-      touch(*lb);
+      RRList* list = mIndex[i].mList;
+      list->update(it->second, begin, end, mUserDefinedTTL);
+      updated(mIndex[i], refreshTime(list));
+      touch(list);
    }
    else
    {
       RRList* val = new RRList(it->second, domain, rrType, begin, end, mUserDefinedTTL);
-      mRRSet.insert(val);
-      mLruHead->push_back(val);
+      insert(h, val, refreshTime(val));
       purge();
    }
-   delete key;
 }
 
 void 
@@ -133,16 +255,14 @@ RRCache::cacheTTL(const Data& target,
       ttl = mUserDefinedTTL;
    }
 
-   RRList* val = new RRList(target, rrType, ttl, status);
-   RRSet::iterator it = mRRSet.find(val);
-   if (it != mRRSet.end())
+   size_t h = hash(target, rrType);
+   size_t i = findSlot(target, rrType, h);
+   if (mIndex[i].mList)
    {
-      (*it)->remove();
-      delete *it;
-      mRRSet.erase(it);
+      erase(i);
    }
-   mRRSet.insert(val);
-   mLruHead->push_back(val);
+   RRList* val = new RRList(target, rrType, ttl, status);
+   insert(h, val, refreshTime(val));
    purge();
 }
 
@@ -155,29 +275,38 @@ RRCache::lookup(const Data& target,
 {
    records.clear();
    status = 0;
-   RRList* key = new RRList(target, type);
-   RRSet::iterator it = mRRSet.find(key);
-   delete key;
-   if (it == mRRSet.end())
+   size_t i = findSlot(target, type, hash(target, type));
+   Slot& slot = mIndex[i];
+   if (slot.mList == 0)
    {
       return false;
    }
-   else
+
+   UInt64 now = Timer::getTimeSecs();
+   if (now >= slot.mList->absoluteExpiry())
    {
-      if (Timer::getTimeSecs() >= (*it)->absoluteExpiry())
-      {
-         delete *it;
-         mRRSet.erase(it);
-         return false;
-      }
-      else
-      {
-         records = (*it)->records(protocol);
-         status = (*it)->status();
-         touch(*it);
-         return true;
-      }
+      erase(i);
+      return false;
    }
+
+   if (now >= slot.mRefreshAt && slot.mHits > 0)
+   {
+      mRefreshes.push_back(std::make_pair(slot.mList->key(), slot.mList->rrType()));
+      slot.mRefreshAt = NEVER;
+   }
+   ++slot.mHits;
+
+   slot.mList->records(protocol, records);
+   status = slot.mList->status();
+   touch(slot.mList);
+   return true;
+}
+
+void
+RRCache::takeRefreshes(RefreshList& refreshes)
+{
+   refreshes.clear();
+   refreshes.swap(mRefreshes);
 }
 
 void 
@@ -196,12 +325,14 @@ RRCache::touch(RRList* node)
 void 
 RRCache::cleanup()
 {
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); it++)
+   for (Index::iterator it = mIndex.begin(); it != mIndex.end(); ++it)
    {
-      (*it)->remove();
-      delete *it;
+      delete it->mList; // also takes it off the LRU list
+      it->mList = 0;
    }
-   mRRSet.clear();
+   mCount = 0;
+   mRefreshes.clear();
+   rehash(MIN_INDEX_SIZE);
 }
 
 int 
@@ -226,51 +357,57 @@ RRCache::getTTL(const RROverlay& overlay)
 void 
 RRCache::purge()
 {
-   if (mRRSet.size() < mSize) return;
-   RRList* lst = *(mLruHead->begin());
-   RRSet::iterator it = mRRSet.find(lst);
-   resip_assert(it != mRRSet.end());
-   lst->remove();
-   delete *it;
-   mRRSet.erase(it);
+   // loops only if the size was lowered
+   while (mCount >= mSize && mCount > 0)
+   {
+      RRList* lst = *(mLruHead->begin());
+      erase(findSlot(lst));
+   }
 }
 
-void 
-RRCache::logCache()
+void
+RRCache::sorted(std::vector<RRList*>& lists)
 {
+   // drops expired entries, and returns the rest in (type, name) order
    UInt64 now = Timer::getTimeSecs();
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); )
+   lists.clear();
+   lists.reserve(mCount);
+   for (LruListType::iterator it = mLruHead->begin(); it != mLruHead->end(); )
    {
-      if (now >= (*it)->absoluteExpiry())
+      RRList* list = *it;
+      ++it;
+      if (now >= list->absoluteExpiry())
       {
-         delete *it;
-         mRRSet.erase(it++);
+         erase(findSlot(list));
       }
       else
       {
-         (*it)->log();
-         ++it;
+         lists.push_back(list);
       }
    }
+   std::sort(lists.begin(), lists.end(), CompareT());
+}
+
+void 
+RRCache::logCache()
+{
+   std::vector<RRList*> lists;
+   sorted(lists);
+   for (std::vector<RRList*>::iterator it = lists.begin(); it != lists.end(); ++it)
+   {
+      (*it)->log();
+   }
 }
 
 void 
 RRCache::getCacheDump(Data& dnsCacheDump)
 {
-   UInt64 now = Timer::getTimeSecs();
+   std::vector<RRList*> lists;
+   sorted(lists);
    DataStream strm(dnsCacheDump);
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); )
+   for (std::vector<RRList*>::iterator it = lists.begin(); it != lists.end(); ++it)
    {
-      if (now >= (*it)->absoluteExpiry())
-      {
-         delete *it;
-         mRRSet.erase(it++);
-      }
-      else
-      {
-         (*it)->encodeRRList(strm);
-         ++it;
-      }
+      (*it)->encodeRRList(strm);
    }
    strm.flush();
 }
@@ -2,8 +2,9 @@
 #define RESIP_RRCACHE_HXX
 
 #include <map>
-#include <set>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "rutil/dns/RRFactory.hxx"
 #include "rutil/dns/DnsResourceRecord.hxx"
@@ -18,6 +19,21 @@ namespace resip
 {
 class RROverlay;
 
+/**
+   The DNS cache used by DnsStub.
+
+   Entries are indexed by (rrType, name) in an open-addressing hash table,
+   using linear probing and a case-insensitive hash of the name, so a
+   lookup compares names in place and does not allocate. They are also kept
+   on an LRU list, which bounds the cache at setSize() entries.
+
+   Refresh-ahead: an entry that is looked up after REFRESH_PERCENT of its
+   TTL has passed, and had already been looked up before, is queued for a
+   refresh (see takeRefreshes()). The caller re-queries it in the
+   background, so busy names are replaced before they expire and lookups
+   for them never miss. Each entry is queued at most once per update.
+   Entries from the hosts file are never refreshed.
+*/
 class RRCache
 {
    public:
@@ -26,11 +42,13 @@ class RRCache
       typedef RRList::Records Result;
       typedef std::vector<RROverlay>::const_iterator Itr;
       typedef std::vector<Data> DataArr;
+      typedef std::vector<std::pair<Data, int> > RefreshList;
 
       RRCache();
       ~RRCache();
       void setTTL(int ttl) { if (ttl > 0) mUserDefinedTTL = ttl * MIN_TO_SEC; }
       void setSize(int size) { mSize = size; }
+      void setRefreshAhead(bool enable) { mRefreshAhead = enable; }
       // Update existing cache record, or add a new one
       void updateCache(const Data& target,
                        const int rrType,
@@ -47,11 +65,20 @@ class RRCache
       void logCache();
       void getCacheDump(Data& dnsCacheDump);
 
+      /// true if there are entries waiting to be refreshed
+      bool refreshPending() const { return !mRefreshes.empty(); }
+      /// hands over the (name, rrType) of the entries due for refresh
+      void takeRefreshes(RefreshList& refreshes);
+
    private:
       static const int MIN_TO_SEC = 60;
       static const int DEFAULT_USER_DEFINED_TTL = 10; // in seconds.
 
-      static const int DEFAULT_SIZE = 512;
+      static const int DEFAULT_SIZE = 8192;
+      static const int REFRESH_PERCENT = 80;
+      static const unsigned int MIN_INDEX_SIZE = 64; // power of 2
+      static const UInt64 NEVER = ~(UInt64)0;
+
       class CompareT
       {
          public:
@@ -72,17 +99,38 @@ class RRCache
             }
       };
 
+      struct Slot
+      {
+         size_t mHash;
+         RRList* mList;  // 0 if the slot is free
+         UInt64 mRefreshAt;  // NEVER once queued for refresh
+         unsigned int mHits; // lookups since the last update
+      };
+      typedef std::vector<Slot> Index;
+
+      static size_t hash(const Data& key, int rrType);
+      size_t findSlot(const Data& key, int rrType, size_t hash) const;
+      size_t findSlot(const RRList* list) const;
+      void insert(size_t hash, RRList* list, UInt64 refreshAt);
+      void updated(Slot& slot, UInt64 refreshAt);
+      void erase(size_t slot);
+      void rehash(size_t size);
+      UInt64 refreshTime(const RRList* list) const;
+
       void touch(RRList* node);
       void cleanup();
       int getTTL(const RROverlay& overlay);
       void purge();
+      void sorted(std::vector<RRList*>& lists);
 
       RRList mHead;
       LruListType* mLruHead;                     
       Result Empty;
 
-      typedef std::set<RRList*, CompareT> RRSet;
-      RRSet mRRSet;
+      Index mIndex;
+      size_t mCount;
+      bool mRefreshAhead;
+      RefreshList mRefreshes;
 
       RRFactory<DnsHostRecord> mHostRecordFactory;
       RRFactory<DnsSrvRecord> mSrvRecordFactory;
@@ -56,6 +56,7 @@ RRList::RRList(const DnsHostRecord &record, int ttl)
 void RRList::update(const DnsHostRecord &record, int ttl)
 {
    this->clear();
+   mStatus = 0;
 
    RecordItem item;
    item.record = new DnsHostRecord(record);
@@ -86,6 +87,7 @@ RRList::RRList(const RRFactoryBase* factory,
 void RRList::update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl)
 {
    this->clear();
+   mStatus = 0;
    mAbsoluteExpiry = ULONG_MAX;
    
    for (Itr it = begin; it != end; it++)
@@ -117,13 +119,17 @@ void RRList::update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl)
 RRList::Records RRList::records(const int protocol)
 {
    Records records;
-   if (mRecords.empty()) return records;
+   this->records(protocol, records);
+   return records;
+}
 
+void RRList::records(const int protocol, Records& records)
+{
+   records.clear();
    for (std::vector<RecordItem>::iterator it = mRecords.begin(); it != mRecords.end(); ++it)
    {
       records.push_back((*it).record);
    }
-   return records;
 }
 
 RRList::RecordItr RRList::find(const Data& value)
@@ -46,6 +46,8 @@ class RRList : public IntrusiveListElement<RRList*>
 
       void update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl);
       Records records(const int protocol);
+      /// as above, but fills in records (reusing its storage)
+      void records(const int protocol, Records& records);
 
       const Data& key() const { return mKey; }
       int status() const { return mStatus; }
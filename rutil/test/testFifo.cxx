@@ -1,4 +1,5 @@
 #include <iostream>
+#include <vector>
 #include "rutil/Log.hxx"
 #include "rutil/Fifo.hxx"
 #include "rutil/FiniteFifo.hxx"
@@ -146,6 +147,96 @@ void Producer::thread()
    }
 }
 
+// Benchmark: a number of producers hammer one Fifo<Foo>, the main thread
+// drains it. Every producer pushes pointers into its own array, so the
+// consumer can verify per-producer ordering without allocating per message.
+class BenchProducer: public ThreadIf
+{
+  public:
+      BenchProducer(Fifo<Foo>& fifo, Foo* msgs, unsigned int count)
+         : mFifo(fifo), mMsgs(msgs), mCount(count)
+      {}
+      virtual ~BenchProducer()
+      {
+         shutdown();
+         join();
+      }
+
+      void thread()
+      {
+         for(unsigned int i = 0; i < mCount; ++i)
+         {
+            mFifo.add(&mMsgs[i]);
+         }
+      }
+
+   private:
+      Fifo<Foo>& mFifo;
+      Foo* mMsgs;
+      unsigned int mCount;
+};
+
+void
+benchFifo(bool lockFree, unsigned int ringSize, unsigned int numProducers, unsigned int total)
+{
+   Fifo<Foo> fifo;
+   if(lockFree)
+   {
+      fifo.setLockFree(ringSize);
+   }
+
+   const unsigned int perProducer = total / numProducers;
+   std::vector<std::vector<Foo> > msgs(numProducers, std::vector<Foo>(perProducer, Foo(Data::Empty)));
+   std::vector<unsigned int> next(numProducers, 0);
+   std::vector<BenchProducer*> producers;
+   for(unsigned int p = 0; p < numProducers; ++p)
+   {
+      producers.push_back(new BenchProducer(fifo, &msgs[p][0], perProducer));
+   }
+
+   UInt64 begin(Timer::getTimeMicroSec());
+   for(unsigned int p = 0; p < numProducers; ++p)
+   {
+      producers[p]->run();
+   }
+
+   unsigned int received = 0;
+   Fifo<Foo>::Messages batch;
+   while(received < perProducer * numProducers)
+   {
+      fifo.getMultiple(1000, batch, 256);
+      while(!batch.empty())
+      {
+         Foo* foo = batch.front();
+         batch.pop_front();
+         // work out which producer this came from, and check it is the next
+         // one we expected from that producer
+         unsigned int p = 0;
+         while(foo < &msgs[p][0] || foo > &msgs[p][perProducer-1])
+         {
+            ++p;
+            assert(p < numProducers);
+         }
+         assert(foo == &msgs[p][next[p]]);
+         ++next[p];
+         ++received;
+      }
+   }
+   UInt64 end(Timer::getTimeMicroSec());
+   assert(fifo.empty());
+   assert(fifo.getCountDepth() == 0);
+
+   for(unsigned int p = 0; p < numProducers; ++p)
+   {
+      delete producers[p];
+   }
+
+   UInt64 elapsed = end > begin ? end - begin : 1;
+   cerr << (lockFree ? "lock-free" : "locked   ") << " producers=" << numProducers
+        << " messages=" << received << " " << elapsed/1000 << " ms "
+        << (UInt64)received*1000000/elapsed << " msg/s" << endl;
+}
+
 bool
 isNear(int value, int reference, int epsilon=250)
 {
@@ -459,6 +550,68 @@ main()
       sleepMS(1000);
    }
 
+   {
+      cerr << "!! Test lock-free fifo" << endl;
+
+      Fifo<Foo> fifo;
+      fifo.setLockFree(4);
+      assert(fifo.isLockFree());
+      assert(fifo.empty());
+      assert(fifo.getNext(-1) == 0);
+
+      UInt64 begin(Timer::getTimeMs());
+      assert(fifo.getNext(500) == 0);
+      UInt64 end(Timer::getTimeMs());
+      assert(isNear((int)(end - begin), 500, 200));
+
+      // overflow the ring; order must survive the spill into the deque
+      std::vector<Foo*> foos;
+      for(int i = 0; i < 10; ++i)
+      {
+         foos.push_back(new Foo(Data(i)));
+         assert(fifo.add(foos.back()) == (size_t)i+1);
+      }
+      assert(fifo.size() == 10);
+      assert(fifo.getCountDepth() == 10);
+      for(int i = 0; i < 5; ++i)
+      {
+         Foo* foo = fifo.getNext();
+         assert(foo == foos[i]);
+         delete foo;
+      }
+      fifo.add(new Foo("after"));
+      Fifo<Foo>::Messages batch;
+      assert(fifo.getMultiple(RESIP_FIFO_NOWAIT, batch, 100));
+      assert(batch.size() == 6);
+      for(int i = 5; i < 10; ++i)
+      {
+         assert(batch.front() == foos[i]);
+         delete batch.front();
+         batch.pop_front();
+      }
+      assert(batch.front()->mVal == "after");
+      delete batch.front();
+      batch.pop_front();
+      assert(fifo.empty());
+
+      fifo.add(new Foo("left over"));
+      fifo.clear();
+      assert(fifo.empty());
+   }
+
+   {
+      cerr << "!! Benchmark locked vs lock-free fifo" << endl;
+
+      const unsigned int producers[] = { 1, 4, 16 };
+      for(size_t i = 0; i < sizeof(producers)/sizeof(producers[0]); ++i)
+      {
+         benchFifo(false, 0, producers[i], 400000);
+         benchFifo(true, 4096, producers[i], 400000);
+      }
+      // a ring much smaller than the backlog keeps spilling into the deque
+      benchFifo(true, 16, 16, 400000);
+   }
+
    cerr << "All OK" << endl;
    return 0;
 }
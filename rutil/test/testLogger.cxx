@@ -1,9 +1,14 @@
 
 #include "rutil/Logger.hxx"
 #include "rutil/Data.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/ThreadIf.hxx"
 #include "rutil/Timer.hxx"
 
+#include <cassert>
+#include <map>
+#include <vector>
+
 #include "TestSubsystemLogLevel.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
@@ -130,6 +135,164 @@ testThreadLocalLoggers(const char *appname)
    }
 }
 
+// Keeps what the (async) writer thread hands it
+class CollectingLogger : public ExternalLogger
+{
+   public:
+      virtual bool operator()(Log::Level level,
+                              const Subsystem& subsystem, 
+                              const Data& appName,
+                              const char* file,
+                              int line,
+                              const Data& message,
+                              const Data& messageWithHeaders)
+      {
+         Lock lock(mMutex);
+         mMessages.push_back(message);
+         mWithHeaders.push_back(messageWithHeaders);
+         return false;
+      }
+
+      Mutex mMutex;
+      std::vector<Data> mMessages;
+      std::vector<Data> mWithHeaders;
+};
+
+class AsyncLogThread : public ThreadIf
+{
+   public:
+      AsyncLogThread(int id, int count) : mId(id), mCount(count) {}
+
+      void thread()
+      {
+         for (int i = 0; i < mCount; i++)
+         {
+            InfoLog(<< "async " << mId << " " << i);
+         }
+      }
+   private:
+      int mId;
+      int mCount;
+};
+
+void
+testAsync(const char* appname)
+{
+   CollectingLogger logger;
+   Log::initialize(Log::OnlyExternal, Log::Info, appname, logger);
+   Log::enableAsync();
+   assert(Log::isAsync());
+
+   const int threads = 4;
+   const int count = 1000;
+   std::vector<AsyncLogThread*> loggers;
+   for (int t = 0; t < threads; t++)
+   {
+      loggers.push_back(new AsyncLogThread(t, count));
+      loggers.back()->run();
+   }
+   for (int t = 0; t < threads; t++)
+   {
+      loggers[t]->join();
+      delete loggers[t];
+   }
+   UInt64 dropped = Log::getAsyncDropCount();
+   Log::disableAsync();
+   assert(!Log::isAsync());
+
+   // every line arrives whole, with its headers, and in order within its thread
+   std::map<int, int> next;
+   int lines = 0;
+   for (size_t i = 0; i < logger.mMessages.size(); i++)
+   {
+      int id;
+      int n;
+      if (sscanf(logger.mMessages[i].c_str(), "async %d %d", &id, &n) != 2)
+      {
+         continue;
+      }
+      assert(logger.mWithHeaders[i].size() > logger.mMessages[i].size());
+      assert(logger.mWithHeaders[i].find("INFO") == 0);
+      assert(n >= next[id]);
+      next[id] = n + 1;
+      lines++;
+   }
+   cerr << "async: " << lines << " lines written, " << dropped << " dropped" << endl;
+   assert(lines + dropped == (UInt64)threads * count);
+
+   // a line that does not fit in the ring is dropped and counted
+   Log::enableAsync(1024);
+   UInt64 before = Log::getAsyncDropCount();
+   Data big(std::string(4096, 'x'));
+   InfoLog(<< big);
+   assert(Log::getAsyncDropCount() == before + 1);
+   Log::disableAsync();
+}
+
+class DisabledLogThread : public ThreadIf
+{
+   public:
+      DisabledLogThread(int count) : mCount(count) {}
+
+      void thread()
+      {
+         for (int i = 0; i < mCount; i++)
+         {
+            DebugLog(<< "disabled " << i);
+         }
+      }
+   private:
+      int mCount;
+};
+
+void
+testLevelPublishing(const char* appname)
+{
+   Log::initialize(Log::Cout, Log::Info, appname);
+   assert(Subsystem::SIP.mayLog(Log::Info));
+   assert(!Subsystem::SIP.mayLog(Log::Debug));
+   assert(!genericLogCheckLevel(Log::Debug, Subsystem::SIP));
+
+   unsigned int generation = Log::getLevelGeneration();
+   Log::setLevel(Log::Debug, Subsystem::SIP);
+   assert(Log::getLevelGeneration() != generation);
+   assert(Subsystem::SIP.mayLog(Log::Debug));
+   assert(!Subsystem::DNS.mayLog(Log::Debug));
+   Log::setLevel(Log::None, Subsystem::SIP);
+   assert(!Subsystem::SIP.mayLog(Log::Debug));
+
+   // a local logger may want more than the global level; only its
+   // threads log at that level
+   Log::LocalLoggerId id = Log::localLoggerCreate(Log::Cout, Log::Stack);
+   assert(Subsystem::SIP.mayLog(Log::Stack));
+   assert(!Log::isLogging(Log::Stack, Subsystem::SIP));
+   Log::localLoggerRemove(id);
+   assert(!Subsystem::SIP.mayLog(Log::Stack));
+
+   Log::setLevel(Log::Warning);
+   assert(!Subsystem::SIP.mayLog(Log::Info));
+   Log::setLevel(Log::Info);
+
+   // cost of a log statement that is turned off, from many threads at once
+   const int threads = 32;
+   const int count = 1000000;
+   std::vector<DisabledLogThread*> loggers;
+   UInt64 start = Timer::getTimeMicroSec();
+   for (int t = 0; t < threads; t++)
+   {
+      loggers.push_back(new DisabledLogThread(count));
+      loggers.back()->run();
+   }
+   for (int t = 0; t < threads; t++)
+   {
+      loggers[t]->join();
+      delete loggers[t];
+   }
+   UInt64 elapsed = Timer::getTimeMicroSec() - start;
+   cerr << threads << " threads x " << count << " disabled DebugLogs took " << elapsed / 1000 << "ms ("
+        << (double)elapsed * 1000 / ((double)threads * count) << "ns per statement, all threads)" << endl;
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -248,6 +411,9 @@ main(int argc, char* argv[])
    cout << endl;
    testThreadLocalLoggers(argv[0]);
 
+   testAsync(argv[0]);
+   testLevelPublishing(argv[0]);
+
    return 0;
 }
 
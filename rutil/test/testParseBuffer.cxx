@@ -5,15 +5,129 @@
 #include <sstream>
 #include <vector>
 #include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
 
 using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TEST
 
+// The skip functions with vector implementations, applied to a
+// ParseBuffer; returns where each one stopped (or 0 if it threw).
+typedef const char* (*Skip)(ParseBuffer& pb);
+
+static const std::bitset<256> tokenChars(Data::toBitset("abcdefghijklmnopqrstuvwxyz"
+                                                        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                                        "0123456789-.!%*_+`'~"));
+static const std::bitset<256> hostDelimiter(Data::toBitset("\r\n\t :;?>"));
+static std::bitset<256> highChars;
+
+static const char* skipToHostDelimiter(ParseBuffer& pb) { return pb.skipToOneOf(hostDelimiter); }
+static const char* skipTokenChars(ParseBuffer& pb) { return pb.skipChars(tokenChars); }
+static const char* skipToHighChar(ParseBuffer& pb) { return pb.skipToOneOf(highChars); }
+static const char* skipNonHighChars(ParseBuffer& pb) { return pb.skipChars(highChars); }
+static const char* skipToParamTerm(ParseBuffer& pb) { return pb.skipToOneOf(ParseBuffer::ParamTerm); }
+static const char* skipToWhitespaceOrGt(ParseBuffer& pb) { return pb.skipToOneOf(ParseBuffer::Whitespace, ">"); }
+static const char* skipToCommaData(ParseBuffer& pb) { return pb.skipToOneOf(Data(",\xe9")); }
+static const char* skipToEndQuote(ParseBuffer& pb) { return pb.skipToEndQuote(); }
+static const char* skipToCRLF(ParseBuffer& pb) { return pb.skipToChars("\r\n"); }
+static const char* skipToBranch(ParseBuffer& pb) { return pb.skipToChars(Data("branch=")); }
+
+static const char*
+run(Skip skip, const char* buf, size_t len, size_t start)
+{
+   ParseBuffer pb(buf, len);
+   pb.skipN((int)start);
+   try
+   {
+      return skip(pb);
+   }
+   catch (ParseException&)
+   {
+      return 0;
+   }
+}
+
+// The vector skips must stop exactly where the scalar ones do, from any
+// starting point.
+static void
+checkVectorSkip(const char* buf, size_t len)
+{
+   const Skip skips[] = { skipToHostDelimiter, skipTokenChars, skipToHighChar,
+                          skipNonHighChars, skipToParamTerm, skipToWhitespaceOrGt,
+                          skipToCommaData, skipToEndQuote, skipToCRLF, skipToBranch };
+   for (size_t i = 0; i < sizeof(skips)/sizeof(*skips); ++i)
+   {
+      for (size_t start = 0; start <= len; ++start)
+      {
+         ParseBuffer::setVectorSkip(false);
+         const char* expected = run(skips[i], buf, len, start);
+         ParseBuffer::setVectorSkip(true);
+         const char* got = run(skips[i], buf, len, start);
+         if (got != expected)
+         {
+            std::cerr << "skip " << i << " from " << start << " stopped at "
+                      << (got ? got - buf : -1) << ", expected "
+                      << (expected ? expected - buf : -1) << std::endl;
+            assert(0);
+         }
+      }
+   }
+}
+
+static void
+benchmark(const char* name, Skip skip, const char* buf, int runs)
+{
+   size_t len = strlen(buf);
+   double ns[2];
+   for (int vector = 0; vector < 2; ++vector)
+   {
+      ParseBuffer::setVectorSkip(vector != 0);
+      UInt64 start = Timer::getTimeMicroSec();
+      for (int i = 0; i < runs; ++i)
+      {
+         run(skip, buf, len, 0);
+      }
+      ns[vector] = (Timer::getTimeMicroSec() - start) * 1000.0 / runs;
+   }
+   ParseBuffer::setVectorSkip(true);
+   std::cerr << name << ": " << ns[0] << " ns scalar, " << ns[1] << " ns "
+             << ParseBuffer::vectorSkipName() << ", speedup " << ns[0] / ns[1]
+             << std::endl;
+}
+
 int
 main(int argc, char** argv)
 {
+   for (int c = 0x80; c < 0x100; c += 3)
+   {
+      highChars.set(c);
+   }
+
+   if (argc > 1 && !strcmp(argv[1], "-bench"))
+   {
+      const int runs = argc > 2 ? atoi(argv[2]) : 1000000;
+      benchmark("Uri host, skipToOneOf(bitset)", skipToHostDelimiter,
+                "pc33.atlanta-proxy-cluster-7.example.com:5060;transport=tcp>", runs);
+      benchmark("Via branch, skipChars(bitset)", skipTokenChars,
+                "z9hG4bK-524287-1---a2b6e0c3f1d49b87a8c4f2e1;rport;received=192.0.2.1", runs);
+      benchmark("Via params, skipToOneOf(\";?\")", skipToParamTerm,
+                "SIP/2.0/UDP pc33.atlanta.example.com:5060;branch=z9hG4bK776asdhds", runs);
+      benchmark("display name, skipToEndQuote()", skipToEndQuote,
+                "Alice Liddell, Atlanta Office (Conference Room 3)\" <sip:alice@atlanta.example.com>", runs);
+      return 0;
+   }
+
    Log::initialize(Log::Cout, argc > 1 ? Log::toLevel(argv[1]) :  Log::Info, argv[0]);
+
+   {
+      // long enough for several vectors, with a bit of everything the sets
+      // look for, including chars >= 0x80, escapes and a NUL
+      const char buf[] = "INVITE sip:bob@biloxi.example.com;transport=tcp?subject=\"x\" SIP/2.0\r\n"
+                         "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bK776asdhds\r\n"
+                         "From: \"Al\\\"ice \xc3\xa9\xff\" <sip:alice@atlanta.example.com>;tag=1928301774,"
+                         "\t\x80\x81\x82\x83 \"unterminated \\\" quote\0and more";
+      checkVectorSkip(buf, sizeof(buf) - 1);
+   }
    
    {
      const char buf[] = "/home/jason/test";